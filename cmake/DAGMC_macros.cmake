@@ -72,6 +72,8 @@ macro (dagmc_setup_options)
   option(BUILD_RPATH "Build libraries and executables with RPATH" ON)
 
   option(DOUBLE_DOWN "Enable ray tracing with Embree via double down" OFF)
+  option(NATIVE_BVH  "Enable ray tracing with the native DAGMC BVH"   OFF)
+  option(BVH_SIMD    "Build the native BVH kernels for the host CPU's SIMD instructions" OFF)
 
   if (BUILD_ALL)
     set(BUILD_MCNP5  ON)
@@ -88,6 +90,10 @@ macro (dagmc_setup_options)
     message(WARNING "DOUBLE_DOWN is enabled but will only be applied to executables using the DAGMC shared library")
   endif()
 
+  if (DOUBLE_DOWN AND NATIVE_BVH)
+    message(FATAL_ERROR "DOUBLE_DOWN and NATIVE_BVH cannot both be ON")
+  endif()
+
 if (DOUBLE_DOWN)
   find_package(DOUBLE_DOWN REQUIRED)
 endif()
@@ -241,6 +247,9 @@ macro (dagmc_install_library lib_name)
       target_compile_definitions(${lib_name}-shared PRIVATE DOUBLE_DOWN)
       target_link_libraries(${lib_name}-shared PUBLIC dd)
     endif()
+    if (NATIVE_BVH)
+      target_compile_definitions(${lib_name}-shared PRIVATE NATIVE_BVH)
+    endif()
     target_include_directories(${lib_name}-shared INTERFACE $<INSTALL_INTERFACE:${INSTALL_INCLUDE_DIR}>
                                                             ${MOAB_INCLUDE_DIRS})
     install(TARGETS ${lib_name}-shared
@@ -260,6 +269,9 @@ macro (dagmc_install_library lib_name)
     endif ()
 
     target_link_libraries(${lib_name}-static ${LINK_LIBS_STATIC})
+    if (NATIVE_BVH)
+      target_compile_definitions(${lib_name}-static PRIVATE NATIVE_BVH)
+    endif()
     target_include_directories(${lib_name}-static INTERFACE $<INSTALL_INTERFACE:${INSTALL_INCLUDE_DIR}>
                                                             ${MOAB_INCLUDE_DIRS})
 
@@ -6,6 +6,7 @@ int main(int argc, char* argv[]) {
   std::string dag_file;
   std::string out_file;
   bool verbose = false;
+  int n_threads = 0;
 
   ProgOptions po("build_obb: A tool to prebuild your DAGMC OBB Tree");
 
@@ -16,6 +17,10 @@ int main(int argc, char* argv[]) {
                          "Specify the output filename (default "
                          ")",
                          &out_file);
+  po.addOpt<int>("threads,t",
+                 "Number of threads to build the trees with, 0 for all "
+                 "hardware threads (default 0, native BVH only)",
+                 &n_threads);
 
   po.addOptionHelpHeading("Options for loading files");
 
@@ -38,6 +43,8 @@ int main(int argc, char* argv[]) {
     std::cout << "Setting default outfile to be " << out_file << std::endl;
   }
 
+  DAG->set_num_threads(n_threads);
+
   // read geometry
   rval = DAG->load_file(dag_file.c_str());
   if (moab::MB_SUCCESS != rval) {
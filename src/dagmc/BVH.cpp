@@ -0,0 +1,1261 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace moab {
+
+// SAH cost of descending into a node relative to testing one block
+static const double traversal_cost = 1.0;
+static const double block_cost = 1.0;
+static const int sah_bins = 16;
+
+// plucker coordinates smaller than this are treated as zero (edge hits),
+// as in GeomUtil::plucker_edge_test
+static const double near_zero = 10 * std::numeric_limits<double>::epsilon();
+
+BVHCounts*& bvh_counts() {
+  static thread_local BVHCounts* counts = NULL;
+  return counts;
+}
+
+BVHRay::BVHRay(const double o[3], const double d[3], double neg,
+               bool use_neg)
+    : neg_len(neg), use_neg_len(use_neg) {
+  for (int i = 0; i < 3; i++) {
+    origin[i] = o[i];
+    dir[i] = d[i];
+    inv_dir[i] = 1.0 / d[i];
+  }
+  normal[0] = dir[1] * origin[2] - dir[2] * origin[1];
+  normal[1] = dir[2] * origin[0] - dir[0] * origin[2];
+  normal[2] = dir[0] * origin[1] - dir[1] * origin[0];
+
+  // to minimize roundoff, distances are measured along the largest
+  // direction component
+  max_axis = 0;
+  double max_abs_dir = 0;
+  for (int i = 0; i < 3; i++) {
+    if (std::fabs(dir[i]) > max_abs_dir) {
+      max_axis = i;
+      max_abs_dir = std::fabs(dir[i]);
+    }
+  }
+}
+
+BVHRayPacket::BVHRayPacket(const BVHRay* packet_rays, int n)
+    : rays(packet_rays), count(n) {
+  for (int lane = 0; lane < BVH_PACKET_WIDTH; lane++) {
+    const BVHRay* ray = lane < count ? &rays[lane] : &rays[0];
+    for (int i = 0; i < 3; i++) {
+      origin[i][lane] = ray->origin[i];
+      inv_dir[i][lane] = ray->inv_dir[i];
+    }
+    tmin[lane] = ray->use_neg_len ? ray->neg_len : 0.0;
+  }
+}
+
+/* SECTION I: Construction */
+
+namespace {
+
+struct BuildState {
+  const std::vector<BVHBox>& boxes;
+  std::vector<double> centroids;
+  std::vector<int>& order;
+  std::vector<BVHNode>& nodes;
+  int leaf_width;
+  int max_leaf_size;
+};
+
+// cost of testing n primitives that are packed into blocks of leaf_width
+inline double leaf_cost(int n, int leaf_width) {
+  return block_cost * ((n + leaf_width - 1) / leaf_width);
+}
+
+int make_leaf(BuildState& s, int idx, int begin, int end) {
+  s.nodes[idx].first = begin;
+  s.nodes[idx].count = end - begin;
+  return idx;
+}
+
+int build_node(BuildState& s, int begin, int end, int depth) {
+  int idx = s.nodes.size();
+  s.nodes.emplace_back();
+
+  BVHBox bounds, cbounds;
+  for (int i = begin; i < end; i++) {
+    int p = s.order[i];
+    bounds.extend(s.boxes[p]);
+    cbounds.extend(&s.centroids[3 * p]);
+  }
+  for (int i = 0; i < 3; i++) {
+    s.nodes[idx].lo[i] = bounds.lo[i];
+    s.nodes[idx].hi[i] = bounds.hi[i];
+  }
+
+  int n = end - begin;
+  if (n <= 1 || depth >= BVH_MAX_DEPTH - 1)
+    return make_leaf(s, idx, begin, end);
+
+  // split along the axis of largest centroid extent
+  int axis = 0;
+  for (int i = 1; i < 3; i++) {
+    if (cbounds.hi[i] - cbounds.lo[i] > cbounds.hi[axis] - cbounds.lo[axis])
+      axis = i;
+  }
+  double extent = cbounds.hi[axis] - cbounds.lo[axis];
+
+  int mid = -1;
+  if (extent > 0.0) {
+    // bin the centroids and evaluate the SAH at each bin boundary
+    int bin_count[sah_bins] = {0};
+    BVHBox bin_box[sah_bins];
+    double scale = sah_bins / extent;
+    auto bin_of = [&](int p) {
+      int b = (int)((s.centroids[3 * p + axis] - cbounds.lo[axis]) * scale);
+      return std::min(std::max(b, 0), sah_bins - 1);
+    };
+    for (int i = begin; i < end; i++) {
+      int p = s.order[i];
+      int b = bin_of(p);
+      bin_count[b]++;
+      bin_box[b].extend(s.boxes[p]);
+    }
+
+    double right_area[sah_bins];
+    int right_count[sah_bins];
+    BVHBox acc;
+    int cnt = 0;
+    for (int b = sah_bins - 1; b > 0; b--) {
+      acc.extend(bin_box[b]);
+      cnt += bin_count[b];
+      right_area[b] = acc.area();
+      right_count[b] = cnt;
+    }
+
+    double best_cost = std::numeric_limits<double>::max();
+    int best_split = -1;
+    acc = BVHBox();
+    cnt = 0;
+    for (int b = 1; b < sah_bins; b++) {
+      acc.extend(bin_box[b - 1]);
+      cnt += bin_count[b - 1];
+      if (0 == cnt || 0 == right_count[b]) continue;
+      double cost = acc.area() * leaf_cost(cnt, s.leaf_width) +
+                    right_area[b] * leaf_cost(right_count[b], s.leaf_width);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_split = b;
+      }
+    }
+
+    if (best_split > 0) {
+      double parent_area = bounds.area();
+      double split_cost =
+          traversal_cost +
+          (parent_area > 0.0 ? best_cost / parent_area : best_cost);
+      if (split_cost >= leaf_cost(n, s.leaf_width) && n <= s.max_leaf_size)
+        return make_leaf(s, idx, begin, end);
+      int* part = std::partition(
+          &s.order[begin], &s.order[0] + end,
+          [&](int p) { return bin_of(p) < best_split; });
+      mid = part - &s.order[0];
+    }
+  } else if (n <= s.max_leaf_size) {
+    return make_leaf(s, idx, begin, end);
+  }
+
+  // coincident centroids: split the range in half to bound the leaf size
+  if (mid <= begin || mid >= end) mid = begin + n / 2;
+
+  build_node(s, begin, mid, depth + 1);
+  int right = build_node(s, mid, end, depth + 1);
+  s.nodes[idx].first = right;
+  s.nodes[idx].count = 0;
+  return idx;
+}
+
+// pad the node boxes so that rays grazing a box are not lost to roundoff
+void pad_nodes(std::vector<BVHNode>& nodes) {
+  for (auto& node : nodes) {
+    for (int i = 0; i < 3; i++) {
+      double mag = std::max(std::fabs(node.lo[i]), std::fabs(node.hi[i]));
+      double pad = 64 * std::numeric_limits<double>::epsilon() *
+                   std::max(mag, 1.0);
+      node.lo[i] -= pad;
+      node.hi[i] += pad;
+    }
+  }
+}
+
+// canonical vertex order of GeomUtil::plucker_edge_test
+inline bool first(const double a[3], const double b[3]) {
+  if (a[0] != b[0]) return a[0] < b[0];
+  if (a[1] != b[1]) return a[1] < b[1];
+  return a[2] < b[2];
+}
+
+// nearest floats at or below and at or above x
+inline float round_down(double x) {
+  if (x > std::numeric_limits<float>::max())
+    return std::numeric_limits<float>::max();
+  if (x < -std::numeric_limits<float>::max())
+    return -std::numeric_limits<float>::infinity();
+  float f = (float)x;
+  return f > x ? std::nextafter(f, -std::numeric_limits<float>::infinity())
+               : f;
+}
+
+inline float round_up(double x) { return -round_down(-x); }
+
+// single precision copies of the nodes and blocks of a tree
+void to_float(const std::vector<BVHNode>& nodes,
+              const std::vector<TriangleBlock>& blocks,
+              std::vector<BVHNodeF>& float_nodes,
+              std::vector<TriangleBlockF>& float_blocks) {
+  float_nodes.resize(nodes.size());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    for (int k = 0; k < 3; k++) {
+      float_nodes[i].lo[k] = round_down(nodes[i].lo[k]);
+      float_nodes[i].hi[k] = round_up(nodes[i].hi[k]);
+    }
+    float_nodes[i].first = nodes[i].first;
+    float_nodes[i].count = nodes[i].count;
+  }
+
+  float_blocks.resize(blocks.size());
+  for (size_t b = 0; b < blocks.size(); b++) {
+    const TriangleBlock& block = blocks[b];
+    TriangleBlockF& fblock = float_blocks[b];
+    std::memset(&fblock, 0, sizeof(TriangleBlockF));
+    double scale = 0.0;
+    for (int v = 0; v < 3; v++) {
+      for (int lane = 0; lane < BVH_BLOCK_WIDTH; lane++) {
+        fblock.x[v][lane] = (float)block.x[v][lane];
+        fblock.y[v][lane] = (float)block.y[v][lane];
+        fblock.z[v][lane] = (float)block.z[v][lane];
+        scale = std::max(scale, std::fabs(block.x[v][lane]));
+        scale = std::max(scale, std::fabs(block.y[v][lane]));
+        scale = std::max(scale, std::fabs(block.z[v][lane]));
+      }
+    }
+    std::copy(block.handle, block.handle + BVH_BLOCK_WIDTH, fblock.handle);
+    fblock.scale = round_up(scale);
+    fblock.count = block.count;
+  }
+}
+
+}  // namespace
+
+void build_bvh(const std::vector<BVHBox>& boxes, int leaf_width,
+               int max_leaf_size, std::vector<BVHNode>& nodes,
+               std::vector<int>& order) {
+  nodes.clear();
+  order.resize(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++) order[i] = i;
+  if (boxes.empty()) return;
+
+  BuildState s{boxes, std::vector<double>(3 * boxes.size()), order, nodes,
+               std::max(leaf_width, 1), std::max(max_leaf_size, 1)};
+  for (size_t i = 0; i < boxes.size(); i++) {
+    for (int j = 0; j < 3; j++) s.centroids[3 * i + j] = boxes[i].center(j);
+  }
+
+  nodes.reserve(2 * boxes.size() / s.max_leaf_size + 1);
+  build_node(s, 0, boxes.size(), 0);
+  pad_nodes(nodes);
+}
+
+void TriangleBVH::build(const std::vector<double>& coords,
+                        const std::vector<EntityHandle>& handles,
+                        BVHPrecision precision) {
+  assert(coords.size() == 9 * handles.size());
+  n_tris = handles.size();
+  box = BVHBox();
+
+  std::vector<BVHBox> tri_boxes(n_tris);
+  for (int i = 0; i < n_tris; i++) {
+    for (int v = 0; v < 3; v++) tri_boxes[i].extend(&coords[9 * i + 3 * v]);
+    box.extend(tri_boxes[i]);
+  }
+
+  std::vector<BVHNode> new_nodes;
+  std::vector<TriangleBlock> new_blocks;
+  std::vector<int> order;
+  build_bvh(tri_boxes, BVH_BLOCK_WIDTH, 2 * BVH_BLOCK_WIDTH, new_nodes, order);
+
+  // copy the triangles of each leaf into its own run of blocks
+  for (auto& node : new_nodes) {
+    if (!node.is_leaf()) continue;
+    int first_block = new_blocks.size();
+    for (int i = 0; i < node.count; i += BVH_BLOCK_WIDTH) {
+      new_blocks.emplace_back();
+      TriangleBlock& block = new_blocks.back();
+      std::memset(&block, 0, sizeof(TriangleBlock));
+      block.count = std::min(BVH_BLOCK_WIDTH, node.count - i);
+      for (int lane = 0; lane < block.count; lane++) {
+        int t = order[node.first + i + lane];
+        const double* v = &coords[9 * t];
+        for (int k = 0; k < 3; k++) {
+          block.x[k][lane] = v[3 * k];
+          block.y[k][lane] = v[3 * k + 1];
+          block.z[k][lane] = v[3 * k + 2];
+        }
+        block.handle[lane] = handles[t];
+        for (int e = 0; e < 3; e++) {
+          if (!first(&v[3 * e], &v[3 * ((e + 1) % 3)]))
+            block.edge_flip[e] |= (1 << lane);
+        }
+      }
+    }
+    node.first = first_block;
+    node.count = new_blocks.size() - first_block;
+  }
+
+  prec = precision;
+  if (BVH_MIXED == precision) {
+    std::vector<BVHNodeF> new_float_nodes;
+    std::vector<TriangleBlockF> new_float_blocks;
+    to_float(new_nodes, new_blocks, new_float_nodes, new_float_blocks);
+    nodes.assign(std::vector<BVHNode>());
+    blocks.assign(std::vector<TriangleBlock>());
+    float_nodes.assign(std::move(new_float_nodes));
+    float_blocks.assign(std::move(new_float_blocks));
+  } else {
+    nodes.assign(std::move(new_nodes));
+    blocks.assign(std::move(new_blocks));
+    float_nodes.assign(std::vector<BVHNodeF>());
+    float_blocks.assign(std::vector<TriangleBlockF>());
+  }
+}
+
+void TriangleBVH::assign_view(const BVHNode* node_data, size_t n_nodes,
+                              const TriangleBlock* block_data,
+                              size_t n_blocks, const BVHBox& bounds,
+                              int num_triangles,
+                              std::shared_ptr<const void> storage) {
+  nodes.assign_view(node_data, n_nodes, storage);
+  blocks.assign_view(block_data, n_blocks, storage);
+  float_nodes.assign(std::vector<BVHNodeF>());
+  float_blocks.assign(std::vector<TriangleBlockF>());
+  prec = BVH_DOUBLE;
+  box = bounds;
+  n_tris = num_triangles;
+}
+
+void TriangleBVH::assign_view(const BVHNodeF* node_data, size_t n_nodes,
+                              const TriangleBlockF* block_data,
+                              size_t n_blocks, const BVHBox& bounds,
+                              int num_triangles,
+                              std::shared_ptr<const void> storage) {
+  nodes.assign(std::vector<BVHNode>());
+  blocks.assign(std::vector<TriangleBlock>());
+  float_nodes.assign_view(node_data, n_nodes, storage);
+  float_blocks.assign_view(block_data, n_blocks, storage);
+  prec = BVH_MIXED;
+  box = bounds;
+  n_tris = num_triangles;
+}
+
+size_t TriangleBVH::memory_size() const {
+  return nodes.size() * sizeof(BVHNode) +
+         blocks.size() * sizeof(TriangleBlock) +
+         float_nodes.size() * sizeof(BVHNodeF) +
+         float_blocks.size() * sizeof(TriangleBlockF);
+}
+
+void TriangleBVH::lane_coords(const TriangleBlock& block, int lane,
+                              double coords[9]) {
+  for (int k = 0; k < 3; k++) {
+    coords[3 * k] = block.x[k][lane];
+    coords[3 * k + 1] = block.y[k][lane];
+    coords[3 * k + 2] = block.z[k][lane];
+  }
+}
+
+bool TriangleBVH::lane_coords(const TriangleBlockF& block, int lane,
+                              const FacetCoordsFn& exact, double coords[9]) {
+  if (exact) return MB_SUCCESS == exact(block.handle[lane], coords);
+  for (int k = 0; k < 3; k++) {
+    coords[3 * k] = block.x[k][lane];
+    coords[3 * k + 1] = block.y[k][lane];
+    coords[3 * k + 2] = block.z[k][lane];
+  }
+  return true;
+}
+
+/* SECTION II: Queries */
+
+namespace {
+
+// GeomUtil::plucker_edge_test on edge a->b, with the canonical ordering
+// decided ahead of time
+inline double plucker_edge(const double a[3], const double b[3],
+                           bool reversed, const BVHRay& ray) {
+  const double* p = reversed ? b : a;
+  const double* q = reversed ? a : b;
+  double e[3] = {q[0] - p[0], q[1] - p[1], q[2] - p[2]};
+  double n[3] = {e[1] * p[2] - e[2] * p[1], e[2] * p[0] - e[0] * p[2],
+                 e[0] * p[1] - e[1] * p[0]};
+  double pip = ray.dir[0] * n[0] + ray.dir[1] * n[1] + ray.dir[2] * n[2] +
+               (ray.normal[0] * e[0] + ray.normal[1] * e[1] +
+                ray.normal[2] * e[2]);
+  if (reversed) pip = -pip;
+  if (near_zero > std::fabs(pip)) pip = 0.0;
+  return pip;
+}
+
+// plucker_ray_tri_intersect on vertices v, where flip[e] reverses edge e
+bool plucker_tri(const double v[3][3], const bool flip[3], const BVHRay& ray,
+                 const int* orient, double& dist, bool& on_edge) {
+  double c0 = plucker_edge(v[0], v[1], flip[0], ray);
+  if (orient && (*orient) * c0 > 0) return false;
+
+  double c1 = plucker_edge(v[1], v[2], flip[1], ray);
+  if (orient && (*orient) * c1 > 0) return false;
+  // without an orientation all coordinates must share a sign (or be zero)
+  if ((0.0 < c0 && 0.0 > c1) || (0.0 > c0 && 0.0 < c1)) return false;
+
+  double c2 = plucker_edge(v[2], v[0], flip[2], ray);
+  if (orient && (*orient) * c2 > 0) return false;
+  if ((0.0 < c1 && 0.0 > c2) || (0.0 > c1 && 0.0 < c2) ||
+      (0.0 < c0 && 0.0 > c2) || (0.0 > c0 && 0.0 < c2))
+    return false;
+
+  // coplanar with the ray
+  if (0.0 == c0 && 0.0 == c1 && 0.0 == c2) return false;
+
+  // only the largest direction component of the intersection is needed
+  const double inverse_sum = 1.0 / (c0 + c1 + c2);
+  const int k = ray.max_axis;
+  const double intersection = c0 * inverse_sum * v[2][k] +
+                              c1 * inverse_sum * v[0][k] +
+                              c2 * inverse_sum * v[1][k];
+  dist = (intersection - ray.origin[k]) / ray.dir[k];
+  on_edge = (0.0 == c0 || 0.0 == c1 || 0.0 == c2);
+  return true;
+}
+
+inline void lane_vertex(const TriangleBlock& block, int lane, int v,
+                        double out[3]) {
+  out[0] = block.x[v][lane];
+  out[1] = block.y[v][lane];
+  out[2] = block.z[v][lane];
+}
+
+}  // namespace
+
+bool plucker_ray_tri_intersect(const TriangleBlock& block, int lane,
+                               const BVHRay& ray, const int* orient,
+                               double& dist, bool& on_edge) {
+  double v[3][3];
+  bool flip[3];
+  for (int k = 0; k < 3; k++) {
+    lane_vertex(block, lane, k, v[k]);
+    flip[k] = (block.edge_flip[k] >> lane) & 1;
+  }
+  return plucker_tri(v, flip, ray, orient, dist, on_edge);
+}
+
+bool plucker_ray_tri_intersect(const double coords[9], const BVHRay& ray,
+                               const int* orient, double& dist,
+                               bool& on_edge) {
+  double v[3][3];
+  bool flip[3];
+  for (int k = 0; k < 3; k++) {
+    for (int i = 0; i < 3; i++) v[k][i] = coords[3 * k + i];
+  }
+  for (int e = 0; e < 3; e++) flip[e] = !first(v[e], v[(e + 1) % 3]);
+  return plucker_tri(v, flip, ray, orient, dist, on_edge);
+}
+
+double closest_point_on_tri(const TriangleBlock& block, int lane,
+                            const double p[3], double closest[3]) {
+  double coords[9];
+  for (int v = 0; v < 3; v++) lane_vertex(block, lane, v, &coords[3 * v]);
+  return closest_point_on_tri(coords, p, closest);
+}
+
+double closest_point_on_tri(const double coords[9], const double p[3],
+                            double closest[3]) {
+  const double* a = coords;
+  const double* b = coords + 3;
+  const double* c = coords + 6;
+
+  auto dot = [](const double* u, const double* v) {
+    return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+  };
+  auto set = [&](double s, double t) {
+    // closest = a + s * ab + t * ac
+    for (int i = 0; i < 3; i++)
+      closest[i] = a[i] + s * (b[i] - a[i]) + t * (c[i] - a[i]);
+  };
+
+  // Voronoi region search, as in Ericson's Real-Time Collision Detection
+  double ab[3], ac[3], ap[3], bp[3], cp[3];
+  for (int i = 0; i < 3; i++) {
+    ab[i] = b[i] - a[i];
+    ac[i] = c[i] - a[i];
+    ap[i] = p[i] - a[i];
+    bp[i] = p[i] - b[i];
+    cp[i] = p[i] - c[i];
+  }
+  double d1 = dot(ab, ap), d2 = dot(ac, ap);
+  double d3 = dot(ab, bp), d4 = dot(ac, bp);
+  double d5 = dot(ab, cp), d6 = dot(ac, cp);
+  double va = d3 * d6 - d5 * d4;
+  double vb = d5 * d2 - d1 * d6;
+  double vc = d1 * d4 - d3 * d2;
+
+  if (d1 <= 0.0 && d2 <= 0.0) {
+    set(0.0, 0.0);
+  } else if (d3 >= 0.0 && d4 <= d3) {
+    set(1.0, 0.0);
+  } else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+    set(d1 / (d1 - d3), 0.0);
+  } else if (d6 >= 0.0 && d5 <= d6) {
+    set(0.0, 1.0);
+  } else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+    set(0.0, d2 / (d2 - d6));
+  } else if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+    double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    set(1.0 - w, w);
+  } else {
+    double denom = va + vb + vc;
+    if (0.0 == denom) {
+      // degenerate triangle, fall back on its first vertex
+      set(0.0, 0.0);
+    } else {
+      set(vb / denom, vc / denom);
+    }
+  }
+
+  double d[3] = {p[0] - closest[0], p[1] - closest[1], p[2] - closest[2]};
+  return dot(d, d);
+}
+
+namespace {
+
+// exact coordinates of a lane, see TriangleBVH::lane_coords
+inline bool exact_lane_coords(const TriangleBlock& block, int lane,
+                              const FacetCoordsFn&, double coords[9]) {
+  for (int v = 0; v < 3; v++) lane_vertex(block, lane, v, &coords[3 * v]);
+  return true;
+}
+
+inline bool exact_lane_coords(const TriangleBlockF& block, int lane,
+                              const FacetCoordsFn& exact, double coords[9]) {
+  if (exact) return MB_SUCCESS == exact(block.handle[lane], coords);
+  for (int v = 0; v < 3; v++) {
+    coords[3 * v] = block.x[v][lane];
+    coords[3 * v + 1] = block.y[v][lane];
+    coords[3 * v + 2] = block.z[v][lane];
+  }
+  return true;
+}
+
+// closest triangle of a block to p, if closer than sqrt(best_dist_sqr)
+bool closest_in_block(const TriangleBlock& block, const double p[3],
+                      double& best_dist_sqr, double closest[3],
+                      EntityHandle& facet, const FacetCoordsFn&,
+                      BVHCounts* counts) {
+  double bound[BVH_BLOCK_WIDTH];
+  block_dist_sqr_lower_bound(block, p, bound);
+  unsigned candidates = 0;
+  for (int lane = 0; lane < block.count; lane++) {
+    if (bound[lane] < best_dist_sqr) candidates |= 1u << lane;
+  }
+  if (!candidates) return false;
+
+  // the vector kernel measures the whole block; the closest point is only
+  // needed for an improvement
+  double dist_sqr[BVH_BLOCK_WIDTH];
+  block_dist_sqr(block, p, dist_sqr);
+  bool found = false;
+  for (int lane = 0; lane < block.count; lane++) {
+    if (!((candidates >> lane) & 1)) continue;
+    if (counts) counts->triangles_tested++;
+    if (dist_sqr[lane] < best_dist_sqr) {
+      closest_point_on_tri(block, lane, p, closest);
+      best_dist_sqr = dist_sqr[lane];
+      facet = block.handle[lane];
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool closest_in_block(const TriangleBlockF& block, const double p[3],
+                      double& best_dist_sqr, double closest[3],
+                      EntityHandle& facet, const FacetCoordsFn& exact,
+                      BVHCounts* counts) {
+  double bound[BVH_BLOCK_WIDTH];
+  block_dist_sqr_lower_bound(block, p, bound);
+  bool found = false;
+  for (int lane = 0; lane < block.count; lane++) {
+    if (bound[lane] >= best_dist_sqr) continue;
+    if (counts) counts->triangles_tested++;
+    double coords[9], pt[3];
+    if (!exact_lane_coords(block, lane, exact, coords)) continue;
+    double d2 = closest_point_on_tri(coords, p, pt);
+    if (d2 < best_dist_sqr) {
+      best_dist_sqr = d2;
+      std::copy(pt, pt + 3, closest);
+      facet = block.handle[lane];
+      found = true;
+    }
+  }
+  return found;
+}
+
+template <typename Node, typename Block>
+bool closest_in_tree(const BVHArray<Node>& nodes,
+                     const BVHArray<Block>& blocks, const double p[3],
+                     double& best_dist_sqr, double closest[3],
+                     EntityHandle& facet, const FacetCoordsFn& exact) {
+  if (nodes.empty() || point_box_dist_sqr(nodes[0], p) > best_dist_sqr)
+    return false;
+
+  BVHCounts* counts = bvh_counts();
+  bool found = false;
+  int stack[BVH_MAX_DEPTH];
+  double stack_d[BVH_MAX_DEPTH];
+  int sp = 0;
+  int idx = 0;
+  while (true) {
+    const Node& node = nodes[idx];
+    if (counts) counts->nodes_visited++;
+    if (node.is_leaf()) {
+      if (counts) counts->leaves_visited++;
+      for (int b = node.first; b < node.first + node.count; b++) {
+        if (closest_in_block(blocks[b], p, best_dist_sqr, closest, facet,
+                             exact, counts))
+          found = true;
+      }
+    } else {
+      int left = idx + 1, right = node.first;
+      double dl = point_box_dist_sqr(nodes[left], p);
+      double dr = point_box_dist_sqr(nodes[right], p);
+      if (dr < dl) {
+        std::swap(left, right);
+        std::swap(dl, dr);
+      }
+      if (dl <= best_dist_sqr) {
+        if (dr <= best_dist_sqr) {
+          stack_d[sp] = dr;
+          stack[sp++] = right;
+        }
+        idx = left;
+        continue;
+      }
+    }
+    do {
+      if (0 == sp) return found;
+      --sp;
+    } while (stack_d[sp] > best_dist_sqr);
+    idx = stack[sp];
+  }
+}
+
+// like closest_in_tree, but with the triangles' bounding boxes standing in
+// for the triangles
+template <typename Node, typename Block>
+void lower_bound_in_tree(const BVHArray<Node>& nodes,
+                         const BVHArray<Block>& blocks, const double p[3],
+                         double& best_dist_sqr) {
+  if (nodes.empty()) return;
+
+  BVHCounts* counts = bvh_counts();
+  int stack[BVH_MAX_DEPTH + 1];
+  double stack_d[BVH_MAX_DEPTH + 1];
+  int sp = 0;
+  stack_d[sp] = point_box_dist_sqr(nodes[0], p);
+  stack[sp++] = 0;
+  while (sp > 0) {
+    --sp;
+    // nothing is below a bound of zero
+    if (stack_d[sp] >= best_dist_sqr || 0.0 == best_dist_sqr) continue;
+    const Node& node = nodes[stack[sp]];
+    if (counts) counts->nodes_visited++;
+    if (node.is_leaf()) {
+      if (counts) counts->leaves_visited++;
+      for (int b = node.first; b < node.first + node.count; b++) {
+        double bound[BVH_BLOCK_WIDTH];
+        block_dist_sqr_lower_bound(blocks[b], p, bound);
+        for (int lane = 0; lane < blocks[b].count; lane++)
+          best_dist_sqr = std::min(best_dist_sqr, bound[lane]);
+      }
+    } else {
+      int left = stack[sp] + 1, right = node.first;
+      double dl = point_box_dist_sqr(nodes[left], p);
+      double dr = point_box_dist_sqr(nodes[right], p);
+      // the nearer child is popped first
+      if (dl < dr) {
+        std::swap(left, right);
+        std::swap(dl, dr);
+      }
+      stack_d[sp] = dl;
+      stack[sp++] = left;
+      stack_d[sp] = dr;
+      stack[sp++] = right;
+    }
+  }
+}
+
+template <typename Node, typename Block>
+void facets_in_tree(const BVHArray<Node>& nodes,
+                    const BVHArray<Block>& blocks, const double p[3],
+                    double max_dist, std::vector<EntityHandle>& facets,
+                    const FacetCoordsFn& exact) {
+  if (nodes.empty()) return;
+  const double max_dist_sqr = max_dist * max_dist;
+
+  BVHCounts* counts = bvh_counts();
+  int stack[BVH_MAX_DEPTH];
+  int sp = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    const Node& node = nodes[stack[--sp]];
+    if (counts) counts->nodes_visited++;
+    if (point_box_dist_sqr(node, p) > max_dist_sqr) continue;
+    if (node.is_leaf()) {
+      if (counts) counts->leaves_visited++;
+      for (int b = node.first; b < node.first + node.count; b++) {
+        const Block& block = blocks[b];
+        double bound[BVH_BLOCK_WIDTH];
+        block_dist_sqr_lower_bound(block, p, bound);
+        for (int lane = 0; lane < block.count; lane++) {
+          if (bound[lane] > max_dist_sqr) continue;
+          if (counts) counts->triangles_tested++;
+          double coords[9], pt[3];
+          if (exact_lane_coords(block, lane, exact, coords) &&
+              closest_point_on_tri(coords, p, pt) <= max_dist_sqr)
+            facets.push_back(block.handle[lane]);
+        }
+      }
+    } else {
+      stack[sp++] = node.first;
+      stack[sp++] = &node - &nodes[0] + 1;
+    }
+  }
+}
+
+}  // namespace
+
+bool TriangleBVH::closest_to_location(const double p[3],
+                                      double& best_dist_sqr,
+                                      double closest[3], EntityHandle& facet,
+                                      const FacetCoordsFn& exact) const {
+  if (BVH_DOUBLE == prec)
+    return closest_in_tree(nodes, blocks, p, best_dist_sqr, closest, facet,
+                           exact);
+  return closest_in_tree(float_nodes, float_blocks, p, best_dist_sqr, closest,
+                         facet, exact);
+}
+
+void TriangleBVH::dist_sqr_lower_bound(const double p[3],
+                                       double& best_dist_sqr) const {
+  if (BVH_DOUBLE == prec)
+    lower_bound_in_tree(nodes, blocks, p, best_dist_sqr);
+  else
+    lower_bound_in_tree(float_nodes, float_blocks, p, best_dist_sqr);
+}
+
+void TriangleBVH::facets_within(const double p[3], double max_dist,
+                                std::vector<EntityHandle>& facets,
+                                const FacetCoordsFn& exact) const {
+  if (BVH_DOUBLE == prec)
+    facets_in_tree(nodes, blocks, p, max_dist, facets, exact);
+  else
+    facets_in_tree(float_nodes, float_blocks, p, max_dist, facets, exact);
+}
+
+/* SECTION III: Block kernels */
+
+namespace {
+
+// Thin wrappers over the vector registers used by the block kernels. Each
+// provides the same operations on `width` doubles at a time; masks are
+// per-lane booleans.
+#if defined(__AVX512F__)
+struct SimdD {
+  static const int width = 8;
+  typedef __m512d V;
+  typedef __mmask8 M;
+  static const char* isa() { return "AVX-512"; }
+  static V load(const double* p) { return _mm512_load_pd(p); }
+  static void store(double* p, V a) { _mm512_storeu_pd(p, a); }
+  static V set1(double x) { return _mm512_set1_pd(x); }
+  static V add(V a, V b) { return _mm512_add_pd(a, b); }
+  static V sub(V a, V b) { return _mm512_sub_pd(a, b); }
+  static V mul(V a, V b) { return _mm512_mul_pd(a, b); }
+  static V div(V a, V b) { return _mm512_div_pd(a, b); }
+  static V min(V a, V b) { return _mm512_min_pd(a, b); }
+  static V max(V a, V b) { return _mm512_max_pd(a, b); }
+  static V abs(V a) { return _mm512_abs_pd(a); }
+  static V neg(V a) {
+    return _mm512_castsi512_pd(_mm512_xor_si512(
+        _mm512_castpd_si512(a), _mm512_set1_epi64(0x8000000000000000LL)));
+  }
+  static M lt(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+  static M le(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+  static M gt(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+  static M ge(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+  static M eq(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+  static M mand(M a, M b) { return a & b; }
+  static M mor(M a, M b) { return a | b; }
+  static M mandnot(M a, M b) { return a & ~b; }
+  static M none() { return 0; }
+  // a where m is set, b elsewhere
+  static V select(M m, V a, V b) { return _mm512_mask_blend_pd(m, b, a); }
+  static M lanes(unsigned bits) { return (M)(bits & 0xff); }
+  static unsigned bits(M m) { return m; }
+};
+#elif defined(__AVX2__)
+struct SimdD {
+  static const int width = 4;
+  typedef __m256d V;
+  typedef __m256d M;
+  static const char* isa() { return "AVX2"; }
+  static V load(const double* p) { return _mm256_load_pd(p); }
+  static void store(double* p, V a) { _mm256_storeu_pd(p, a); }
+  static V set1(double x) { return _mm256_set1_pd(x); }
+  static V add(V a, V b) { return _mm256_add_pd(a, b); }
+  static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+  static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+  static V div(V a, V b) { return _mm256_div_pd(a, b); }
+  static V min(V a, V b) { return _mm256_min_pd(a, b); }
+  static V max(V a, V b) { return _mm256_max_pd(a, b); }
+  static V abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+  static V neg(V a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+  static M lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static M le(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+  static M gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  static M ge(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+  static M eq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+  static M mand(M a, M b) { return _mm256_and_pd(a, b); }
+  static M mor(M a, M b) { return _mm256_or_pd(a, b); }
+  static M mandnot(M a, M b) { return _mm256_andnot_pd(b, a); }
+  static M none() { return _mm256_setzero_pd(); }
+  static V select(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+  static M lanes(unsigned bits) {
+    const __m256i sel = _mm256_set_epi64x(8, 4, 2, 1);
+    __m256i v = _mm256_and_si256(_mm256_set1_epi64x(bits), sel);
+    return _mm256_castsi256_pd(_mm256_cmpeq_epi64(v, sel));
+  }
+  static unsigned bits(M m) { return _mm256_movemask_pd(m); }
+};
+#else
+struct SimdD {
+  static const int width = 1;
+  typedef double V;
+  typedef bool M;
+  static const char* isa() { return "scalar"; }
+  static V load(const double* p) { return *p; }
+  static void store(double* p, V a) { *p = a; }
+  static V set1(double x) { return x; }
+  static V add(V a, V b) { return a + b; }
+  static V sub(V a, V b) { return a - b; }
+  static V mul(V a, V b) { return a * b; }
+  static V div(V a, V b) { return a / b; }
+  static V min(V a, V b) { return a < b ? a : b; }
+  static V max(V a, V b) { return a > b ? a : b; }
+  static V abs(V a) { return std::fabs(a); }
+  static V neg(V a) { return -a; }
+  static M lt(V a, V b) { return a < b; }
+  static M le(V a, V b) { return a <= b; }
+  static M gt(V a, V b) { return a > b; }
+  static M ge(V a, V b) { return a >= b; }
+  static M eq(V a, V b) { return a == b; }
+  static M mand(M a, M b) { return a && b; }
+  static M mor(M a, M b) { return a || b; }
+  static M mandnot(M a, M b) { return a && !b; }
+  static M none() { return false; }
+  static V select(M m, V a, V b) { return m ? a : b; }
+  static M lanes(unsigned bits) { return bits & 1; }
+  static unsigned bits(M m) { return m; }
+};
+#endif
+
+// Single precision counterpart of SimdD, with a whole block in one AVX
+// register
+#if defined(__AVX512F__) || defined(__AVX2__)
+struct SimdF {
+  static const int width = 8;
+  typedef __m256 V;
+  typedef __m256 M;
+  static V load(const float* p) { return _mm256_load_ps(p); }
+  static V set1(float x) { return _mm256_set1_ps(x); }
+  static V add(V a, V b) { return _mm256_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  static V div(V a, V b) { return _mm256_div_ps(a, b); }
+  static V abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+  static M lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static M gt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static M mand(M a, M b) { return _mm256_and_ps(a, b); }
+  static M mor(M a, M b) { return _mm256_or_ps(a, b); }
+  static M none() { return _mm256_setzero_ps(); }
+  static unsigned bits(M m) { return _mm256_movemask_ps(m); }
+};
+#else
+struct SimdF {
+  static const int width = 1;
+  typedef float V;
+  typedef bool M;
+  static V load(const float* p) { return *p; }
+  static V set1(float x) { return x; }
+  static V add(V a, V b) { return a + b; }
+  static V sub(V a, V b) { return a - b; }
+  static V mul(V a, V b) { return a * b; }
+  static V div(V a, V b) { return a / b; }
+  static V abs(V a) { return std::fabs(a); }
+  static M lt(V a, V b) { return a < b; }
+  static M gt(V a, V b) { return a > b; }
+  static M mand(M a, M b) { return a && b; }
+  static M mor(M a, M b) { return a || b; }
+  static M none() { return false; }
+  static unsigned bits(M m) { return m; }
+};
+#endif
+
+typedef SimdD S;
+typedef S::V V;
+typedef S::M M;
+typedef SimdF F;
+
+// plucker_edge for `width` lanes; flip selects the reversed edge order
+inline V plucker_edge(const V a[3], const V b[3], M flip, const V d[3],
+                      const V m[3], V near) {
+  V p[3], e[3];
+  for (int i = 0; i < 3; i++) {
+    p[i] = S::select(flip, b[i], a[i]);
+    e[i] = S::sub(S::select(flip, a[i], b[i]), p[i]);
+  }
+  V n0 = S::sub(S::mul(e[1], p[2]), S::mul(e[2], p[1]));
+  V n1 = S::sub(S::mul(e[2], p[0]), S::mul(e[0], p[2]));
+  V n2 = S::sub(S::mul(e[0], p[1]), S::mul(e[1], p[0]));
+  V pip = S::add(
+      S::add(S::add(S::mul(d[0], n0), S::mul(d[1], n1)), S::mul(d[2], n2)),
+      S::add(S::add(S::mul(m[0], e[0]), S::mul(m[1], e[1])),
+             S::mul(m[2], e[2])));
+  pip = S::select(flip, S::neg(pip), pip);
+  return S::select(S::lt(S::abs(pip), near), S::set1(0.0), pip);
+}
+
+}  // namespace
+
+const char* bvh_simd_isa() { return S::isa(); }
+
+unsigned ray_block_intersect(const TriangleBlock& block, const BVHRay& ray,
+                             const int* orient, double tmax,
+                             double dist[BVH_BLOCK_WIDTH], unsigned& on_edge) {
+  const V zero = S::set1(0.0), near = S::set1(near_zero);
+  const V d[3] = {S::set1(ray.dir[0]), S::set1(ray.dir[1]),
+                  S::set1(ray.dir[2])};
+  const V m[3] = {S::set1(ray.normal[0]), S::set1(ray.normal[1]),
+                  S::set1(ray.normal[2])};
+  const V o = S::set1(orient ? *orient : 0);
+  const int k = ray.max_axis;
+  const V origin_k = S::set1(ray.origin[k]), dir_k = S::set1(ray.dir[k]);
+  const V upper = S::set1(tmax), lower = S::set1(ray.neg_len);
+  const double(*coord_k)[BVH_BLOCK_WIDTH] =
+      0 == k ? block.x : (1 == k ? block.y : block.z);
+  const unsigned valid = (1u << block.count) - 1;
+
+  unsigned hits = 0;
+  on_edge = 0;
+  for (int base = 0; base < BVH_BLOCK_WIDTH; base += S::width) {
+    if (!(valid >> base)) break;
+    V v[3][3];
+    for (int j = 0; j < 3; j++) {
+      v[j][0] = S::load(&block.x[j][base]);
+      v[j][1] = S::load(&block.y[j][base]);
+      v[j][2] = S::load(&block.z[j][base]);
+    }
+
+    V c[3];
+    M pos[3], neg[3], zer[3];
+    M reject = S::none();
+    for (int e = 0; e < 3; e++) {
+      M flip = S::lanes(block.edge_flip[e] >> base);
+      c[e] = plucker_edge(v[e], v[(e + 1) % 3], flip, d, m, near);
+      if (orient) reject = S::mor(reject, S::gt(S::mul(o, c[e]), zero));
+      pos[e] = S::gt(c[e], zero);
+      neg[e] = S::lt(c[e], zero);
+      zer[e] = S::eq(c[e], zero);
+    }
+    // all coordinates must share a sign (or be zero) and not all be zero
+    for (int e = 0; e < 3; e++) {
+      int f = (e + 1) % 3;
+      reject = S::mor(reject, S::mand(pos[e], neg[f]));
+      reject = S::mor(reject, S::mand(neg[e], pos[f]));
+    }
+    M edge = S::mor(S::mor(zer[0], zer[1]), zer[2]);
+    reject = S::mor(reject, S::mand(S::mand(zer[0], zer[1]), zer[2]));
+
+    const V inverse_sum =
+        S::div(S::set1(1.0), S::add(S::add(c[0], c[1]), c[2]));
+    V intersection = S::add(
+        S::add(S::mul(S::mul(c[0], inverse_sum), S::load(&coord_k[2][base])),
+               S::mul(S::mul(c[1], inverse_sum), S::load(&coord_k[0][base]))),
+        S::mul(S::mul(c[2], inverse_sum), S::load(&coord_k[1][base])));
+    V t = S::div(S::sub(intersection, origin_k), dir_k);
+
+    // the distance limits of the MOAB ray-triangle test
+    M in_range = S::le(t, upper);
+    in_range = S::mand(in_range,
+                       ray.use_neg_len ? S::gt(t, lower) : S::ge(t, zero));
+
+    M hit = S::mandnot(S::mand(S::lanes(valid >> base), in_range), reject);
+    S::store(&dist[base], t);
+    hits |= S::bits(hit) << base;
+    on_edge |= S::bits(edge) << base;
+  }
+  return hits;
+}
+
+unsigned ray_block_filter(const TriangleBlockF& block, const BVHRay& ray,
+                          const int* orient, double tmax) {
+  // The test runs on vertices translated to the ray origin, where the
+  // plucker coordinate of an edge p->q is dir . ((q - p) x p). With
+  // a = |v|_1 + |origin|_1 bounding the rounding of a translated vertex,
+  // r = |p|_1 and E = |q - p|_1, single precision evaluation errs by less
+  // than eps * max|dir| * (2 E a + 2 a r + 9 E r) / 2; tol is four times
+  // that. Coordinates within tol of zero may have either sign in double
+  // precision, where the untranslated test adds an error of its own.
+  const float eps = std::numeric_limits<float>::epsilon();
+  const int k = ray.max_axis;
+  const double dir_max = std::fabs(ray.dir[k]);
+  const double origin_sum = std::fabs(ray.origin[0]) +
+                            std::fabs(ray.origin[1]) +
+                            std::fabs(ray.origin[2]);
+  const double scale = block.scale;
+  const double double_err =
+      1024 * std::numeric_limits<double>::epsilon() * 6.0 * scale *
+          (3.0 * scale * dir_max + dir_max * origin_sum) +
+      near_zero;
+
+  const F::V zero = F::set1(0.0f);
+  const F::V tol_scale = F::set1(round_up(2 * eps * dir_max));
+  const F::V tol_min = F::set1(round_up(double_err));
+  const F::V two = F::set1(2.0f), nine = F::set1(9.0f);
+  const F::V d[3] = {F::set1(ray.dir[0]), F::set1(ray.dir[1]),
+                     F::set1(ray.dir[2])};
+  const F::V o[3] = {F::set1(ray.origin[0]), F::set1(ray.origin[1]),
+                     F::set1(ray.origin[2])};
+  const F::V o_sum = F::set1(round_up(origin_sum));
+  const F::V dir_k = F::set1(ray.dir[k]), abs_dir_k = F::abs(dir_k);
+  const F::V upper = F::set1(round_up(tmax));
+  const F::V lower =
+      F::set1(round_down(ray.use_neg_len ? ray.neg_len : 0.0));
+  const F::V coord_err = F::set1(8 * eps), origin_err = F::set1(2 * eps);
+  const unsigned valid = (1u << block.count) - 1;
+
+  unsigned candidates = 0;
+  for (int base = 0; base < BVH_BLOCK_WIDTH; base += F::width) {
+    if (!(valid >> base)) break;
+    // translated vertices, with the magnitudes of the original (a) and
+    // translated (r) ones
+    F::V v[3][3], a[3], r[3];
+    for (int j = 0; j < 3; j++) {
+      const float* coords[3] = {&block.x[j][base], &block.y[j][base],
+                                &block.z[j][base]};
+      a[j] = o_sum;
+      r[j] = zero;
+      for (int i = 0; i < 3; i++) {
+        F::V c = F::load(coords[i]);
+        v[j][i] = F::sub(c, o[i]);
+        a[j] = F::add(a[j], F::abs(c));
+        r[j] = F::add(r[j], F::abs(v[j][i]));
+      }
+    }
+
+    F::V c[3], tol_sum = zero;
+    F::M pos[3], neg[3];
+    F::M reject = F::none();
+    for (int e = 0; e < 3; e++) {
+      const F::V* p = v[e];
+      const F::V* q = v[(e + 1) % 3];
+      F::V edge[3];
+      for (int i = 0; i < 3; i++) edge[i] = F::sub(q[i], p[i]);
+      F::V n0 = F::sub(F::mul(edge[1], p[2]), F::mul(edge[2], p[1]));
+      F::V n1 = F::sub(F::mul(edge[2], p[0]), F::mul(edge[0], p[2]));
+      F::V n2 = F::sub(F::mul(edge[0], p[1]), F::mul(edge[1], p[0]));
+      c[e] = F::add(F::add(F::mul(d[0], n0), F::mul(d[1], n1)),
+                    F::mul(d[2], n2));
+
+      F::V edge_sum = F::add(F::add(F::abs(edge[0]), F::abs(edge[1])),
+                             F::abs(edge[2]));
+      F::V a_pq = F::add(a[e], a[(e + 1) % 3]);
+      F::V terms = F::add(
+          F::add(F::mul(two, F::mul(edge_sum, a_pq)),
+                 F::mul(two, F::mul(a_pq, r[e]))),
+          F::mul(nine, F::mul(edge_sum, r[e])));
+      F::V tol = F::add(F::mul(tol_scale, terms), tol_min);
+      tol_sum = F::add(tol_sum, tol);
+
+      pos[e] = F::gt(c[e], tol);
+      neg[e] = F::lt(c[e], F::sub(zero, tol));
+      if (orient) reject = F::mor(reject, *orient > 0 ? pos[e] : neg[e]);
+    }
+    // coordinates that certainly differ in sign
+    for (int e = 0; e < 3; e++) {
+      int f = (e + 1) % 3;
+      reject = F::mor(reject, F::mand(pos[e], neg[f]));
+      reject = F::mor(reject, F::mand(neg[e], pos[f]));
+    }
+
+    // Where every coordinate has a certain sign, the intersection is an
+    // average of the vertices whose weights err by at most
+    // 2 sum(tol) / |c0 + c1 + c2| in total.
+    F::M certain = F::mand(F::mand(F::mor(pos[0], neg[0]),
+                                   F::mor(pos[1], neg[1])),
+                           F::mor(pos[2], neg[2]));
+    const F::V sum = F::add(F::add(c[0], c[1]), c[2]);
+    const F::V intersection = F::div(
+        F::add(F::add(F::mul(c[0], v[2][k]), F::mul(c[1], v[0][k])),
+               F::mul(c[2], v[1][k])),
+        sum);
+    const F::V t = F::div(intersection, dir_k);
+    F::V r_max = F::add(F::add(r[0], r[1]), r[2]);
+    F::V a_max = F::add(F::add(a[0], a[1]), a[2]);
+    const F::V t_err = F::div(
+        F::add(F::mul(r_max, F::add(F::div(F::mul(two, tol_sum),
+                                           F::abs(sum)),
+                                    coord_err)),
+               F::mul(origin_err, a_max)),
+        abs_dir_k);
+    reject = F::mor(reject,
+                    F::mand(certain, F::gt(F::sub(t, t_err), upper)));
+    reject = F::mor(reject,
+                    F::mand(certain, F::lt(F::add(t, t_err), lower)));
+
+    candidates |= (~F::bits(reject) & ((1u << F::width) - 1)) << base;
+  }
+  return candidates & valid;
+}
+
+void block_dist_sqr(const TriangleBlock& block, const double p[3],
+                    double dist_sqr[BVH_BLOCK_WIDTH]) {
+  const V zero = S::set1(0.0), one = S::set1(1.0);
+  const V pv[3] = {S::set1(p[0]), S::set1(p[1]), S::set1(p[2])};
+  const double(*coords[3])[BVH_BLOCK_WIDTH] = {block.x, block.y, block.z};
+  auto dot = [](const V* u, const V* v) {
+    return S::add(S::add(S::mul(u[0], v[0]), S::mul(u[1], v[1])),
+                  S::mul(u[2], v[2]));
+  };
+  const unsigned valid = (1u << block.count) - 1;
+
+  for (int base = 0; base < BVH_BLOCK_WIDTH; base += S::width) {
+    if (!(valid >> base)) break;
+    V a[3], ab[3], ac[3], ap[3], bp[3], cp[3];
+    for (int i = 0; i < 3; i++) {
+      a[i] = S::load(&coords[i][0][base]);
+      V b = S::load(&coords[i][1][base]);
+      V c = S::load(&coords[i][2][base]);
+      ab[i] = S::sub(b, a[i]);
+      ac[i] = S::sub(c, a[i]);
+      ap[i] = S::sub(pv[i], a[i]);
+      bp[i] = S::sub(pv[i], b);
+      cp[i] = S::sub(pv[i], c);
+    }
+    V d1 = dot(ab, ap), d2 = dot(ac, ap);
+    V d3 = dot(ab, bp), d4 = dot(ac, bp);
+    V d5 = dot(ab, cp), d6 = dot(ac, cp);
+    V va = S::sub(S::mul(d3, d6), S::mul(d5, d4));
+    V vb = S::sub(S::mul(d5, d2), S::mul(d1, d6));
+    V vc = S::sub(S::mul(d1, d4), S::mul(d3, d2));
+
+    // The Voronoi regions of closest_point_on_tri, applied from the last
+    // to the first so that earlier regions take precedence. Divisions by
+    // zero only reach lanes that are overwritten.
+    V denom = S::add(S::add(va, vb), vc);
+    M degenerate = S::eq(denom, zero);
+    V s = S::select(degenerate, zero, S::div(vb, denom));
+    V t = S::select(degenerate, zero, S::div(vc, denom));
+
+    V d43 = S::sub(d4, d3), d56 = S::sub(d5, d6);
+    M m = S::mand(S::mand(S::le(va, zero), S::ge(d43, zero)),
+                  S::ge(d56, zero));
+    V w = S::div(d43, S::add(d43, d56));
+    s = S::select(m, S::sub(one, w), s);
+    t = S::select(m, w, t);
+
+    m = S::mand(S::mand(S::le(vb, zero), S::ge(d2, zero)), S::le(d6, zero));
+    s = S::select(m, zero, s);
+    t = S::select(m, S::div(d2, S::sub(d2, d6)), t);
+
+    m = S::mand(S::ge(d6, zero), S::le(d5, d6));
+    s = S::select(m, zero, s);
+    t = S::select(m, one, t);
+
+    m = S::mand(S::mand(S::le(vc, zero), S::ge(d1, zero)), S::le(d3, zero));
+    s = S::select(m, S::div(d1, S::sub(d1, d3)), s);
+    t = S::select(m, zero, t);
+
+    m = S::mand(S::ge(d3, zero), S::le(d4, d3));
+    s = S::select(m, one, s);
+    t = S::select(m, zero, t);
+
+    m = S::mand(S::le(d1, zero), S::le(d2, zero));
+    s = S::select(m, zero, s);
+    t = S::select(m, zero, t);
+
+    V acc = zero;
+    for (int i = 0; i < 3; i++) {
+      V closest = S::add(S::add(a[i], S::mul(s, ab[i])), S::mul(t, ac[i]));
+      V d = S::sub(pv[i], closest);
+      acc = S::add(acc, S::mul(d, d));
+    }
+    S::store(&dist_sqr[base], acc);
+  }
+}
+
+void block_dist_sqr_lower_bound(const TriangleBlock& block, const double p[3],
+                                double dist_sqr[BVH_BLOCK_WIDTH]) {
+  const V zero = S::set1(0.0);
+  const double(*coords[3])[BVH_BLOCK_WIDTH] = {block.x, block.y, block.z};
+  for (int base = 0; base < BVH_BLOCK_WIDTH; base += S::width) {
+    V acc = zero;
+    for (int i = 0; i < 3; i++) {
+      V a = S::load(&coords[i][0][base]);
+      V b = S::load(&coords[i][1][base]);
+      V c = S::load(&coords[i][2][base]);
+      V lo = S::min(S::min(a, b), c), hi = S::max(S::max(a, b), c);
+      V pi = S::set1(p[i]);
+      V dd = S::max(S::max(S::sub(lo, pi), S::sub(pi, hi)), zero);
+      acc = S::add(acc, S::mul(dd, dd));
+    }
+    S::store(&dist_sqr[base], acc);
+  }
+}
+
+void block_dist_sqr_lower_bound(const TriangleBlockF& block,
+                                const double p[3],
+                                double dist_sqr[BVH_BLOCK_WIDTH]) {
+  // the exact coordinates are within this of the rounded ones
+  const double err =
+      0.5 * std::numeric_limits<float>::epsilon() * block.scale;
+  const float(*coords[3])[BVH_BLOCK_WIDTH] = {block.x, block.y, block.z};
+  for (int lane = 0; lane < BVH_BLOCK_WIDTH; lane++) {
+    double acc = 0.0;
+    for (int i = 0; i < 3; i++) {
+      double a = coords[i][0][lane], b = coords[i][1][lane],
+             c = coords[i][2][lane];
+      double lo = std::min(std::min(a, b), c) - err;
+      double hi = std::max(std::max(a, b), c) + err;
+      double dd = std::max(std::max(lo - p[i], p[i] - hi), 0.0);
+      acc += dd * dd;
+    }
+    dist_sqr[lane] = acc;
+  }
+}
+
+}  // namespace moab
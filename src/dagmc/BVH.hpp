@@ -0,0 +1,731 @@
+#ifndef DAGMC_BVH_HPP
+#define DAGMC_BVH_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "moab/Types.hpp"
+
+namespace moab {
+
+/** number of triangles stored side by side in a TriangleBlock */
+static const int BVH_BLOCK_WIDTH = 8;
+
+/** maximum depth of a BVH, also the size of the traversal stacks */
+static const int BVH_MAX_DEPTH = 64;
+
+/** number of rays traced together in a BVHRayPacket */
+static const int BVH_PACKET_WIDTH = 8;
+
+/** storage precision of a TriangleBVH */
+enum BVHPrecision {
+  /** double precision boxes and triangles */
+  BVH_DOUBLE = 0,
+  /** single precision boxes and triangles find candidate triangles, which
+   *  are then tested in double precision on their exact coordinates */
+  BVH_MIXED = 1
+};
+
+/**\brief Traversal work of a geometry query
+ *
+ * While the calling thread has set bvh_counts, the queries of the native
+ * BVH add their work to it. Counting is off, and costs a branch per node,
+ * when it is null.
+ */
+struct BVHCounts {
+  uint64_t nodes_visited = 0;
+  uint64_t leaves_visited = 0;
+  uint64_t triangles_tested = 0;
+  /** intersections skipped because the facet is in the ray history */
+  uint64_t history_hits = 0;
+  /** queries repeated to resolve an ambiguous answer */
+  uint64_t retries = 0;
+
+  void add(const BVHCounts& other) {
+    nodes_visited += other.nodes_visited;
+    leaves_visited += other.leaves_visited;
+    triangles_tested += other.triangles_tested;
+    history_hits += other.history_hits;
+    retries += other.retries;
+  }
+};
+
+/** the counts of the calling thread's current query, or null */
+BVHCounts*& bvh_counts();
+
+/** axis-aligned box used while building a BVH */
+struct BVHBox {
+  double lo[3];
+  double hi[3];
+
+  BVHBox() {
+    for (int i = 0; i < 3; i++) {
+      lo[i] = std::numeric_limits<double>::max();
+      hi[i] = -std::numeric_limits<double>::max();
+    }
+  }
+
+  bool empty() const { return lo[0] > hi[0]; }
+
+  void extend(const double p[3]) {
+    for (int i = 0; i < 3; i++) {
+      if (p[i] < lo[i]) lo[i] = p[i];
+      if (p[i] > hi[i]) hi[i] = p[i];
+    }
+  }
+
+  void extend(const BVHBox& b) {
+    for (int i = 0; i < 3; i++) {
+      if (b.lo[i] < lo[i]) lo[i] = b.lo[i];
+      if (b.hi[i] > hi[i]) hi[i] = b.hi[i];
+    }
+  }
+
+  double center(int axis) const { return 0.5 * (lo[axis] + hi[axis]); }
+
+  double area() const {
+    if (empty()) return 0.0;
+    double dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+    return 2.0 * (dx * dy + dy * dz + dz * dx);
+  }
+};
+
+/**\brief A node of a flattened BVH
+ *
+ * Nodes are stored depth first in a contiguous array, so the first child of
+ * an interior node is always the next node in the array and only the index
+ * of the second child is stored. A node fills exactly one cache line.
+ */
+struct alignas(64) BVHNode {
+  double lo[3];
+  double hi[3];
+  /** leaf: index of the first item; interior: index of the second child */
+  int first;
+  /** leaf: number of items (always > 0); interior: 0 */
+  int count;
+
+  bool is_leaf() const { return count > 0; }
+};
+
+/**\brief Single precision BVHNode
+ *
+ * The box is rounded outwards, so it always contains the double precision
+ * box it was made from. Two nodes fill a cache line.
+ */
+struct alignas(32) BVHNodeF {
+  float lo[3];
+  float hi[3];
+  int first;
+  int count;
+
+  bool is_leaf() const { return count > 0; }
+};
+
+/**\brief Triangles of a BVH leaf in structure-of-arrays form
+ *
+ * The vertex coordinates of up to BVH_BLOCK_WIDTH triangles are stored lane
+ * by lane so that a leaf can be tested without touching the MOAB database.
+ * Unused lanes (lane >= count) hold degenerate triangles.
+ */
+struct alignas(64) TriangleBlock {
+  /** coordinates as [vertex][lane] */
+  double x[3][BVH_BLOCK_WIDTH];
+  double y[3][BVH_BLOCK_WIDTH];
+  double z[3][BVH_BLOCK_WIDTH];
+  /** MOAB handle of each triangle */
+  EntityHandle handle[BVH_BLOCK_WIDTH];
+  /** bit `lane` of edge_flip[e] is set when edge e (v_e -> v_(e+1)%3) of
+   *  that triangle is not in the canonical vertex order of the watertight
+   *  Plucker test and must be reversed */
+  unsigned char edge_flip[3];
+  int count;
+};
+
+/**\brief Single precision TriangleBlock
+ *
+ * Coordinates are rounded to the nearest float, so they are only good for
+ * finding candidate triangles; the exact coordinates are looked up by
+ * handle (see FacetCoordsFn).
+ */
+struct alignas(32) TriangleBlockF {
+  float x[3][BVH_BLOCK_WIDTH];
+  float y[3][BVH_BLOCK_WIDTH];
+  float z[3][BVH_BLOCK_WIDTH];
+  EntityHandle handle[BVH_BLOCK_WIDTH];
+  /** largest coordinate magnitude in the block, which bounds the rounding
+   *  error of every coordinate */
+  float scale;
+  int count;
+};
+
+/** looks up the exact (double precision) coordinates of a facet, 9 values */
+typedef std::function<ErrorCode(EntityHandle facet, double* coords)>
+    FacetCoordsFn;
+
+/** a ray prepared for BVH traversal */
+struct BVHRay {
+  /** uninitialized, to be assigned */
+  BVHRay() = default;
+  BVHRay(const double origin[3], const double dir[3],
+         double neg_len = 0.0, bool use_neg_len = false);
+
+  double origin[3];
+  double dir[3];
+  double inv_dir[3];
+  /** Plucker moment of the ray, dir x origin */
+  double normal[3];
+  /** axis of the largest direction component, used to compute distances */
+  int max_axis;
+  /** intersections must be further than neg_len along the ray when
+   *  use_neg_len is set, or at a non-negative distance otherwise */
+  double neg_len;
+  bool use_neg_len;
+};
+
+/**\brief Up to BVH_PACKET_WIDTH rays traced through one traversal
+ *
+ * The origins and reciprocal directions are also stored lane by lane, so
+ * that a node's slabs are tested against every ray of the packet in one
+ * pass. Lanes at or beyond count are never active.
+ */
+struct BVHRayPacket {
+  /** a packet of rays[0, count); rays must outlive the packet */
+  BVHRayPacket(const BVHRay* rays, int count);
+
+  const BVHRay* rays;
+  int count;
+  double origin[3][BVH_PACKET_WIDTH];
+  double inv_dir[3][BVH_PACKET_WIDTH];
+  /** lower distance limit of each ray, neg_len or 0 */
+  double tmin[BVH_PACKET_WIDTH];
+};
+
+/**\brief Build a BVH over a set of primitive boxes
+ *
+ * Uses a binned surface area heuristic. On return, order holds the
+ * primitive indices in leaf order and each leaf addresses the range
+ * [first, first + count) of order. Leaf costs are rounded up to multiples
+ * of leaf_width primitives so that leaves fill whole SIMD blocks. Leaves
+ * never hold more than max_leaf_size primitives unless the primitives
+ * cannot be separated.
+ */
+void build_bvh(const std::vector<BVHBox>& boxes, int leaf_width,
+               int max_leaf_size, std::vector<BVHNode>& nodes,
+               std::vector<int>& order);
+
+/** slab test of a ray against a node (BVHNode or BVHNodeF), clipped to
+ *  [tmin, tmax] */
+template <typename Node>
+inline bool ray_box_intersect(const Node& node, const BVHRay& ray,
+                              double tmin, double tmax, double& tentry) {
+  for (int i = 0; i < 3; i++) {
+    double t0 = (node.lo[i] - ray.origin[i]) * ray.inv_dir[i];
+    double t1 = (node.hi[i] - ray.origin[i]) * ray.inv_dir[i];
+    if (t0 > t1) std::swap(t0, t1);
+    // NaN (origin on a slab of a zero direction) leaves the bounds unchanged
+    tmin = t0 > tmin ? t0 : tmin;
+    tmax = t1 < tmax ? t1 : tmax;
+  }
+  tentry = tmin;
+  return tmin <= tmax;
+}
+
+/** ray_box_intersect for the rays of a packet, each clipped to
+ *  [tmin, tmax[lane]]; returns the lanes of active that hit the node */
+template <typename Node>
+inline unsigned ray_box_intersect(const Node& node,
+                                  const BVHRayPacket& packet, unsigned active,
+                                  const double tmax[BVH_PACKET_WIDTH]) {
+  // every lane is tested, axis by axis, so that the loops vectorize
+  double lo[BVH_PACKET_WIDTH], hi[BVH_PACKET_WIDTH];
+  for (int lane = 0; lane < BVH_PACKET_WIDTH; lane++) {
+    lo[lane] = packet.tmin[lane];
+    hi[lane] = tmax[lane];
+  }
+  for (int i = 0; i < 3; i++) {
+    const double node_lo = node.lo[i], node_hi = node.hi[i];
+    for (int lane = 0; lane < BVH_PACKET_WIDTH; lane++) {
+      double t0 = (node_lo - packet.origin[i][lane]) * packet.inv_dir[i][lane];
+      double t1 = (node_hi - packet.origin[i][lane]) * packet.inv_dir[i][lane];
+      // the same NaN handling as the single ray test
+      double tnear = t0 > t1 ? t1 : t0, tfar = t0 > t1 ? t0 : t1;
+      lo[lane] = tnear > lo[lane] ? tnear : lo[lane];
+      hi[lane] = tfar < hi[lane] ? tfar : hi[lane];
+    }
+  }
+  unsigned result = 0;
+  for (int lane = 0; lane < BVH_PACKET_WIDTH; lane++)
+    result |= (unsigned)(lo[lane] <= hi[lane]) << lane;
+  return result & active;
+}
+
+/**\brief Depth-first traversal of a BVH by a packet of rays
+ *
+ * The packet shares one stack. Each node popped is tested once against
+ * the rays of the lanes that reached its parent and is skipped if none of
+ * them hits it; children are visited nearer first along the first such
+ * ray. leaf(node, lanes) is called with the lanes that hit a leaf and may
+ * lower their tmax.
+ */
+template <typename Node, typename LeafFn>
+void traverse_ray_packet(const Node* nodes, size_t n_nodes,
+                         const BVHRayPacket& packet, unsigned active,
+                         const double tmax[BVH_PACKET_WIDTH],
+                         BVHCounts* counts, LeafFn&& leaf) {
+  if (0 == n_nodes || !active) return;
+
+  int stack[BVH_MAX_DEPTH + 1];
+  unsigned stack_lanes[BVH_MAX_DEPTH + 1];
+  int sp = 0;
+  stack[sp] = 0;
+  stack_lanes[sp++] = active;
+  while (sp > 0) {
+    --sp;
+    int idx = stack[sp];
+    const Node& node = nodes[idx];
+    unsigned lanes = ray_box_intersect(node, packet, stack_lanes[sp], tmax);
+    if (!lanes) continue;
+    if (counts) counts->nodes_visited++;
+    if (node.is_leaf()) {
+      if (counts) counts->leaves_visited++;
+      leaf(node, lanes);
+      continue;
+    }
+
+    int left = idx + 1, right = node.first;
+    int lane = 0;
+    while (!((lanes >> lane) & 1)) lane++;
+    const double* dir = packet.rays[lane].dir;
+    double ahead = 0.0;
+    for (int i = 0; i < 3; i++) {
+      ahead += ((double)nodes[right].lo[i] + nodes[right].hi[i] -
+                nodes[left].lo[i] - nodes[left].hi[i]) *
+               dir[i];
+    }
+    // push the farther child first
+    if (ahead < 0.0) std::swap(left, right);
+    stack[sp] = right;
+    stack_lanes[sp++] = lanes;
+    stack[sp] = left;
+    stack_lanes[sp++] = lanes;
+  }
+}
+
+/** squared distance from a point to a node's box */
+template <typename Node>
+inline double point_box_dist_sqr(const Node& node, const double p[3]) {
+  double d2 = 0.0;
+  for (int i = 0; i < 3; i++) {
+    double d = 0.0;
+    if (p[i] < node.lo[i])
+      d = node.lo[i] - p[i];
+    else if (p[i] > node.hi[i])
+      d = p[i] - node.hi[i];
+    d2 += d * d;
+  }
+  return d2;
+}
+
+/**\brief Ray test against one lane of a TriangleBlock
+ *
+ * Identical in arithmetic to GeomUtil::plucker_ray_tri_intersect so that
+ * results are bit-for-bit those of the MOAB OBB tree. If orient is
+ * non-null, only intersections where orient * (plucker coords) <= 0 are
+ * reported. Distance limits are not applied here.
+ *\param on_edge set if the ray hits an edge or vertex of the triangle
+ */
+bool plucker_ray_tri_intersect(const TriangleBlock& block, int lane,
+                               const BVHRay& ray, const int* orient,
+                               double& dist, bool& on_edge);
+
+/** plucker_ray_tri_intersect on a triangle given by 9 coordinates */
+bool plucker_ray_tri_intersect(const double coords[9], const BVHRay& ray,
+                               const int* orient, double& dist,
+                               bool& on_edge);
+
+/**\brief Ray test against every lane of a TriangleBlock
+ *
+ * Applies plucker_ray_tri_intersect to all lanes at once using AVX-512 or
+ * AVX2 when the library is built for them (see the BVH_SIMD CMake option)
+ * and plain scalar code otherwise. The distance limits of the ray and
+ * tmax are applied as well.
+ *\return bit mask of the lanes hit; dist and the on_edge bits are set for
+ *        those lanes
+ */
+unsigned ray_block_intersect(const TriangleBlock& block, const BVHRay& ray,
+                             const int* orient, double tmax,
+                             double dist[BVH_BLOCK_WIDTH], unsigned& on_edge);
+
+/**\brief Candidate lanes of a single precision block
+ *
+ * A conservative single precision version of ray_block_intersect: every
+ * lane that ray_block_intersect would report for the exact triangle is
+ * set, along with lanes too close to an edge or to the distance limits to
+ * be decided in single precision.
+ */
+unsigned ray_block_filter(const TriangleBlockF& block, const BVHRay& ray,
+                          const int* orient, double tmax);
+
+/** closest point to p on lane of a TriangleBlock, returns squared distance */
+double closest_point_on_tri(const TriangleBlock& block, int lane,
+                            const double p[3], double closest[3]);
+
+/** closest_point_on_tri on a triangle given by 9 coordinates */
+double closest_point_on_tri(const double coords[9], const double p[3],
+                            double closest[3]);
+
+/** squared distance from p to each triangle of a block, the distance
+ *  closest_point_on_tri returns, computed for all lanes at once like
+ *  ray_block_intersect */
+void block_dist_sqr(const TriangleBlock& block, const double p[3],
+                    double dist_sqr[BVH_BLOCK_WIDTH]);
+
+/** lower bound on the squared distance from p to each triangle of a block,
+ *  the distance to the triangle's bounding box (vectorized like
+ *  ray_block_intersect) */
+void block_dist_sqr_lower_bound(const TriangleBlock& block, const double p[3],
+                                double dist_sqr[BVH_BLOCK_WIDTH]);
+
+/** block_dist_sqr_lower_bound of a single precision block, lowered to
+ *  allow for the rounding of its coordinates */
+void block_dist_sqr_lower_bound(const TriangleBlockF& block,
+                                const double p[3],
+                                double dist_sqr[BVH_BLOCK_WIDTH]);
+
+/** name of the instruction set used by the block kernels */
+const char* bvh_simd_isa();
+
+/**\brief Read-only array that owns its elements or views memory held
+ * elsewhere, such as a memory-mapped cache file
+ */
+template <typename T>
+class BVHArray {
+ public:
+  void assign(std::vector<T>&& items) {
+    owned = std::move(items);
+    view = NULL;
+    n_view = 0;
+    storage.reset();
+  }
+
+  /** view n items at data; storage keeps the memory alive */
+  void assign_view(const T* data, size_t n,
+                   std::shared_ptr<const void> storage_owner) {
+    owned.clear();
+    view = data;
+    n_view = n;
+    storage = std::move(storage_owner);
+  }
+
+  const T* data() const { return view ? view : owned.data(); }
+  size_t size() const { return view ? n_view : owned.size(); }
+  bool empty() const { return 0 == size(); }
+  const T& operator[](size_t i) const { return data()[i]; }
+  const T* begin() const { return data(); }
+  const T* end() const { return data() + size(); }
+
+ private:
+  std::vector<T> owned;
+  const T* view = NULL;
+  size_t n_view = 0;
+  std::shared_ptr<const void> storage;
+};
+
+/**\brief BVH over the triangles of one surface
+ *
+ * Triangle coordinates are copied out of MOAB at build time, so queries on
+ * a BVH_DOUBLE tree never go back to the mesh database. A BVH_MIXED tree
+ * stores single precision copies, about half the size, and looks up the
+ * exact coordinates of the few candidate triangles each query finds
+ * through a FacetCoordsFn, so its results are those of a BVH_DOUBLE tree.
+ * The node and block arrays can also be views of a BVH cache file (see
+ * BVHCache.hpp).
+ */
+class TriangleBVH {
+ public:
+  /** build from n triangles: coords holds 9 values per triangle */
+  void build(const std::vector<double>& coords,
+             const std::vector<EntityHandle>& handles,
+             BVHPrecision precision = BVH_DOUBLE);
+
+  /** use node and block arrays stored elsewhere, kept alive by storage */
+  void assign_view(const BVHNode* node_data, size_t n_nodes,
+                   const TriangleBlock* block_data, size_t n_blocks,
+                   const BVHBox& bounds, int num_triangles,
+                   std::shared_ptr<const void> storage);
+
+  /** assign_view for the arrays of a BVH_MIXED tree */
+  void assign_view(const BVHNodeF* node_data, size_t n_nodes,
+                   const TriangleBlockF* block_data, size_t n_blocks,
+                   const BVHBox& bounds, int num_triangles,
+                   std::shared_ptr<const void> storage);
+
+  bool empty() const { return nodes.empty() && float_nodes.empty(); }
+  BVHPrecision precision() const { return prec; }
+  int num_triangles() const { return n_tris; }
+  const BVHBox& bounds() const { return box; }
+  /** node and block arrays of a BVH_DOUBLE tree */
+  const BVHArray<BVHNode>& get_nodes() const { return nodes; }
+  const BVHArray<TriangleBlock>& get_blocks() const { return blocks; }
+  /** node and block arrays of a BVH_MIXED tree */
+  const BVHArray<BVHNodeF>& get_float_nodes() const { return float_nodes; }
+  const BVHArray<TriangleBlockF>& get_float_blocks() const {
+    return float_blocks;
+  }
+  /** bytes used by the node and block arrays */
+  size_t memory_size() const;
+
+  /* The queries below take the exact coordinates of the triangles of a
+   * BVH_MIXED tree from exact; without it the rounded coordinates are used.
+   * Facets whose coordinates cannot be looked up are skipped. */
+
+  /**\brief Visit all triangle intersections of a ray within (neg, tmax]
+   *
+   * hit(facet, coords, dist, on_edge) is called for each intersection in
+   * range, with the 9 coordinates of the facet; it may lower tmax to prune
+   * the rest of the traversal.
+   */
+  template <typename HitFn>
+  void ray_intersect(const BVHRay& ray, const int* orient, double& tmax,
+                     HitFn&& hit,
+                     const FacetCoordsFn& exact = FacetCoordsFn()) const;
+
+  /**\brief ray_intersect for the rays of a packet, sharing one traversal
+   *
+   * hit(lane, facet, coords, dist, on_edge) is called for the intersections
+   * of the ray of each lane of active; it may lower tmax[lane].
+   */
+  template <typename HitFn>
+  void ray_intersect(const BVHRayPacket& packet, unsigned active,
+                     const int* orient, double tmax[BVH_PACKET_WIDTH],
+                     HitFn&& hit,
+                     const FacetCoordsFn& exact = FacetCoordsFn()) const;
+
+  /**\brief Closest triangle to a point
+   *
+   * Only triangles closer than sqrt(best_dist_sqr) are considered; on a
+   * closer hit best_dist_sqr, closest and facet are updated.
+   *\return true if a closer triangle was found
+   */
+  bool closest_to_location(const double p[3], double& best_dist_sqr,
+                           double closest[3], EntityHandle& facet,
+                           const FacetCoordsFn& exact = FacetCoordsFn()) const;
+
+  /**\brief Lower bound on the distance from a point to the triangles
+   *
+   * Computed from the bounding boxes of the nodes and of the triangles,
+   * without testing any triangle. best_dist_sqr is lowered to the bound if
+   * that is smaller.
+   */
+  void dist_sqr_lower_bound(const double p[3], double& best_dist_sqr) const;
+
+  /** all triangles whose distance to p is at most max_dist */
+  void facets_within(const double p[3], double max_dist,
+                     std::vector<EntityHandle>& facets,
+                     const FacetCoordsFn& exact = FacetCoordsFn()) const;
+
+  /** call fn(facet, coords) for every triangle of the tree */
+  template <typename FacetFn>
+  void for_each_facet(FacetFn&& fn,
+                      const FacetCoordsFn& exact = FacetCoordsFn()) const;
+
+ private:
+  /** depth-first ray traversal of a node array, nearer child first;
+   *  leaf(node) may lower tmax */
+  template <typename Node, typename LeafFn>
+  static void traverse_ray(const BVHArray<Node>& node_array,
+                           const BVHRay& ray, const double& tmax,
+                           BVHCounts* counts, LeafFn&& leaf);
+
+  /** the intersections of a ray with the triangles of a leaf */
+  template <typename HitFn>
+  void leaf_ray_intersect(const BVHNode& node, const BVHRay& ray,
+                          const int* orient, double& tmax, BVHCounts* counts,
+                          const FacetCoordsFn& exact, HitFn&& hit) const;
+  template <typename HitFn>
+  void leaf_ray_intersect(const BVHNodeF& node, const BVHRay& ray,
+                          const int* orient, double& tmax, BVHCounts* counts,
+                          const FacetCoordsFn& exact, HitFn&& hit) const;
+
+  /** coordinates of lane of a single precision block, false if the exact
+   *  coordinates cannot be looked up */
+  static bool lane_coords(const TriangleBlockF& block, int lane,
+                          const FacetCoordsFn& exact, double coords[9]);
+  static void lane_coords(const TriangleBlock& block, int lane,
+                          double coords[9]);
+
+  BVHArray<BVHNode> nodes;
+  BVHArray<TriangleBlock> blocks;
+  BVHArray<BVHNodeF> float_nodes;
+  BVHArray<TriangleBlockF> float_blocks;
+  BVHPrecision prec = BVH_DOUBLE;
+  BVHBox box;
+  int n_tris = 0;
+};
+
+template <typename Node, typename LeafFn>
+void TriangleBVH::traverse_ray(const BVHArray<Node>& node_array,
+                               const BVHRay& ray, const double& tmax,
+                               BVHCounts* counts, LeafFn&& leaf) {
+  if (node_array.empty()) return;
+
+  const double tmin = ray.use_neg_len ? ray.neg_len : 0.0;
+  int stack[BVH_MAX_DEPTH];
+  double stack_t[BVH_MAX_DEPTH];
+  int sp = 0;
+  double tentry;
+  if (!ray_box_intersect(node_array[0], ray, tmin, tmax, tentry)) return;
+
+  int idx = 0;
+  while (true) {
+    const Node& node = node_array[idx];
+    if (counts) counts->nodes_visited++;
+    if (node.is_leaf()) {
+      if (counts) counts->leaves_visited++;
+      leaf(node);
+    } else {
+      // visit the nearer child first
+      int left = idx + 1, right = node.first;
+      double tl, tr;
+      bool hit_l = ray_box_intersect(node_array[left], ray, tmin, tmax, tl);
+      bool hit_r = ray_box_intersect(node_array[right], ray, tmin, tmax, tr);
+      if (hit_l && hit_r) {
+        if (tr < tl) {
+          std::swap(left, right);
+          std::swap(tl, tr);
+        }
+        stack_t[sp] = tr;
+        stack[sp++] = right;
+        idx = left;
+        continue;
+      } else if (hit_l) {
+        idx = left;
+        continue;
+      } else if (hit_r) {
+        idx = right;
+        continue;
+      }
+    }
+    // skip deferred nodes that are now beyond the closest hit
+    do {
+      if (0 == sp) return;
+      --sp;
+    } while (stack_t[sp] > tmax);
+    idx = stack[sp];
+  }
+}
+
+template <typename HitFn>
+void TriangleBVH::leaf_ray_intersect(const BVHNode& node, const BVHRay& ray,
+                                     const int* orient, double& tmax,
+                                     BVHCounts* counts, const FacetCoordsFn&,
+                                     HitFn&& hit) const {
+  for (int b = node.first; b < node.first + node.count; b++) {
+    const TriangleBlock& block = blocks[b];
+    if (counts) counts->triangles_tested += block.count;
+    double dist[BVH_BLOCK_WIDTH];
+    unsigned on_edge;
+    unsigned hits =
+        ray_block_intersect(block, ray, orient, tmax, dist, on_edge);
+    for (int lane = 0; hits; lane++, hits >>= 1) {
+      // tmax may have been lowered by an earlier lane
+      if (!(hits & 1) || dist[lane] > tmax) continue;
+      double coords[9];
+      lane_coords(block, lane, coords);
+      hit(block.handle[lane], coords, dist[lane], (on_edge >> lane) & 1);
+    }
+  }
+}
+
+template <typename HitFn>
+void TriangleBVH::leaf_ray_intersect(const BVHNodeF& node, const BVHRay& ray,
+                                     const int* orient, double& tmax,
+                                     BVHCounts* counts,
+                                     const FacetCoordsFn& exact,
+                                     HitFn&& hit) const {
+  // single precision candidates, decided on the exact coordinates
+  for (int b = node.first; b < node.first + node.count; b++) {
+    const TriangleBlockF& block = float_blocks[b];
+    if (counts) counts->triangles_tested += block.count;
+    unsigned candidates = ray_block_filter(block, ray, orient, tmax);
+    for (int lane = 0; candidates; lane++, candidates >>= 1) {
+      if (!(candidates & 1)) continue;
+      double coords[9], dist;
+      bool on_edge;
+      if (!lane_coords(block, lane, exact, coords) ||
+          !plucker_ray_tri_intersect(coords, ray, orient, dist, on_edge))
+        continue;
+      if (dist > tmax || (ray.use_neg_len ? dist <= ray.neg_len : dist < 0.0))
+        continue;
+      hit(block.handle[lane], coords, dist, on_edge);
+    }
+  }
+}
+
+template <typename HitFn>
+void TriangleBVH::ray_intersect(const BVHRay& ray, const int* orient,
+                                double& tmax, HitFn&& hit,
+                                const FacetCoordsFn& exact) const {
+  BVHCounts* counts = bvh_counts();
+  if (BVH_DOUBLE == prec) {
+    traverse_ray(nodes, ray, tmax, counts, [&](const BVHNode& node) {
+      leaf_ray_intersect(node, ray, orient, tmax, counts, exact, hit);
+    });
+  } else {
+    traverse_ray(float_nodes, ray, tmax, counts, [&](const BVHNodeF& node) {
+      leaf_ray_intersect(node, ray, orient, tmax, counts, exact, hit);
+    });
+  }
+}
+
+template <typename HitFn>
+void TriangleBVH::ray_intersect(const BVHRayPacket& packet, unsigned active,
+                                const int* orient,
+                                double tmax[BVH_PACKET_WIDTH], HitFn&& hit,
+                                const FacetCoordsFn& exact) const {
+  BVHCounts* counts = bvh_counts();
+  auto leaf = [&](const auto& node, unsigned lanes) {
+    for (int lane = 0; lanes; lane++, lanes >>= 1) {
+      if (!(lanes & 1)) continue;
+      leaf_ray_intersect(node, packet.rays[lane], orient, tmax[lane], counts,
+                         exact,
+                         [&](EntityHandle facet, const double* coords,
+                             double dist, bool on_edge) {
+                           hit(lane, facet, coords, dist, on_edge);
+                         });
+    }
+  };
+  if (BVH_DOUBLE == prec)
+    traverse_ray_packet(nodes.data(), nodes.size(), packet, active, tmax,
+                        counts, leaf);
+  else
+    traverse_ray_packet(float_nodes.data(), float_nodes.size(), packet,
+                        active, tmax, counts, leaf);
+}
+
+template <typename FacetFn>
+void TriangleBVH::for_each_facet(FacetFn&& fn,
+                                 const FacetCoordsFn& exact) const {
+  double coords[9];
+  for (const auto& block : blocks) {
+    for (int lane = 0; lane < block.count; lane++) {
+      lane_coords(block, lane, coords);
+      fn(block.handle[lane], coords);
+    }
+  }
+  for (const auto& block : float_blocks) {
+    for (int lane = 0; lane < block.count; lane++) {
+      if (lane_coords(block, lane, exact, coords))
+        fn(block.handle[lane], coords);
+    }
+  }
+}
+
+}  // namespace moab
+
+#endif
@@ -0,0 +1,639 @@
+#include "BVHCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <random>
+#include <sstream>
+
+#include <chrono>
+#include <thread>
+
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DAGMC_HAVE_MMAP
+#endif
+
+namespace moab {
+
+namespace {
+
+// Layout of a cache file: a header, a table with one entry per surface,
+// then the node and block arrays of each surface, and optionally the arrays
+// of a compact mesh. Arrays start on 64 byte boundaries so that they can be
+// used in place once the file is mapped.
+const char cache_magic[8] = {'D', 'A', 'G', 'M', 'C', 'B', 'V', 'H'};
+const uint32_t cache_version = 3;
+const uint32_t byte_order_mark = 0x01020304;
+const size_t cache_alignment = 64;
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t node_size;
+  uint32_t block_size;
+  uint32_t precision;
+  uint32_t reserved;
+  uint64_t hash;
+  uint64_t n_surfaces;
+  uint64_t file_size;
+  /** offset of the CacheMesh, or 0 if there is no compact mesh */
+  uint64_t mesh_offset;
+};
+
+struct CacheSurface {
+  uint64_t surface;
+  uint64_t n_triangles;
+  uint64_t node_offset;
+  uint64_t n_nodes;
+  uint64_t block_offset;
+  uint64_t n_blocks;
+  double lo[3];
+  double hi[3];
+};
+
+struct CacheMesh {
+  uint64_t n_surfaces;
+  uint64_t surface_offset;
+  uint64_t n_runs;
+  uint64_t run_offset;
+  uint64_t n_vertex_words;
+  uint64_t vertex_offset;
+  uint64_t n_conn_words;
+  uint64_t conn_offset;
+};
+
+// header, surface table and mesh arrays of a cache image, with the offset
+// of every array
+struct CacheLayout {
+  CacheHeader header;
+  std::vector<CacheSurface> table;
+  CacheMesh mesh;
+};
+
+size_t align_up(size_t n) {
+  return (n + cache_alignment - 1) / cache_alignment * cache_alignment;
+}
+
+// sizes of the node and block structs of trees of a precision
+uint32_t node_size(BVHPrecision precision) {
+  return BVH_MIXED == precision ? sizeof(BVHNodeF) : sizeof(BVHNode);
+}
+
+uint32_t block_size(BVHPrecision precision) {
+  return BVH_MIXED == precision ? sizeof(TriangleBlockF)
+                                : sizeof(TriangleBlock);
+}
+
+uint64_t splitmix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// true if [offset, offset + size) lies in a file of file_size bytes
+bool in_file(uint64_t offset, uint64_t size, uint64_t file_size) {
+  return offset % cache_alignment == 0 && offset <= file_size &&
+         size <= file_size - offset;
+}
+
+// true if n items of item_size bytes at offset lie in a file
+bool array_in_file(uint64_t offset, uint64_t n, uint64_t item_size,
+                   uint64_t file_size) {
+  return n <= file_size / item_size &&
+         in_file(offset, n * item_size, file_size);
+}
+
+// First bytes of a shared memory segment, followed by a cache image. The
+// leader creates the segment with just this block, so that the others can
+// tell whether it is still building, and grows it once the image is built.
+enum SharedState { SHARED_BUILDING = 0, SHARED_READY = 1, SHARED_FAILED = 2 };
+
+struct SharedControl {
+  uint32_t state;
+  /** process id of the leader, 0 until it is known */
+  uint32_t pid;
+  uint64_t image_size;
+  /** geometry hash of the image, so that the others need not compute it */
+  uint64_t hash;
+  char padding[cache_alignment - 24];
+};
+
+#ifdef DAGMC_HAVE_MMAP
+bool write_control(int fd, const SharedControl& control) {
+  return (ssize_t)sizeof(control) == pwrite(fd, &control, sizeof(control), 0);
+}
+
+// read-only mapping of a shared memory segment
+struct SharedMapping {
+  const char* addr = NULL;
+  size_t length = 0;
+  ~SharedMapping() {
+    if (addr) munmap(const_cast<char*>(addr), length);
+  }
+};
+#endif
+
+ErrorCode layout_cache(
+    uint64_t hash,
+    const std::vector<std::pair<EntityHandle, const TriangleBVH*>>& trees,
+    const CompactMesh* mesh, CacheLayout& layout) {
+  // a file holds trees of a single precision
+  BVHPrecision precision = trees.empty() ? BVH_DOUBLE
+                                         : trees[0].second->precision();
+  for (const auto& tree : trees) {
+    if (tree.second->precision() != precision) return MB_FAILURE;
+  }
+
+  CacheHeader& header = layout.header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  header.version = cache_version;
+  header.byte_order = byte_order_mark;
+  header.node_size = node_size(precision);
+  header.block_size = block_size(precision);
+  header.precision = precision;
+  header.hash = hash;
+  header.n_surfaces = trees.size();
+
+  // lay out the arrays of every tree
+  layout.table.resize(trees.size());
+  size_t offset =
+      align_up(sizeof(CacheHeader) + trees.size() * sizeof(CacheSurface));
+  for (size_t i = 0; i < trees.size(); i++) {
+    const TriangleBVH& tree = *trees[i].second;
+    CacheSurface& entry = layout.table[i];
+    entry.surface = trees[i].first;
+    entry.n_triangles = tree.num_triangles();
+    entry.n_nodes = BVH_MIXED == precision ? tree.get_float_nodes().size()
+                                           : tree.get_nodes().size();
+    entry.node_offset = offset;
+    offset = align_up(offset + entry.n_nodes * header.node_size);
+    entry.n_blocks = BVH_MIXED == precision ? tree.get_float_blocks().size()
+                                            : tree.get_blocks().size();
+    entry.block_offset = offset;
+    offset = align_up(offset + entry.n_blocks * header.block_size);
+    for (int k = 0; k < 3; k++) {
+      entry.lo[k] = tree.bounds().lo[k];
+      entry.hi[k] = tree.bounds().hi[k];
+    }
+  }
+
+  std::memset(&layout.mesh, 0, sizeof(layout.mesh));
+  if (mesh) {
+    CacheMesh& entry = layout.mesh;
+    header.mesh_offset = offset;
+    offset = align_up(offset + sizeof(CacheMesh));
+    entry.n_surfaces = mesh->get_surfaces().size();
+    entry.surface_offset = offset;
+    offset = align_up(offset +
+                      entry.n_surfaces * sizeof(CompactMesh::Surface));
+    entry.n_runs = mesh->get_runs().size();
+    entry.run_offset = offset;
+    offset = align_up(offset + entry.n_runs * sizeof(CompactMesh::HandleRun));
+    entry.n_vertex_words = mesh->get_vertices().size();
+    entry.vertex_offset = offset;
+    offset = align_up(offset + entry.n_vertex_words * sizeof(uint32_t));
+    entry.n_conn_words = mesh->get_connectivity().size();
+    entry.conn_offset = offset;
+    offset = align_up(offset + entry.n_conn_words * sizeof(uint32_t));
+  }
+  header.file_size = offset;
+  return MB_SUCCESS;
+}
+
+// Writes the image laid out by layout_cache through write(data, n).
+// Returns the number of bytes written.
+template <typename Write>
+size_t write_cache(
+    const CacheLayout& layout,
+    const std::vector<std::pair<EntityHandle, const TriangleBVH*>>& trees,
+    const CompactMesh* mesh, Write&& write) {
+  const CacheHeader& header = layout.header;
+  const char padding[cache_alignment] = {0};
+  size_t written = 0;
+  auto put = [&](const void* data, size_t n) {
+    if (n) write(data, n);
+    written += n;
+  };
+  auto pad = [&]() { put(padding, align_up(written) - written); };
+
+  put(&header, sizeof(header));
+  put(layout.table.data(), layout.table.size() * sizeof(CacheSurface));
+  pad();
+  bool mixed = BVH_MIXED == (BVHPrecision)header.precision;
+  for (size_t i = 0; i < trees.size(); i++) {
+    const TriangleBVH& tree = *trees[i].second;
+    const void* node_data = mixed ? (const void*)tree.get_float_nodes().data()
+                                  : (const void*)tree.get_nodes().data();
+    const void* block_data = mixed
+                                 ? (const void*)tree.get_float_blocks().data()
+                                 : (const void*)tree.get_blocks().data();
+    put(node_data, layout.table[i].n_nodes * header.node_size);
+    pad();
+    put(block_data, layout.table[i].n_blocks * header.block_size);
+    pad();
+  }
+  if (mesh) {
+    put(&layout.mesh, sizeof(CacheMesh));
+    pad();
+    put(mesh->get_surfaces().data(),
+        mesh->get_surfaces().size() * sizeof(CompactMesh::Surface));
+    pad();
+    put(mesh->get_runs().data(),
+        mesh->get_runs().size() * sizeof(CompactMesh::HandleRun));
+    pad();
+    put(mesh->get_vertices().data(),
+        mesh->get_vertices().size() * sizeof(uint32_t));
+    pad();
+    put(mesh->get_connectivity().data(),
+        mesh->get_connectivity().size() * sizeof(uint32_t));
+    pad();
+  }
+  return written;
+}
+
+// Reads the cache image of size bytes at data, which storage keeps alive.
+// The trees and mesh are only replaced if the whole image is valid.
+ErrorCode read_cache(
+    const char* data, size_t size, std::shared_ptr<const void> storage,
+    uint64_t hash, BVHPrecision precision,
+    std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>>&
+        trees,
+    CompactMesh* mesh) {
+  CacheHeader header;
+  if (size < sizeof(header)) return MB_FAILURE;
+  std::memcpy(&header, data, sizeof(header));
+  if (0 != std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) ||
+      header.version != cache_version ||
+      header.byte_order != byte_order_mark ||
+      header.precision != (uint32_t)precision ||
+      header.node_size != node_size(precision) ||
+      header.block_size != block_size(precision) || header.hash != hash ||
+      header.file_size != size ||
+      header.n_surfaces > size / sizeof(CacheSurface))
+    return MB_FAILURE;
+  // an image has a compact mesh exactly when one is asked for
+  if ((0 != header.mesh_offset) != (NULL != mesh)) return MB_FAILURE;
+
+  const uint64_t table_size = header.n_surfaces * sizeof(CacheSurface);
+  if (table_size > size - sizeof(header)) return MB_FAILURE;
+  const CacheSurface* table =
+      reinterpret_cast<const CacheSurface*>(data + sizeof(header));
+
+  std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>> read;
+  for (uint64_t i = 0; i < header.n_surfaces; i++) {
+    const CacheSurface& entry = table[i];
+    if (!array_in_file(entry.node_offset, entry.n_nodes, header.node_size,
+                       size) ||
+        !array_in_file(entry.block_offset, entry.n_blocks, header.block_size,
+                       size))
+      return MB_FAILURE;
+
+    BVHBox box;
+    for (int k = 0; k < 3; k++) {
+      box.lo[k] = entry.lo[k];
+      box.hi[k] = entry.hi[k];
+    }
+    auto tree = std::make_shared<TriangleBVH>();
+    const char* node_data = data + entry.node_offset;
+    const char* block_data = data + entry.block_offset;
+    if (BVH_MIXED == precision)
+      tree->assign_view(reinterpret_cast<const BVHNodeF*>(node_data),
+                        entry.n_nodes,
+                        reinterpret_cast<const TriangleBlockF*>(block_data),
+                        entry.n_blocks, box, entry.n_triangles, storage);
+    else
+      tree->assign_view(reinterpret_cast<const BVHNode*>(node_data),
+                        entry.n_nodes,
+                        reinterpret_cast<const TriangleBlock*>(block_data),
+                        entry.n_blocks, box, entry.n_triangles, storage);
+    read[entry.surface] = tree;
+  }
+
+  if (mesh) {
+    if (!in_file(header.mesh_offset, sizeof(CacheMesh), size))
+      return MB_FAILURE;
+    CacheMesh entry;
+    std::memcpy(&entry, data + header.mesh_offset, sizeof(entry));
+    if (!array_in_file(entry.surface_offset, entry.n_surfaces,
+                       sizeof(CompactMesh::Surface), size) ||
+        !array_in_file(entry.run_offset, entry.n_runs,
+                       sizeof(CompactMesh::HandleRun), size) ||
+        !array_in_file(entry.vertex_offset, entry.n_vertex_words,
+                       sizeof(uint32_t), size) ||
+        !array_in_file(entry.conn_offset, entry.n_conn_words,
+                       sizeof(uint32_t), size))
+      return MB_FAILURE;
+    mesh->assign_view(
+        reinterpret_cast<const CompactMesh::Surface*>(data +
+                                                      entry.surface_offset),
+        entry.n_surfaces,
+        reinterpret_cast<const CompactMesh::HandleRun*>(data +
+                                                        entry.run_offset),
+        entry.n_runs,
+        reinterpret_cast<const uint32_t*>(data + entry.vertex_offset),
+        entry.n_vertex_words,
+        reinterpret_cast<const uint32_t*>(data + entry.conn_offset),
+        entry.n_conn_words, storage);
+  }
+  trees.swap(read);
+  return MB_SUCCESS;
+}
+
+}  // namespace
+
+void GeometryHash::add(uint64_t word) {
+  state = splitmix64((state ^ word) + 0x9e3779b97f4a7c15ULL);
+}
+
+void GeometryHash::add(double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  add(bits);
+}
+
+MappedFile::~MappedFile() {
+  if (!addr) return;
+#ifdef DAGMC_HAVE_MMAP
+  if (mapped) {
+    munmap(const_cast<char*>(addr), length);
+    return;
+  }
+#endif
+  ::operator delete(const_cast<char*>(addr), std::align_val_t(cache_alignment));
+}
+
+ErrorCode MappedFile::open(const std::string& filename) {
+  if (addr) return MB_FAILURE;
+
+#ifdef DAGMC_HAVE_MMAP
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return MB_FILE_DOES_NOT_EXIST;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    ::close(fd);
+    return MB_FILE_DOES_NOT_EXIST;
+  }
+  void* p = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (MAP_FAILED == p) return MB_FAILURE;
+  addr = static_cast<const char*>(p);
+  length = info.st_size;
+  mapped = true;
+#else
+  std::ifstream file(filename.c_str(), std::ios::binary | std::ios::ate);
+  if (!file) return MB_FILE_DOES_NOT_EXIST;
+  std::streamoff size = file.tellg();
+  if (size <= 0) return MB_FILE_DOES_NOT_EXIST;
+  char* buffer = static_cast<char*>(
+      ::operator new(size, std::align_val_t(cache_alignment)));
+  file.seekg(0);
+  if (!file.read(buffer, size)) {
+    ::operator delete(buffer, std::align_val_t(cache_alignment));
+    return MB_FAILURE;
+  }
+  addr = buffer;
+  length = size;
+#endif
+  return MB_SUCCESS;
+}
+
+std::string bvh_cache_filename(const std::string& model_file,
+                               const std::string& cache_dir, uint64_t hash) {
+  if (!cache_dir.empty()) {
+    std::ostringstream name;
+    name << cache_dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+         << hash << ".dagbvh";
+    return name.str();
+  }
+  if (!model_file.empty()) return model_file + ".dagbvh";
+  return std::string();
+}
+
+ErrorCode write_bvh_cache(
+    const std::string& filename, uint64_t hash,
+    const std::vector<std::pair<EntityHandle, const TriangleBVH*>>& trees,
+    const CompactMesh* mesh) {
+  CacheLayout layout;
+  ErrorCode rval = layout_cache(hash, trees, mesh, layout);
+  if (MB_SUCCESS != rval) return rval;
+
+  // write under a unique temporary name so that other jobs sharing the
+  // cache never read a partial file
+  std::random_device rd;
+  std::ostringstream tmp_name;
+  tmp_name << filename << ".tmp" << std::hex << rd() << rd();
+  std::ofstream file(tmp_name.str().c_str(), std::ios::binary);
+  if (!file) return MB_FAILURE;
+  size_t written =
+      write_cache(layout, trees, mesh, [&](const void* data, size_t n) {
+        file.write(static_cast<const char*>(data), n);
+      });
+  file.close();
+
+  if (!file || written != layout.header.file_size ||
+      0 != std::rename(tmp_name.str().c_str(), filename.c_str())) {
+    std::remove(tmp_name.str().c_str());
+    return MB_FAILURE;
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode read_bvh_cache(
+    const std::string& filename, uint64_t hash, BVHPrecision precision,
+    std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>>&
+        trees,
+    CompactMesh* mesh) {
+  auto file = std::make_shared<MappedFile>();
+  ErrorCode rval = file->open(filename);
+  if (MB_SUCCESS != rval) return rval;
+  return read_cache(file->data(), file->size(), file, hash, precision, trees,
+                    mesh);
+}
+
+ErrorCode model_file_key(const std::string& filename,
+                         const std::string& options, uint64_t& key) {
+#ifdef DAGMC_HAVE_MMAP
+  struct stat info;
+  if (filename.empty() || 0 != stat(filename.c_str(), &info))
+    return MB_FILE_DOES_NOT_EXIST;
+  GeometryHash file_hash;
+  file_hash.add((uint64_t)info.st_dev);
+  file_hash.add((uint64_t)info.st_ino);
+  file_hash.add((uint64_t)info.st_size);
+  file_hash.add((uint64_t)info.st_mtime);
+  for (size_t i = 0; i < options.size(); i++)
+    file_hash.add((uint64_t)(unsigned char)options[i]);
+  key = file_hash.value();
+  return MB_SUCCESS;
+#else
+  return MB_NOT_IMPLEMENTED;
+#endif
+}
+
+std::string shared_bvh_cache_name(uint64_t key) {
+  std::ostringstream name;
+  name << "/dagmc";
+#ifdef DAGMC_HAVE_MMAP
+  // segments are private to their user
+  name << "-" << getuid();
+#endif
+  name << "-" << std::hex << std::setw(16) << std::setfill('0') << key;
+  return name.str();
+}
+
+SharedBVHCache::SharedBVHCache(const std::string& segment_name)
+    : name(segment_name) {}
+
+SharedBVHCache::~SharedBVHCache() {
+#ifdef DAGMC_HAVE_MMAP
+  // don't leave the others waiting for trees that will never come
+  if (leader && !published) abandon();
+  if (fd >= 0) ::close(fd);
+  // processes that already mapped the segment keep it until they unmap it
+  if (leader) shm_unlink(name.c_str());
+#endif
+}
+
+ErrorCode SharedBVHCache::join(bool& is_leader) {
+#ifdef DAGMC_HAVE_MMAP
+  if (fd >= 0) return MB_FAILURE;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+      SharedControl control;
+      std::memset(&control, 0, sizeof(control));
+      control.state = SHARED_BUILDING;
+      control.pid = getpid();
+      if (0 != ftruncate(fd, sizeof(control)) ||
+          !write_control(fd, control)) {
+        ::close(fd);
+        fd = -1;
+        shm_unlink(name.c_str());
+        return MB_FAILURE;
+      }
+      leader = is_leader = true;
+      return MB_SUCCESS;
+    }
+    if (EEXIST != errno) return MB_FAILURE;
+    fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd >= 0) {
+      is_leader = false;
+      return MB_SUCCESS;
+    }
+    // removed in between: try to create it again
+  }
+  return MB_FAILURE;
+#else
+  return MB_NOT_IMPLEMENTED;
+#endif
+}
+
+ErrorCode SharedBVHCache::publish(
+    uint64_t hash,
+    const std::vector<std::pair<EntityHandle, const TriangleBVH*>>& trees,
+    const CompactMesh* mesh) {
+#ifdef DAGMC_HAVE_MMAP
+  if (!leader) return MB_FAILURE;
+  CacheLayout layout;
+  ErrorCode rval = layout_cache(hash, trees, mesh, layout);
+  if (MB_SUCCESS != rval) return rval;
+
+  size_t length = sizeof(SharedControl) + layout.header.file_size;
+  if (0 != ftruncate(fd, length)) return MB_FAILURE;
+  void* p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == p) return MB_FAILURE;
+  char* image = static_cast<char*>(p) + sizeof(SharedControl);
+  size_t written =
+      write_cache(layout, trees, mesh, [&](const void* data, size_t n) {
+        std::memcpy(image, data, n);
+        image += n;
+      });
+  munmap(p, length);
+  if (written != layout.header.file_size) return MB_FAILURE;
+
+  // only now let the others map the image
+  SharedControl control;
+  std::memset(&control, 0, sizeof(control));
+  control.state = SHARED_READY;
+  control.pid = getpid();
+  control.image_size = written;
+  control.hash = hash;
+  if (!write_control(fd, control)) return MB_FAILURE;
+  published = true;
+  return MB_SUCCESS;
+#else
+  return MB_NOT_IMPLEMENTED;
+#endif
+}
+
+void SharedBVHCache::abandon() {
+#ifdef DAGMC_HAVE_MMAP
+  if (!leader) return;
+  SharedControl control;
+  std::memset(&control, 0, sizeof(control));
+  control.state = SHARED_FAILED;
+  control.pid = getpid();
+  write_control(fd, control);
+  // later processes start over instead of joining a failed segment
+  shm_unlink(name.c_str());
+  leader = false;
+#endif
+}
+
+ErrorCode SharedBVHCache::read(
+    BVHPrecision precision, double max_wait,
+    std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>>&
+        trees,
+    uint64_t& hash, CompactMesh* mesh) {
+#ifdef DAGMC_HAVE_MMAP
+  if (fd < 0) return MB_FAILURE;
+
+  // wait for the leader to publish the image; a leader that is still
+  // building after max_wait keeps the segment for later processes
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration<double>(max_wait);
+  SharedControl control;
+  for (;;) {
+    struct stat info;
+    if (0 != fstat(fd, &info)) return MB_FAILURE;
+    if ((size_t)info.st_size >= sizeof(control)) {
+      if ((ssize_t)sizeof(control) != pread(fd, &control, sizeof(control), 0))
+        return MB_FAILURE;
+      if (SHARED_READY == control.state) break;
+      if (SHARED_FAILED == control.state) return MB_FAILURE;
+      // a segment left behind by a leader that died while building
+      if (control.pid && 0 != kill(control.pid, 0) && ESRCH == errno) {
+        shm_unlink(name.c_str());
+        return MB_FAILURE;
+      }
+    }
+    if (std::chrono::steady_clock::now() >= deadline) return MB_FAILURE;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  auto mapping = std::make_shared<SharedMapping>();
+  mapping->length = sizeof(control) + control.image_size;
+  void* p = mmap(NULL, mapping->length, PROT_READ, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == p) return MB_FAILURE;
+  mapping->addr = static_cast<const char*>(p);
+  ErrorCode rval =
+      read_cache(mapping->addr + sizeof(control), control.image_size, mapping,
+                 control.hash, precision, trees, mesh);
+  if (MB_SUCCESS == rval) hash = control.hash;
+  return rval;
+#else
+  return MB_NOT_IMPLEMENTED;
+#endif
+}
+
+}  // namespace moab
@@ -0,0 +1,158 @@
+#ifndef DAGMC_BVH_CACHE_HPP
+#define DAGMC_BVH_CACHE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BVH.hpp"
+#include "CompactMesh.hpp"
+#include "moab/Types.hpp"
+
+namespace moab {
+
+/**\brief 64-bit hash of geometry data, used to key BVH cache files
+ *
+ * Each word is mixed into the state with the splitmix64 finalizer, so a
+ * change to any coordinate or handle changes the hash. Not cryptographic.
+ */
+class GeometryHash {
+ public:
+  void add(uint64_t word);
+  /** hashes the bit pattern of value */
+  void add(double value);
+
+  uint64_t value() const { return state; }
+
+ private:
+  uint64_t state = 0x243f6a8885a308d3ULL;
+};
+
+/**\brief Read-only view of a whole file
+ *
+ * The file is memory-mapped where the platform supports it, so pages are
+ * shared between processes reading the same file, and read into memory
+ * otherwise.
+ */
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /** map filename, returns MB_FILE_DOES_NOT_EXIST if it cannot be opened */
+  ErrorCode open(const std::string& filename);
+
+  const char* data() const { return addr; }
+  size_t size() const { return length; }
+
+ private:
+  const char* addr = NULL;
+  size_t length = 0;
+  bool mapped = false;
+};
+
+/** cache file of a geometry: "<cache_dir>/<hash>.dagbvh" if cache_dir is
+ *  set, "<model_file>.dagbvh" otherwise, or empty if neither is known */
+std::string bvh_cache_filename(const std::string& model_file,
+                               const std::string& cache_dir, uint64_t hash);
+
+/**\brief Write the surface trees of a geometry to a BVH cache file
+ *
+ * The file is written under a temporary name and renamed into place, so
+ * concurrent readers never see a partial file. All trees must have the same
+ * precision. The compact mesh the trees were built from, if any, is stored
+ * with them.
+ */
+ErrorCode write_bvh_cache(
+    const std::string& filename, uint64_t hash,
+    const std::vector<std::pair<EntityHandle, const TriangleBVH*>>& trees,
+    const CompactMesh* mesh = NULL);
+
+/**\brief Read the surface trees of a BVH cache file
+ *
+ * The trees, and the compact mesh if one is passed, are views of the
+ * memory-mapped file, which stays mapped for as long as any of them exists.
+ *\return MB_FILE_DOES_NOT_EXIST if there is no cache file, MB_FAILURE if
+ *        it is invalid, was written for a different hash or precision, or
+ *        has a compact mesh exactly when mesh is null
+ */
+ErrorCode read_bvh_cache(
+    const std::string& filename, uint64_t hash, BVHPrecision precision,
+    std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>>&
+        trees,
+    CompactMesh* mesh = NULL);
+
+/** name of the shared memory segment with the given key, see
+ *  SharedBVHCache */
+std::string shared_bvh_cache_name(uint64_t key);
+
+/** key of a model file for shared_bvh_cache_name, from its device, inode,
+ *  size and modification time and the options it is read with; cheap
+ *  enough for every process of a node, unlike GeometryHash
+ *\return MB_FILE_DOES_NOT_EXIST if the file cannot be found */
+ErrorCode model_file_key(const std::string& filename,
+                         const std::string& options, uint64_t& key);
+
+/**\brief A BVH cache in POSIX shared memory
+ *
+ * Lets the processes of a node, e.g. the MPI ranks of a job, share one copy
+ * of the surface trees and compact mesh of a geometry. The first process to
+ * join a segment creates it and becomes the leader: it builds the trees and
+ * publishes them with the hash of the geometry, or abandons the segment if
+ * it cannot. The others wait in read until the trees are published and then
+ * map them read-only, exactly as read_bvh_cache maps a file, or give up and
+ * build their own.
+ *
+ * The leader removes the segment's name when its SharedBVHCache is
+ * destroyed; processes that have mapped it keep their mappings. A segment
+ * whose leader died while building is removed by the next process to wait
+ * on it.
+ */
+class SharedBVHCache {
+ public:
+  explicit SharedBVHCache(const std::string& segment_name);
+  ~SharedBVHCache();
+  SharedBVHCache(const SharedBVHCache&) = delete;
+  SharedBVHCache& operator=(const SharedBVHCache&) = delete;
+
+  /** open the segment, creating it if no other process has
+   *\return MB_NOT_IMPLEMENTED without POSIX shared memory */
+  ErrorCode join(bool& is_leader);
+
+  /** leader: copy the trees and mesh into the segment for the others */
+  ErrorCode publish(
+      uint64_t hash,
+      const std::vector<std::pair<EntityHandle, const TriangleBVH*>>& trees,
+      const CompactMesh* mesh = NULL);
+
+  /** leader: tell the others that nothing will be published; done by the
+   *  destructor if publish did not succeed */
+  void abandon();
+
+  /** wait up to max_wait seconds for the segment to be published and map
+   *  its trees and mesh, as read_bvh_cache does
+   *\param hash set to the geometry hash the trees were published with
+   *\return MB_FAILURE if the leader abandoned the segment, died or did not
+   *        publish in time */
+  ErrorCode read(
+      BVHPrecision precision, double max_wait,
+      std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>>&
+          trees,
+      uint64_t& hash, CompactMesh* mesh = NULL);
+
+  bool is_leader() const { return leader; }
+
+ private:
+  std::string name;
+  int fd = -1;
+  bool leader = false;
+  bool published = false;
+};
+
+}  // namespace moab
+
+#endif
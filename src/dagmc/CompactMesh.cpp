@@ -0,0 +1,264 @@
+#include "CompactMesh.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+namespace moab {
+
+namespace {
+
+// Exponent of the grid step of a surface: coarse enough that the extent of
+// its bounding box is at most 2^31 steps, but no finer than the resolution
+// of doubles of magnitude max_abs, where the grid already holds every
+// coordinate exactly.
+int grid_exponent(double extent, double max_abs) {
+  if (0.0 == max_abs) return 0;
+  int exponent = ilogb(max_abs) - 52;
+  if (extent > 0.0) exponent = std::max(exponent, ilogb(extent) - 30);
+  return exponent;
+}
+
+}  // namespace
+
+ErrorCode CompactMesh::build(Interface* mbi, const Range& surfs) {
+  clear();
+
+  // the step each vertex is rounded to: the coarsest of its surfaces
+  Range all_verts;
+  ErrorCode rval = mbi->get_entities_by_type(0, MBVERTEX, all_verts);
+  MB_CHK_SET_ERR(rval, "Failed to get vertices");
+  std::vector<EntityHandle> vert_handles(all_verts.begin(), all_verts.end());
+  std::vector<int> vert_exponents(vert_handles.size(), INT_MIN);
+  auto vert_index = [&](EntityHandle vert) {
+    return std::lower_bound(vert_handles.begin(), vert_handles.end(), vert) -
+           vert_handles.begin();
+  };
+
+  std::vector<int> exponents;
+  std::vector<double> coords;
+  for (Range::const_iterator it = surfs.begin(); it != surfs.end(); ++it) {
+    Range tris, verts;
+    rval = mbi->get_entities_by_type(*it, MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of surface " << *it);
+    rval = mbi->get_connectivity(tris, verts, true);
+    MB_CHK_SET_ERR(rval, "Failed to get the vertices of surface " << *it);
+    coords.resize(3 * verts.size());
+    if (!verts.empty()) {
+      rval = mbi->get_coords(verts, coords.data());
+      MB_CHK_SET_ERR(rval, "Failed to get the coordinates of " << *it);
+    }
+
+    double lo[3] = {HUGE_VAL, HUGE_VAL, HUGE_VAL};
+    double hi[3] = {-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+    double max_abs = 0.0;
+    for (size_t i = 0; i < coords.size(); i++) {
+      lo[i % 3] = std::min(lo[i % 3], coords[i]);
+      hi[i % 3] = std::max(hi[i % 3], coords[i]);
+      max_abs = std::max(max_abs, fabs(coords[i]));
+    }
+    double extent = 0.0;
+    if (!verts.empty()) {
+      for (int j = 0; j < 3; j++) extent = std::max(extent, hi[j] - lo[j]);
+    }
+    int exponent = grid_exponent(extent, max_abs);
+    exponents.push_back(exponent);
+    for (Range::iterator v = verts.begin(); v != verts.end(); ++v) {
+      int& vert_exponent = vert_exponents[vert_index(*v)];
+      vert_exponent = std::max(vert_exponent, exponent);
+    }
+  }
+
+  std::vector<Surface> surf_data;
+  std::vector<HandleRun> run_data;
+  std::vector<uint32_t> vertex_data, conn_data;
+  std::vector<EntityHandle> local_verts;
+  std::vector<int64_t> steps;
+  size_t n = 0;
+  for (Range::const_iterator it = surfs.begin(); it != surfs.end(); ++it, ++n) {
+    Range tris, verts;
+    rval = mbi->get_entities_by_type(*it, MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of surface " << *it);
+    rval = mbi->get_connectivity(tris, verts, true);
+    MB_CHK_SET_ERR(rval, "Failed to get the vertices of surface " << *it);
+    coords.resize(3 * verts.size());
+    if (!verts.empty()) {
+      rval = mbi->get_coords(verts, coords.data());
+      MB_CHK_SET_ERR(rval, "Failed to get the coordinates of " << *it);
+    }
+
+    // round each vertex on its own grid, then express it in the steps of
+    // this surface; coarser grids are multiples of finer ones
+    Surface surf;
+    surf.surface = *it;
+    surf.exponent = exponents[n];
+    surf.reserved = 0;
+    steps.resize(coords.size());
+    local_verts.assign(verts.begin(), verts.end());
+    for (size_t i = 0; i < local_verts.size(); i++) {
+      int exponent = vert_exponents[vert_index(local_verts[i])];
+      int shift = exponent - surf.exponent;
+      if (shift > 62)
+        MB_SET_ERR(MB_FAILURE, "Surface " << *it << " is too small for the "
+                                          << "grid of its neighbors");
+      for (int j = 0; j < 3; j++) {
+        int64_t rounded = llround(ldexp(coords[3 * i + j], -exponent));
+        steps[3 * i + j] = rounded * ((int64_t)1 << shift);
+      }
+    }
+    for (int j = 0; j < 3; j++) {
+      surf.base[j] = 0;
+      for (size_t i = 0; i < local_verts.size(); i++) {
+        if (0 == i || steps[3 * i + j] < surf.base[j])
+          surf.base[j] = steps[3 * i + j];
+      }
+    }
+
+    surf.first_vertex = vertex_data.size() / 3;
+    for (size_t i = 0; i < steps.size(); i++) {
+      uint64_t offset = (uint64_t)(steps[i] - surf.base[i % 3]);
+      if (offset > UINT32_MAX)
+        MB_SET_ERR(MB_FAILURE, "Surface " << *it << " cannot be quantized");
+      vertex_data.push_back((uint32_t)offset);
+    }
+
+    surf.first_triangle = conn_data.size() / 3;
+    surf.n_triangles = tris.size();
+    for (Range::iterator t = tris.begin(); t != tris.end(); ++t) {
+      const EntityHandle* conn;
+      int len;
+      rval = mbi->get_connectivity(*t, conn, len, true);
+      MB_CHK_SET_ERR(rval, "Failed to get triangle connectivity");
+      if (3 != len)
+        MB_SET_ERR(MB_FAILURE, "Facet " << *t << " is not a triangle");
+      for (int j = 0; j < 3; j++) {
+        conn_data.push_back(
+            (uint32_t)(std::lower_bound(local_verts.begin(), local_verts.end(),
+                                        conn[j]) -
+                       local_verts.begin()));
+      }
+    }
+
+    surf.first_run = run_data.size();
+    uint64_t tri_index = 0;
+    for (Range::const_pair_iterator p = tris.const_pair_begin();
+         p != tris.const_pair_end(); ++p) {
+      HandleRun run = {p->first, p->second, tri_index};
+      run_data.push_back(run);
+      tri_index += p->second - p->first + 1;
+    }
+    surf.n_runs = run_data.size() - surf.first_run;
+    surf_data.push_back(surf);
+  }
+
+  surf_data.shrink_to_fit();
+  run_data.shrink_to_fit();
+  vertex_data.shrink_to_fit();
+  conn_data.shrink_to_fit();
+  surfaces.assign(std::move(surf_data));
+  runs.assign(std::move(run_data));
+  vertices.assign(std::move(vertex_data));
+  connectivity.assign(std::move(conn_data));
+  build_index();
+  return MB_SUCCESS;
+}
+
+void CompactMesh::clear() {
+  surfaces.assign(std::vector<Surface>());
+  runs.assign(std::vector<HandleRun>());
+  vertices.assign(std::vector<uint32_t>());
+  connectivity.assign(std::vector<uint32_t>());
+  index.clear();
+}
+
+void CompactMesh::assign_view(const Surface* surf_data, size_t n_surfs,
+                              const HandleRun* run_data, size_t n_runs,
+                              const uint32_t* vertex_data,
+                              size_t n_vertex_words, const uint32_t* conn_data,
+                              size_t n_conn_words,
+                              std::shared_ptr<const void> storage) {
+  surfaces.assign_view(surf_data, n_surfs, storage);
+  runs.assign_view(run_data, n_runs, storage);
+  vertices.assign_view(vertex_data, n_vertex_words, storage);
+  connectivity.assign_view(conn_data, n_conn_words, storage);
+  build_index();
+}
+
+void CompactMesh::build_index() {
+  index.clear();
+  for (size_t i = 0; i < surfaces.size(); i++)
+    index[surfaces[i].surface] = i;
+}
+
+void CompactMesh::decode(const Surface& surf, uint32_t vertex,
+                         double xyz[3]) const {
+  const uint32_t* offsets = &vertices[3 * (surf.first_vertex + vertex)];
+  // exact: the steps fit in a double's mantissa
+  for (int j = 0; j < 3; j++)
+    xyz[j] = ldexp((double)(surf.base[j] + offsets[j]), surf.exponent);
+}
+
+ErrorCode CompactMesh::get_surface_triangles(
+    EntityHandle surface, std::vector<double>& coords,
+    std::vector<EntityHandle>& handles) const {
+  auto it = index.find(surface);
+  if (it == index.end())
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "Surface " << surface << " is not in "
+                                               << "the compact mesh");
+  const Surface& surf = surfaces[it->second];
+
+  handles.clear();
+  for (uint64_t r = surf.first_run; r < surf.first_run + surf.n_runs; r++) {
+    for (EntityHandle h = runs[r].first; h <= runs[r].last; h++)
+      handles.push_back(h);
+  }
+  coords.resize(9 * surf.n_triangles);
+  const uint32_t* conn = connectivity.data() + 3 * surf.first_triangle;
+  for (size_t i = 0; i < 3 * surf.n_triangles; i++)
+    decode(surf, conn[i], &coords[3 * i]);
+  return MB_SUCCESS;
+}
+
+ErrorCode CompactMesh::get_facet_coords(EntityHandle surface,
+                                        EntityHandle facet,
+                                        double coords[9]) const {
+  auto it = index.find(surface);
+  if (it == index.end())
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "Surface " << surface << " is not in "
+                                               << "the compact mesh");
+  const Surface& surf = surfaces[it->second];
+
+  // the last run starting at or before facet
+  const HandleRun* first = runs.data() + surf.first_run;
+  const HandleRun* last = first + surf.n_runs;
+  const HandleRun* run = std::upper_bound(
+      first, last, facet,
+      [](EntityHandle h, const HandleRun& r) { return h < r.first; });
+  if (run == first || facet > (--run)->last)
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "Facet " << facet << " is not in "
+                                             << "surface " << surface);
+
+  const uint32_t* conn =
+      &connectivity[3 * (surf.first_triangle + run->index +
+                         (facet - run->first))];
+  for (int j = 0; j < 3; j++) decode(surf, conn[j], &coords[3 * j]);
+  return MB_SUCCESS;
+}
+
+size_t CompactMesh::num_triangles(EntityHandle surface) const {
+  auto it = index.find(surface);
+  return it == index.end() ? 0 : surfaces[it->second].n_triangles;
+}
+
+size_t CompactMesh::memory_size() const {
+  return surfaces.size() * sizeof(Surface) +
+         runs.size() * sizeof(HandleRun) +
+         vertices.size() * sizeof(uint32_t) +
+         connectivity.size() * sizeof(uint32_t) +
+         index.size() * (sizeof(EntityHandle) + sizeof(size_t) +
+                         2 * sizeof(void*));
+}
+
+}  // namespace moab
@@ -0,0 +1,118 @@
+#ifndef DAGMC_COMPACT_MESH_HPP
+#define DAGMC_COMPACT_MESH_HPP
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "BVH.hpp"
+#include "moab/Interface.hpp"
+#include "moab/Range.hpp"
+
+namespace moab {
+
+/**\brief Compact copy of the triangles of a set of surfaces
+ *
+ * Each surface has a pool of vertices whose coordinates are stored as
+ * 32-bit offsets from the corner of the surface's bounding box, in steps of
+ * a power of two chosen so that the box spans at most 2^31 steps. Triangles
+ * are three 32-bit indices into the pool of their surface. A vertex and a
+ * triangle take 12 bytes each, against the 24 and 24 bytes of MOAB's
+ * coordinates and connectivity before tags and adjacencies.
+ *
+ * A vertex shared by several surfaces is rounded once, to the coarsest step
+ * of those surfaces. Every surface decodes it to the same coordinates, so
+ * the mesh stays watertight. Coordinates are exact where the step is below
+ * their double precision resolution and otherwise within half a step,
+ * about 2^-32 of the size of the surface.
+ *
+ * Triangles keep their MOAB handles, which remain valid as identifiers
+ * after the MOAB triangles are deleted. Like the arrays of a TriangleBVH,
+ * the arrays of the mesh can be views of a BVH cache (see BVHCache.hpp).
+ */
+class CompactMesh {
+ public:
+  /** a contiguous range of triangle handles of a surface */
+  struct HandleRun {
+    EntityHandle first;
+    EntityHandle last;
+    /** index of first in the triangles of the surface */
+    uint64_t index;
+  };
+
+  struct Surface {
+    EntityHandle surface;
+    /** corner of the bounding box, in steps */
+    int64_t base[3];
+    /** the step is 2^exponent */
+    int32_t exponent;
+    uint32_t reserved;
+    uint64_t first_vertex;
+    uint64_t first_triangle;
+    uint64_t n_triangles;
+    uint64_t first_run;
+    uint64_t n_runs;
+  };
+
+  /** copy the triangles of surfaces out of MOAB, replacing any contents */
+  ErrorCode build(Interface* mbi, const Range& surfaces);
+
+  void clear();
+
+  /** use arrays owned by storage, e.g. a mapped BVH cache file */
+  void assign_view(const Surface* surf_data, size_t n_surfs,
+                   const HandleRun* run_data, size_t n_runs,
+                   const uint32_t* vertex_data, size_t n_vertex_words,
+                   const uint32_t* conn_data, size_t n_conn_words,
+                   std::shared_ptr<const void> storage);
+
+  /** forget a surface, e.g. one deleted from MOAB whose handle may be
+   *  reused; its triangles stay in memory until the next build */
+  void remove_surface(EntityHandle surface) { index.erase(surface); }
+
+  bool has_surface(EntityHandle surface) const {
+    return index.count(surface) != 0;
+  }
+
+  /** triangle handles and coordinates of a surface, in handle order */
+  ErrorCode get_surface_triangles(EntityHandle surface,
+                                  std::vector<double>& coords,
+                                  std::vector<EntityHandle>& handles) const;
+
+  /** coordinates of a triangle of surface */
+  ErrorCode get_facet_coords(EntityHandle surface, EntityHandle facet,
+                             double coords[9]) const;
+
+  size_t num_surfaces() const { return surfaces.size(); }
+  size_t num_vertices() const { return vertices.size() / 3; }
+  size_t num_triangles() const { return connectivity.size() / 3; }
+  /** number of triangles of a surface, 0 if it is not in the mesh */
+  size_t num_triangles(EntityHandle surface) const;
+
+  /** bytes used by the mesh */
+  size_t memory_size() const;
+
+  const BVHArray<Surface>& get_surfaces() const { return surfaces; }
+  const BVHArray<HandleRun>& get_runs() const { return runs; }
+  const BVHArray<uint32_t>& get_vertices() const { return vertices; }
+  const BVHArray<uint32_t>& get_connectivity() const { return connectivity; }
+
+ private:
+  void decode(const Surface& surf, uint32_t vertex, double xyz[3]) const;
+
+  /** index the surfaces by handle */
+  void build_index();
+
+  BVHArray<Surface> surfaces;
+  std::unordered_map<EntityHandle, size_t> index;
+  BVHArray<HandleRun> runs;
+  /** x, y, z offsets of each vertex from the base of its surface */
+  BVHArray<uint32_t> vertices;
+  /** three vertex indices of each triangle, local to its surface */
+  BVHArray<uint32_t> connectivity;
+};
+
+}  // namespace moab
+
+#endif
@@ -0,0 +1,129 @@
+#include "CompactRayHistory.hpp"
+
+#include <string.h>
+
+#include <utility>
+#include <vector>
+
+namespace moab {
+
+namespace {
+
+// smallest block, in handles
+const uint32_t MIN_BLOCK_CAPACITY = 16;
+// free blocks kept per size; more are freed
+const size_t MAX_FREE_BLOCKS = 64;
+
+// Free blocks of each power-of-two capacity. A block may be returned to
+// the pool of another thread than the one it came from.
+struct BlockPool {
+  std::vector<EntityHandle*> free_blocks[32];
+
+  ~BlockPool();
+};
+
+// The calling thread's pool is constructed on first use. Once it is
+// destroyed, e.g. while other thread_local histories are destroyed at
+// thread exit, blocks go straight to the heap.
+thread_local bool pool_destroyed = false;
+thread_local BlockPool block_pool;
+
+BlockPool::~BlockPool() {
+  pool_destroyed = true;
+  for (auto& blocks : free_blocks) {
+    for (EntityHandle* block : blocks) delete[] block;
+  }
+}
+
+int log2_capacity(uint32_t capacity) {
+  int k = 0;
+  while (((uint32_t)1 << k) < capacity) k++;
+  return k;
+}
+
+// capacity of the smallest block holding n handles
+uint32_t block_capacity(uint32_t n) {
+  uint32_t capacity = MIN_BLOCK_CAPACITY;
+  while (capacity < n) capacity *= 2;
+  return capacity;
+}
+
+}  // namespace
+
+CompactRayHistory::CompactRayHistory(const CompactRayHistory& other)
+    : CompactRayHistory() {
+  *this = other;
+}
+
+CompactRayHistory::CompactRayHistory(CompactRayHistory&& other) noexcept
+    : CompactRayHistory() {
+  *this = std::move(other);
+}
+
+CompactRayHistory& CompactRayHistory::operator=(
+    const CompactRayHistory& other) {
+  if (this == &other) return *this;
+  if (other.count > capacity) {
+    if (heap) release_block(heap, capacity);
+    capacity = block_capacity(other.count);
+    heap = acquire_block(capacity);
+  }
+  count = other.count;
+  memcpy(data(), other.data(), count * sizeof(EntityHandle));
+  return *this;
+}
+
+CompactRayHistory& CompactRayHistory::operator=(
+    CompactRayHistory&& other) noexcept {
+  if (this == &other) return *this;
+  if (other.heap) {
+    if (heap) release_block(heap, capacity);
+    heap = other.heap;
+    capacity = other.capacity;
+    other.heap = NULL;
+    other.capacity = INLINE_CAPACITY;
+  } else {
+    // our capacity is at least INLINE_CAPACITY
+    memcpy(data(), other.local, other.count * sizeof(EntityHandle));
+  }
+  count = other.count;
+  other.count = 0;
+  return *this;
+}
+
+void CompactRayHistory::grow() {
+  uint32_t new_capacity = block_capacity(2 * capacity);
+  EntityHandle* block = acquire_block(new_capacity);
+  memcpy(block, data(), count * sizeof(EntityHandle));
+  if (heap) release_block(heap, capacity);
+  heap = block;
+  capacity = new_capacity;
+}
+
+EntityHandle* CompactRayHistory::acquire_block(uint32_t capacity) {
+  if (!pool_destroyed) {
+    std::vector<EntityHandle*>& blocks =
+        block_pool.free_blocks[log2_capacity(capacity)];
+    if (!blocks.empty()) {
+      EntityHandle* block = blocks.back();
+      blocks.pop_back();
+      return block;
+    }
+  }
+  return new EntityHandle[capacity];
+}
+
+void CompactRayHistory::release_block(EntityHandle* block,
+                                      uint32_t capacity) {
+  if (!pool_destroyed) {
+    std::vector<EntityHandle*>& blocks =
+        block_pool.free_blocks[log2_capacity(capacity)];
+    if (blocks.size() < MAX_FREE_BLOCKS) {
+      blocks.push_back(block);
+      return;
+    }
+  }
+  delete[] block;
+}
+
+}  // namespace moab
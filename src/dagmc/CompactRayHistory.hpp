@@ -0,0 +1,97 @@
+#ifndef DAGMC_COMPACT_RAY_HISTORY_HPP
+#define DAGMC_COMPACT_RAY_HISTORY_HPP
+
+#include <cstdint>
+
+#include "moab/Types.hpp"
+
+namespace moab {
+
+/**\brief The facets a particle has crossed, skipped by its next queries
+ *
+ * Same interface as GeomQueryTool::RayHistory. Up to INLINE_CAPACITY
+ * facets are stored in the object itself, which is one cache line, so the
+ * usual short histories are created, copied and reset without touching the
+ * heap. Longer histories move to a buffer from a per-thread pool of
+ * power-of-two blocks, which are recycled rather than freed. Moving a
+ * history never copies its facets.
+ */
+class CompactRayHistory {
+ public:
+  static const uint32_t INLINE_CAPACITY = 6;
+
+  CompactRayHistory() : count(0), capacity(INLINE_CAPACITY), heap(NULL) {}
+  CompactRayHistory(const CompactRayHistory& other);
+  CompactRayHistory(CompactRayHistory&& other) noexcept;
+  CompactRayHistory& operator=(const CompactRayHistory& other);
+  CompactRayHistory& operator=(CompactRayHistory&& other) noexcept;
+  ~CompactRayHistory() {
+    if (heap) release_block(heap, capacity);
+  }
+
+  /** forget every facet */
+  void reset() { count = 0; }
+
+  /** keep only the last facet */
+  void reset_to_last_intersection() {
+    if (count > 1) {
+      EntityHandle* facets = data();
+      facets[0] = facets[count - 1];
+      count = 1;
+    }
+  }
+
+  /** forget the last facet */
+  void rollback_last_intersection() {
+    if (count) count--;
+  }
+
+  /**\return MB_ENTITY_NOT_FOUND if the history is empty */
+  ErrorCode get_last_intersection(EntityHandle& last_facet_hit) const {
+    if (!count) return MB_ENTITY_NOT_FOUND;
+    last_facet_hit = data()[count - 1];
+    return MB_SUCCESS;
+  }
+
+  int size() const { return count; }
+
+  bool in_history(EntityHandle facet) const {
+    const EntityHandle* facets = data();
+    for (uint32_t i = 0; i < count; i++) {
+      if (facets[i] == facet) return true;
+    }
+    return false;
+  }
+
+  void add_entity(EntityHandle facet) {
+    if (count == capacity) grow();
+    data()[count++] = facet;
+  }
+
+  /** the facets, oldest first */
+  const EntityHandle* begin() const { return data(); }
+  const EntityHandle* end() const { return data() + count; }
+
+ private:
+  EntityHandle* data() { return heap ? heap : local; }
+  const EntityHandle* data() const { return heap ? heap : local; }
+
+  /** double the capacity, moving the facets to a pooled block */
+  void grow();
+
+  /** a block of capacity handles from the calling thread's pool */
+  static EntityHandle* acquire_block(uint32_t capacity);
+
+  /** return a block to the calling thread's pool */
+  static void release_block(EntityHandle* block, uint32_t capacity);
+
+  uint32_t count;
+  uint32_t capacity;
+  /** pooled block holding the facets, or null if they are in local */
+  EntityHandle* heap;
+  EntityHandle local[INLINE_CAPACITY];
+};
+
+}  // namespace moab
+
+#endif
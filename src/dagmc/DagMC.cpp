@@ -8,10 +8,12 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <climits>
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
@@ -20,6 +22,12 @@
 #include "double_down/RTI.hpp"
 #endif
 
+#ifdef NATIVE_BVH
+#include "NativeRayTracer.hpp"
+#endif
+
+#include "BVHCache.hpp"
+#include "ParallelFor.hpp"
 #include "util.hpp"
 #ifndef M_PI /* windows */
 #define M_PI 3.14159265358979323846
@@ -43,6 +51,121 @@ namespace moab {
 
 const bool counting = false; /* controls counts of ray casts and pt_in_vols */
 
+namespace {
+
+// a point_in_volume verdict remembered by the thread that computed it
+struct PointVerdict {
+  uint64_t generation = 0;
+  EntityHandle volume = 0;
+  double xyz[3];
+  double uvw[3];
+  bool has_uvw;
+  int result;
+
+  bool matches(uint64_t gen, EntityHandle vol, const double p[3],
+               const double* dir) const {
+    if (generation != gen || volume != vol || has_uvw != (dir != NULL))
+      return false;
+    for (int i = 0; i < 3; i++) {
+      if (xyz[i] != p[i] || (dir && uvw[i] != dir[i])) return false;
+    }
+    return true;
+  }
+};
+
+// a few verdicts per thread, direct-mapped by volume and point
+const int POINT_CACHE_BITS = 4;
+thread_local PointVerdict point_cache[1 << POINT_CACHE_BITS];
+
+std::atomic<uint64_t> next_point_cache_generation(1);
+
+PointVerdict& point_cache_slot(EntityHandle volume, const double xyz[3]) {
+  uint64_t h = volume;
+  for (int i = 0; i < 3; i++) {
+    uint64_t bits;
+    memcpy(&bits, &xyz[i], sizeof(bits));
+    h = (h ^ bits) * 0x9E3779B97F4A7C15ull;
+  }
+  return point_cache[h >> (64 - POINT_CACHE_BITS)];
+}
+
+#if defined(NATIVE_BVH) && !defined(DOUBLE_DOWN)
+// the native BVH takes DagMC's RayHistory
+inline DagMC::RayHistory* tracer_history(DagMC::RayHistory* history) {
+  return history;
+}
+inline const DagMC::RayHistory* tracer_history(
+    const DagMC::RayHistory* history) {
+  return history;
+}
+inline void copy_back(const DagMC::RayHistory*, DagMC::RayHistory*) {}
+#else
+// MOAB's RayHistory holding the facets of history, or null. Only GQT and
+// double-down need it: each query copies the history's few facets into a
+// per-thread copy, which only allocates while its longest history grows
+GeomQueryTool::RayHistory* tracer_history(const DagMC::RayHistory* history) {
+  thread_local GeomQueryTool::RayHistory copy;
+  if (!history) return NULL;
+  copy.reset();
+  for (EntityHandle facet : *history) copy.add_entity(facet);
+  return &copy;
+}
+
+// add the facet ray_fire appended to the copy to history
+void copy_back(const GeomQueryTool::RayHistory* copy,
+               DagMC::RayHistory* history) {
+  if (!history || copy->size() <= history->size()) return;
+  EntityHandle facet;
+  if (MB_SUCCESS == copy->get_last_intersection(facet))
+    history->add_entity(facet);
+}
+#endif
+
+#if !defined(DOUBLE_DOWN) && !defined(NATIVE_BVH)
+// add the traversal MOAB's OBB trees reported to counts
+void add_trv_stats(const OrientedBoxTreeTool::TrvStats& stats,
+                   BVHCounts& counts) {
+  for (unsigned n : stats.nodes_visited()) counts.nodes_visited += n;
+  for (unsigned n : stats.leaves_visited()) counts.leaves_visited += n;
+  counts.triangles_tested += stats.ray_tri_tests();
+}
+#endif
+
+// true if rotation, row-major, has orthonormal rows and a positive
+// determinant
+bool is_proper_rotation(const double rotation[9]) {
+  const double tol = 1e-9;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      double dot = 0.0;
+      for (int k = 0; k < 3; k++)
+        dot += rotation[3 * i + k] * rotation[3 * j + k];
+      if (std::fabs(dot - (i == j ? 1.0 : 0.0)) > tol) return false;
+    }
+  }
+  CartVect row0(rotation), row1(rotation + 3), row2(rotation + 6);
+  return (row0 * row1) % row2 > 0.0;
+}
+
+#ifdef NATIVE_BVH
+// the transform applying b and then a; transforms are a row-major
+// rotation followed by a translation
+void compose_transforms(const double a[12], const double b[12],
+                        double result[12]) {
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      result[3 * i + j] = 0.0;
+      for (int k = 0; k < 3; k++)
+        result[3 * i + j] += a[3 * i + k] * b[3 * k + j];
+    }
+    result[9 + i] = a[9 + i];
+    for (int k = 0; k < 3; k++) result[9 + i] += a[3 * i + k] * b[9 + k];
+  }
+}
+#endif
+
+}  // namespace
+
 // Empty synonym map for DagMC::parse_metadata()
 const std::map<std::string, std::string> DagMC::no_synonyms;
 
@@ -52,6 +175,8 @@ DagMC::DagMC(std::shared_ptr<moab::Interface> mb_impl, double overlap_tolerance,
     : logger(verbosity) {
 #ifdef DOUBLE_DOWN
   logger.message("Using the DOUBLE-DOWN interface to Embree.");
+#elif defined(NATIVE_BVH)
+  logger.message("Using the native DAGMC BVH for ray tracing.");
 #endif
 
   moab_instance_created = false;
@@ -67,7 +192,7 @@ DagMC::DagMC(std::shared_ptr<moab::Interface> mb_impl, double overlap_tolerance,
 
   // make new GeomTopoTool and GeomQueryTool
   GTT = std::make_shared<GeomTopoTool>(MBI, false);
-#ifdef DOUBLE_DOWN
+#if defined(DOUBLE_DOWN) || defined(NATIVE_BVH)
   ray_tracer = std::unique_ptr<RayTracer>(new RayTracer(GTT));
 #else
   ray_tracer = std::unique_ptr<RayTracer>(new RayTracer(GTT.get()));
@@ -86,7 +211,7 @@ DagMC::DagMC(Interface* mb_impl, double overlap_tolerance,
 
   // make new GeomTopoTool and GeomQueryTool
   GTT = std::make_shared<GeomTopoTool>(MBI, false);
-#ifdef DOUBLE_DOWN
+#if defined(DOUBLE_DOWN) || defined(NATIVE_BVH)
   ray_tracer = std::unique_ptr<RayTracer>(new RayTracer(GTT));
 #else
   ray_tracer = std::unique_ptr<RayTracer>(new RayTracer(GTT.get()));
@@ -118,11 +243,17 @@ float DagMC::version(std::string* version_string) {
 ErrorCode DagMC::load_file(const char* cfile) {
   ErrorCode rval;
   std::string filename(cfile);
+  modelFile = filename;
   std::stringstream ss;
   ss << "Loading file " << cfile;
   logger.message(ss.str());
+  loadTimes.clear();
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
   // load options
-  char options[120] = {0};
+  std::string options = loadOptions;
+  const char* env_options = getenv("DAGMC_LOAD_OPTIONS");
+  if (options.empty() && env_options) options = env_options;
   std::string file_ext = "";  // file extension
 
   // get the last 4 chars of file .i.e .h5m .sat etc
@@ -134,7 +265,7 @@ ErrorCode DagMC::load_file(const char* cfile) {
   rval = MBI->create_meshset(MESHSET_SET, file_set);
   if (MB_SUCCESS != rval) return rval;
 
-  rval = MBI->load_file(cfile, &file_set, options, NULL, 0, 0);
+  rval = MBI->load_file(cfile, &file_set, options.c_str(), NULL, 0, 0);
 
   if (MB_UNHANDLED_OPTION == rval) {
     // Some options were unhandled; this is common for loading h5m files.
@@ -154,12 +285,28 @@ ErrorCode DagMC::load_file(const char* cfile) {
 
     return rval;
   }
+  record_load_time("read", start);
 
   return finish_loading();
 }
 
 // helper function to load the existing contents of a MOAB instance into DAGMC
-ErrorCode DagMC::load_existing_contents() { return finish_loading(); }
+ErrorCode DagMC::load_existing_contents() {
+  loadTimes.clear();
+  return finish_loading();
+}
+
+void DagMC::record_load_time(const char* phase,
+                             std::chrono::steady_clock::time_point& start) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - start).count();
+  loadTimes.push_back(std::make_pair(std::string(phase), seconds));
+  start = now;
+
+  std::stringstream ss;
+  ss << "Load phase \"" << phase << "\" took " << seconds << " s";
+  logger.message(ss.str());
+}
 
 // setup the implicit compliment
 ErrorCode DagMC::setup_impl_compl() {
@@ -194,18 +341,117 @@ ErrorCode DagMC::setup_obbs() {
   ErrorCode rval;
 
   // If we havent got an OBB Tree, build one.
-  if (!GTT->have_obb_tree()) {
+#ifdef NATIVE_BVH
+  // OBB trees stored in the file are not used by the native BVH
+  bool have_trees = ray_tracer->has_bvh();
+#else
+  bool have_trees = GTT->have_obb_tree();
+#endif
+  if (!have_trees) {
+#ifdef NATIVE_BVH
+    rval = init_native_bvh();
+#else
     logger.message("Building acceleration data structures...");
 #ifdef DOUBLE_DOWN
     rval = ray_tracer->init();
 #else
     rval = GTT->construct_obb_trees();
+#endif
 #endif
     MB_CHK_SET_ERR(rval, "Failed to build obb trees");
   }
   return MB_SUCCESS;
 }
 
+#ifdef NATIVE_BVH
+// builds the native BVH, or reads it from shared memory or a cache file
+// written for the same facet data
+ErrorCode DagMC::init_native_bvh() {
+  ErrorCode rval;
+  std::string cache_file, shared_name;
+  uint64_t hash = 0;
+  bool have_hash = false, cache_hit = false, cache_file_missing = false,
+       shared_leader = false;
+  const char* env_shared = getenv("DAGMC_SHARED_MEMORY");
+  bool use_shared = useSharedMemory || (env_shared && *env_shared &&
+                                        std::string("0") != env_shared);
+
+  // one process per node builds the BVH, or reads it from the cache file,
+  // and the others map its copy. The segment is keyed on the model file so
+  // that only the leader hashes the facets; a model not read from a file is
+  // keyed on the hash.
+  if (use_shared) {
+    uint64_t key;
+    if (MB_SUCCESS != model_file_key(modelFile, loadOptions, key)) {
+      rval = ray_tracer->geometry_hash(hash);
+      MB_CHK_SET_ERR(rval, "Failed to hash the geometry");
+      have_hash = true;
+      key = hash;
+    }
+    shared_name = shared_bvh_cache_name(key);
+    if (MB_SUCCESS !=
+        ray_tracer->join_shared_cache(shared_name, shared_leader)) {
+      logger.message("Could not open shared memory segment " + shared_name);
+    } else if (!shared_leader) {
+      logger.message(
+          "Reading acceleration data structures from shared memory segment " +
+          shared_name);
+      cache_hit = MB_SUCCESS ==
+                  ray_tracer->load_shared_cache(sharedMemoryWait, hash);
+      have_hash = have_hash || cache_hit;
+      if (!cache_hit)
+        logger.message("Shared memory segment " + shared_name +
+                       " was abandoned or not published in time");
+    }
+  }
+
+  if (!have_hash && ((useBVHCache && !cache_hit) || shared_leader)) {
+    rval = ray_tracer->geometry_hash(hash);
+    MB_CHK_SET_ERR(rval, "Failed to hash the geometry");
+  }
+
+  if (useBVHCache && !cache_hit) {
+    std::string cache_dir = bvhCacheDir;
+    const char* env_dir = getenv("DAGMC_BVH_CACHE_DIR");
+    if (cache_dir.empty() && env_dir) cache_dir = env_dir;
+    cache_file = bvh_cache_filename(modelFile, cache_dir, hash);
+    cache_hit = !cache_file.empty() &&
+                MB_SUCCESS == ray_tracer->load_cache(cache_file, hash);
+    if (cache_hit)
+      logger.message("Reading acceleration data structures from " +
+                     cache_file);
+    else
+      cache_file_missing = !cache_file.empty();
+  }
+
+  if (!cache_hit) logger.message("Building acceleration data structures...");
+  rval = ray_tracer->init();
+  MB_CHK_ERR(rval);
+
+  // a cache that cannot be written (e.g. in a read-only model directory)
+  // only costs the next run a rebuild
+  if (cache_file_missing) {
+    if (MB_SUCCESS == ray_tracer->save_cache(cache_file, hash))
+      logger.message("Wrote acceleration data structures to " + cache_file);
+    else
+      logger.message("Could not write BVH cache file " + cache_file);
+  }
+
+  // a segment that cannot be written (e.g. /dev/shm is full) only costs
+  // the memory of private trees
+  if (shared_leader) {
+    if (MB_SUCCESS == ray_tracer->publish_shared_cache(hash))
+      logger.message("Shared acceleration data structures in memory segment " +
+                     shared_name);
+    else
+      logger.warning("Could not share acceleration data structures in "
+                     "memory segment " +
+                     shared_name + ", using private copies");
+  }
+  return MB_SUCCESS;
+}
+#endif
+
 // setups of the indices for the problem, builds a list of surface and volumes
 // indices
 ErrorCode DagMC::setup_indices() {
@@ -348,6 +594,10 @@ ErrorCode DagMC::remove_graveyard() {
   // delete accumulated entity sets
   rval = moab_instance()->delete_entities(sets_to_delete);
   MB_CHK_SET_ERR(rval, "Failed to delete graveyard entity sets");
+#ifdef NATIVE_BVH
+  // MOAB may reuse the handles of the deleted surfaces
+  ray_tracer->remove_from_compact_mesh(sets_to_delete);
+#endif
 
   // delete accumulated entities
   rval = moab_instance()->delete_entities(ents_to_delete);
@@ -586,6 +836,490 @@ ErrorCode DagMC::create_graveyard(bool overwrite) {
   return rval;
 }
 
+ErrorCode DagMC::insert_volume(EntityHandle volume) {
+  return insert_volumes(std::vector<EntityHandle>(1, volume));
+}
+
+ErrorCode DagMC::insert_volumes(const std::vector<EntityHandle>& volumes) {
+  ErrorCode rval;
+  bool trees_exist = has_acceleration_datastructures();
+
+  // the surfaces of the new volumes, which may be shared between them
+  Range surfs;
+  std::vector<std::pair<EntityHandle, int>> new_sets;
+  for (EntityHandle volume : volumes) {
+    std::vector<EntityHandle> children;
+    rval = MBI->get_child_meshsets(volume, children);
+    MB_CHK_SET_ERR(rval, "Failed to get the surfaces of a new volume");
+    if (children.empty())
+      MB_SET_ERR(MB_FAILURE, "New volume " << volume << " has no surfaces");
+    for (EntityHandle surf : children) {
+      EntityHandle senses[2];
+      rval = MBI->tag_get_data(sense_tag(), &surf, 1, senses);
+      MB_CHK_SET_ERR(rval, "Failed to get the senses of a new surface");
+      if (senses[0] != volume && senses[1] != volume)
+        MB_SET_ERR(MB_FAILURE, "A surface has no sense for new volume "
+                                   << volume);
+      surfs.insert(surf);
+    }
+    if (geom_tool()->dimension(volume) == -1)
+      new_sets.push_back(std::make_pair(volume, 3));
+  }
+  for (EntityHandle surf : surfs) {
+    if (geom_tool()->dimension(surf) == -1)
+      new_sets.push_back(std::make_pair(surf, 2));
+  }
+
+  EntityHandle implicit_complement = 0;
+  rval = geom_tool()->get_implicit_complement(implicit_complement);
+  MB_CHK_SET_ERR(rval, "Could not get the implicit complement");
+
+  // the implicit complement tree is rebuilt with its new surfaces
+  if (trees_exist) {
+    rval = remove_bvh(implicit_complement, true);
+    MB_CHK_SET_ERR(rval, "Failed to delete the implicit complement tree");
+  }
+
+  // tag the new geometry sets
+  for (const auto& new_set : new_sets) {
+    rval = geom_tool()->add_geo_set(new_set.first, new_set.second);
+    MB_CHK_SET_ERR(rval, "Failed to add a new set to the GeomTopoTool");
+    std::string category = 3 == new_set.second ? "Volume" : "Surface";
+    category.resize(CATEGORY_TAG_SIZE);
+    rval = MBI->tag_set_data(category_tag(), &new_set.first, 1,
+                             category.c_str());
+    MB_CHK_SET_ERR(rval, "Failed to set the category of a new set");
+  }
+
+  // the implicit complement takes the open side of each surface and gives
+  // up the sides now taken by the new volumes
+  Range complement_surfs;
+  rval = MBI->get_child_meshsets(implicit_complement, complement_surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get the implicit complement surfaces");
+  for (EntityHandle surf : surfs) {
+    EntityHandle senses[2];
+    rval = MBI->tag_get_data(sense_tag(), &surf, 1, senses);
+    MB_CHK_SET_ERR(rval, "Failed to get the senses of a new surface");
+
+    bool bounds_complement = false;
+    for (int j = 0; j < 2; j++) {
+      if (0 == senses[j]) senses[j] = implicit_complement;
+      if (implicit_complement == senses[j]) bounds_complement = true;
+    }
+    rval = MBI->tag_set_data(sense_tag(), &surf, 1, senses);
+    MB_CHK_SET_ERR(rval, "Failed to set the senses of a new surface");
+
+    bool is_child = complement_surfs.find(surf) != complement_surfs.end();
+    if (bounds_complement && !is_child)
+      rval = MBI->add_parent_child(implicit_complement, surf);
+    else if (!bounds_complement && is_child)
+      rval = MBI->remove_parent_child(implicit_complement, surf);
+    MB_CHK_SET_ERR(rval, "Failed to update the implicit complement surfaces");
+  }
+
+  // update the geometry sets
+  rval = geom_tool()->find_geomsets();
+  MB_CHK_SET_ERR(rval, "Failed to update the geometry sets");
+
+  if (trees_exist) {
+    for (EntityHandle volume : volumes) {
+      rval = build_bvh(volume);
+      MB_CHK_SET_ERR(rval, "Failed to build the tree of a new volume");
+    }
+    rval = build_bvh(implicit_complement);
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the implicit complement tree");
+  }
+
+  rval = setup_indices();
+  MB_CHK_SET_ERR(rval, "Failed to setup indices after inserting volumes");
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::delete_volume(EntityHandle volume) {
+  ErrorCode rval;
+  bool trees_exist = has_acceleration_datastructures();
+
+  if (geom_tool()->dimension(volume) != 3)
+    MB_SET_ERR(MB_FAILURE, "Entity " << volume << " is not a volume");
+  if (is_implicit_complement(volume))
+    MB_SET_ERR(MB_FAILURE, "The implicit complement cannot be deleted");
+
+  EntityHandle implicit_complement = 0;
+  rval = geom_tool()->get_implicit_complement(implicit_complement);
+  MB_CHK_SET_ERR(rval, "Could not get the implicit complement");
+
+  Range surfs;
+  rval = MBI->get_child_meshsets(volume, surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get the surfaces of the volume");
+  rval = check_no_instances(surfs);
+  MB_CHK_ERR(rval);
+
+  // keep the surface trees, some are shared with other volumes
+  if (trees_exist) {
+    rval = remove_bvh(implicit_complement, true);
+    MB_CHK_SET_ERR(rval, "Failed to delete the implicit complement tree");
+    rval = remove_bvh(volume, true);
+    MB_CHK_SET_ERR(rval, "Failed to delete the tree of the volume");
+  }
+
+  // shared surfaces now bound the implicit complement; the others go
+  Range sets_to_delete, surfs_to_delete;
+  sets_to_delete.insert(volume);
+  for (EntityHandle surf : surfs) {
+    EntityHandle senses[2];
+    rval = MBI->tag_get_data(sense_tag(), &surf, 1, senses);
+    MB_CHK_SET_ERR(rval, "Failed to get the senses of a surface");
+    EntityHandle other = senses[0] == volume ? senses[1] : senses[0];
+    if (other && other != volume && other != implicit_complement) {
+      for (int j = 0; j < 2; j++) {
+        if (volume == senses[j]) senses[j] = implicit_complement;
+      }
+      rval = MBI->tag_set_data(sense_tag(), &surf, 1, senses);
+      MB_CHK_SET_ERR(rval, "Failed to set the senses of a shared surface");
+      rval = MBI->add_parent_child(implicit_complement, surf);
+      MB_CHK_SET_ERR(rval, "Failed to add a surface to the complement");
+      continue;
+    }
+
+    surfs_to_delete.insert(surf);
+    if (trees_exist) {
+      rval = remove_bvh(surf);
+      MB_CHK_SET_ERR(rval, "Failed to delete the tree of a surface");
+    }
+  }
+  sets_to_delete.merge(surfs_to_delete);
+
+  // curves and vertex sets go with the last surface using them
+  Range children;
+  for (EntityHandle surf : surfs_to_delete) {
+    rval = MBI->get_child_meshsets(surf, children, -1);
+    MB_CHK_SET_ERR(rval, "Failed to get the child sets of a surface");
+  }
+  for (EntityHandle child : children) {
+    Range parents;
+    rval = MBI->get_parent_meshsets(child, parents);
+    MB_CHK_SET_ERR(rval, "Failed to get the parent sets of a child set");
+    if (subtract(parents, sets_to_delete).empty()) sets_to_delete.insert(child);
+  }
+
+  // the triangles of the deleted surfaces, and the vertices used by no
+  // other triangle
+  Range tris, verts, verts_to_delete;
+  for (EntityHandle surf : surfs_to_delete) {
+    rval = MBI->get_entities_by_type(surf, MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of a surface");
+  }
+  rval = MBI->get_connectivity(tris, verts);
+  MB_CHK_SET_ERR(rval, "Failed to get the vertices of the triangles");
+  for (EntityHandle vert : verts) {
+    Range adj;
+    rval = MBI->get_adjacencies(&vert, 1, 2, false, adj);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of a vertex");
+    if (subtract(adj, tris).empty()) verts_to_delete.insert(vert);
+  }
+  Range edges;
+  rval = MBI->get_adjacencies(verts_to_delete, 1, false, edges,
+                              Interface::UNION);
+  MB_CHK_SET_ERR(rval, "Failed to get the edges of the deleted vertices");
+
+  // the volume leaves its groups
+  for (size_t i = 1; i < group_handles().size(); i++) {
+    rval = MBI->remove_entities(group_handles()[i], &volume, 1);
+    MB_CHK_SET_ERR(rval, "Failed to remove the volume from a group");
+  }
+
+  rval = MBI->delete_entities(sets_to_delete);
+  MB_CHK_SET_ERR(rval, "Failed to delete the volume's sets");
+#ifdef NATIVE_BVH
+  // MOAB may reuse the handles of the deleted surfaces
+  ray_tracer->remove_from_compact_mesh(surfs_to_delete);
+#endif
+  rval = MBI->delete_entities(tris);
+  MB_CHK_SET_ERR(rval, "Failed to delete the volume's triangles");
+  rval = MBI->delete_entities(edges);
+  MB_CHK_SET_ERR(rval, "Failed to delete the volume's edges");
+  rval = MBI->delete_entities(verts_to_delete);
+  MB_CHK_SET_ERR(rval, "Failed to delete the volume's vertices");
+
+  rval = geom_tool()->find_geomsets();
+  MB_CHK_SET_ERR(rval, "Failed to update the geometry sets");
+
+  if (trees_exist) {
+    rval = build_bvh(implicit_complement);
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the implicit complement tree");
+  }
+
+  rval = setup_indices();
+  MB_CHK_SET_ERR(rval, "Failed to setup indices after deleting a volume");
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::transform_volume(EntityHandle volume,
+                                  const double rotation[9],
+                                  const double translation[3]) {
+  ErrorCode rval;
+  bool trees_exist = has_acceleration_datastructures();
+
+  if (!is_proper_rotation(rotation))
+    MB_SET_ERR(MB_FAILURE, "The transform is not a proper rotation");
+
+  if (is_implicit_complement(volume))
+    MB_SET_ERR(MB_FAILURE, "The implicit complement cannot be moved");
+
+  EntityHandle implicit_complement = 0;
+  rval = geom_tool()->get_implicit_complement(implicit_complement);
+  MB_CHK_SET_ERR(rval, "Could not get the implicit complement");
+
+  Range surfs;
+  rval = MBI->get_child_meshsets(volume, surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get the surfaces of the volume");
+  rval = check_no_instances(surfs);
+  MB_CHK_ERR(rval);
+
+  // instance surfaces have no vertices, their transforms are updated
+  Range tris, verts, instance_surfs;
+  for (EntityHandle surf : surfs) {
+    EntityHandle senses[2];
+    rval = MBI->tag_get_data(sense_tag(), &surf, 1, senses);
+    MB_CHK_SET_ERR(rval, "Failed to get the senses of a surface");
+    EntityHandle other = senses[0] == volume ? senses[1] : senses[0];
+    if (other && other != implicit_complement)
+      MB_SET_ERR(MB_FAILURE, "Volume " << get_entity_id(volume)
+                                       << " shares a surface with volume "
+                                       << get_entity_id(other));
+    EntityHandle prototype;
+    rval = get_instance_prototype(surf, prototype);
+    MB_CHK_ERR(rval);
+    if (prototype) {
+      instance_surfs.insert(surf);
+      continue;
+    }
+    rval = MBI->get_entities_by_type(surf, MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of a surface");
+  }
+  rval = MBI->get_connectivity(tris, verts);
+  MB_CHK_SET_ERR(rval, "Failed to get the vertices of the volume");
+  Range adj;
+  rval = MBI->get_adjacencies(verts, 2, false, adj, Interface::UNION);
+  MB_CHK_SET_ERR(rval, "Failed to get the triangles of the vertices");
+  if (!subtract(adj, tris).empty())
+    MB_SET_ERR(MB_FAILURE, "Volume " << get_entity_id(volume)
+                                     << " shares vertices with other volumes");
+
+  // the trees of the volume and its surfaces are rebuilt
+  if (trees_exist) {
+    rval = remove_bvh(implicit_complement, true);
+    MB_CHK_SET_ERR(rval, "Failed to delete the implicit complement tree");
+    rval = remove_bvh(volume);
+    MB_CHK_SET_ERR(rval, "Failed to delete the tree of the volume");
+  }
+#ifdef NATIVE_BVH
+  // read the moved triangles from MOAB
+  ray_tracer->remove_from_compact_mesh(surfs);
+#endif
+
+  std::vector<double> coords(3 * verts.size());
+  rval = MBI->get_coords(verts, coords.data());
+  MB_CHK_SET_ERR(rval, "Failed to get the vertex coordinates");
+  CartVect row0(rotation), row1(rotation + 3), row2(rotation + 6);
+  for (size_t i = 0; i < coords.size(); i += 3) {
+    CartVect x(&coords[i]);
+    coords[i] = row0 % x + translation[0];
+    coords[i + 1] = row1 % x + translation[1];
+    coords[i + 2] = row2 % x + translation[2];
+  }
+  rval = MBI->set_coords(verts, coords.data());
+  MB_CHK_SET_ERR(rval, "Failed to set the vertex coordinates");
+
+#ifdef NATIVE_BVH
+  if (!instance_surfs.empty()) {
+    Tag prototype_tag, transform_tag;
+    rval = NativeRayTracer::get_instance_tags(MBI, prototype_tag,
+                                              transform_tag);
+    MB_CHK_ERR(rval);
+    double motion[12];
+    std::copy(rotation, rotation + 9, motion);
+    std::copy(translation, translation + 3, motion + 9);
+    for (EntityHandle surf : instance_surfs) {
+      double transform[12], moved[12];
+      rval = MBI->tag_get_data(transform_tag, &surf, 1, transform);
+      MB_CHK_SET_ERR(rval, "Failed to get the transform of an instance");
+      compose_transforms(motion, transform, moved);
+      rval = MBI->tag_set_data(transform_tag, &surf, 1, moved);
+      MB_CHK_SET_ERR(rval, "Failed to set the transform of an instance");
+    }
+  }
+#endif
+
+  if (trees_exist) {
+    rval = build_bvh(volume);
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the tree of the volume");
+    rval = build_bvh(implicit_complement);
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the implicit complement tree");
+  }
+
+  // drops the cached bounding boxes and point_in_volume verdicts
+  rval = setup_indices();
+  MB_CHK_SET_ERR(rval, "Failed to setup indices after moving a volume");
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::create_instances(const std::vector<EntityHandle>& volumes,
+                                  const std::vector<double>& transforms,
+                                  std::vector<EntityHandle>& instances) {
+  instances.clear();
+#ifndef NATIVE_BVH
+  MB_SET_ERR(MB_NOT_IMPLEMENTED, "Instances need the native BVH");
+#else
+  ErrorCode rval;
+  if (volumes.empty() || transforms.size() % 12)
+    MB_SET_ERR(MB_FAILURE, "Each copy needs a 12 value transform");
+  for (size_t c = 0; c < transforms.size(); c += 12) {
+    if (!is_proper_rotation(&transforms[c]))
+      MB_SET_ERR(MB_FAILURE, "The transform is not a proper rotation");
+  }
+
+  EntityHandle implicit_complement = 0;
+  rval = geom_tool()->get_implicit_complement(implicit_complement);
+  MB_CHK_SET_ERR(rval, "Could not get the implicit complement");
+
+  std::map<EntityHandle, size_t> volume_index;
+  for (size_t i = 0; i < volumes.size(); i++) {
+    if (geom_tool()->dimension(volumes[i]) != 3 ||
+        volumes[i] == implicit_complement)
+      MB_SET_ERR(MB_FAILURE, "Entity " << volumes[i] << " cannot be copied");
+    volume_index[volumes[i]] = i;
+  }
+
+  // the surfaces may only bound the volumes or the implicit complement
+  Range surfs;
+  for (EntityHandle volume : volumes) {
+    rval = MBI->get_child_meshsets(volume, surfs);
+    MB_CHK_SET_ERR(rval, "Failed to get the surfaces of a volume");
+  }
+  std::vector<EntityHandle> surf_senses(2 * surfs.size());
+  rval = MBI->tag_get_data(sense_tag(), surfs, surf_senses.data());
+  MB_CHK_SET_ERR(rval, "Failed to get the surface senses");
+  for (EntityHandle side : surf_senses) {
+    if (side && side != implicit_complement && !volume_index.count(side))
+      MB_SET_ERR(MB_FAILURE, "A copied surface bounds volume "
+                                 << get_entity_id(side));
+  }
+
+  // copies of instances share the prototypes of the instances
+  Tag prototype_tag, transform_tag;
+  rval = NativeRayTracer::get_instance_tags(MBI, prototype_tag, transform_tag);
+  MB_CHK_ERR(rval);
+  std::vector<EntityHandle> prototypes;
+  std::vector<double> base_transforms(12 * surfs.size(), 0.0);
+  for (EntityHandle surf : surfs) {
+    double* base = &base_transforms[12 * prototypes.size()];
+    EntityHandle prototype;
+    rval = get_instance_prototype(surf, prototype);
+    MB_CHK_ERR(rval);
+    if (prototype) {
+      rval = MBI->tag_get_data(transform_tag, &surf, 1, base);
+      MB_CHK_SET_ERR(rval, "Failed to get the transform of an instance");
+    } else {
+      prototype = surf;
+      base[0] = base[4] = base[8] = 1.0;
+    }
+    prototypes.push_back(prototype);
+  }
+
+  // the groups of each volume
+  std::vector<std::vector<EntityHandle>> volume_groups(volumes.size());
+  for (size_t g = 1; g < group_handles().size(); g++) {
+    for (size_t i = 0; i < volumes.size(); i++) {
+      if (MBI->contains_entities(group_handles()[g], &volumes[i], 1))
+        volume_groups[i].push_back(group_handles()[g]);
+    }
+  }
+
+  for (size_t c = 0; c < transforms.size(); c += 12) {
+    std::vector<EntityHandle> copies(volumes.size());
+    for (size_t i = 0; i < volumes.size(); i++) {
+      rval = MBI->create_meshset(0, copies[i]);
+      MB_CHK_SET_ERR(rval, "Failed to create a volume set");
+      for (EntityHandle group : volume_groups[i]) {
+        rval = MBI->add_entities(group, &copies[i], 1);
+        MB_CHK_SET_ERR(rval, "Failed to add a copy to a group");
+      }
+    }
+
+    for (size_t s = 0; s < prototypes.size(); s++) {
+      EntityHandle surf;
+      rval = MBI->create_meshset(0, surf);
+      MB_CHK_SET_ERR(rval, "Failed to create a surface set");
+      rval = MBI->tag_set_data(prototype_tag, &surf, 1, &prototypes[s]);
+      MB_CHK_SET_ERR(rval, "Failed to set the prototype of an instance");
+      double transform[12];
+      compose_transforms(&transforms[c], &base_transforms[12 * s], transform);
+      rval = MBI->tag_set_data(transform_tag, &surf, 1, transform);
+      MB_CHK_SET_ERR(rval, "Failed to set the transform of an instance");
+
+      // the open sides go to the implicit complement on insertion
+      EntityHandle senses[2] = {0, 0};
+      for (int j = 0; j < 2; j++) {
+        auto it = volume_index.find(surf_senses[2 * s + j]);
+        if (it != volume_index.end()) senses[j] = copies[it->second];
+      }
+      rval = MBI->tag_set_data(sense_tag(), &surf, 1, senses);
+      MB_CHK_SET_ERR(rval, "Failed to set the senses of an instance");
+      for (int j = 0; j < 2; j++) {
+        if (senses[j] && (0 == j || senses[0] != senses[1])) {
+          rval = MBI->add_parent_child(senses[j], surf);
+          MB_CHK_SET_ERR(rval, "Failed to add an instance to its volume");
+        }
+      }
+    }
+    instances.insert(instances.end(), copies.begin(), copies.end());
+  }
+
+  rval = insert_volumes(instances);
+  MB_CHK_SET_ERR(rval, "Failed to insert the copies");
+  return MB_SUCCESS;
+#endif
+}
+
+ErrorCode DagMC::get_instance_prototype(EntityHandle surface,
+                                        EntityHandle& prototype) {
+  prototype = 0;
+#ifdef NATIVE_BVH
+  Tag prototype_tag, transform_tag;
+  if (MB_SUCCESS != NativeRayTracer::get_instance_tags(MBI, prototype_tag,
+                                                       transform_tag, false))
+    return MB_SUCCESS;
+  ErrorCode rval = MBI->tag_get_data(prototype_tag, &surface, 1, &prototype);
+  if (MB_TAG_NOT_FOUND == rval) {
+    prototype = 0;
+    return MB_SUCCESS;
+  }
+  MB_CHK_SET_ERR(rval, "Failed to get the prototype of a surface");
+#endif
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::check_no_instances(const Range& surfs) {
+#ifdef NATIVE_BVH
+  Tag prototype_tag, transform_tag;
+  if (MB_SUCCESS != NativeRayTracer::get_instance_tags(MBI, prototype_tag,
+                                                       transform_tag, false))
+    return MB_SUCCESS;
+  for (EntityHandle surf : surfs) {
+    const void* value[] = {&surf};
+    Range instance_surfs;
+    ErrorCode rval = MBI->get_entities_by_type_and_tag(
+        0, MBENTITYSET, &prototype_tag, value, 1, instance_surfs);
+    MB_CHK_SET_ERR(rval, "Failed to get the instances of a surface");
+    if (!instance_surfs.empty())
+      MB_SET_ERR(MB_FAILURE, "Surface " << get_entity_id(surf)
+                                        << " is the prototype of instances");
+  }
+#endif
+  return MB_SUCCESS;
+}
+
 ErrorCode DagMC::box_to_surf(const double llc[3], const double urc[3],
                              EntityHandle& surface_set) {
   ErrorCode rval;
@@ -671,31 +1405,37 @@ ErrorCode DagMC::box_to_surf(const double llc[3], const double urc[3],
 // initialise the obb tree
 ErrorCode DagMC::init_OBBTree() {
   ErrorCode rval;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
 
   // find all geometry sets
   rval = GTT->find_geomsets();
   MB_CHK_SET_ERR(rval, "GeomTopoTool could not find the geometry sets");
+  record_load_time("geometry sets (init)", start);
 
   // implicit compliment
   rval = setup_impl_compl();
   MB_CHK_SET_ERR(rval, "Failed to setup the implicit compliment");
+  record_load_time("implicit complement", start);
 
   // build obbs
   rval = setup_obbs();
   MB_CHK_SET_ERR(rval, "Failed to setup the OBBs");
+  record_load_time("acceleration data structures", start);
 
   // setup indices
   rval = setup_indices();
   MB_CHK_SET_ERR(rval, "Failed to setup problem indices");
+  record_load_time("indices", start);
 
   return MB_SUCCESS;
 }
 
 ErrorCode DagMC::remove_bvh(EntityHandle volume, bool unjoin_vol) {
   ErrorCode rval = MB_SUCCESS;
-#ifdef DOUBLE_DOWN
+#if defined(DOUBLE_DOWN) || defined(NATIVE_BVH)
   // we don't use unjoin_volume here because
-  // double-down creates a BVH for each volume
+  // double-down and the native BVH create a BVH for each volume
   ray_tracer->deleteBVH(volume);
 #else
   rval = geom_tool()->delete_obb_tree(volume, unjoin_vol);
@@ -708,6 +1448,9 @@ ErrorCode DagMC::build_bvh(EntityHandle volume) {
   ErrorCode rval = MB_SUCCESS;
 #ifdef DOUBLE_DOWN
   ray_tracer->createBVH(volume);
+#elif defined(NATIVE_BVH)
+  rval = ray_tracer->createBVH(volume);
+  MB_CHK_SET_ERR(rval, "Failed to create the bvh for a volume.");
 #else
   rval = geom_tool()->construct_obb_tree(volume);
   MB_CHK_SET_ERR(rval, "Failed to create the bvh for a volume.");
@@ -716,7 +1459,7 @@ ErrorCode DagMC::build_bvh(EntityHandle volume) {
 }
 
 bool DagMC::has_acceleration_datastructures() {
-#ifdef DOUBLE_DOWN
+#if defined(DOUBLE_DOWN) || defined(NATIVE_BVH)
   return ray_tracer->has_bvh();
 #else
   return geom_tool()->have_obb_tree();
@@ -726,6 +1469,8 @@ bool DagMC::has_acceleration_datastructures() {
 // helper function to finish setting up required tags.
 ErrorCode DagMC::finish_loading() {
   ErrorCode rval;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
 
   nameTag = get_tag(NAME_TAG_NAME, NAME_TAG_SIZE, MB_TAG_SPARSE, MB_TYPE_OPAQUE,
                     NULL, false);
@@ -761,11 +1506,13 @@ ErrorCode DagMC::finish_loading() {
   if ((root_tagged || other_set_tagged) && facet_tol_tagvalue > 0) {
     facetingTolerance = facet_tol_tagvalue;
   }
+  record_load_time("faceting tolerance", start);
 
   // initialize ray_tracer
   logger.message("Initializing the GeomQueryTool...");
   rval = GTT->find_geomsets();
   MB_CHK_SET_ERR(rval, "Failed to find the geometry sets");
+  record_load_time("geometry sets (load)", start);
 
   std::stringstream ss;
   ss << "Using faceting tolerance: " << facetingTolerance;
@@ -776,22 +1523,136 @@ ErrorCode DagMC::finish_loading() {
 
 /* SECTION II: Fundamental Geometry Operations/Queries */
 
+bool DagMC::concurrent_queries() {
+#ifdef NATIVE_BVH
+  return true;
+#else
+  return false;
+#endif
+}
+
 ErrorCode DagMC::ray_fire(const EntityHandle volume, const double point[3],
                           const double dir[3], EntityHandle& next_surf,
                           double& next_surf_dist, RayHistory* history,
                           double user_dist_limit, int ray_orientation,
                           OrientedBoxTreeTool::TrvStats* stats) {
-  ErrorCode rval =
-      ray_tracer->ray_fire(volume, point, dir, next_surf, next_surf_dist,
-                           history, user_dist_limit, ray_orientation, stats);
+  QueryCounters::Scope scope(queryCounters, volume, QUERY_RAY_FIRE);
+#if !defined(DOUBLE_DOWN) && !defined(NATIVE_BVH)
+  // MOAB's OBB trees report their traversal through TrvStats
+  OrientedBoxTreeTool::TrvStats trv;
+  if (scope.counts() && !stats) stats = &trv;
+#endif
+  auto tracer_hist = tracer_history(history);
+  ErrorCode rval = ray_tracer->ray_fire(volume, point, dir, next_surf,
+                                        next_surf_dist, tracer_hist,
+                                        user_dist_limit, ray_orientation,
+                                        stats);
+  copy_back(tracer_hist, history);
+#if !defined(DOUBLE_DOWN) && !defined(NATIVE_BVH)
+  if (scope.counts() && stats) add_trv_stats(*stats, *scope.counts());
+#endif
+  if (MB_SUCCESS == rval) scope.set_surface(next_surf);
   return rval;
 }
 
+ErrorCode DagMC::ray_fire_batch(const EntityHandle volume, int n_rays,
+                                const double* origins, const double* dirs,
+                                EntityHandle* next_surfs,
+                                double* next_surf_dists, RayHistory* histories,
+                                const double* dist_limits,
+                                int ray_orientation) {
+  if (n_rays < 0 || (n_rays > 0 && (!origins || !dirs || !next_surfs ||
+                                    !next_surf_dists))) {
+    MB_CHK_SET_ERR(MB_FAILURE, "Invalid ray packet passed to ray_fire_batch");
+  }
+
+  QueryCounters::Scope scope(queryCounters, volume, QUERY_RAY_FIRE);
+  scope.set_calls(n_rays);
+#if defined(NATIVE_BVH) && !defined(DOUBLE_DOWN)
+  // the rays of each packet share one traversal
+  ErrorCode rval = ray_tracer->ray_fire_packet(
+      volume, n_rays, origins, dirs, next_surfs, next_surf_dists, histories,
+      dist_limits, ray_orientation);
+  MB_CHK_SET_ERR(rval, "Failed to fire a packet of rays");
+#else
+  OrientedBoxTreeTool::TrvStats trv, *stats = NULL;
+#ifndef DOUBLE_DOWN
+  // MOAB's OBB trees report the traversal of all the rays through TrvStats
+  if (scope.counts()) stats = &trv;
+#endif
+  // gather each ray out of the SoA packet and fire it, stopping on the
+  // first failure so the caller can tell which ray was bad
+  for (int i = 0; i < n_rays; i++) {
+    double point[3] = {origins[i], origins[n_rays + i],
+                       origins[2 * n_rays + i]};
+    double dir[3] = {dirs[i], dirs[n_rays + i], dirs[2 * n_rays + i]};
+    RayHistory* history = histories ? &histories[i] : NULL;
+    auto tracer_hist = tracer_history(history);
+    ErrorCode rval = ray_tracer->ray_fire(
+        volume, point, dir, next_surfs[i], next_surf_dists[i], tracer_hist,
+        dist_limits ? dist_limits[i] : 0, ray_orientation, stats);
+    copy_back(tracer_hist, history);
+    MB_CHK_SET_ERR(rval, "Failed to fire ray " << i << " of packet");
+  }
+#ifndef DOUBLE_DOWN
+  if (stats) add_trv_stats(*stats, *scope.counts());
+#endif
+#endif
+
+  if (scope.counts()) {
+    for (int i = 0; i < n_rays; i++) {
+      if (next_surfs[i]) scope.add_packet_surface(next_surfs[i]);
+    }
+  }
+  return MB_SUCCESS;
+}
+
 ErrorCode DagMC::point_in_volume(const EntityHandle volume, const double xyz[3],
                                  int& result, const double* uvw,
                                  const RayHistory* history) {
-  ErrorCode rval =
-      ray_tracer->point_in_volume(volume, xyz, result, uvw, history);
+  QueryCounters::Scope scope(queryCounters, volume, QUERY_POINT_IN_VOLUME);
+
+#ifndef NATIVE_BVH
+  // a point outside the volume's box is outside the volume; the native ray
+  // tracer rejects such points itself
+  if (!pointBoxes.empty() && volume >= setOffset &&
+      volume - setOffset < entIndices.size()) {
+    size_t index = entIndices[volume - setOffset];
+    if (index < pointBoxes.size() && vol_handles()[index] == volume) {
+      const BVHBox& box = pointBoxes[index];
+      for (int i = 0; i < 3; i++) {
+        if (xyz[i] < box.lo[i] || xyz[i] > box.hi[i]) {
+          result = 0;
+          return MB_SUCCESS;
+        }
+      }
+    }
+  }
+#endif
+
+  // the history changes which facets the rays may hit, so only queries
+  // without one are cached
+  PointVerdict* verdict = NULL;
+  if (usePointCache && !history) {
+    verdict = &point_cache_slot(volume, xyz);
+    if (verdict->matches(pointCacheGeneration, volume, xyz, uvw)) {
+      result = verdict->result;
+      return MB_SUCCESS;
+    }
+  }
+
+  ErrorCode rval = ray_tracer->point_in_volume(volume, xyz, result, uvw,
+                                               tracer_history(history));
+  if (verdict && MB_SUCCESS == rval) {
+    verdict->generation = pointCacheGeneration;
+    verdict->volume = volume;
+    for (int i = 0; i < 3; i++) {
+      verdict->xyz[i] = xyz[i];
+      verdict->uvw[i] = uvw ? uvw[i] : 0.0;
+    }
+    verdict->has_uvw = uvw != NULL;
+    verdict->result = result;
+  }
   return rval;
 }
 
@@ -799,8 +1660,12 @@ ErrorCode DagMC::test_volume_boundary(const EntityHandle volume,
                                       const EntityHandle surface,
                                       const double xyz[3], const double uvw[3],
                                       int& result, const RayHistory* history) {
+  QueryCounters::Scope scope(queryCounters, volume,
+                             QUERY_TEST_VOLUME_BOUNDARY);
+  scope.set_surface(surface);
   ErrorCode rval = ray_tracer->test_volume_boundary(volume, surface, xyz, uvw,
-                                                    result, history);
+                                                    result,
+                                                    tracer_history(history));
   return rval;
 }
 
@@ -815,23 +1680,187 @@ ErrorCode DagMC::point_in_volume_slow(EntityHandle volume, const double xyz[3],
 ErrorCode DagMC::closest_to_location(EntityHandle volume,
                                      const double coords[3], double& result,
                                      EntityHandle* surface) {
+  QueryCounters::Scope scope(queryCounters, volume,
+                             QUERY_CLOSEST_TO_LOCATION);
+  // the closest surface is needed to count the query on it
+  EntityHandle closest = 0;
+  if (scope.counts() && !surface) surface = &closest;
   ErrorCode rval =
       ray_tracer->closest_to_location(volume, coords, result, surface);
+  if (MB_SUCCESS == rval && surface) scope.set_surface(*surface);
   return rval;
 }
 
+ErrorCode DagMC::safety_distance(EntityHandle volume, const double xyz[3],
+                                 double& result, bool lower_bound_ok) {
+#ifdef NATIVE_BVH
+  if (lower_bound_ok) {
+    QueryCounters::Scope scope(queryCounters, volume,
+                               QUERY_SAFETY_LOWER_BOUND);
+    return ray_tracer->safety_distance(volume, xyz, result);
+  }
+#endif
+  return closest_to_location(volume, xyz, result);
+}
+
 // calculate volume of polyhedron
 ErrorCode DagMC::measure_volume(EntityHandle volume, double& result) {
+  if (cached_measure(3, volume, result)) return MB_SUCCESS;
   ErrorCode rval = ray_tracer->measure_volume(volume, result);
   return rval;
 }
 
 // sum area of elements in surface
 ErrorCode DagMC::measure_area(EntityHandle surface, double& result) {
+  if (cached_measure(2, surface, result)) return MB_SUCCESS;
   ErrorCode rval = ray_tracer->measure_area(surface, result);
   return rval;
 }
 
+ErrorCode DagMC::measure_all() {
+  int n_surfs = num_entities(2);
+  int n_vols = num_entities(3);
+  if (surfVolIndices.size() != 2 * (size_t)(n_surfs + 1))
+    MB_SET_ERR(MB_FAILURE, "Indices not set up, call setup_indices first");
+
+  // the area of each surface, the signed volume beneath it (x 6.0) and a
+  // hash of its facet handles and coordinates, which tells stored measures
+  // of this geometry from stale ones; MOAB is not thread safe, so only the
+  // sums and hashes run concurrently
+  std::vector<double> areas(n_surfs + 1, 0.0), sums(n_surfs + 1, 0.0);
+  std::vector<uint64_t> hashes[4];
+  hashes[2].assign(n_surfs + 1, 0);
+  std::mutex moab_mutex;
+  int n_threads = resolve_num_threads(numThreads);
+  ErrorCode rval = parallel_for(n_surfs, n_threads, [&](size_t k) {
+    int i = k + 1;
+    EntityHandle surf = entity_by_index(2, i);
+    std::vector<double> coords;
+    std::vector<EntityHandle> handles;
+    {
+      std::lock_guard<std::mutex> lock(moab_mutex);
+      ErrorCode result = get_surface_triangles(surf, coords, handles);
+      if (MB_SUCCESS != result) return result;
+    }
+    GeometryHash geom_hash;
+    geom_hash.add((uint64_t)surf);
+    geom_hash.add((uint64_t)handles.size());
+    for (size_t j = 0; j < handles.size(); j++)
+      geom_hash.add((uint64_t)handles[j]);
+    for (size_t j = 0; j < coords.size(); j++) geom_hash.add(coords[j]);
+    hashes[2][i] = geom_hash.value();
+    double area = 0.0, sum = 0.0;
+    for (size_t j = 0; j < coords.size(); j += 9) {
+      const double* c = &coords[j];
+      double a[3] = {c[3] - c[0], c[4] - c[1], c[5] - c[2]};
+      double b[3] = {c[6] - c[0], c[7] - c[1], c[8] - c[2]};
+      double normal[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+                          a[0] * b[1] - a[1] * b[0]};
+      area += sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                   normal[2] * normal[2]);
+      sum += c[0] * normal[0] + c[1] * normal[1] + c[2] * normal[2];
+    }
+    areas[i] = 0.5 * area;
+    sums[i] = sum;
+    return MB_SUCCESS;
+  });
+  MB_CHK_SET_ERR(rval, "Failed to measure the surfaces");
+
+  // a volume's hash is that of its surfaces and their senses
+  std::vector<double> volumes(n_vols + 1, 0.0);
+  std::vector<GeometryHash> vol_hashes(n_vols + 1);
+  for (int i = 1; i <= n_surfs; i++) {
+    const int* sides = &surfVolIndices[2 * i];
+    // like measure_volume, skip surfaces with the volume on both sides
+    if (sides[0] == sides[1]) continue;
+    volumes[sides[0]] += sums[i];
+    volumes[sides[1]] -= sums[i];
+    for (int j = 0; j < 2; j++) {
+      vol_hashes[sides[j]].add(hashes[2][i]);
+      vol_hashes[sides[j]].add((uint64_t)j);
+    }
+  }
+  // entry 0 collected the surfaces with no volume on one side
+  volumes[0] = 0.0;
+  for (int i = 1; i <= n_vols; i++) volumes[i] /= 6.0;
+  hashes[3].resize(n_vols + 1);
+  for (int i = 0; i <= n_vols; i++) hashes[3][i] = vol_hashes[i].value();
+
+  Tag tag, hash_tag;
+  rval = MBI->tag_get_handle("DAGMC_MEASURE", 1, MB_TYPE_DOUBLE, tag,
+                             MB_TAG_SPARSE | MB_TAG_CREAT);
+  MB_CHK_SET_ERR(rval, "Failed to get the DAGMC_MEASURE tag");
+  rval = MBI->tag_get_handle("DAGMC_MEASURE_HASH", sizeof(uint64_t),
+                             MB_TYPE_OPAQUE, hash_tag,
+                             MB_TAG_SPARSE | MB_TAG_CREAT);
+  MB_CHK_SET_ERR(rval, "Failed to get the DAGMC_MEASURE_HASH tag");
+
+  // keep the stored measure of each set whose hash still matches, so that
+  // measures stored with the model are used as long as its facets are
+  // unchanged
+  entMeasures[2] = areas;
+  entMeasures[3] = volumes;
+  for (int dim = 2; dim <= 3; dim++) {
+    int n = num_entities(dim);
+    if (0 == n) continue;
+    std::vector<double> stored(n);
+    std::vector<uint64_t> stored_hashes(n);
+    // fails if any set has no measure
+    if (MB_SUCCESS == MBI->tag_get_data(tag, &entHandles[dim][1], n,
+                                        stored.data()) &&
+        MB_SUCCESS == MBI->tag_get_data(hash_tag, &entHandles[dim][1], n,
+                                        stored_hashes.data())) {
+      for (int i = 0; i < n; i++) {
+        if (stored_hashes[i] == hashes[dim][i + 1])
+          entMeasures[dim][i + 1] = stored[i];
+      }
+    }
+    rval = MBI->tag_set_data(tag, &entHandles[dim][1], n,
+                             &entMeasures[dim][1]);
+    MB_CHK_SET_ERR(rval, "Failed to set the DAGMC_MEASURE tags");
+    rval = MBI->tag_set_data(hash_tag, &entHandles[dim][1], n,
+                             &hashes[dim][1]);
+    MB_CHK_SET_ERR(rval, "Failed to set the DAGMC_MEASURE_HASH tags");
+  }
+  return MB_SUCCESS;
+}
+
+bool DagMC::cached_measure(int dimension, EntityHandle set,
+                           double& result) const {
+  const std::vector<double>& measures = entMeasures[dimension];
+  if (measures.empty() || set < setOffset ||
+      set - setOffset >= entIndices.size())
+    return false;
+  int index = entIndices[set - setOffset];
+  if (index < 1 || (size_t)index >= measures.size() ||
+      entHandles[dimension][index] != set)
+    return false;
+  result = measures[index];
+  return true;
+}
+
+ErrorCode DagMC::get_surface_triangles(EntityHandle surface,
+                                       std::vector<double>& coords,
+                                       std::vector<EntityHandle>& handles) {
+#ifdef NATIVE_BVH
+  // the facets may only be in the compact mesh
+  return ray_tracer->get_surface_triangles(surface, coords, handles);
+#else
+  Range tris;
+  ErrorCode rval = MBI->get_entities_by_type(surface, MBTRI, tris);
+  MB_CHK_SET_ERR(rval, "Failed to get the triangles of surface " << surface);
+  handles.assign(tris.begin(), tris.end());
+  std::vector<EntityHandle> conn;
+  rval = MBI->get_connectivity(tris, conn, true);
+  MB_CHK_SET_ERR(rval, "Failed to get the vertices of surface " << surface);
+  coords.resize(3 * conn.size());
+  if (conn.empty()) return MB_SUCCESS;
+  rval = MBI->get_coords(conn.data(), conn.size(), coords.data());
+  MB_CHK_SET_ERR(rval, "Failed to get the coordinates of " << surface);
+  return MB_SUCCESS;
+#endif
+}
+
 // get sense of surface(s) wrt volume
 ErrorCode DagMC::surface_sense(EntityHandle volume, int num_surfaces,
                                const EntityHandle* surfaces, int* senses_out) {
@@ -849,7 +1878,8 @@ ErrorCode DagMC::surface_sense(EntityHandle volume, EntityHandle surface,
 
 ErrorCode DagMC::get_angle(EntityHandle surf, const double in_pt[3],
                            double angle[3], const RayHistory* history) {
-  ErrorCode rval = ray_tracer->get_normal(surf, in_pt, angle, history);
+  ErrorCode rval =
+      ray_tracer->get_normal(surf, in_pt, angle, tracer_history(history));
   return rval;
 }
 
@@ -859,6 +1889,94 @@ ErrorCode DagMC::next_vol(EntityHandle surface, EntityHandle old_volume,
   return rval;
 }
 
+ErrorCode DagMC::next_vol_by_index(int surface, int old_volume,
+                                   int& new_volume) {
+  if (surface < 1 || 2 * (size_t)surface + 1 >= surfVolIndices.size())
+    MB_SET_ERR(MB_INDEX_OUT_OF_RANGE, "Bad surface index " << surface);
+  const int* sides = &surfVolIndices[2 * surface];
+  if (sides[0] == old_volume) {
+    new_volume = sides[1];
+  } else if (sides[1] == old_volume) {
+    new_volume = sides[0];
+  } else {
+    MB_SET_ERR(MB_FAILURE, "Volume " << old_volume << " is not adjacent to "
+                                     << "surface " << surface);
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::surface_sense_by_index(int volume, int surface,
+                                        int& sense_out) {
+  if (surface < 1 || 2 * (size_t)surface + 1 >= surfVolIndices.size())
+    MB_SET_ERR(MB_INDEX_OUT_OF_RANGE, "Bad surface index " << surface);
+  const int* sides = &surfVolIndices[2 * surface];
+  if (sides[0] == volume && sides[1] == volume) {
+    sense_out = 0;
+  } else if (sides[0] == volume) {
+    sense_out = 1;
+  } else if (sides[1] == volume) {
+    sense_out = -1;
+  } else {
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "Volume " << volume << " is not adjacent "
+                                              << "to surface " << surface);
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::find_volume(const double xyz[3], EntityHandle& volume,
+                             const double* uvw) {
+  volume = 0;
+
+  // indices of the volumes whose boxes contain the point, in index order
+  std::vector<int> candidates;
+  if (volumeIndexNodes.empty() && !volumeIndexComplement) {
+    for (int i = 1; i <= (int)num_entities(3); i++) candidates.push_back(i);
+  } else {
+    int stack[BVH_MAX_DEPTH + 1];
+    int sp = 0;
+    // a model of just the implicit complement has an empty tree
+    if (!volumeIndexNodes.empty()) stack[sp++] = 0;
+    while (sp > 0) {
+      int idx = stack[--sp];
+      const BVHNode& node = volumeIndexNodes[idx];
+      if (point_box_dist_sqr(node, xyz) > 0.0) continue;
+      if (node.is_leaf()) {
+        for (int i = node.first; i < node.first + node.count; i++)
+          candidates.push_back(volumeIndexOrder[i] + 1);
+      } else {
+        stack[sp++] = node.first;
+        stack[sp++] = idx + 1;
+      }
+    }
+    if (volumeIndexComplement) candidates.push_back(volumeIndexComplement);
+    std::sort(candidates.begin(), candidates.end());
+  }
+
+  for (int index : candidates) {
+    EntityHandle vol = entity_by_index(3, index);
+    int result;
+    ErrorCode rval = point_in_volume(vol, xyz, result, uvw);
+    MB_CHK_SET_ERR(rval, "Failed in point_in_volume");
+    if (1 != result) continue;
+
+    if (uvw) {
+      // confirm with a ray in the opposite direction, then the slow test
+      double reverse[3] = {-uvw[0], -uvw[1], -uvw[2]};
+      rval = point_in_volume(vol, xyz, result, reverse);
+      MB_CHK_SET_ERR(rval, "Failed in point_in_volume");
+      if (1 != result) {
+        queryCounters.add_retry(vol, QUERY_POINT_IN_VOLUME);
+        rval = point_in_volume_slow(vol, xyz, result);
+        MB_CHK_SET_ERR(rval, "Failed in point_in_volume_slow");
+        if (1 != result) continue;
+      }
+    }
+    volume = vol;
+    return MB_SUCCESS;
+  }
+  return MB_SUCCESS;
+}
+
 /* SECTION III: Indexing & Cross-referencing */
 
 EntityHandle DagMC::entity_by_id(int dimension, int id) {
@@ -866,6 +1984,10 @@ EntityHandle DagMC::entity_by_id(int dimension, int id) {
 }
 
 int DagMC::id_by_index(int dimension, int index) {
+  if ((2 == dimension || 3 == dimension) && index >= 0 &&
+      (size_t)index < entIds[dimension].size())
+    return entIds[dimension][index];
+
   EntityHandle h = entity_by_index(dimension, index);
   if (!h) return 0;
 
@@ -926,6 +2048,92 @@ ErrorCode DagMC::build_indices(Range& surfs, Range& vols) {
   group_handles()[0] = 0;
   std::copy(groups.begin(), groups.end(), &group_handles()[1]);
 
+  // cache the global IDs; index 0 has ID 0
+  for (int dim = 2; dim <= 3; dim++) {
+    entIds[dim].assign(entHandles[dim].size(), 0);
+    for (size_t i = 1; i < entHandles[dim].size(); i++)
+      MBI->tag_get_data(GTT->get_gid_tag(), &entHandles[dim][i], 1,
+                        &entIds[dim][i]);
+  }
+
+  rval = build_surface_neighbors();
+  MB_CHK_SET_ERR(rval, "Failed to build the surface neighbor table");
+  entMeasures[2].clear();
+  entMeasures[3].clear();
+
+  invalidate_point_cache();
+  return build_volume_index();
+}
+
+ErrorCode DagMC::build_surface_neighbors() {
+  int n_surfs = num_entities(2);
+  surfVolIndices.assign(2 * (n_surfs + 1), 0);
+  for (int i = 1; i <= n_surfs; i++) {
+    EntityHandle sides[2] = {0, 0};
+    ErrorCode rval =
+        GTT->get_surface_senses(entity_by_index(2, i), sides[0], sides[1]);
+    // a surface without sense data has no volume on either side
+    if (MB_SUCCESS != rval) continue;
+    for (int j = 0; j < 2; j++) {
+      // volumes outside the indexed range (none, or not yet indexed) are 0
+      if (sides[j] < setOffset || sides[j] - setOffset >= entIndices.size())
+        continue;
+      int index = entIndices[sides[j] - setOffset];
+      if ((size_t)index < vol_handles().size() &&
+          vol_handles()[index] == sides[j])
+        surfVolIndices[2 * i + j] = index;
+    }
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::build_volume_index() {
+  volumeIndexNodes.clear();
+  volumeIndexOrder.clear();
+  volumeIndexComplement = 0;
+  pointBoxes.clear();
+  if (!has_acceleration_datastructures()) return MB_SUCCESS;
+
+  // the implicit complement is everything outside the other volumes, so it
+  // has no box, find_volume always tests it and its box rejects nothing
+  int n_vols = num_entities(3);
+  std::vector<BVHBox> boxes;
+  std::vector<int> indices;
+  double inf = std::numeric_limits<double>::infinity();
+  double all_lo[3] = {-inf, -inf, -inf}, all_hi[3] = {inf, inf, inf};
+  pointBoxes.resize(n_vols + 1);
+  for (int i = 0; i < n_vols; i++) {
+    EntityHandle vol = entity_by_index(3, i + 1);
+    if (is_implicit_complement(vol)) {
+      volumeIndexComplement = i + 1;
+      pointBoxes[i + 1].extend(all_lo);
+      pointBoxes[i + 1].extend(all_hi);
+      continue;
+    }
+    double lo[3], hi[3];
+    if (MB_SUCCESS != getobb(vol, lo, hi)) {
+      // without every box find_volume falls back to testing all volumes
+      logger.message("Not building the volume index, a volume has no box");
+      volumeIndexComplement = 0;
+      pointBoxes.clear();
+      return MB_SUCCESS;
+    }
+    // pad so that points on a face of a box are never missed
+    for (int k = 0; k < 3; k++) {
+      lo[k] -= numerical_precision();
+      hi[k] += numerical_precision();
+    }
+    boxes.push_back(BVHBox());
+    boxes.back().extend(lo);
+    boxes.back().extend(hi);
+    pointBoxes[i + 1] = boxes.back();
+    indices.push_back(i);
+  }
+
+  // a few volumes per leaf, their point_in_volume calls dominate anyway
+  moab::build_bvh(boxes, 1, 4, volumeIndexNodes, volumeIndexOrder);
+  for (size_t i = 0; i < volumeIndexOrder.size(); i++)
+    volumeIndexOrder[i] = indices[volumeIndexOrder[i]];
   return MB_SUCCESS;
 }
 
@@ -958,10 +2166,159 @@ double DagMC::numerical_precision() {
 
 void DagMC::set_overlap_thickness(double new_thickness) {
   ray_tracer->set_overlap_thickness(new_thickness);
+  invalidate_point_cache();
 }
 
 void DagMC::set_numerical_precision(double new_precision) {
   ray_tracer->set_numerical_precision(new_precision);
+  invalidate_point_cache();
+}
+
+void DagMC::set_bvh_cache(bool use_cache, const std::string& cache_dir) {
+  useBVHCache = use_cache;
+  bvhCacheDir = cache_dir;
+}
+
+void DagMC::set_num_threads(int n_threads) {
+  numThreads = n_threads;
+#ifdef NATIVE_BVH
+  ray_tracer->set_num_threads(n_threads);
+#endif
+}
+
+void DagMC::set_mixed_precision(bool mixed) {
+#ifdef NATIVE_BVH
+  ray_tracer->set_precision(mixed ? BVH_MIXED : BVH_DOUBLE);
+#endif
+}
+
+void DagMC::set_compact_mesh(bool compact) {
+#ifdef NATIVE_BVH
+  ray_tracer->set_compact_mesh(compact);
+#endif
+}
+
+void DagMC::set_shared_memory(bool shared, double max_wait) {
+  useSharedMemory = shared;
+  sharedMemoryWait = max_wait;
+}
+
+void DagMC::set_point_cache(bool use_cache) { usePointCache = use_cache; }
+
+void DagMC::invalidate_point_cache() {
+  pointCacheGeneration = next_point_cache_generation++;
+}
+
+void DagMC::set_query_counters(bool enable) { queryCounters.enable(enable); }
+
+ErrorCode DagMC::write_query_counters(const std::string& filename) {
+  std::ofstream out(filename.c_str());
+  queryCounters.write_csv(
+      out, [this](EntityHandle vol) { return get_entity_id(vol); });
+  if (!out) MB_SET_ERR(MB_FAILURE, "Failed to write " << filename);
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::tag_query_costs(bool tag_facets) {
+  static const char* names[4] = {"DAGMC_QUERY_CALLS", "DAGMC_QUERY_SECONDS",
+                                 "DAGMC_QUERY_NODES",
+                                 "DAGMC_QUERY_TRIANGLES"};
+  Tag tags[4];
+  double zero = 0.0;
+  for (int i = 0; i < 4; i++) {
+    ErrorCode rval = MBI->tag_get_handle(names[i], 1, MB_TYPE_DOUBLE, tags[i],
+                                         MB_TAG_DENSE | MB_TAG_CREAT, &zero);
+    MB_CHK_SET_ERR(rval, "Failed to get the " << names[i] << " tag");
+  }
+
+  std::map<EntityHandle, QueryCounters::VolumeStats> stats[2];
+  queryCounters.collect(stats[0]);
+  queryCounters.collect_surfaces(stats[1]);
+
+  std::vector<double> facet_values;
+  for (int dim = 3; dim >= 2; dim--) {
+    const std::map<EntityHandle, QueryCounters::VolumeStats>& by_set =
+        stats[3 - dim];
+    for (int i = 1; i <= (int)num_entities(dim); i++) {
+      EntityHandle set = entity_by_index(dim, i);
+      // summed over the query types
+      QueryStats total;
+      auto it = by_set.find(set);
+      if (it != by_set.end()) {
+        for (const QueryStats& type_stats : it->second) total.add(type_stats);
+      }
+      double values[4] = {(double)total.calls, total.seconds,
+                          (double)total.counts.nodes_visited,
+                          (double)total.counts.triangles_tested};
+      for (int j = 0; j < 4; j++) {
+        ErrorCode rval = MBI->tag_set_data(tags[j], &set, 1, &values[j]);
+        MB_CHK_SET_ERR(rval, "Failed to set the " << names[j] << " tag");
+      }
+      if (2 != dim || !tag_facets) continue;
+
+      // the triangles of a surface show its cost in visualization tools
+      Range tris;
+      ErrorCode rval = MBI->get_entities_by_type(set, MBTRI, tris);
+      MB_CHK_SET_ERR(rval, "Failed to get the triangles of surface " << i);
+      if (tris.empty()) continue;
+      for (int j = 0; j < 4; j++) {
+        facet_values.assign(tris.size(), values[j]);
+        rval = MBI->tag_set_data(tags[j], tris, facet_values.data());
+        MB_CHK_SET_ERR(rval, "Failed to set the " << names[j] << " tag");
+      }
+    }
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::release_facet_data() {
+#ifdef NATIVE_BVH
+  const CompactMesh& mesh = ray_tracer->get_compact_mesh();
+  if (0 == mesh.num_surfaces())
+    MB_SET_ERR(MB_FAILURE, "No compact mesh, call set_compact_mesh(true) "
+                               << "before init_OBBTree");
+
+  Range surfs;
+  ErrorCode rval = GTT->get_gsets_by_dimension(2, surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get surfaces");
+
+  // the compacted surfaces, and the curves and vertex sets below them
+  Range sets;
+  for (auto surf : surfs) {
+    if (!mesh.has_surface(surf)) continue;
+    sets.insert(surf);
+    Range children;
+    rval = MBI->get_child_meshsets(surf, children, -1);
+    MB_CHK_SET_ERR(rval, "Failed to get the curves of surface " << surf);
+    sets.merge(children);
+  }
+
+  Range tris, edges, verts;
+  for (auto set : sets) {
+    rval = MBI->get_entities_by_type(set, MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of set " << set);
+    rval = MBI->get_entities_by_type(set, MBEDGE, edges);
+    MB_CHK_SET_ERR(rval, "Failed to get the edges of set " << set);
+    rval = MBI->get_entities_by_type(set, MBVERTEX, verts);
+    MB_CHK_SET_ERR(rval, "Failed to get the vertices of set " << set);
+  }
+
+  // empty the sets, keeping their tags, parents and children
+  rval = MBI->clear_meshset(sets);
+  MB_CHK_SET_ERR(rval, "Failed to clear the geometry sets");
+
+  rval = MBI->delete_entities(tris);
+  MB_CHK_SET_ERR(rval, "Failed to delete triangles");
+  rval = MBI->delete_entities(edges);
+  MB_CHK_SET_ERR(rval, "Failed to delete edges");
+  // delete vertices last
+  rval = MBI->delete_entities(verts);
+  MB_CHK_SET_ERR(rval, "Failed to delete vertices");
+  return MB_SUCCESS;
+#else
+  MB_SET_ERR(MB_NOT_IMPLEMENTED,
+             "Releasing the facet data requires the native BVH");
+#endif
 }
 
 ErrorCode DagMC::write_mesh(const char* ffile, const int flen) {
@@ -1036,37 +2393,50 @@ ErrorCode DagMC::detect_available_props(std::vector<std::string>& keywords_list,
   return MB_SUCCESS;
 }
 
-ErrorCode DagMC::append_packed_string(Tag tag, EntityHandle eh,
-                                      std::string& new_string) {
+ErrorCode DagMC::append_packed_strings(
+    Tag tag, const std::map<EntityHandle, std::string>& packed) {
   // When properties have multiple values, the values are tagged in a single
   // character array with the different values separated by null characters
   ErrorCode rval;
-  const void* p;
-  const char* str;
-  int len;
-  rval = MBI->tag_get_by_ptr(tag, &eh, 1, &p, &len);
-  if (rval == MB_TAG_NOT_FOUND) {
-    // This is the first entry, and can be set directly
-    p = new_string.c_str();
-    return MBI->tag_clear_data(tag, &eh, 1, p, new_string.length() + 1);
-  } else if (rval != MB_SUCCESS)
-    return rval;
-  else {
-    str = static_cast<const char*>(p);
-  }
+  if (packed.empty()) return MB_SUCCESS;
 
-  // append a new value for the property to the existing property string
-  unsigned int tail_len = new_string.length() + null_delimiter_length;
-  int new_len = tail_len + len;
+  // values already on an entity, e.g. from an earlier parse_properties,
+  // stay in front of the new ones
+  Range tagged;
+  rval = MBI->get_entities_by_type_and_tag(0, MBENTITYSET, &tag, NULL, 1,
+                                           tagged);
+  if (MB_SUCCESS != rval) return rval;
 
-  char* new_packed_string = new char[new_len];
-  memcpy(new_packed_string, str, len);
-  memcpy(new_packed_string + len, new_string.c_str(), tail_len);
+  std::vector<EntityHandle> handles;
+  std::vector<const void*> data;
+  std::vector<int> lengths;
+  // reserved so that the pointers to the merged strings stay valid
+  std::vector<std::string> merged;
+  handles.reserve(packed.size());
+  data.reserve(packed.size());
+  lengths.reserve(packed.size());
+  merged.reserve(std::min(packed.size(), tagged.size()));
+  for (const auto& entry : packed) {
+    EntityHandle eh = entry.first;
+    handles.push_back(eh);
+    if (tagged.find(eh) == tagged.end()) {
+      data.push_back(entry.second.data());
+      lengths.push_back(entry.second.length());
+      continue;
+    }
 
-  p = new_packed_string;
-  rval = MBI->tag_set_by_ptr(tag, &eh, 1, &p, &new_len);
-  delete[] new_packed_string;
-  return rval;
+    const void* p;
+    int len;
+    rval = MBI->tag_get_by_ptr(tag, &eh, 1, &p, &len);
+    if (MB_SUCCESS != rval) return rval;
+    merged.push_back(std::string(static_cast<const char*>(p), len));
+    merged.back() += entry.second;
+    data.push_back(merged.back().data());
+    lengths.push_back(merged.back().length());
+  }
+
+  return MBI->tag_set_by_ptr(tag, handles.data(), handles.size(), data.data(),
+                             lengths.data());
 }
 
 ErrorCode DagMC::unpack_packed_string(Tag tag, EntityHandle eh,
@@ -1122,6 +2492,10 @@ ErrorCode DagMC::parse_properties(
     property_tagmap[(*i)] = new_tag;
   }
 
+  // the new values of each property tag on each entity, packed as they are
+  // stored, so that every tag is written once after all groups are parsed
+  std::map<Tag, std::map<EntityHandle, std::string>> assignments;
+
   // now that the keywords and tags are ready, iterate over all the actual
   // geometry groups
   for (std::vector<EntityHandle>::iterator grp = group_handles().begin();
@@ -1143,16 +2517,22 @@ ErrorCode DagMC::parse_properties(
       std::string groupkey = (*i).first;
       std::string groupval = (*i).second;
 
-      if (property_tagmap.find(groupkey) != property_tagmap.end()) {
-        Tag proptag = property_tagmap[groupkey];
-        const unsigned int groupsize = grp_sets.size();
-        for (unsigned int j = 0; j < groupsize; ++j) {
-          rval = append_packed_string(proptag, grp_sets[j], groupval);
-          if (MB_SUCCESS != rval) return rval;
+      std::map<std::string, Tag>::iterator tag = property_tagmap.find(groupkey);
+      if (tag != property_tagmap.end()) {
+        std::map<EntityHandle, std::string>& values = assignments[tag->second];
+        for (Range::iterator j = grp_sets.begin(); j != grp_sets.end(); ++j) {
+          std::string& packed = values[*j];
+          packed += groupval;
+          packed.append(null_delimiter_length, '\0');
         }
       }
     }
   }
+
+  for (auto& assignment : assignments) {
+    rval = append_packed_strings(assignment.first, assignment.second);
+    if (MB_SUCCESS != rval) return rval;
+  }
   return MB_SUCCESS;
 }
 
@@ -1308,7 +2688,7 @@ Tag DagMC::get_tag(const char* name, int size, TagType store, DataType type,
 /* SECTION VI: Other */
 
 ErrorCode DagMC::getobb(EntityHandle volume, double minPt[3], double maxPt[3]) {
-#ifdef DOUBLE_DOWN
+#if defined(DOUBLE_DOWN) || defined(NATIVE_BVH)
   ErrorCode rval = ray_tracer->get_bbox(volume, minPt, maxPt);
 #else
   ErrorCode rval = GTT->get_bounding_coords(volume, minPt, maxPt);
@@ -1319,7 +2699,7 @@ ErrorCode DagMC::getobb(EntityHandle volume, double minPt[3], double maxPt[3]) {
 
 ErrorCode DagMC::getobb(EntityHandle volume, double center[3], double axis1[3],
                         double axis2[3], double axis3[3]) {
-#ifdef DOUBLE_DOWN
+#if defined(DOUBLE_DOWN) || defined(NATIVE_BVH)
   ErrorCode rval = ray_tracer->get_obb(volume, center, axis1, axis2, axis3);
 #else
   ErrorCode rval = GTT->get_obb(volume, center, axis1, axis2, axis3);
@@ -3,15 +3,20 @@
 
 #include <assert.h>
 
+#include <chrono>
 #include <limits>
 #include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "BVH.hpp"
+#include "CompactRayHistory.hpp"
 #include "DagMCVersion.hpp"
 #include "MBTagConventions.hpp"
+#include "QueryCounters.hpp"
 #include "logger.hpp"
 #include "moab/CartVect.hpp"
 #include "moab/Core.hpp"
@@ -45,6 +50,7 @@ static const std::string GRAVEYARD_NAME = "mat:graveyard";
 
 class CartVect;
 class GeomQueryTool;
+class NativeRayTracer;
 
 /**\brief
  *
@@ -188,6 +194,56 @@ class DagMC {
   /** Retrieve the graveyard group on the model if it exists */
   ErrorCode get_graveyard_group(EntityHandle& graveyard_group);
 
+  /**\brief Add a volume to a loaded model
+   *
+   * volume is an entity set whose child surface sets hold their triangles
+   * and whose senses with respect to volume are set. Surfaces with no
+   * volume on their other side are bounded by the implicit complement. A
+   * surface that bounded another volume and the implicit complement may be
+   * reused with volume in place of the implicit complement. Only the trees
+   * of volume and the implicit complement are built, if the model has
+   * trees, and the indices are rebuilt.
+   */
+  ErrorCode insert_volume(EntityHandle volume);
+
+  /** insert_volume for several volumes, which may share surfaces, rebuilding
+   *  the implicit complement once */
+  ErrorCode insert_volumes(const std::vector<EntityHandle>& volumes);
+
+  /**\brief Remove a volume from a loaded model
+   *
+   * Surfaces it shares with other volumes are kept and bound the implicit
+   * complement instead; its other surfaces and their triangles are
+   * deleted. Only the tree of the implicit complement is rebuilt, and the
+   * indices are rebuilt.
+   */
+  ErrorCode delete_volume(EntityHandle volume);
+
+  /**\brief Move a volume by a rigid transform, x' = rotation x + translation
+   *
+   * rotation is a row-major proper rotation matrix. The volume's surfaces
+   * may only bound the implicit complement and its vertices may not be
+   * shared with other volumes. Only the trees of the volume, its surfaces
+   * and the implicit complement are rebuilt.
+   */
+  ErrorCode transform_volume(EntityHandle volume, const double rotation[9],
+                             const double translation[3]);
+
+  /**\brief Add copies of volumes that share their triangles and trees
+   *
+   * transforms holds 12 values per copy: a row-major proper rotation and a
+   * translation, x' = rotation x + translation. The surfaces of each copy
+   * are instances of the original surfaces: they hold no triangles and are
+   * traced in the frame of the original, whose surface tree serves every
+   * copy. The surfaces of volumes may only bound volumes or the implicit
+   * complement. The copies join the groups of their originals and are
+   * returned in instances, volumes.size() per copy. Needs the native BVH;
+   * volumes whose surfaces have instances cannot be moved or deleted.
+   */
+  ErrorCode create_instances(const std::vector<EntityHandle>& volumes,
+                             const std::vector<double>& transforms,
+                             std::vector<EntityHandle>& instances);
+
  private:
   /** convenience function for converting a bounding box into a box of triangles
    *  with outward facing normals and setting up set structure necessary for
@@ -202,16 +258,61 @@ class DagMC {
   /**\brief Builds the BVH for a specified volume */
   ErrorCode build_bvh(EntityHandle volume);
 
+  /** the prototype of surface if it is an instance surface, 0 if not */
+  ErrorCode get_instance_prototype(EntityHandle surface,
+                                   EntityHandle& prototype);
+
+  /** fails if any of surfs is the prototype of an instance surface */
+  ErrorCode check_no_instances(const Range& surfs);
+
   /** loading code shared by load_file and load_existing_contents */
   ErrorCode finish_loading();
 
+  /** add the time since start to load_times as phase and restart start */
+  void record_load_time(const char* phase,
+                        std::chrono::steady_clock::time_point& start);
+
+  /** build the BVH over the volume bounding boxes used by find_volume */
+  ErrorCode build_volume_index();
+
+  /** forget the point_in_volume verdicts of every thread */
+  void invalidate_point_cache();
+
+#ifdef NATIVE_BVH
+  /** build the native BVH, using the BVH cache file if enabled */
+  ErrorCode init_native_bvh();
+#endif
+
   /* SECTION II: Fundamental Geometry Operations/Queries */
  public:
   /** The methods in this section are thin wrappers around methods in the
    *  GeometryQueryTool.
+   *
+   *  With the native BVH (NATIVE_BVH), once the geometry has been
+   *  initialized, ray_fire, point_in_volume, test_volume_boundary and
+   *  closest_to_location keep no mutable state in the DagMC instance and
+   *  may be called concurrently from several threads on one shared
+   *  instance. Any per-particle state (the RayHistory and the distance
+   *  limit) belongs to the calling thread and must not be shared. The other
+   *  ray tracers, GeomQueryTool and double-down, go through shared MOAB
+   *  state such as the sequence manager's cache, and point_in_volume
+   *  without a direction uses rand(), so their queries must be serialized
+   *  by the caller. Geometry setup and modification (init_OBBTree,
+   *  create_graveyard, ...) must not run concurrently with queries in any
+   *  build.
    */
 
-  typedef GeomQueryTool::RayHistory RayHistory;
+  /** true if the queries may be called concurrently, i.e. with the native
+   *  BVH
+   */
+  static bool concurrent_queries();
+
+  /** The facets a particle has crossed. DagMC's own compact history, which
+   *  needs no heap allocation for short histories, in every build; the ray
+   *  tracers other than the native BVH are given a GeomQueryTool::RayHistory
+   *  copy inside each query.
+   */
+  typedef CompactRayHistory RayHistory;
 
   ErrorCode ray_fire(const EntityHandle volume, const double ray_start[3],
                      const double ray_dir[3], EntityHandle& next_surf,
@@ -219,6 +320,32 @@ class DagMC {
                      double dist_limit = 0, int ray_orientation = 1,
                      OrientedBoxTreeTool::TrvStats* stats = NULL);
 
+  /**\brief Fire a packet of rays at a single volume
+   *
+   * A convenience for callers that hold several rays of one volume,
+   * equivalent to calling ray_fire once per ray; it is not meant to be
+   * faster. The native ray tracer shares the tree traversal between groups
+   * of BVH_PACKET_WIDTH rays, the others fire one ray at a time. Every ray
+   * is counted as one ray_fire call of the volume and of the surface it
+   * hits when query counting is on. Ray data is passed as a
+   * structure of arrays: the first n_rays entries of origins/dirs hold the x
+   * components, the next n_rays the y components and the last n_rays the z
+   * components.
+   *\param n_rays number of rays in the packet
+   *\param origins ray start points (3 * n_rays values, SoA layout)
+   *\param dirs unit ray directions (3 * n_rays values, SoA layout)
+   *\param next_surfs output, the surface hit by each ray (0 if none)
+   *\param next_surf_dists output, the distance to each hit
+   *\param histories optional array of n_rays ray histories
+   *\param dist_limits optional array of n_rays distance limits
+   */
+  ErrorCode ray_fire_batch(const EntityHandle volume, int n_rays,
+                           const double* origins, const double* dirs,
+                           EntityHandle* next_surfs, double* next_surf_dists,
+                           RayHistory* histories = NULL,
+                           const double* dist_limits = NULL,
+                           int ray_orientation = 1);
+
   ErrorCode point_in_volume(const EntityHandle volume, const double xyz[3],
                             int& result, const double* uvw = NULL,
                             const RayHistory* history = NULL);
@@ -234,10 +361,37 @@ class DagMC {
   ErrorCode closest_to_location(EntityHandle volume, const double point[3],
                                 double& result, EntityHandle* surface = 0);
 
+  /**\brief Distance from a point to the nearest surface of a volume
+   *
+   * With lower_bound_ok false this is closest_to_location. With it true the
+   * result may be smaller than the distance, but never larger, as a
+   * transport code's safety distance may be. The native BVH (NATIVE_BVH)
+   * then answers from the bounding boxes of its nodes and triangles
+   * without testing any triangle, counted as QUERY_SAFETY_LOWER_BOUND by
+   * the query counters; other ray tracers return the distance.
+   */
+  ErrorCode safety_distance(EntityHandle volume, const double xyz[3],
+                            double& result, bool lower_bound_ok = false);
+
+  /** volume of a volume; the value cached by measure_all if there is one */
   ErrorCode measure_volume(EntityHandle volume, double& result);
 
+  /** area of a surface; the value cached by measure_all if there is one */
   ErrorCode measure_area(EntityHandle surface, double& result);
 
+  /**\brief Measure every volume and surface at once
+   *
+   * Measures every surface on set_num_threads() threads and sums the
+   * surfaces into their volumes. A set keeps the measure in its
+   * DAGMC_MEASURE tag instead if its DAGMC_MEASURE_HASH tag matches a hash
+   * of the handles and coordinates of its facets, those of its surfaces for
+   * a volume, so a moved vertex or changed facet makes the set be measured
+   * again. Writes both tags, which write_mesh then saves with the model.
+   * Until the next setup_indices, measure_volume and measure_area return
+   * the cached values.
+   */
+  ErrorCode measure_all();
+
   ErrorCode surface_sense(EntityHandle volume, int num_surfaces,
                           const EntityHandle* surfaces, int* senses_out);
 
@@ -250,6 +404,92 @@ class DagMC {
   ErrorCode next_vol(EntityHandle surface, EntityHandle old_volume,
                      EntityHandle& new_volume);
 
+  /** next_vol on base-1 surface and volume indices, from a table of the
+   *  volumes on either side of each surface built with the other indices;
+   *  no MOAB tags are read. new_volume is 0 if there is no volume on the
+   *  other side. Geometry changes after setup_indices are not seen. */
+  ErrorCode next_vol_by_index(int surface, int old_volume, int& new_volume);
+
+  /** surface_sense on base-1 indices, from the table of next_vol_by_index:
+   *  1 if the volume is on the forward side of the surface, -1 if it is on
+   *  the reverse side and 0 if it is on both */
+  ErrorCode surface_sense_by_index(int volume, int surface, int& sense_out);
+
+  /** The queries above keyed by base-1 volume and surface indices, as used
+   *  by the Monte Carlo codes, instead of EntityHandles. Indices are looked
+   *  up in the flat arrays built by setup_indices; a surface index of 0
+   *  means no surface. */
+  ErrorCode ray_fire_by_index(int volume, const double ray_start[3],
+                              const double ray_dir[3], int& next_surf,
+                              double& next_surf_dist,
+                              RayHistory* history = NULL,
+                              double dist_limit = 0, int ray_orientation = 1,
+                              OrientedBoxTreeTool::TrvStats* stats = NULL);
+
+  ErrorCode point_in_volume_by_index(int volume, const double xyz[3],
+                                     int& result, const double* uvw = NULL,
+                                     const RayHistory* history = NULL);
+
+  ErrorCode test_volume_boundary_by_index(int volume, int surface,
+                                          const double xyz[3],
+                                          const double uvw[3], int& result,
+                                          const RayHistory* history = NULL);
+
+  ErrorCode closest_to_location_by_index(int volume, const double point[3],
+                                         double& result, int* surface = 0);
+
+  ErrorCode safety_distance_by_index(int volume, const double xyz[3],
+                                     double& result,
+                                     bool lower_bound_ok = false);
+
+  ErrorCode get_angle_by_index(int surface, const double xyz[3],
+                               double angle[3],
+                               const RayHistory* history = NULL);
+
+  ErrorCode measure_volume_by_index(int volume, double& result);
+
+  ErrorCode measure_area_by_index(int surface, double& result);
+
+  /**\brief Find the volume containing a point
+   *
+   * Only the volumes whose bounding boxes contain xyz are tested, found in
+   * a BVH over the volume bounding boxes that is built with the other
+   * indices once the acceleration data structures exist (all volumes are
+   * tested otherwise), and the implicit complement, which is always tested
+   * since it is unbounded. Candidates are tested with point_in_volume in index
+   * order, so the result is that of a loop over all volumes. If uvw is
+   * given, an inside result is confirmed with a ray in the opposite
+   * direction and, if the two disagree, with point_in_volume_slow.
+   *\param xyz the point
+   *\param volume set to the volume containing xyz, or 0 if there is none
+   *\param uvw optional direction of the point_in_volume rays
+   */
+  ErrorCode find_volume(const double xyz[3], EntityHandle& volume,
+                        const double* uvw = NULL);
+
+  /** Count the calls, time and traversal work of ray_fire,
+   *  point_in_volume, test_volume_boundary and closest_to_location per
+   *  volume, on every thread (see QueryCounters). Also enabled by setting
+   *  the environment variable DAGMC_QUERY_COUNTERS. Default false.
+   */
+  void set_query_counters(bool enable);
+
+  QueryCounters& query_counters() { return queryCounters; }
+
+  /** Write the query counters as CSV; not while queries are running */
+  ErrorCode write_query_counters(const std::string& filename);
+
+  /** Store the query counters as a cost map of the geometry: the double
+   *  tags DAGMC_QUERY_CALLS, DAGMC_QUERY_SECONDS, DAGMC_QUERY_NODES and
+   *  DAGMC_QUERY_TRIANGLES, summed over the query types, on every volume
+   *  and surface set. A surface's counts are those of the queries that
+   *  answered with it, e.g. the rays that hit it. With tag_facets the
+   *  triangles of each surface get its values too, so that a file written
+   *  with write_mesh shows the cost map in VisIt or ParaView. Not while
+   *  queries are running.
+   */
+  ErrorCode tag_query_costs(bool tag_facets = true);
+
   /* SECTION III: Indexing & Cross-referencing */
  public:
   /** Most calling apps refer to geometric entities with a combination of
@@ -262,7 +502,8 @@ class DagMC {
   EntityHandle entity_by_id(int dimension, int id);
   /** map from dimension & base-1 ordinal index to EntityHandle */
   EntityHandle entity_by_index(int dimension, int index);
-  /** map from dimension & base-1 ordinal index to global ID */
+  /** map from dimension & base-1 ordinal index to global ID; cached by
+   *  setup_indices for surfaces and volumes */
   int id_by_index(int dimension, int index);
   /** PPHW: Missing dim & global ID ==> base-1 ordinal index */
   /** map from EntityHandle to base-1 ordinal index */
@@ -287,6 +528,18 @@ class DagMC {
   /** build internal index vectors that speed up handle-by-id, etc. */
   ErrorCode build_indices(Range& surfs, Range& vols);
 
+  /** build the table of volumes on either side of each surface */
+  ErrorCode build_surface_neighbors();
+
+  /** coordinates of the triangles of a surface, nine per triangle, and
+   *  their handles */
+  ErrorCode get_surface_triangles(EntityHandle surface,
+                                  std::vector<double>& coords,
+                                  std::vector<EntityHandle>& handles);
+
+  /** the volume or area of a set cached by measure_all, if any */
+  bool cached_measure(int dimension, EntityHandle set, double& result) const;
+
   /* SECTION IV: Handling DagMC settings */
  public:
   /** retrieve overlap thickness */
@@ -305,6 +558,85 @@ class DagMC {
    */
   void set_numerical_precision(double new_precision);
 
+  /** Enable or disable the BVH cache file. When enabled, init_OBBTree
+   *  memory-maps the surface trees from a cache file matching a hash of the
+   *  facet data instead of building them, and writes the file if it is
+   *  missing or stale. The file is "<hash>.dagbvh" in cache_dir, or in the
+   *  directory named by the DAGMC_BVH_CACHE_DIR environment variable, or
+   *  else "<model file>.dagbvh" next to the model. Enabled by default; only
+   *  used with the native BVH (NATIVE_BVH).
+   */
+  void set_bvh_cache(bool use_cache, const std::string& cache_dir = "");
+
+  /** Set the number of threads used to build the acceleration data
+   *  structures in init_OBBTree and by measure_all; 0 uses every hardware
+   *  thread. Only the native BVH (NATIVE_BVH) is built in parallel; MOAB's
+   *  OBB trees are always built serially. Default 1.
+   */
+  void set_num_threads(int n_threads);
+
+  /** Store the acceleration data structures in single precision, about
+   *  half the memory, and re-check the candidate facets each query finds in
+   *  double precision, so that ray_fire, point_in_volume and the other
+   *  queries return what they would in double precision. Applies to the
+   *  structures built by the next init_OBBTree. Only the native BVH
+   *  (NATIVE_BVH) supports this; MOAB's OBB trees are always double
+   *  precision. Default false.
+   */
+  void set_mixed_precision(bool mixed);
+
+  /** Copy the facets of every surface into a compact mesh of quantized
+   *  coordinates and 32-bit connectivity in init_OBBTree, and answer every
+   *  query from it instead of MOAB. Vertices move by at most 2^-32 of the
+   *  size of their surfaces, and surfaces stay watertight. Only the native
+   *  BVH (NATIVE_BVH) supports this. Default false.
+   */
+  void set_compact_mesh(bool compact);
+
+  /** Share the acceleration data structures, and the compact mesh if there
+   *  is one, between the processes of a node that load the same geometry,
+   *  e.g. the MPI ranks of a run. The first process to reach init_OBBTree
+   *  builds them, or reads them from the BVH cache, into POSIX shared
+   *  memory, and the others map that copy instead of building their own.
+   *  Setting the environment variable DAGMC_SHARED_MEMORY to anything but 0
+   *  has the same effect. Only the native BVH (NATIVE_BVH) on platforms
+   *  with shm_open supports this; elsewhere each process builds its own.
+   *  A process that has waited max_wait seconds for the first one builds
+   *  its own too. Default false.
+   */
+  void set_shared_memory(bool shared, double max_wait = 600.0);
+
+  /** Remember the last point_in_volume verdicts of each thread, keyed by
+   *  volume, point and direction, and answer repeated queries, e.g. a
+   *  Geant4 Inside followed by DistanceToIn at the same point, from them.
+   *  Queries with a RayHistory are not cached. The verdicts are forgotten
+   *  when setup_indices runs or a tolerance changes; geometry modified
+   *  through MOAB directly needs setup_indices, or the cache disabled.
+   *  Default false.
+   */
+  void set_point_cache(bool use_cache);
+
+  /** Delete the triangles, edges and vertices of the compacted surfaces
+   *  from MOAB once init_OBBTree has built the compact mesh, keeping the
+   *  geometry sets with their tags and topology. Queries are unaffected,
+   *  but the facets can no longer be read from MOAB or written out.
+   *\return MB_FAILURE if there is no compact mesh, MB_NOT_IMPLEMENTED
+   *        without the native BVH
+   */
+  ErrorCode release_facet_data();
+
+  /** Extra MOAB read options for load_file, e.g. "BUFFER_SIZE=<bytes>" for
+   *  the HDF5 reader, which reads in chunks of that size. If none are set,
+   *  those in the environment variable DAGMC_LOAD_OPTIONS are used.
+   */
+  void set_load_options(const std::string& options) { loadOptions = options; }
+
+  /** seconds spent in each phase of loading, in order: those of the last
+   *  load_file or load_existing_contents and of every init_OBBTree since */
+  const std::vector<std::pair<std::string, double>>& load_times() const {
+    return loadTimes;
+  }
+
   /* SECTION V: Metadata handling */
   /** Detect all the property keywords that appear in the loaded geometry
    *
@@ -424,8 +756,11 @@ class DagMC {
   /** Parse a group name into a set of key:value pairs */
   ErrorCode parse_group_name(EntityHandle group_set, prop_map& result,
                              const char* delimiters = "_");
-  /** Add a string value to a property tag for a given entity */
-  ErrorCode append_packed_string(Tag, EntityHandle, std::string&);
+  /** Append packed values to a property tag on many entities, writing the
+   *  tag once; packed maps each entity to its values, each followed by a
+   *  null character */
+  ErrorCode append_packed_strings(
+      Tag tag, const std::map<EntityHandle, std::string>& packed);
   /** Convert a property tag's value on a handle to a list of strings */
   ErrorCode unpack_packed_string(Tag tag, EntityHandle eh,
                                  std::vector<std::string>& values);
@@ -483,6 +818,8 @@ class DagMC {
   // type alias for ray tracing engine
 #ifdef DOUBLE_DOWN
   using RayTracer = double_down::RayTracingInterface;
+#elif defined(NATIVE_BVH)
+  using RayTracer = NativeRayTracer;
 #else
   using RayTracer = GeomQueryTool;
 #endif
@@ -499,8 +836,29 @@ class DagMC {
   EntityHandle setOffset;
   /** entity index (contiguous 1-N indices); indexed like rootSets */
   std::vector<int> entIndices;
+  /** global IDs of the surfaces and volumes, indexed like entHandles */
+  std::vector<int> entIds[5];
   /** corresponding geometric entities; also indexed like rootSets */
   std::vector<RefEntity*> geomEntities;
+  /** BVH over the bounding boxes of the volumes, empty if there are no
+   *  acceleration data structures; leaves address volumeIndexOrder */
+  std::vector<BVHNode> volumeIndexNodes;
+  /** volume indices in BVH leaf order, without the implicit complement */
+  std::vector<int> volumeIndexOrder;
+  /** index of the implicit complement, which has no box in the volume
+   *  index and is a candidate of every find_volume; 0 if there is none or
+   *  no volume index */
+  int volumeIndexComplement = 0;
+  /** bounding box of each volume index, padded like the boxes of the
+   *  volume index and unbounded for the implicit complement; empty if the
+   *  volume index is */
+  std::vector<BVHBox> pointBoxes;
+  /** forward and reverse volume index of each surface index, 0 for none;
+   *  the entries of surface i are 2 * i and 2 * i + 1 */
+  std::vector<int> surfVolIndices;
+  /** areas of the surfaces and volumes of the volumes from measure_all,
+   *  indexed like entHandles; empty until measure_all */
+  std::vector<double> entMeasures[5];
 
   /* metadata */
   /** empty synonym map to provide as a default argument to parse_properties()
@@ -513,10 +871,22 @@ class DagMC {
 
   double facetingTolerance;
 
-  /** vectors for point_in_volume: */
-  std::vector<double> disList;
-  std::vector<int> dirList;
-  std::vector<EntityHandle> surList, facList;
+  /** file passed to load_file, names the BVH cache by default */
+  std::string modelFile;
+  bool useBVHCache = true;
+  std::string bvhCacheDir;
+  bool useSharedMemory = false;
+  /** seconds to wait for the leader of a shared memory segment */
+  double sharedMemoryWait = 600.0;
+  std::string loadOptions;
+  std::vector<std::pair<std::string, double>> loadTimes;
+  /** threads of parallel work; 0 uses every hardware thread */
+  int numThreads = 1;
+  bool usePointCache = false;
+  /** tells the point_in_volume verdicts of the current geometry and
+   *  tolerances apart from all others, of any DagMC instance */
+  uint64_t pointCacheGeneration = 0;
+  QueryCounters queryCounters;
 
   /** logger **/
   DagMC_Logger logger;
@@ -571,6 +941,69 @@ inline int DagMC::index_by_handle(EntityHandle handle) {
   return entIndices[handle - setOffset];
 }
 
+inline ErrorCode DagMC::ray_fire_by_index(
+    int volume, const double ray_start[3], const double ray_dir[3],
+    int& next_surf, double& next_surf_dist, RayHistory* history,
+    double dist_limit, int ray_orientation,
+    OrientedBoxTreeTool::TrvStats* stats) {
+  EntityHandle surf = 0;
+  ErrorCode rval = ray_fire(entity_by_index(3, volume), ray_start, ray_dir,
+                            surf, next_surf_dist, history, dist_limit,
+                            ray_orientation, stats);
+  next_surf = surf ? index_by_handle(surf) : 0;
+  return rval;
+}
+
+inline ErrorCode DagMC::point_in_volume_by_index(int volume,
+                                                 const double xyz[3],
+                                                 int& result,
+                                                 const double* uvw,
+                                                 const RayHistory* history) {
+  return point_in_volume(entity_by_index(3, volume), xyz, result, uvw,
+                         history);
+}
+
+inline ErrorCode DagMC::test_volume_boundary_by_index(
+    int volume, int surface, const double xyz[3], const double uvw[3],
+    int& result, const RayHistory* history) {
+  return test_volume_boundary(entity_by_index(3, volume),
+                              entity_by_index(2, surface), xyz, uvw, result,
+                              history);
+}
+
+inline ErrorCode DagMC::closest_to_location_by_index(int volume,
+                                                     const double point[3],
+                                                     double& result,
+                                                     int* surface) {
+  EntityHandle surf = 0;
+  ErrorCode rval = closest_to_location(entity_by_index(3, volume), point,
+                                       result, surface ? &surf : 0);
+  if (surface) *surface = surf ? index_by_handle(surf) : 0;
+  return rval;
+}
+
+inline ErrorCode DagMC::safety_distance_by_index(int volume,
+                                                 const double xyz[3],
+                                                 double& result,
+                                                 bool lower_bound_ok) {
+  return safety_distance(entity_by_index(3, volume), xyz, result,
+                         lower_bound_ok);
+}
+
+inline ErrorCode DagMC::get_angle_by_index(int surface, const double xyz[3],
+                                           double angle[3],
+                                           const RayHistory* history) {
+  return get_angle(entity_by_index(2, surface), xyz, angle, history);
+}
+
+inline ErrorCode DagMC::measure_volume_by_index(int volume, double& result) {
+  return measure_volume(entity_by_index(3, volume), result);
+}
+
+inline ErrorCode DagMC::measure_area_by_index(int surface, double& result) {
+  return measure_area(entity_by_index(2, surface), result);
+}
+
 inline unsigned int DagMC::num_entities(int dimension) {
   assert(vertex_handle_idx <= dimension && groups_handle_idx >= dimension);
   return entHandles[dimension].size() - 1;
@@ -0,0 +1,1212 @@
+#include "NativeRayTracer.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <random>
+
+#include "BVHCache.hpp"
+#include "ParallelFor.hpp"
+#include "moab/Range.hpp"
+
+#ifndef M_PI /* windows */
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace moab {
+
+namespace {
+
+// un-normalized facet normal, (v1 - v0) x (v2 - v0)
+void facet_normal(const double c[9], double normal[3]) {
+  double a[3] = {c[3] - c[0], c[4] - c[1], c[5] - c[2]};
+  double b[3] = {c[6] - c[0], c[7] - c[1], c[8] - c[2]};
+  normal[0] = a[1] * b[2] - a[2] * b[1];
+  normal[1] = a[2] * b[0] - a[0] * b[2];
+  normal[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Same as GeomQueryTool::boundary_case. Returns 1 if a ray along uvw
+// enters the volume through the facet, 0 if it leaves and -1 if it is
+// tangent to the facet or no direction was given.
+int boundary_case(const double coords[9], int sense, const double uvw[3]) {
+  if (!(uvw[0] <= 1.0 && uvw[1] <= 1.0 && uvw[2] <= 1.0)) return -1;
+  double normal[3];
+  facet_normal(coords, normal);
+  double ddot = 0.0;
+  for (int i = 0; i < 3; i++) ddot += uvw[i] * sense * normal[i];
+  if (ddot < 0.0) return 1;
+  if (ddot > 0.0) return 0;
+  return -1;
+}
+
+// GeomQueryTool uses rand() here; keep a generator per thread instead so
+// that concurrent point_in_volume calls do not share state
+void random_direction(double dir[3]) {
+  static thread_local std::mt19937 gen(12345);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  double len = 0.0;
+  while (0.0 == len) {
+    for (int i = 0; i < 3; i++) dir[i] = normal(gen);
+    len = sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+  }
+  for (int i = 0; i < 3; i++) dir[i] /= len;
+}
+
+// signed solid angle subtended by a triangle at the origin
+// (van Oosterom & Strackee)
+double tri_solid_angle(const double c[9], const double p[3]) {
+  double a[3], b[3], d[3];
+  for (int i = 0; i < 3; i++) {
+    a[i] = c[i] - p[i];
+    b[i] = c[3 + i] - p[i];
+    d[i] = c[6 + i] - p[i];
+  }
+  auto dot = [](const double* u, const double* v) {
+    return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+  };
+  double la = sqrt(dot(a, a)), lb = sqrt(dot(b, b)), ld = sqrt(dot(d, d));
+  double bxd[3] = {b[1] * d[2] - b[2] * d[1], b[2] * d[0] - b[0] * d[2],
+                   b[0] * d[1] - b[1] * d[0]};
+  double num = dot(a, bxd);
+  double den = la * lb * ld + dot(a, b) * ld + dot(a, d) * lb + dot(b, d) * la;
+  return 2.0 * atan2(num, den);
+}
+
+const char INSTANCE_OF_TAG_NAME[] = "DAGMC_INSTANCE_OF";
+const char INSTANCE_TRANSFORM_TAG_NAME[] = "DAGMC_INSTANCE_TRANSFORM";
+
+// the facet keys of instance surfaces occupy bits 40-59 of the handles
+const int INSTANCE_KEY_SHIFT = 40;
+const uint64_t MAX_INSTANCE_KEYS = (uint64_t)1 << 20;
+const EntityHandle INSTANCE_KEY_MASK = (EntityHandle)(MAX_INSTANCE_KEYS - 1)
+                                       << INSTANCE_KEY_SHIFT;
+
+// true if facet is in the ray history, counting the skipped hit
+inline bool in_history(const CompactRayHistory* history,
+                       EntityHandle facet) {
+  if (!history || !history->in_history(facet)) return false;
+  if (BVHCounts* counts = bvh_counts()) counts->history_hits++;
+  return true;
+}
+
+}  // namespace
+
+NativeRayTracer::NativeRayTracer(std::shared_ptr<GeomTopoTool> gtt,
+                                 double overlap_thickness,
+                                 double numerical_precision)
+    : GTT(gtt),
+      MBI(gtt->get_moab_instance()),
+      overlapThickness(overlap_thickness),
+      numericalPrecision(numerical_precision),
+      numThreads(1),
+      precision(BVH_DOUBLE),
+      useCompactMesh(false) {}
+
+void NativeRayTracer::Instance::to_world(const double local[3],
+                                        double world[3]) const {
+  for (int i = 0; i < 3; i++) {
+    world[i] = rotation[3 * i] * local[0] + rotation[3 * i + 1] * local[1] +
+               rotation[3 * i + 2] * local[2] + translation[i];
+  }
+}
+
+void NativeRayTracer::Instance::to_local(const double world[3],
+                                        double local[3]) const {
+  double d[3] = {world[0] - translation[0], world[1] - translation[1],
+                 world[2] - translation[2]};
+  dir_to_local(d, local);
+}
+
+void NativeRayTracer::Instance::dir_to_local(const double world[3],
+                                            double local[3]) const {
+  // the inverse of a rotation is its transpose
+  for (int i = 0; i < 3; i++) {
+    local[i] = rotation[i] * world[0] + rotation[3 + i] * world[1] +
+               rotation[6 + i] * world[2];
+  }
+}
+
+BVHBox NativeRayTracer::Instance::to_world(const BVHBox& local) const {
+  BVHBox box;
+  if (local.empty()) return box;
+  for (int c = 0; c < 8; c++) {
+    double corner[3], world[3];
+    for (int i = 0; i < 3; i++)
+      corner[i] = (c >> i) & 1 ? local.hi[i] : local.lo[i];
+    to_world(corner, world);
+    box.extend(world);
+  }
+  return box;
+}
+
+/* SECTION I: BVH construction */
+
+ErrorCode NativeRayTracer::init() {
+  Range vols;
+  ErrorCode rval = GTT->get_gsets_by_dimension(3, vols);
+  MB_CHK_SET_ERR(rval, "Failed to get volumes");
+
+  EntityHandle impl_compl;
+  if (MB_SUCCESS == GTT->get_implicit_complement(impl_compl))
+    vols.insert(impl_compl);
+
+  if (useCompactMesh && 0 == compactMesh.num_surfaces()) {
+    rval = build_compact_mesh();
+    MB_CHK_ERR(rval);
+  }
+
+  // the surface trees are the bulk of the work; build them all first so
+  // that the volumes below only join them
+  rval = build_surface_trees(vols);
+  MB_CHK_ERR(rval);
+
+  for (Range::iterator it = vols.begin(); it != vols.end(); ++it) {
+    rval = createBVH(*it);
+    MB_CHK_SET_ERR(rval, "Failed to build the BVH of volume " << *it);
+  }
+  // trees of surfaces no volume uses are dropped
+  pending_surfaces.clear();
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::build_surface_trees(const Range& vols) {
+  // instance surfaces use the trees of their prototypes
+  Tag prototype_tag = 0, transform_tag = 0;
+  if (MB_SUCCESS != get_instance_tags(MBI, prototype_tag, transform_tag, false))
+    prototype_tag = 0;
+
+  // surfaces that have no tree yet
+  std::vector<EntityHandle> todo;
+  for (Range::const_iterator it = vols.begin(); it != vols.end(); ++it) {
+    std::vector<EntityHandle> child_surfs;
+    ErrorCode rval = MBI->get_child_meshsets(*it, child_surfs);
+    MB_CHK_SET_ERR(rval, "Failed to get the surfaces of volume " << *it);
+    for (auto surf : child_surfs) {
+      EntityHandle prototype = 0;
+      if (prototype_tag &&
+          MB_SUCCESS ==
+              MBI->tag_get_data(prototype_tag, &surf, 1, &prototype) &&
+          prototype)
+        surf = prototype;
+      if (!find_surface(surf) && !pending_surfaces.count(surf))
+        todo.push_back(surf);
+    }
+  }
+  std::sort(todo.begin(), todo.end());
+  todo.erase(std::unique(todo.begin(), todo.end()), todo.end());
+
+  // largest first, so that no thread starts a long build at the very end
+  std::vector<std::pair<int, EntityHandle>> by_size(todo.size());
+  for (size_t i = 0; i < todo.size(); i++) {
+    int n_tris;
+    ErrorCode rval = MBI->get_number_entities_by_type(todo[i], MBTRI, n_tris);
+    MB_CHK_SET_ERR(rval, "Failed to count the triangles of " << todo[i]);
+    by_size[i] = std::make_pair(-n_tris, todo[i]);
+  }
+  std::sort(by_size.begin(), by_size.end());
+
+  // MOAB is not thread safe, so only the builds themselves run concurrently
+  std::vector<std::shared_ptr<const TriangleBVH>> trees(by_size.size());
+  std::mutex moab_mutex;
+  ErrorCode rval =
+      parallel_for(by_size.size(), get_num_threads(), [&](size_t i) {
+        std::vector<double> coords;
+        std::vector<EntityHandle> handles;
+        {
+          std::lock_guard<std::mutex> lock(moab_mutex);
+          ErrorCode result =
+              get_surface_triangles(by_size[i].second, coords, handles);
+          if (MB_SUCCESS != result) return result;
+        }
+        auto tree = std::make_shared<TriangleBVH>();
+        tree->build(coords, handles, precision);
+        trees[i] = tree;
+        return MB_SUCCESS;
+      });
+  MB_CHK_SET_ERR(rval, "Failed to build the surface trees");
+
+  for (size_t i = 0; i < by_size.size(); i++)
+    pending_surfaces[by_size[i].second] = trees[i];
+  return MB_SUCCESS;
+}
+
+int NativeRayTracer::get_num_threads() const {
+  return resolve_num_threads(numThreads);
+}
+
+ErrorCode NativeRayTracer::geometry_hash(uint64_t& hash) const {
+  Range surfs;
+  ErrorCode rval = GTT->get_gsets_by_dimension(2, surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get surfaces");
+
+  GeometryHash geom_hash;
+  geom_hash.add((uint64_t)surfs.size());
+  std::vector<double> coords;
+  std::vector<EntityHandle> handles;
+  for (Range::iterator it = surfs.begin(); it != surfs.end(); ++it) {
+    rval = get_surface_triangles(*it, coords, handles);
+    MB_CHK_ERR(rval);
+    geom_hash.add((uint64_t)*it);
+    geom_hash.add((uint64_t)handles.size());
+    for (size_t i = 0; i < handles.size(); i++)
+      geom_hash.add((uint64_t)handles[i]);
+    for (size_t i = 0; i < coords.size(); i++) geom_hash.add(coords[i]);
+  }
+  hash = geom_hash.value();
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::load_cache(const std::string& filename,
+                                      uint64_t hash) {
+  return read_bvh_cache(filename, hash, precision, pending_surfaces,
+                        useCompactMesh ? &compactMesh : NULL);
+}
+
+ErrorCode NativeRayTracer::save_cache(const std::string& filename,
+                                      uint64_t hash) const {
+  std::vector<std::pair<EntityHandle, const TriangleBVH*>> trees;
+  std::vector<std::shared_ptr<const TriangleBVH>> held;
+  used_surface_trees(trees, held);
+  return write_bvh_cache(filename, hash, trees,
+                         useCompactMesh ? &compactMesh : NULL);
+}
+
+void NativeRayTracer::used_surface_trees(
+    std::vector<std::pair<EntityHandle, const TriangleBVH*>>& trees,
+    std::vector<std::shared_ptr<const TriangleBVH>>& held) const {
+  for (const auto& surf : surfaces) {
+    std::shared_ptr<const TriangleBVH> tree = surf.second.lock();
+    if (!tree) continue;
+    trees.push_back(std::make_pair(surf.first, tree.get()));
+    held.push_back(tree);
+  }
+}
+
+ErrorCode NativeRayTracer::join_shared_cache(const std::string& name,
+                                             bool& leader) {
+  auto segment = std::unique_ptr<SharedBVHCache>(new SharedBVHCache(name));
+  ErrorCode rval = segment->join(leader);
+  if (MB_SUCCESS != rval) return rval;
+  sharedCache = std::move(segment);
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::load_shared_cache(double max_wait,
+                                             uint64_t& hash) {
+  if (!sharedCache) return MB_FAILURE;
+  return sharedCache->read(precision, max_wait, pending_surfaces, hash,
+                           useCompactMesh ? &compactMesh : NULL);
+}
+
+ErrorCode NativeRayTracer::publish_shared_cache(uint64_t hash) {
+  if (!sharedCache || !sharedCache->is_leader()) return MB_FAILURE;
+  ErrorCode rval;
+  {
+    std::vector<std::pair<EntityHandle, const TriangleBVH*>> trees;
+    std::vector<std::shared_ptr<const TriangleBVH>> held;
+    used_surface_trees(trees, held);
+    rval = sharedCache->publish(hash, trees,
+                                useCompactMesh ? &compactMesh : NULL);
+  }
+  if (MB_SUCCESS != rval) {
+    // mark the segment failed: the others build their own trees and this
+    // process keeps its private ones
+    sharedCache->abandon();
+    sharedCache.reset();
+    return rval;
+  }
+
+  // use the shared copies, freeing this process' own; the others can map
+  // the segment even if this process cannot
+  uint64_t published;
+  rval = load_shared_cache(0.0, published);
+  if (MB_SUCCESS != rval) return rval;
+  volumes.clear();
+  surfaces.clear();
+  return init();
+}
+
+size_t NativeRayTracer::memory_size() const {
+  size_t bytes = 0;
+  for (const auto& surf : surfaces) {
+    std::shared_ptr<const TriangleBVH> tree = surf.second.lock();
+    if (tree) bytes += tree->memory_size();
+  }
+  for (const auto& vol : volumes) {
+    bytes += vol.second.nodes.size() * sizeof(BVHNode) +
+             vol.second.surfaces.size() * sizeof(SurfaceRef);
+  }
+  return bytes;
+}
+
+ErrorCode NativeRayTracer::build_compact_mesh() {
+  Range surfs;
+  ErrorCode rval = GTT->get_gsets_by_dimension(2, surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get surfaces");
+  rval = compactMesh.build(MBI, surfs);
+  MB_CHK_SET_ERR(rval, "Failed to build the compact mesh");
+  return MB_SUCCESS;
+}
+
+void NativeRayTracer::remove_from_compact_mesh(const Range& surfs) {
+  for (Range::const_iterator it = surfs.begin(); it != surfs.end(); ++it)
+    compactMesh.remove_surface(*it);
+}
+
+ErrorCode NativeRayTracer::get_surface_triangles(
+    EntityHandle surface, std::vector<double>& coords,
+    std::vector<EntityHandle>& handles) const {
+  if (const Instance* instance = find_instance(surface)) {
+    ErrorCode rval =
+        get_surface_triangles(instance->prototype, coords, handles);
+    MB_CHK_ERR(rval);
+    for (size_t i = 0; i < handles.size(); i++) {
+      handles[i] |= instance->facet_key;
+      for (int v = 0; v < 3; v++) {
+        double* vertex = &coords[9 * i + 3 * v];
+        double local[3] = {vertex[0], vertex[1], vertex[2]};
+        instance->to_world(local, vertex);
+      }
+    }
+    return MB_SUCCESS;
+  }
+
+  if (compactMesh.has_surface(surface))
+    return compactMesh.get_surface_triangles(surface, coords, handles);
+
+  Range tris;
+  ErrorCode rval = MBI->get_entities_by_type(surface, MBTRI, tris);
+  MB_CHK_SET_ERR(rval, "Failed to get the triangles of surface " << surface);
+
+  handles.assign(tris.begin(), tris.end());
+  coords.resize(9 * handles.size());
+  for (size_t i = 0; i < handles.size(); i++) {
+    rval = get_facet_coords(surface, handles[i], &coords[9 * i]);
+    MB_CHK_ERR(rval);
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::get_facet_coords(EntityHandle surface,
+                                            EntityHandle facet,
+                                            double coords[9]) const {
+  if (const Instance* instance = find_instance(surface)) {
+    double local[9];
+    ErrorCode rval = get_facet_coords(instance->prototype,
+                                      facet & ~INSTANCE_KEY_MASK, local);
+    if (MB_SUCCESS != rval) return rval;
+    for (int v = 0; v < 3; v++)
+      instance->to_world(local + 3 * v, coords + 3 * v);
+    return MB_SUCCESS;
+  }
+
+  if (compactMesh.has_surface(surface))
+    return compactMesh.get_facet_coords(surface, facet, coords);
+
+  const EntityHandle* conn;
+  int len;
+  ErrorCode rval = MBI->get_connectivity(facet, conn, len, true);
+  MB_CHK_SET_ERR(rval, "Failed to get triangle connectivity");
+  if (3 != len)
+    MB_SET_ERR(MB_FAILURE, "Facet " << facet << " is not a triangle");
+  rval = MBI->get_coords(conn, 3, coords);
+  MB_CHK_SET_ERR(rval, "Failed to get triangle coordinates");
+  return MB_SUCCESS;
+}
+
+FacetCoordsFn NativeRayTracer::facet_coords(EntityHandle surface) const {
+  return [this, surface](EntityHandle facet, double* coords) {
+    return get_facet_coords(surface, facet, coords);
+  };
+}
+
+ErrorCode NativeRayTracer::createBVH(EntityHandle volume) {
+  std::vector<EntityHandle> child_surfs;
+  ErrorCode rval = MBI->get_child_meshsets(volume, child_surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get the surfaces of volume " << volume);
+
+  std::vector<int> senses(child_surfs.size());
+  if (!child_surfs.empty()) {
+    rval = GTT->get_surface_senses(volume, child_surfs.size(), &child_surfs[0],
+                                   &senses[0]);
+    MB_CHK_SET_ERR(rval, "Failed to get surface senses for volume " << volume);
+  }
+
+  // instance surfaces, if the model has any
+  Tag prototype_tag = 0, transform_tag = 0;
+  if (MB_SUCCESS != get_instance_tags(MBI, prototype_tag, transform_tag, false))
+    prototype_tag = 0;
+
+  VolumeBVH vol;
+  std::vector<BVHBox> boxes;
+  for (size_t i = 0; i < child_surfs.size(); i++) {
+    std::shared_ptr<const Instance> instance;
+    if (prototype_tag) {
+      rval = update_instance(prototype_tag, transform_tag, child_surfs[i],
+                             instance);
+      MB_CHK_ERR(rval);
+    }
+    // the surface whose triangles the tree holds
+    EntityHandle tree_surf = instance ? instance->prototype : child_surfs[i];
+
+    std::shared_ptr<const TriangleBVH> tree = find_surface(tree_surf);
+    if (!tree) {
+      auto cached = pending_surfaces.find(tree_surf);
+      if (cached != pending_surfaces.end()) {
+        tree = cached->second;
+        surfaces[tree_surf] = tree;
+      }
+    }
+    if (!tree) {
+      std::vector<double> coords;
+      std::vector<EntityHandle> handles;
+      rval = get_surface_triangles(tree_surf, coords, handles);
+      MB_CHK_ERR(rval);
+      auto new_tree = std::make_shared<TriangleBVH>();
+      new_tree->build(coords, handles, precision);
+      tree = new_tree;
+      surfaces[tree_surf] = tree;
+    }
+    if (tree->empty()) continue;
+
+    SurfaceRef ref = {child_surfs[i], senses[i], tree, facet_coords(tree_surf),
+                      instance};
+    BVHBox box = instance ? instance->to_world(tree->bounds()) : tree->bounds();
+    vol.surfaces.push_back(ref);
+    boxes.push_back(box);
+    vol.box.extend(box);
+  }
+
+  // one surface per leaf: surface trees are tested as a whole
+  std::vector<int> order;
+  build_bvh(boxes, 1, 1, vol.nodes, order);
+  std::vector<SurfaceRef> sorted(vol.surfaces.size());
+  for (size_t i = 0; i < order.size(); i++) sorted[i] = vol.surfaces[order[i]];
+  vol.surfaces.swap(sorted);
+
+  volumes[volume] = std::move(vol);
+  return MB_SUCCESS;
+}
+
+void NativeRayTracer::deleteBVH(EntityHandle volume) {
+  volumes.erase(volume);
+  // drop surfaces whose trees were only held by this volume
+  for (auto it = surfaces.begin(); it != surfaces.end();) {
+    if (it->second.expired())
+      it = surfaces.erase(it);
+    else
+      ++it;
+  }
+}
+
+const NativeRayTracer::VolumeBVH* NativeRayTracer::find_volume(
+    EntityHandle volume) const {
+  auto it = volumes.find(volume);
+  return it == volumes.end() ? NULL : &it->second;
+}
+
+ErrorCode NativeRayTracer::get_instance_tags(Interface* mbi,
+                                             Tag& prototype_tag,
+                                             Tag& transform_tag, bool create) {
+  unsigned flags = MB_TAG_SPARSE | (create ? MB_TAG_CREAT : 0);
+  ErrorCode rval = mbi->tag_get_handle(INSTANCE_OF_TAG_NAME, 1, MB_TYPE_HANDLE,
+                                       prototype_tag, flags);
+  if (MB_TAG_NOT_FOUND == rval) return rval;
+  MB_CHK_SET_ERR(rval, "Failed to get the " << INSTANCE_OF_TAG_NAME << " tag");
+  rval = mbi->tag_get_handle(INSTANCE_TRANSFORM_TAG_NAME, 12, MB_TYPE_DOUBLE,
+                             transform_tag, flags);
+  if (MB_TAG_NOT_FOUND == rval) return rval;
+  MB_CHK_SET_ERR(rval,
+                 "Failed to get the " << INSTANCE_TRANSFORM_TAG_NAME << " tag");
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::update_instance(
+    Tag prototype_tag, Tag transform_tag, EntityHandle surface,
+    std::shared_ptr<const Instance>& instance) {
+  instance.reset();
+  EntityHandle prototype = 0;
+  ErrorCode rval = MBI->tag_get_data(prototype_tag, &surface, 1, &prototype);
+  if (MB_TAG_NOT_FOUND == rval || (MB_SUCCESS == rval && !prototype)) {
+    instances.erase(surface);
+    return MB_SUCCESS;
+  }
+  MB_CHK_SET_ERR(rval, "Failed to get the prototype of surface " << surface);
+
+  // instances of instances are stored with their transforms composed
+  EntityHandle nested = 0;
+  if (MB_SUCCESS == MBI->tag_get_data(prototype_tag, &prototype, 1, &nested) &&
+      nested)
+    MB_SET_ERR(MB_FAILURE, "The prototype of surface " << surface
+                                                       << " is an instance");
+
+  auto new_instance = std::make_shared<Instance>();
+  new_instance->prototype = prototype;
+  double transform[12];
+  rval = MBI->tag_get_data(transform_tag, &surface, 1, transform);
+  MB_CHK_SET_ERR(rval, "Failed to get the transform of surface " << surface);
+  std::copy(transform, transform + 9, new_instance->rotation);
+  std::copy(transform + 9, transform + 12, new_instance->translation);
+
+  // keep the key of a surface built before, histories may hold it
+  auto old = instances.find(surface);
+  if (old != instances.end()) {
+    new_instance->facet_key = old->second->facet_key;
+  } else {
+    if (numInstanceKeys + 1 >= MAX_INSTANCE_KEYS)
+      MB_SET_ERR(MB_FAILURE, "Too many instance surfaces");
+    new_instance->facet_key = (EntityHandle)(++numInstanceKeys)
+                              << INSTANCE_KEY_SHIFT;
+  }
+  instances[surface] = new_instance;
+  instance = new_instance;
+  return MB_SUCCESS;
+}
+
+const NativeRayTracer::Instance* NativeRayTracer::find_instance(
+    EntityHandle surface) const {
+  if (instances.empty()) return NULL;
+  auto it = instances.find(surface);
+  return it == instances.end() ? NULL : it->second.get();
+}
+
+std::shared_ptr<const TriangleBVH> NativeRayTracer::find_surface(
+    EntityHandle surface) const {
+  auto it = surfaces.find(surface);
+  return it == surfaces.end() ? nullptr : it->second.lock();
+}
+
+/* SECTION II: Queries */
+
+template <typename HitFn>
+void NativeRayTracer::volume_ray_intersect(const VolumeBVH& vol,
+                                           const BVHRay& ray,
+                                           const int* ray_orientation,
+                                           double& tmax, HitFn&& hit) const {
+  if (vol.nodes.empty()) return;
+
+  const double tmin = ray.use_neg_len ? ray.neg_len : 0.0;
+  BVHCounts* counts = bvh_counts();
+  int stack[BVH_MAX_DEPTH];
+  int sp = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    const BVHNode& node = vol.nodes[stack[--sp]];
+    if (counts) counts->nodes_visited++;
+    double tentry;
+    if (!ray_box_intersect(node, ray, tmin, tmax, tentry)) continue;
+
+    if (!node.is_leaf()) {
+      int left = &node - &vol.nodes[0] + 1, right = node.first;
+      double tl, tr;
+      bool hit_l = ray_box_intersect(vol.nodes[left], ray, tmin, tmax, tl);
+      bool hit_r = ray_box_intersect(vol.nodes[right], ray, tmin, tmax, tr);
+      if (hit_l && hit_r) {
+        // push the farther child first so the nearer one is visited first
+        if (tl < tr) std::swap(left, right);
+        stack[sp++] = left;
+        stack[sp++] = right;
+      } else if (hit_l) {
+        stack[sp++] = left;
+      } else if (hit_r) {
+        stack[sp++] = right;
+      }
+      continue;
+    }
+
+    for (int i = node.first; i < node.first + node.count; i++) {
+      const SurfaceRef& ref = vol.surfaces[i];
+      // orient the facets relative to the volume; surfaces with both
+      // senses in the volume are not filtered
+      int orient = ray_orientation ? *ray_orientation * ref.sense : 0;
+      if (!ref.instance) {
+        ref.tree->ray_intersect(
+            ray, orient ? &orient : NULL, tmax,
+            [&](EntityHandle facet, const double* coords, double dist,
+                bool on_edge) { hit(ref, facet, coords, dist, on_edge); },
+            ref.coords);
+        continue;
+      }
+
+      // an instance is traced in the frame of its prototype, where the
+      // distances along the ray are the same
+      const Instance& instance = *ref.instance;
+      double origin[3], dir[3];
+      instance.to_local(ray.origin, origin);
+      instance.dir_to_local(ray.dir, dir);
+      BVHRay local_ray(origin, dir, ray.neg_len, ray.use_neg_len);
+      ref.tree->ray_intersect(
+          local_ray, orient ? &orient : NULL, tmax,
+          [&](EntityHandle facet, const double* coords, double dist,
+              bool on_edge) {
+            double world[9];
+            for (int v = 0; v < 3; v++)
+              instance.to_world(coords + 3 * v, world + 3 * v);
+            hit(ref, facet | instance.facet_key, world, dist, on_edge);
+          },
+          ref.coords);
+    }
+  }
+}
+
+template <typename HitFn>
+void NativeRayTracer::volume_packet_intersect(const VolumeBVH& vol,
+                                              const BVHRayPacket& packet,
+                                              unsigned active,
+                                              const int* ray_orientation,
+                                              double tmax[BVH_PACKET_WIDTH],
+                                              HitFn&& hit) const {
+  traverse_ray_packet(
+      vol.nodes.data(), vol.nodes.size(), packet, active, tmax, bvh_counts(),
+      [&](const BVHNode& node, unsigned lanes) {
+        for (int i = node.first; i < node.first + node.count; i++) {
+          const SurfaceRef& ref = vol.surfaces[i];
+          int orient = ray_orientation ? *ray_orientation * ref.sense : 0;
+          if (!ref.instance) {
+            ref.tree->ray_intersect(
+                packet, lanes, orient ? &orient : NULL, tmax,
+                [&](int lane, EntityHandle facet, const double* coords,
+                    double dist, bool on_edge) {
+                  hit(lane, ref, facet, coords, dist, on_edge);
+                },
+                ref.coords);
+            continue;
+          }
+
+          // the packet moved to the frame of the prototype
+          const Instance& instance = *ref.instance;
+          BVHRay local_rays[BVH_PACKET_WIDTH];
+          for (int lane = 0; lane < packet.count; lane++) {
+            const BVHRay& ray = packet.rays[lane];
+            double origin[3], dir[3];
+            instance.to_local(ray.origin, origin);
+            instance.dir_to_local(ray.dir, dir);
+            local_rays[lane] =
+                BVHRay(origin, dir, ray.neg_len, ray.use_neg_len);
+          }
+          BVHRayPacket local_packet(local_rays, packet.count);
+          ref.tree->ray_intersect(
+              local_packet, lanes, orient ? &orient : NULL, tmax,
+              [&](int lane, EntityHandle facet, const double* coords,
+                  double dist, bool on_edge) {
+                double world[9];
+                for (int v = 0; v < 3; v++)
+                  instance.to_world(coords + 3 * v, world + 3 * v);
+                hit(lane, ref, facet | instance.facet_key, world, dist,
+                    on_edge);
+              },
+              ref.coords);
+        }
+      });
+}
+
+ErrorCode NativeRayTracer::ray_fire(
+    const EntityHandle volume, const double point[3], const double dir[3],
+    EntityHandle& next_surf, double& next_surf_dist, RayHistory* history,
+    double user_dist_limit, int ray_orientation,
+    OrientedBoxTreeTool::TrvStats* stats) const {
+  const VolumeBVH* vol = find_volume(volume);
+  if (!vol) MB_SET_ERR(MB_FAILURE, "No BVH for volume " << volume);
+
+  // with overlaps, also look behind the ray origin for a surface the
+  // particle should already have left through
+  double tmax = user_dist_limit > 0 ? user_dist_limit
+                                    : std::numeric_limits<double>::max();
+  BVHRay ray(point, dir, -overlapThickness, 0 != overlapThickness);
+
+  double pos_dist = std::numeric_limits<double>::max();
+  double neg_dist = -std::numeric_limits<double>::max();
+  EntityHandle pos_surf = 0, pos_facet = 0, neg_surf = 0, neg_facet = 0;
+  volume_ray_intersect(
+      *vol, ray, &ray_orientation, tmax,
+      [&](const SurfaceRef& ref, EntityHandle facet, const double* coords,
+          double dist, bool on_edge) {
+        if (in_history(history, facet)) return;
+        if (dist >= 0.0) {
+          if (dist < pos_dist) {
+            pos_dist = dist;
+            pos_surf = ref.surface;
+            pos_facet = facet;
+            tmax = dist;
+          }
+        } else if (dist > neg_dist) {
+          neg_dist = dist;
+          neg_surf = ref.surface;
+          neg_facet = facet;
+        }
+      });
+
+  if (neg_surf) {
+    // the ray starts inside an overlap, leave through the surface behind it
+    next_surf = neg_surf;
+    next_surf_dist = 0.0;
+    if (history) history->add_entity(neg_facet);
+  } else if (pos_surf) {
+    next_surf = pos_surf;
+    next_surf_dist = pos_dist;
+    if (history) history->add_entity(pos_facet);
+  } else {
+    next_surf = 0;
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::ray_fire_packet(
+    const EntityHandle volume, int n_rays, const double* origins,
+    const double* dirs, EntityHandle* next_surfs, double* next_surf_dists,
+    RayHistory* histories, const double* dist_limits,
+    int ray_orientation) const {
+  const VolumeBVH* vol = find_volume(volume);
+  if (!vol) MB_SET_ERR(MB_FAILURE, "No BVH for volume " << volume);
+
+  for (int first = 0; first < n_rays; first += BVH_PACKET_WIDTH) {
+    int count = std::min(BVH_PACKET_WIDTH, n_rays - first);
+    BVHRay rays[BVH_PACKET_WIDTH];
+    double tmax[BVH_PACKET_WIDTH];
+    double pos_dist[BVH_PACKET_WIDTH], neg_dist[BVH_PACKET_WIDTH];
+    EntityHandle pos_surf[BVH_PACKET_WIDTH], pos_facet[BVH_PACKET_WIDTH];
+    EntityHandle neg_surf[BVH_PACKET_WIDTH], neg_facet[BVH_PACKET_WIDTH];
+    for (int lane = 0; lane < BVH_PACKET_WIDTH; lane++) {
+      int i = first + std::min(lane, count - 1);
+      double point[3] = {origins[i], origins[n_rays + i],
+                         origins[2 * n_rays + i]};
+      double dir[3] = {dirs[i], dirs[n_rays + i], dirs[2 * n_rays + i]};
+      rays[lane] = BVHRay(point, dir, -overlapThickness, 0 != overlapThickness);
+      double limit = dist_limits ? dist_limits[i] : 0.0;
+      tmax[lane] = limit > 0 ? limit : std::numeric_limits<double>::max();
+      pos_dist[lane] = std::numeric_limits<double>::max();
+      neg_dist[lane] = -std::numeric_limits<double>::max();
+      pos_surf[lane] = pos_facet[lane] = neg_surf[lane] = neg_facet[lane] = 0;
+    }
+
+    // the hits of each ray are handled as in ray_fire
+    BVHRayPacket packet(rays, count);
+    RayHistory* packet_histories = histories ? histories + first : NULL;
+    volume_packet_intersect(
+        *vol, packet, (1u << count) - 1, &ray_orientation, tmax,
+        [&](int lane, const SurfaceRef& ref, EntityHandle facet,
+            const double* coords, double dist, bool on_edge) {
+          if (packet_histories && in_history(&packet_histories[lane], facet))
+            return;
+          if (dist >= 0.0) {
+            if (dist < pos_dist[lane]) {
+              pos_dist[lane] = dist;
+              pos_surf[lane] = ref.surface;
+              pos_facet[lane] = facet;
+              tmax[lane] = dist;
+            }
+          } else if (dist > neg_dist[lane]) {
+            neg_dist[lane] = dist;
+            neg_surf[lane] = ref.surface;
+            neg_facet[lane] = facet;
+          }
+        });
+
+    for (int lane = 0; lane < count; lane++) {
+      int i = first + lane;
+      RayHistory* history = packet_histories ? &packet_histories[lane] : NULL;
+      if (neg_surf[lane]) {
+        next_surfs[i] = neg_surf[lane];
+        next_surf_dists[i] = 0.0;
+        if (history) history->add_entity(neg_facet[lane]);
+      } else if (pos_surf[lane]) {
+        next_surfs[i] = pos_surf[lane];
+        next_surf_dists[i] = pos_dist[lane];
+        if (history) history->add_entity(pos_facet[lane]);
+      } else {
+        next_surfs[i] = 0;
+      }
+    }
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::point_in_volume(const EntityHandle volume,
+                                           const double xyz[3], int& result,
+                                           const double* uvw,
+                                           const RayHistory* history) const {
+  const VolumeBVH* vol = find_volume(volume);
+  if (!vol) MB_SET_ERR(MB_FAILURE, "No BVH for volume " << volume);
+
+  // a point outside the bounding box cannot be in the volume
+  for (int i = 0; i < 3; i++) {
+    if (xyz[i] < vol->box.lo[i] || xyz[i] > vol->box.hi[i]) {
+      result = 0;
+      return MB_SUCCESS;
+    }
+  }
+
+  double dir[3] = {0.0, 0.0, 0.0};
+  if (uvw) std::copy(uvw, uvw + 3, dir);
+  if (0.0 == dir[0] && 0.0 == dir[1] && 0.0 == dir[2]) random_direction(dir);
+
+  BVHRay ray(xyz, dir);
+  double tmax = 1e15;
+
+  // Without overlaps only the first crossing is needed. With overlaps the
+  // crossings to infinity are counted: more exits than entrances means
+  // the point is inside.
+  if (0 == overlapThickness) {
+    double best = std::numeric_limits<double>::max();
+    int dir_result = -2;
+    volume_ray_intersect(
+        *vol, ray, NULL, tmax,
+        [&](const SurfaceRef& ref, EntityHandle facet, const double* coords,
+            double dist, bool on_edge) {
+          if (in_history(history, facet)) return;
+          if (dist < best) {
+            best = dist;
+            dir_result = boundary_case(coords, ref.sense, dir);
+            tmax = dist;
+          }
+        });
+    if (-2 == dir_result)
+      result = 0;  // no crossing, pt is outside
+    else if (1 == dir_result)
+      result = 0;  // entering, pt is outside
+    else if (0 == dir_result)
+      result = 1;  // leaving, pt is inside
+    else
+      MB_SET_ERR(MB_FAILURE, "direction==tangent");
+    return MB_SUCCESS;
+  }
+
+  struct Crossing {
+    double dist;
+    EntityHandle surface;
+    int dir;
+  };
+  std::vector<Crossing> crossings;
+  volume_ray_intersect(
+      *vol, ray, NULL, tmax,
+      [&](const SurfaceRef& ref, EntityHandle facet, const double* coords,
+          double dist, bool on_edge) {
+        if (in_history(history, facet)) return;
+        int d = boundary_case(coords, ref.sense, dir);
+        // a hit on an edge or vertex is seen by every facet sharing it
+        if (on_edge) {
+          for (const auto& c : crossings) {
+            if (c.dist == dist && c.surface == ref.surface && c.dir == d)
+              return;
+          }
+        }
+        crossings.push_back({dist, ref.surface, d});
+      });
+
+  int sum = 0;
+  for (const auto& c : crossings) {
+    if (1 == c.dir)
+      sum += 1;  // +1 for entering
+    else if (0 == c.dir)
+      sum -= 1;  // -1 for leaving
+  }
+  if (0 < sum)
+    result = 0;
+  else if (0 > sum)
+    result = 1;
+  else
+    result = GTT->is_implicit_complement(volume) ? 1 : 0;
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::point_in_volume_slow(const EntityHandle volume,
+                                                const double xyz[3],
+                                                int& result) const {
+  const VolumeBVH* vol = find_volume(volume);
+  if (!vol) MB_SET_ERR(MB_FAILURE, "No BVH for volume " << volume);
+
+  // the solid angle of a closed surface is 4 pi from inside, 0 from outside
+  double sum = 0.0;
+  for (const auto& ref : vol->surfaces) {
+    if (!ref.sense) continue;
+    // solid angles do not change under a rigid transform
+    double local[3];
+    const double* p = xyz;
+    if (ref.instance) {
+      ref.instance->to_local(xyz, local);
+      p = local;
+    }
+    double sub_sum = 0.0;
+    ref.tree->for_each_facet(
+        [&](EntityHandle, const double* coords) {
+          sub_sum += tri_solid_angle(coords, p);
+        },
+        ref.coords);
+    sum += ref.sense * sub_sum;
+  }
+  result = fabs(sum) > 2.0 * M_PI;
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::test_volume_boundary(
+    const EntityHandle volume, const EntityHandle surface, const double xyz[3],
+    const double uvw[3], int& result, const RayHistory* history) const {
+  EntityHandle facet = 0;
+  if (history && history->size()) {
+    // the current facet is the last one in the history
+    ErrorCode rval = history->get_last_intersection(facet);
+    MB_CHK_SET_ERR(rval, "Failed to get the last intersection");
+  } else {
+    const Instance* instance = find_instance(surface);
+    EntityHandle tree_surf = instance ? instance->prototype : surface;
+    double local[3] = {xyz[0], xyz[1], xyz[2]};
+    if (instance) instance->to_local(xyz, local);
+    std::shared_ptr<const TriangleBVH> tree = find_surface(tree_surf);
+    if (!tree) MB_SET_ERR(MB_FAILURE, "No BVH for surface " << surface);
+    double dist_sqr = std::numeric_limits<double>::max();
+    double closest[3];
+    tree->closest_to_location(local, dist_sqr, closest, facet,
+                              facet_coords(tree_surf));
+    if (!facet) MB_SET_ERR(MB_FAILURE, "Surface " << surface << " is empty");
+  }
+
+  int sense;
+  ErrorCode rval = GTT->get_sense(surface, volume, sense);
+  MB_CHK_SET_ERR(rval, "Failed to get the surface sense");
+  double coords[9];
+  rval = get_facet_coords(surface, facet, coords);
+  MB_CHK_ERR(rval);
+  result = boundary_case(coords, sense, uvw);
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::closest_to_location(EntityHandle volume,
+                                               const double point[3],
+                                               double& result,
+                                               EntityHandle* surface) const {
+  const VolumeBVH* vol = find_volume(volume);
+  if (!vol) MB_SET_ERR(MB_FAILURE, "No BVH for volume " << volume);
+
+  double best = std::numeric_limits<double>::max();
+  double closest[3];
+  EntityHandle facet = 0, closest_surf = 0;
+
+  int stack[BVH_MAX_DEPTH];
+  int sp = 0;
+  if (!vol->nodes.empty()) stack[sp++] = 0;
+  while (sp > 0) {
+    const BVHNode& node = vol->nodes[stack[--sp]];
+    if (point_box_dist_sqr(node, point) > best) continue;
+    if (node.is_leaf()) {
+      for (int i = node.first; i < node.first + node.count; i++) {
+        const SurfaceRef& ref = vol->surfaces[i];
+        // distances do not change under a rigid transform
+        double local[3];
+        const double* p = point;
+        if (ref.instance) {
+          ref.instance->to_local(point, local);
+          p = local;
+        }
+        if (ref.tree->closest_to_location(p, best, closest, facet, ref.coords))
+          closest_surf = ref.surface;
+      }
+    } else {
+      int left = &node - &vol->nodes[0] + 1, right = node.first;
+      // visit the nearer child first
+      if (point_box_dist_sqr(vol->nodes[left], point) <
+          point_box_dist_sqr(vol->nodes[right], point))
+        std::swap(left, right);
+      stack[sp++] = left;
+      stack[sp++] = right;
+    }
+  }
+
+  result = sqrt(best);
+  if (surface) *surface = closest_surf;
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::safety_distance(EntityHandle volume,
+                                           const double point[3],
+                                           double& result) const {
+  const VolumeBVH* vol = find_volume(volume);
+  if (!vol) MB_SET_ERR(MB_FAILURE, "No BVH for volume " << volume);
+
+  double best = std::numeric_limits<double>::max();
+  int stack[BVH_MAX_DEPTH];
+  int sp = 0;
+  if (!vol->nodes.empty()) stack[sp++] = 0;
+  while (sp > 0 && best > 0.0) {
+    const BVHNode& node = vol->nodes[stack[--sp]];
+    if (point_box_dist_sqr(node, point) >= best) continue;
+    if (node.is_leaf()) {
+      for (int i = node.first; i < node.first + node.count; i++) {
+        const SurfaceRef& ref = vol->surfaces[i];
+        double local[3];
+        const double* p = point;
+        if (ref.instance) {
+          ref.instance->to_local(point, local);
+          p = local;
+        }
+        ref.tree->dist_sqr_lower_bound(p, best);
+      }
+    } else {
+      int left = &node - &vol->nodes[0] + 1, right = node.first;
+      // visit the nearer child first
+      if (point_box_dist_sqr(vol->nodes[left], point) <
+          point_box_dist_sqr(vol->nodes[right], point))
+        std::swap(left, right);
+      stack[sp++] = left;
+      stack[sp++] = right;
+    }
+  }
+
+  result = sqrt(best);
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::measure_volume(EntityHandle volume,
+                                          double& result) const {
+  std::vector<EntityHandle> child_surfs;
+  ErrorCode rval = MBI->get_child_meshsets(volume, child_surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get the surfaces of volume " << volume);
+  std::vector<int> senses(child_surfs.size());
+  if (!child_surfs.empty()) {
+    rval = GTT->get_surface_senses(volume, child_surfs.size(), &child_surfs[0],
+                                   &senses[0]);
+    MB_CHK_SET_ERR(rval, "Surface-Volume relative sense not available. "
+                             << "Cannot calculate volume.");
+  }
+
+  result = 0.0;
+  std::vector<double> coords;
+  std::vector<EntityHandle> handles;
+  for (size_t i = 0; i < child_surfs.size(); i++) {
+    // skip non-manifold surfaces
+    if (!senses[i]) continue;
+    rval = get_surface_triangles(child_surfs[i], coords, handles);
+    MB_CHK_ERR(rval);
+    // signed volume beneath the surface (x 6.0)
+    double surf_sum = 0.0;
+    for (size_t j = 0; j < handles.size(); j++) {
+      const double* c = &coords[9 * j];
+      double normal[3];
+      facet_normal(c, normal);
+      surf_sum += c[0] * normal[0] + c[1] * normal[1] + c[2] * normal[2];
+    }
+    result += senses[i] * surf_sum;
+  }
+  result /= 6.0;
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::measure_area(EntityHandle surface,
+                                        double& result) const {
+  std::vector<double> coords;
+  std::vector<EntityHandle> handles;
+  ErrorCode rval = get_surface_triangles(surface, coords, handles);
+  MB_CHK_ERR(rval);
+
+  result = 0.0;
+  for (size_t j = 0; j < handles.size(); j++) {
+    double normal[3];
+    facet_normal(&coords[9 * j], normal);
+    result += sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                   normal[2] * normal[2]);
+  }
+  result *= 0.5;
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::count_surface_triangles(EntityHandle surface,
+                                                   int& n) const {
+  if (const Instance* instance = find_instance(surface))
+    return count_surface_triangles(instance->prototype, n);
+  if (compactMesh.has_surface(surface)) {
+    n = compactMesh.num_triangles(surface);
+    return MB_SUCCESS;
+  }
+  ErrorCode rval = MBI->get_number_entities_by_type(surface, MBTRI, n);
+  MB_CHK_SET_ERR(rval, "Failed to count the triangles of " << surface);
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::get_normal(EntityHandle surf, const double xyz[3],
+                                      double angle[3],
+                                      const RayHistory* history) const {
+  std::vector<EntityHandle> facets;
+  if (history && history->size()) {
+    // use the most recent facet in the history
+    EntityHandle facet;
+    ErrorCode rval = history->get_last_intersection(facet);
+    MB_CHK_SET_ERR(rval, "Failed to get the last intersection");
+    facets.push_back(facet);
+  } else {
+    // otherwise average the facets closest to the point
+    const Instance* instance = find_instance(surf);
+    EntityHandle tree_surf = instance ? instance->prototype : surf;
+    double local[3] = {xyz[0], xyz[1], xyz[2]};
+    if (instance) instance->to_local(xyz, local);
+    std::shared_ptr<const TriangleBVH> tree = find_surface(tree_surf);
+    if (!tree) MB_SET_ERR(MB_FAILURE, "No BVH for surface " << surf);
+    double dist_sqr = std::numeric_limits<double>::max();
+    double closest[3];
+    EntityHandle facet = 0;
+    FacetCoordsFn exact = facet_coords(tree_surf);
+    tree->closest_to_location(local, dist_sqr, closest, facet, exact);
+    if (!facet) MB_SET_ERR(MB_FAILURE, "Surface " << surf << " is empty");
+    tree->facets_within(local, sqrt(dist_sqr) + numericalPrecision, facets,
+                        exact);
+  }
+
+  double normal[3] = {0.0, 0.0, 0.0};
+  for (size_t i = 0; i < facets.size(); i++) {
+    double coords[9], n[3];
+    ErrorCode rval = get_facet_coords(surf, facets[i], coords);
+    MB_CHK_ERR(rval);
+    facet_normal(coords, n);
+    for (int j = 0; j < 3; j++) normal[j] += n[j];
+  }
+  double len = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                    normal[2] * normal[2]);
+  for (int j = 0; j < 3; j++) angle[j] = normal[j] / len;
+  return MB_SUCCESS;
+}
+
+/* SECTION III: Bounding boxes and tolerances */
+
+ErrorCode NativeRayTracer::get_bbox(EntityHandle volume, double min[3],
+                                    double max[3]) const {
+  const VolumeBVH* vol = find_volume(volume);
+  if (!vol) MB_SET_ERR(MB_FAILURE, "No BVH for volume " << volume);
+  std::copy(vol->box.lo, vol->box.lo + 3, min);
+  std::copy(vol->box.hi, vol->box.hi + 3, max);
+  return MB_SUCCESS;
+}
+
+ErrorCode NativeRayTracer::get_obb(EntityHandle volume, double center[3],
+                                   double axis1[3], double axis2[3],
+                                   double axis3[3]) const {
+  double min[3], max[3];
+  ErrorCode rval = get_bbox(volume, min, max);
+  MB_CHK_ERR(rval);
+  double* axes[3] = {axis1, axis2, axis3};
+  for (int i = 0; i < 3; i++) {
+    center[i] = 0.5 * (min[i] + max[i]);
+    for (int j = 0; j < 3; j++)
+      axes[i][j] = i == j ? 0.5 * (max[i] - min[i]) : 0.0;
+  }
+  return MB_SUCCESS;
+}
+
+void NativeRayTracer::set_overlap_thickness(double new_thickness) {
+  if (new_thickness < 0 || new_thickness > 100) {
+    std::cerr << "Invalid overlap_thickness = " << new_thickness << std::endl;
+  } else {
+    overlapThickness = new_thickness;
+  }
+}
+
+void NativeRayTracer::set_numerical_precision(double new_precision) {
+  if (new_precision <= 0 || new_precision > 1) {
+    std::cerr << "Invalid numerical_precision = " << new_precision
+              << std::endl;
+  } else {
+    numericalPrecision = new_precision;
+  }
+}
+
+}  // namespace moab
@@ -0,0 +1,316 @@
+#ifndef DAGMC_NATIVE_RAY_TRACER_HPP
+#define DAGMC_NATIVE_RAY_TRACER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BVH.hpp"
+#include "BVHCache.hpp"
+#include "CompactMesh.hpp"
+#include "CompactRayHistory.hpp"
+#include "moab/GeomQueryTool.hpp"
+#include "moab/GeomTopoTool.hpp"
+#include "moab/Interface.hpp"
+#include "moab/Range.hpp"
+
+namespace moab {
+
+/**\brief Ray tracing on DAGMC's built-in BVH
+ *
+ * A drop-in replacement for GeomQueryTool that answers the same queries
+ * with the same semantics (ray orientation, overlap thickness, ray
+ * histories) from flattened BVHs instead of MOAB's entity-set OBB trees.
+ *
+ * Each surface gets a BVH over its triangles, whose coordinates are copied
+ * into cache-aligned blocks so that queries never call back into MOAB. Each
+ * volume gets a small top-level BVH over its surfaces, so surface trees are
+ * shared between the two volumes on either side of a surface. In BVH_MIXED
+ * precision the copies are single precision, and the candidate triangles
+ * they find are re-checked on MOAB's coordinates (see TriangleBVH).
+ *
+ * With set_compact_mesh the triangles are read from a CompactMesh instead
+ * of MOAB, and MOAB's copies of them may be deleted. Surfaces added to MOAB
+ * later are still read from MOAB. The surface trees and compact mesh can be
+ * shared between processes through a BVH cache file or a SharedBVHCache.
+ *
+ * A surface tagged as an instance (see get_instance_tags) has no triangles
+ * of its own: it is its prototype surface moved by a rigid transform and
+ * shares the prototype's tree, so a component repeated many times is
+ * faceted and built once. The volume BVHs over their surfaces act as the
+ * top-level BVHs over the instances. The facets of an instance are
+ * reported as the prototype's handles with an instance key in bits 40-59,
+ * which keeps the copies apart in ray histories; facet handles must have
+ * ids below 2^40.
+ *
+ * The MOAB geometry sets must not change while the BVHs are in use; call
+ * deleteBVH/createBVH around any change to a volume.
+ */
+class NativeRayTracer {
+ public:
+  typedef CompactRayHistory RayHistory;
+
+  NativeRayTracer(std::shared_ptr<GeomTopoTool> gtt,
+                  double overlap_thickness = 0.,
+                  double numerical_precision = 0.001);
+  NativeRayTracer(const NativeRayTracer&) = delete;
+  NativeRayTracer& operator=(const NativeRayTracer&) = delete;
+
+  /** build BVHs for every volume, including the implicit complement;
+   *  surface trees are built on get_num_threads() threads, and those read
+   *  by load_cache or load_shared_cache are used instead of being rebuilt.
+   *  The compact mesh is built first if enabled and not read. */
+  ErrorCode init();
+
+  /** hash of the triangle handles and coordinates of every surface */
+  ErrorCode geometry_hash(uint64_t& hash) const;
+
+  /** read the surface trees, and the compact mesh if enabled, of a BVH
+   *  cache file written for hash, to be used by the next call to init()
+   *  (see read_bvh_cache) */
+  ErrorCode load_cache(const std::string& filename, uint64_t hash);
+
+  /** write the surface trees of every volume, and the compact mesh if
+   *  enabled, to a BVH cache file */
+  ErrorCode save_cache(const std::string& filename, uint64_t hash) const;
+
+  /** open the shared memory segment name (see SharedBVHCache); the leader
+   *  builds the trees with init() and publishes them, the others read them
+   *  with load_shared_cache */
+  ErrorCode join_shared_cache(const std::string& name, bool& leader);
+
+  /** wait up to max_wait seconds for the leader of the joined segment and
+   *  read its surface trees and compact mesh, to be used by the next call
+   *  to init(); hash is set to the geometry hash they were published with */
+  ErrorCode load_shared_cache(double max_wait, uint64_t& hash);
+
+  /** leader: publish the surface trees and compact mesh in the joined
+   *  segment, then replace them with views of it
+   *\return an error, with this process' own trees still in use, if the
+   *  segment could not be written (it is then marked failed) or mapped */
+  ErrorCode publish_shared_cache(uint64_t hash);
+
+  /** the tags of an instance surface: its prototype surface, a handle,
+   *  and its transform, a row-major rotation followed by a translation (12
+   *  doubles). Unless create is set, returns MB_TAG_NOT_FOUND if the model
+   *  has no instances. */
+  static ErrorCode get_instance_tags(Interface* mbi, Tag& prototype_tag,
+                                     Tag& transform_tag, bool create = true);
+
+  /** build the BVH of a single volume (and of any surface missing one);
+   *  re-reads the transforms of its instance surfaces */
+  ErrorCode createBVH(EntityHandle volume);
+
+  /** remove a volume's BVH, freeing surface trees no other volume uses */
+  void deleteBVH(EntityHandle volume);
+
+  /** true if any volume has a BVH */
+  bool has_bvh() const { return !volumes.empty(); }
+
+  ErrorCode ray_fire(const EntityHandle volume, const double point[3],
+                     const double dir[3], EntityHandle& next_surf,
+                     double& next_surf_dist, RayHistory* history = NULL,
+                     double user_dist_limit = 0, int ray_orientation = 1,
+                     OrientedBoxTreeTool::TrvStats* stats = NULL) const;
+
+  /**\brief ray_fire for n_rays rays, traced in packets of
+   * BVH_PACKET_WIDTH rays that share one traversal of the trees
+   *
+   * origins and dirs hold the x, then the y, then the z components of the
+   * rays (see DagMC::ray_fire_batch); histories and dist_limits may be
+   * null. Each ray gets the result ray_fire would give it. The triangles
+   * of a leaf are still tested one ray at a time, so this is about as fast
+   * as ray_fire per ray.
+   */
+  ErrorCode ray_fire_packet(const EntityHandle volume, int n_rays,
+                            const double* origins, const double* dirs,
+                            EntityHandle* next_surfs, double* next_surf_dists,
+                            RayHistory* histories = NULL,
+                            const double* dist_limits = NULL,
+                            int ray_orientation = 1) const;
+
+  ErrorCode point_in_volume(const EntityHandle volume, const double xyz[3],
+                            int& result, const double* uvw = NULL,
+                            const RayHistory* history = NULL) const;
+
+  ErrorCode point_in_volume_slow(const EntityHandle volume,
+                                 const double xyz[3], int& result) const;
+
+  ErrorCode test_volume_boundary(const EntityHandle volume,
+                                 const EntityHandle surface,
+                                 const double xyz[3], const double uvw[3],
+                                 int& result,
+                                 const RayHistory* history = NULL) const;
+
+  ErrorCode closest_to_location(EntityHandle volume, const double point[3],
+                                double& result,
+                                EntityHandle* surface = 0) const;
+
+  /** lower bound on the distance from point to the surfaces of volume,
+   *  from the bounding boxes of the BVH nodes and triangles alone */
+  ErrorCode safety_distance(EntityHandle volume, const double point[3],
+                            double& result) const;
+
+  ErrorCode measure_volume(EntityHandle volume, double& result) const;
+
+  ErrorCode measure_area(EntityHandle surface, double& result) const;
+
+  /** copy the triangles of a surface out of the compact mesh or MOAB; not
+   *  thread safe unless the surface is in the compact mesh */
+  ErrorCode get_surface_triangles(EntityHandle surface,
+                                  std::vector<double>& coords,
+                                  std::vector<EntityHandle>& handles) const;
+
+  /** number of triangles of a surface, in the compact mesh or MOAB */
+  ErrorCode count_surface_triangles(EntityHandle surface, int& n) const;
+
+  ErrorCode get_normal(EntityHandle surf, const double xyz[3],
+                       double angle[3],
+                       const RayHistory* history = NULL) const;
+
+  /** axis-aligned bounding box of a volume */
+  ErrorCode get_bbox(EntityHandle volume, double min[3], double max[3]) const;
+
+  /** the axis-aligned bounding box of a volume in OBB form; the axes are
+   *  scaled to the half-widths of the box */
+  ErrorCode get_obb(EntityHandle volume, double center[3], double axis1[3],
+                    double axis2[3], double axis3[3]) const;
+
+  double get_overlap_thickness() const { return overlapThickness; }
+  double get_numerical_precision() const { return numericalPrecision; }
+  void set_overlap_thickness(double new_thickness);
+  void set_numerical_precision(double new_precision);
+
+  /** precision of the surface trees built from now on */
+  void set_precision(BVHPrecision new_precision) { precision = new_precision; }
+  BVHPrecision get_precision() const { return precision; }
+
+  /** bytes used by the surface and volume trees */
+  size_t memory_size() const;
+
+  /** read the triangles of every surface from a compact mesh, built by
+   *  the next init(), instead of MOAB */
+  void set_compact_mesh(bool compact) { useCompactMesh = compact; }
+  const CompactMesh& get_compact_mesh() const { return compactMesh; }
+
+  /** read surfaces from MOAB again, for surfaces deleted from MOAB */
+  void remove_from_compact_mesh(const Range& surfs);
+
+  /** number of threads init() builds surface trees on; 0 uses every
+   *  hardware thread */
+  void set_num_threads(int n_threads) { numThreads = n_threads; }
+  int get_num_threads() const;
+
+ private:
+  /** an instance surface, see get_instance_tags */
+  struct Instance {
+    EntityHandle prototype;
+    /** x' = rotation x + translation, rotation row-major */
+    double rotation[9];
+    double translation[3];
+    /** or-ed into the prototype's facet handles */
+    EntityHandle facet_key;
+
+    void to_world(const double local[3], double world[3]) const;
+    void to_local(const double world[3], double local[3]) const;
+    /** a direction in the prototype's frame */
+    void dir_to_local(const double world[3], double local[3]) const;
+    /** the bounding box of a box of the prototype once moved */
+    BVHBox to_world(const BVHBox& local) const;
+  };
+
+  /** a surface as seen from one volume */
+  struct SurfaceRef {
+    EntityHandle surface;
+    int sense;
+    /** the tree of the surface, or of its prototype */
+    std::shared_ptr<const TriangleBVH> tree;
+    /** exact coordinates of the tree's facets for BVH_MIXED trees */
+    FacetCoordsFn coords;
+    /** null unless the surface is an instance */
+    std::shared_ptr<const Instance> instance;
+  };
+
+  /** top-level BVH of a volume; leaves address ranges of surfaces */
+  struct VolumeBVH {
+    std::vector<BVHNode> nodes;
+    std::vector<SurfaceRef> surfaces;
+    BVHBox box;
+  };
+
+  const VolumeBVH* find_volume(EntityHandle volume) const;
+
+  /** read the instance tags of a surface into instances; instance is null
+   *  if the surface is not an instance */
+  ErrorCode update_instance(Tag prototype_tag, Tag transform_tag,
+                            EntityHandle surface,
+                            std::shared_ptr<const Instance>& instance);
+
+  /** the instance a surface was last built as, or null */
+  const Instance* find_instance(EntityHandle surface) const;
+
+  /** copy the triangles of every surface into the compact mesh */
+  ErrorCode build_compact_mesh();
+
+  /** the surface trees in use; held keeps them alive */
+  void used_surface_trees(
+      std::vector<std::pair<EntityHandle, const TriangleBVH*>>& trees,
+      std::vector<std::shared_ptr<const TriangleBVH>>& held) const;
+
+  /** shared surface tree, or null if no volume using it has a BVH */
+  std::shared_ptr<const TriangleBVH> find_surface(EntityHandle surface) const;
+
+  ErrorCode get_facet_coords(EntityHandle surface, EntityHandle facet,
+                             double coords[9]) const;
+
+  /** get_facet_coords of the facets of a surface */
+  FacetCoordsFn facet_coords(EntityHandle surface) const;
+
+  /** build the trees of every surface of vols that has none, in parallel */
+  ErrorCode build_surface_trees(const Range& vols);
+
+  /** visit every intersection of a ray with the surfaces of a volume;
+   *  hit(ref, facet, coords, dist, on_edge) is called for each */
+  template <typename HitFn>
+  void volume_ray_intersect(const VolumeBVH& vol, const BVHRay& ray,
+                            const int* ray_orientation, double& tmax,
+                            HitFn&& hit) const;
+
+  /** volume_ray_intersect for the rays of the lanes of active;
+   *  hit(lane, ref, facet, coords, dist, on_edge) may lower tmax[lane] */
+  template <typename HitFn>
+  void volume_packet_intersect(const VolumeBVH& vol,
+                               const BVHRayPacket& packet, unsigned active,
+                               const int* ray_orientation,
+                               double tmax[BVH_PACKET_WIDTH],
+                               HitFn&& hit) const;
+
+  std::shared_ptr<GeomTopoTool> GTT;
+  Interface* MBI;
+
+  std::unordered_map<EntityHandle, VolumeBVH> volumes;
+  std::unordered_map<EntityHandle, std::weak_ptr<const TriangleBVH>> surfaces;
+  /** instance surfaces seen by createBVH; their facet keys never change */
+  std::unordered_map<EntityHandle, std::shared_ptr<const Instance>> instances;
+  uint64_t numInstanceKeys = 0;
+  /** surface trees read from a cache file or built ahead by init(),
+   *  waiting for createBVH */
+  std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>>
+      pending_surfaces;
+
+  double overlapThickness;
+  double numericalPrecision;
+  int numThreads;
+  BVHPrecision precision;
+  CompactMesh compactMesh;
+  bool useCompactMesh;
+  /** joined shared memory segment; the leader's removes its name when the
+   *  tracer is destroyed */
+  std::unique_ptr<SharedBVHCache> sharedCache;
+};
+
+}  // namespace moab
+
+#endif
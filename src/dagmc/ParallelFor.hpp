@@ -0,0 +1,46 @@
+#ifndef DAGMC_PARALLEL_FOR_HPP
+#define DAGMC_PARALLEL_FOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "moab/Types.hpp"
+
+namespace moab {
+
+/** number of threads n_threads asks for; 0 is every hardware thread */
+inline int resolve_num_threads(int n_threads) {
+  if (n_threads > 0) return n_threads;
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**\brief Runs task(i) for every i in [0, n) on up to n_threads threads
+ *
+ * Each thread takes the next unstarted task from a shared counter, so a
+ * few long tasks do not hold up the others. Stops at the first task that
+ * fails and returns its error. The calling thread is one of the threads.
+ */
+template <typename Task>
+ErrorCode parallel_for(size_t n, int n_threads, Task task) {
+  std::atomic<size_t> next(0);
+  std::atomic<int> result(MB_SUCCESS);
+  auto worker = [&]() {
+    for (size_t i = next++; i < n && MB_SUCCESS == result; i = next++) {
+      ErrorCode rval = task(i);
+      if (MB_SUCCESS != rval) result = rval;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < std::min((size_t)n_threads, n); t++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads) thread.join();
+  return (ErrorCode)result.load();
+}
+
+}  // namespace moab
+
+#endif
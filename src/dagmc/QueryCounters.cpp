@@ -0,0 +1,156 @@
+#include "QueryCounters.hpp"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+
+namespace moab {
+
+namespace {
+
+std::atomic<uint64_t> next_counters_id(1);
+
+// the bucket the calling thread last used, and the instance it belongs to
+struct BucketCache {
+  uint64_t owner = 0;
+  void* bucket = NULL;
+};
+thread_local BucketCache bucket_cache;
+
+void write_row(std::ostream& out, const std::string& volume, QueryType type,
+               const QueryStats& stats) {
+  out << volume << "," << query_type_name(type) << "," << stats.calls << ","
+      << stats.seconds << "," << stats.counts.nodes_visited << ","
+      << stats.counts.leaves_visited << "," << stats.counts.triangles_tested
+      << "," << stats.counts.history_hits << "," << stats.counts.retries
+      << "\n";
+}
+
+// the part of stats of n of its calls
+QueryStats share(const QueryStats& stats, uint64_t n) {
+  double f = (double)n / stats.calls;
+  auto part = [f](uint64_t count) { return (uint64_t)(count * f + 0.5); };
+  QueryStats result;
+  result.calls = n;
+  result.seconds = stats.seconds * f;
+  result.counts.nodes_visited = part(stats.counts.nodes_visited);
+  result.counts.leaves_visited = part(stats.counts.leaves_visited);
+  result.counts.triangles_tested = part(stats.counts.triangles_tested);
+  result.counts.history_hits = part(stats.counts.history_hits);
+  result.counts.retries = part(stats.counts.retries);
+  return result;
+}
+
+}  // namespace
+
+const char* query_type_name(QueryType type) {
+  static const char* names[NUM_QUERY_TYPES] = {
+      "ray_fire", "point_in_volume", "test_volume_boundary",
+      "closest_to_location", "safety_lower_bound"};
+  return type < NUM_QUERY_TYPES ? names[type] : "unknown";
+}
+
+QueryCounters::QueryCounters() : on(false), id(next_counters_id++) {
+  const char* env = getenv("DAGMC_QUERY_COUNTERS");
+  if (env && *env && std::string("0") != env) enable(true);
+}
+
+QueryCounters::Bucket& QueryCounters::thread_bucket() {
+  if (bucket_cache.owner == id)
+    return *static_cast<Bucket*>(bucket_cache.bucket);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<Bucket>& bucket = buckets[std::this_thread::get_id()];
+  if (!bucket) bucket.reset(new Bucket);
+  bucket_cache.owner = id;
+  bucket_cache.bucket = bucket.get();
+  return *bucket;
+}
+
+void QueryCounters::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto& bucket : buckets) {
+    bucket.second->volumes.clear();
+    bucket.second->surfaces.clear();
+  }
+}
+
+void QueryCounters::collect(std::map<EntityHandle, VolumeStats>& totals) const {
+  totals.clear();
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto& bucket : buckets) {
+    for (const auto& vol : bucket.second->volumes) {
+      VolumeStats& total = totals[vol.first];
+      for (int t = 0; t < NUM_QUERY_TYPES; t++) total[t].add(vol.second[t]);
+    }
+  }
+}
+
+void QueryCounters::collect_surfaces(
+    std::map<EntityHandle, SurfaceStats>& totals) const {
+  totals.clear();
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto& bucket : buckets) {
+    for (const auto& surf : bucket.second->surfaces) {
+      SurfaceStats& total = totals[surf.first];
+      for (int t = 0; t < NUM_QUERY_TYPES; t++) total[t].add(surf.second[t]);
+    }
+  }
+}
+
+void QueryCounters::write_csv(
+    std::ostream& out,
+    const std::function<int(EntityHandle)>& volume_id) const {
+  std::map<EntityHandle, VolumeStats> totals;
+  collect(totals);
+
+  out << "volume,query,calls,seconds,nodes_visited,leaves_visited,"
+      << "triangles_tested,history_hits,retries\n";
+  VolumeStats all;
+  for (const auto& vol : totals) {
+    std::string name = std::to_string(volume_id(vol.first));
+    for (int t = 0; t < NUM_QUERY_TYPES; t++) {
+      if (0 == vol.second[t].calls && 0 == vol.second[t].counts.retries)
+        continue;
+      write_row(out, name, (QueryType)t, vol.second[t]);
+      all[t].add(vol.second[t]);
+    }
+  }
+  for (int t = 0; t < NUM_QUERY_TYPES; t++)
+    write_row(out, "total", (QueryType)t, all[t]);
+}
+
+void QueryCounters::add_retry(EntityHandle volume, QueryType type) {
+  if (enabled()) thread_bucket().volumes[volume][type].counts.retries++;
+}
+
+void QueryCounters::Scope::begin() {
+  BVHCounts*& current = bvh_counts();
+  outer = current;
+  current = &stats.counts;
+  start = std::chrono::steady_clock::now();
+}
+
+void QueryCounters::Scope::end() {
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  stats.calls = calls;
+  bvh_counts() = outer;
+  Bucket& bucket = owner->thread_bucket();
+  bucket.volumes[volume][type].add(stats);
+  if (surface) bucket.surfaces[surface][type].add(stats);
+  if (packet_surfaces.empty() || 0 == calls) return;
+
+  // each surface gets the share of the queries that answered with it
+  std::sort(packet_surfaces.begin(), packet_surfaces.end());
+  for (size_t i = 0, j; i < packet_surfaces.size(); i = j) {
+    for (j = i; j < packet_surfaces.size(); j++) {
+      if (packet_surfaces[j] != packet_surfaces[i]) break;
+    }
+    bucket.surfaces[packet_surfaces[i]][type].add(share(stats, j - i));
+  }
+}
+
+}  // namespace moab
@@ -0,0 +1,162 @@
+#ifndef DAGMC_QUERY_COUNTERS_HPP
+#define DAGMC_QUERY_COUNTERS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "BVH.hpp"
+#include "moab/Types.hpp"
+
+namespace moab {
+
+/** the geometry queries counted by QueryCounters */
+enum QueryType {
+  QUERY_RAY_FIRE = 0,
+  QUERY_POINT_IN_VOLUME,
+  QUERY_TEST_VOLUME_BOUNDARY,
+  QUERY_CLOSEST_TO_LOCATION,
+  /** safety_distance answered with a lower bound */
+  QUERY_SAFETY_LOWER_BOUND,
+  NUM_QUERY_TYPES
+};
+
+/** name of a query type, e.g. "ray_fire" */
+const char* query_type_name(QueryType type);
+
+/** totals of one type of query on one volume */
+struct QueryStats {
+  uint64_t calls = 0;
+  double seconds = 0.0;
+  BVHCounts counts;
+
+  void add(const QueryStats& other) {
+    calls += other.calls;
+    seconds += other.seconds;
+    counts.add(other.counts);
+  }
+};
+
+/**\brief Per-volume and per-surface counters of the geometry queries of a
+ * DagMC instance
+ *
+ * Every query is counted on its volume. A query that answers with a
+ * surface (the surface a ray hits, the closest surface, the surface whose
+ * boundary is tested) is also counted, with all of its cost, on that
+ * surface.
+ *
+ * Counting is off until enable(true), or from construction if the
+ * environment variable DAGMC_QUERY_COUNTERS is set to anything but 0. Off,
+ * a query costs one relaxed atomic load; on, two clock reads and one or
+ * two hash lookups. Each thread counts into its own buckets without locking, so
+ * reset, collect and write_csv must not run concurrently with queries.
+ *
+ * The traversal counts come from the native BVH (see bvh_counts) and, for
+ * ray_fire on MOAB's OBB trees, from OrientedBoxTreeTool::TrvStats. Other
+ * ray tracers only report calls and time.
+ */
+class QueryCounters {
+ public:
+  typedef std::array<QueryStats, NUM_QUERY_TYPES> VolumeStats;
+  typedef std::array<QueryStats, NUM_QUERY_TYPES> SurfaceStats;
+
+  QueryCounters();
+  QueryCounters(const QueryCounters&) = delete;
+  QueryCounters& operator=(const QueryCounters&) = delete;
+
+  void enable(bool enabled) { on.store(enabled, std::memory_order_relaxed); }
+  bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+  /** forget all counts */
+  void reset();
+
+  /** the counts of all threads, by volume */
+  void collect(std::map<EntityHandle, VolumeStats>& totals) const;
+
+  /** the counts of all threads, by surface */
+  void collect_surfaces(std::map<EntityHandle, SurfaceStats>& totals) const;
+
+  /** write the counts as CSV, one line per volume and query type followed
+   *  by the totals of each query type; volume_id names the volumes */
+  void write_csv(std::ostream& out,
+                 const std::function<int(EntityHandle)>& volume_id) const;
+
+  /** count a query repeated to resolve an ambiguous answer */
+  void add_retry(EntityHandle volume, QueryType type);
+
+  /**\brief Counts one query from construction to destruction
+   *
+   * While a Scope of an enabled QueryCounters exists, the native BVH counts
+   * the traversal work of the calling thread into counts().
+   */
+  class Scope {
+   public:
+    Scope(QueryCounters& counters, EntityHandle volume, QueryType type)
+        : owner(counters.enabled() ? &counters : NULL),
+          volume(volume),
+          type(type) {
+      if (owner) begin();
+    }
+    ~Scope() {
+      if (owner) end();
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    /** the counts of this query, or null if counting is off */
+    BVHCounts* counts() { return owner ? &stats.counts : NULL; }
+
+    /** also count the query on the surface it answered with */
+    void set_surface(EntityHandle surf) { surface = surf; }
+
+    /** count the scope as a packet of n queries, e.g. ray_fire_batch */
+    void set_calls(uint64_t n) { calls = n; }
+
+    /** count one query of a packet on the surface it answered with, which
+     *  is charged that query's share of the packet's time and work */
+    void add_packet_surface(EntityHandle surf) {
+      if (owner) packet_surfaces.push_back(surf);
+    }
+
+   private:
+    void begin();
+    void end();
+
+    QueryCounters* owner;
+    EntityHandle volume;
+    QueryType type;
+    EntityHandle surface = 0;
+    uint64_t calls = 1;
+    std::vector<EntityHandle> packet_surfaces;
+    QueryStats stats;
+    BVHCounts* outer = NULL;
+    std::chrono::steady_clock::time_point start;
+  };
+
+ private:
+  struct Bucket {
+    std::unordered_map<EntityHandle, VolumeStats> volumes;
+    std::unordered_map<EntityHandle, SurfaceStats> surfaces;
+  };
+
+  /** the calling thread's bucket, created on first use */
+  Bucket& thread_bucket();
+
+  std::atomic<bool> on;
+  /** tells instances apart in the threads' bucket caches */
+  const uint64_t id;
+  mutable std::mutex mutex;
+  std::unordered_map<std::thread::id, std::unique_ptr<Bucket>> buckets;
+};
+
+}  // namespace moab
+
+#endif
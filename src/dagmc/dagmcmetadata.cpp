@@ -633,6 +633,85 @@ std::pair<std::string, std::string> dagmcMetaData::split_string(
   return {first, second};
 }
 
+// build the dense property tables
+void dagmcMetaData::compile_tables() {
+  int num_vols = DAG->num_entities(3);
+  int num_surfs = DAG->num_entities(2);
+
+  compiled_material_indices.assign(num_vols + 1, -1);
+  compiled_material_numbers.assign(num_vols + 1, -1);
+  compiled_densities.assign(num_vols + 1, 0.0);
+  compiled_volume_kinds.assign(num_vols + 1, VOLUME_MATERIAL);
+  compiled_materials.clear();
+  compiled_particles.assign(imp_particles.begin(), imp_particles.end());
+  compiled_importances.assign((num_vols + 1) * compiled_particles.size(),
+                              1.0);
+  compiled_boundaries.assign(num_surfs + 1, BOUNDARY_NONE);
+
+  std::map<std::string, int> material_indices;
+  for (int i = 1; i <= num_vols; ++i) {
+    moab::EntityHandle eh = DAG->entity_by_index(3, i);
+
+    auto mat = volume_material_data_eh.find(eh);
+    std::string material =
+        mat == volume_material_data_eh.end() ? "" : mat->second;
+    if (material == graveyard_str) {
+      compiled_volume_kinds[i] = VOLUME_GRAVEYARD;
+    } else if (material == vacuum_str) {
+      compiled_volume_kinds[i] = VOLUME_VACUUM;
+    } else if (!material.empty()) {
+      auto inserted = material_indices.insert(
+          std::make_pair(material, (int)compiled_materials.size()));
+      if (inserted.second) compiled_materials.push_back(material);
+      compiled_material_indices[i] = inserted.first->second;
+      if (try_to_make_int(material))
+        compiled_material_numbers[i] = std::stoi(material);
+    }
+
+    auto rho = volume_density_data_eh.find(eh);
+    if (rho != volume_density_data_eh.end() && !rho->second.empty()) {
+      try {
+        compiled_densities[i] = std::stod(rho->second);
+      } catch (const std::exception& e) {
+        std::stringstream ss;
+        ss << "Can't parse density " << rho->second << " of volume with ID "
+           << DAG->id_by_index(3, i) << " as a float: " << e.what();
+        logger.error(ss.str());
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    auto imps = importance_map.find(eh);
+    if (imps == importance_map.end()) continue;
+    for (size_t j = 0; j < compiled_particles.size(); j++) {
+      auto imp = imps->second.find(compiled_particles[j]);
+      if (imp != imps->second.end())
+        compiled_importances[i * compiled_particles.size() + j] = imp->second;
+    }
+  }
+
+  for (int i = 1; i <= num_surfs; ++i) {
+    auto bc = surface_boundary_data_eh.find(DAG->entity_by_index(2, i));
+    if (bc == surface_boundary_data_eh.end()) continue;
+    if (bc->second == vacuum_str)
+      compiled_boundaries[i] = BOUNDARY_VACUUM;
+    else if (bc->second == reflecting_str)
+      compiled_boundaries[i] = BOUNDARY_REFLECTING;
+    else if (bc->second == white_str)
+      compiled_boundaries[i] = BOUNDARY_WHITE;
+    else if (bc->second == periodic_str)
+      compiled_boundaries[i] = BOUNDARY_PERIODIC;
+  }
+}
+
+int dagmcMetaData::importance_particle_index(
+    const std::string& particle) const {
+  auto it = std::lower_bound(compiled_particles.begin(),
+                             compiled_particles.end(), particle);
+  if (it == compiled_particles.end() || *it != particle) return -1;
+  return it - compiled_particles.begin();
+}
+
 bool dagmcMetaData::try_to_make_int(std::string value) {
   // try to convert the string value into an int
   char* end;
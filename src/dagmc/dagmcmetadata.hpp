@@ -2,6 +2,8 @@
 #define SRC_DAGMC_DAGMCMETADATA_HPP_
 #include <iostream>
 #include <set>
+#include <string>
+#include <vector>
 
 #include "DagMC.hpp"
 #include "logger.hpp"
@@ -51,6 +53,58 @@ class dagmcMetaData {
   // test to see if string is an int
   bool try_to_make_int(std::string value);
 
+  // boundary condition of a surface in the compiled tables
+  enum Boundary {
+    BOUNDARY_NONE = 0,
+    BOUNDARY_VACUUM,
+    BOUNDARY_REFLECTING,
+    BOUNDARY_WHITE,
+    BOUNDARY_PERIODIC
+  };
+
+  // build dense tables of the parsed properties indexed by volume and
+  // surface index, for the typed lookups below; call after
+  // load_property_data, and again if the properties or indices change
+  void compile_tables();
+  bool tables_compiled() const { return !compiled_material_indices.empty(); }
+
+  // The compiled lookups take a volume or surface index, 1 to
+  // num_entities, and do not check it.
+
+  // index in compiled_material_names of the material of a volume, -1 for
+  // the graveyard and vacuum
+  int volume_material_index(int vol) const {
+    return compiled_material_indices[vol];
+  }
+  // material number of a volume with an integer material name, else -1
+  int volume_material_number(int vol) const {
+    return compiled_material_numbers[vol];
+  }
+  // density of a volume, 0.0 if it has none
+  double volume_density(int vol) const { return compiled_densities[vol]; }
+  bool volume_is_graveyard(int vol) const {
+    return compiled_volume_kinds[vol] == VOLUME_GRAVEYARD;
+  }
+  bool volume_is_vacuum(int vol) const {
+    return compiled_volume_kinds[vol] == VOLUME_VACUUM;
+  }
+  // the distinct material names, excluding the graveyard and vacuum
+  const std::vector<std::string>& compiled_material_names() const {
+    return compiled_materials;
+  }
+
+  // index of a particle in the importance table, -1 if no volume has an
+  // importance for it; the particles are in the order of imp_particles
+  int importance_particle_index(const std::string& particle) const;
+  // importance of a volume for a particle index, 1.0 where none was given
+  double volume_importance(int vol, int particle) const {
+    return compiled_importances[vol * compiled_particles.size() + particle];
+  }
+
+  Boundary surface_boundary(int surf) const {
+    return (Boundary)compiled_boundaries[surf];
+  }
+
   // private member functions
  private:
   // parse the material data
@@ -112,6 +166,19 @@ class dagmcMetaData {
 
   // private member variables
  private:
+  enum VolumeKind { VOLUME_MATERIAL = 0, VOLUME_VACUUM, VOLUME_GRAVEYARD };
+
+  // compiled tables, indexed by volume or surface index
+  std::vector<int> compiled_material_indices;
+  std::vector<int> compiled_material_numbers;
+  std::vector<double> compiled_densities;
+  std::vector<unsigned char> compiled_volume_kinds;
+  std::vector<std::string> compiled_materials;
+  std::vector<std::string> compiled_particles;
+  // importance of volume i for particle j at i * num particles + j
+  std::vector<double> compiled_importances;
+  std::vector<unsigned char> compiled_boundaries;
+
   moab::DagMC* DAG;  // Pointer to DAGMC instance
   bool verbose;      // Provide additional output while setting up and parsing
                      // properties
@@ -0,0 +1,288 @@
+#include <gtest/gtest.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "DagMC.hpp"
+#include "moab/CartVect.hpp"
+#include "moab/Core.hpp"
+#include "moab/GeomTopoTool.hpp"
+#include "moab/Interface.hpp"
+
+using namespace moab;
+
+using moab::DagMC;
+
+static std::string simple_file = "test_dagmc.h5m";
+
+class DagmcEditTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {}
+  virtual void TearDown() {}
+};
+
+// a volume set bounded by one surface holding the triangles of a box, with
+// outward normals; the surface's reverse sense is left open
+static ErrorCode make_box(DagMC* dag, const double lo[3], const double hi[3],
+                          EntityHandle& volume) {
+  Interface* mbi = dag->moab_instance();
+  ErrorCode rval;
+
+  std::vector<EntityHandle> verts(8);
+  for (int i = 0; i < 8; i++) {
+    double xyz[3];
+    for (int j = 0; j < 3; j++) xyz[j] = (i >> j) & 1 ? hi[j] : lo[j];
+    rval = mbi->create_vertex(xyz, verts[i]);
+    if (MB_SUCCESS != rval) return rval;
+  }
+
+  // each face as a quad of corner indices, split into two triangles
+  const int faces[6][4] = {{0, 2, 6, 4}, {1, 3, 7, 5}, {0, 1, 5, 4},
+                           {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 5, 7, 6}};
+  CartVect center = 0.5 * (CartVect(lo) + CartVect(hi));
+  Range tris;
+  for (const auto& face : faces) {
+    const int halves[2][3] = {{face[0], face[1], face[2]},
+                              {face[0], face[2], face[3]}};
+    for (const auto& half : halves) {
+      EntityHandle conn[3] = {verts[half[0]], verts[half[1]], verts[half[2]]};
+      CartVect p[3];
+      rval = mbi->get_coords(conn, 3, p[0].array());
+      if (MB_SUCCESS != rval) return rval;
+      if (((p[1] - p[0]) * (p[2] - p[0])) % (p[0] - center) < 0.0)
+        std::swap(conn[1], conn[2]);
+      EntityHandle tri;
+      rval = mbi->create_element(MBTRI, conn, 3, tri);
+      if (MB_SUCCESS != rval) return rval;
+      tris.insert(tri);
+    }
+  }
+
+  EntityHandle surface;
+  rval = mbi->create_meshset(0, surface);
+  if (MB_SUCCESS != rval) return rval;
+  rval = mbi->add_entities(surface, tris);
+  if (MB_SUCCESS != rval) return rval;
+  rval = mbi->add_entities(surface, verts.data(), verts.size());
+  if (MB_SUCCESS != rval) return rval;
+
+  rval = mbi->create_meshset(0, volume);
+  if (MB_SUCCESS != rval) return rval;
+  rval = mbi->add_parent_child(volume, surface);
+  if (MB_SUCCESS != rval) return rval;
+  return dag->geom_tool()->set_surface_senses(surface, volume, 0);
+}
+
+// the upper corner of the bounding box of the model's volumes
+static ErrorCode model_upper_corner(DagMC* dag, double model_hi[3]) {
+  std::fill(model_hi, model_hi + 3, -HUGE_VAL);
+  for (int i = 1; i <= dag->num_entities(3); i++) {
+    EntityHandle vol = dag->entity_by_index(3, i);
+    if (dag->is_implicit_complement(vol)) continue;
+    double vmin[3], vmax[3];
+    ErrorCode rval = dag->getobb(vol, vmin, vmax);
+    if (MB_SUCCESS != rval) return rval;
+    for (int j = 0; j < 3; j++) model_hi[j] = std::max(model_hi[j], vmax[j]);
+  }
+  return MB_SUCCESS;
+}
+
+TEST_F(DagmcEditTest, dagmc_insert_move_delete_volume) {
+  std::unique_ptr<DagMC> DAG(new DagMC());
+  ErrorCode rval = DAG->load_file(simple_file.c_str());
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  Range starting_tris;
+  rval = DAG->moab_instance()->get_entities_by_type(0, MBTRI, starting_tris);
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  int n_vols = DAG->num_entities(3);
+  int n_surfs = DAG->num_entities(2);
+
+  // a 2 cm box beyond the model
+  double model_hi[3];
+  rval = model_upper_corner(DAG.get(), model_hi);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  double lo[3], hi[3], center[3];
+  for (int j = 0; j < 3; j++) {
+    lo[j] = model_hi[j] + 10.0;
+    hi[j] = lo[j] + 2.0;
+    center[j] = lo[j] + 1.0;
+  }
+
+  EntityHandle box;
+  rval = make_box(DAG.get(), lo, hi, box);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  rval = DAG->insert_volume(box);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(n_vols + 1, DAG->num_entities(3));
+  EXPECT_EQ(n_surfs + 1, DAG->num_entities(2));
+
+  EntityHandle ic;
+  rval = DAG->geom_tool()->get_implicit_complement(ic);
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  int result;
+  rval = DAG->point_in_volume(box, center, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, result);
+  rval = DAG->point_in_volume(ic, center, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(0, result);
+
+  // the implicit complement sees the new box
+  double start[3] = {center[0] - 5.0, center[1], center[2]};
+  double dir[3] = {1.0, 0.0, 0.0};
+  EntityHandle next_surf;
+  double dist;
+  rval = DAG->ray_fire(ic, start, dir, next_surf, dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  std::vector<EntityHandle> box_surfs;
+  rval = DAG->moab_instance()->get_child_meshsets(box, box_surfs);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  ASSERT_EQ(1u, box_surfs.size());
+  EXPECT_EQ(box_surfs[0], next_surf);
+  EXPECT_NEAR(4.0, dist, 1e-8);
+
+  double volume;
+  rval = DAG->measure_volume(box, volume);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(8.0, volume, 1e-8);
+
+  // a quarter turn about z and a shift up, still beyond the model
+  const double rotation[9] = {0.0, -1.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0};
+  const double translation[3] = {0.0, 0.0, 20.0};
+  rval = DAG->transform_volume(box, rotation, translation);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  double moved[3] = {-center[1], center[0], center[2] + 20.0};
+  rval = DAG->point_in_volume(box, moved, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, result);
+  rval = DAG->point_in_volume(box, center, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(0, result);
+  rval = DAG->measure_volume(box, volume);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(8.0, volume, 1e-8);
+
+  // reflections are not rigid motions
+  const double reflection[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, -1.0};
+  rval = DAG->transform_volume(box, reflection, translation);
+  EXPECT_NE(MB_SUCCESS, rval);
+
+  rval = DAG->delete_volume(box);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(n_vols, DAG->num_entities(3));
+  EXPECT_EQ(n_surfs, DAG->num_entities(2));
+  rval = DAG->point_in_volume(ic, moved, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, result);
+
+  Range tris;
+  rval = DAG->moab_instance()->get_entities_by_type(0, MBTRI, tris);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(starting_tris.size(), tris.size());
+
+  // the implicit complement cannot be deleted
+  rval = DAG->delete_volume(ic);
+  EXPECT_NE(MB_SUCCESS, rval);
+}
+
+TEST_F(DagmcEditTest, dagmc_create_instances) {
+  std::unique_ptr<DagMC> DAG(new DagMC());
+  ErrorCode rval = DAG->load_file(simple_file.c_str());
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  int n_vols = DAG->num_entities(3);
+
+  // a 2 cm box beyond the model, copied twice
+  double model_hi[3];
+  rval = model_upper_corner(DAG.get(), model_hi);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  double lo[3], hi[3], center[3];
+  for (int j = 0; j < 3; j++) {
+    center[j] = model_hi[j] + 11.0;
+    lo[j] = center[j] - 1.0;
+    hi[j] = center[j] + 1.0;
+  }
+  EntityHandle box;
+  rval = make_box(DAG.get(), lo, hi, box);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  rval = DAG->insert_volume(box);
+  ASSERT_EQ(MB_SUCCESS, rval);
+
+  // quarter turns about the box's z axis, then shifts up
+  std::vector<double> transforms;
+  for (int c = 1; c <= 2; c++) {
+    const double transform[12] = {
+        0.0, -1.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0,
+        center[0] + center[1], center[1] - center[0], 10.0 * c};
+    transforms.insert(transforms.end(), transform, transform + 12);
+  }
+  std::vector<EntityHandle> copies;
+  rval = DAG->create_instances(std::vector<EntityHandle>(1, box), transforms,
+                               copies);
+  // instances need the native BVH
+  if (MB_NOT_IMPLEMENTED == rval) return;
+  ASSERT_EQ(MB_SUCCESS, rval);
+  ASSERT_EQ(2u, copies.size());
+  EXPECT_EQ(n_vols + 3, DAG->num_entities(3));
+
+  EntityHandle ic;
+  rval = DAG->geom_tool()->get_implicit_complement(ic);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  for (int c = 0; c < 2; c++) {
+    double copy_center[3] = {center[0], center[1], center[2] + 10.0 * (c + 1)};
+    int result;
+    rval = DAG->point_in_volume(copies[c], copy_center, result);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(1, result);
+    rval = DAG->point_in_volume(ic, copy_center, result);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(0, result);
+
+    double volume;
+    rval = DAG->measure_volume(copies[c], volume);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_NEAR(8.0, volume, 1e-8);
+
+    // the implicit complement sees the copies
+    double start[3] = {center[0] - 10.0, center[1], copy_center[2]};
+    double dir[3] = {1.0, 0.0, 0.0};
+    EntityHandle next_surf;
+    double dist;
+    rval = DAG->ray_fire(ic, start, dir, next_surf, dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_NEAR(9.0, dist, 1e-8);
+  }
+
+  // the original cannot move or go while it has copies, the copies can
+  const double rotation[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+  const double translation[3] = {0.0, 0.0, 10.0};
+  rval = DAG->transform_volume(box, rotation, translation);
+  EXPECT_NE(MB_SUCCESS, rval);
+  rval = DAG->delete_volume(box);
+  EXPECT_NE(MB_SUCCESS, rval);
+  rval = DAG->transform_volume(copies[1], rotation, translation);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  double moved[3] = {center[0], center[1], center[2] + 30.0};
+  int result;
+  rval = DAG->point_in_volume(copies[1], moved, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, result);
+
+  for (EntityHandle vol : copies) {
+    rval = DAG->delete_volume(vol);
+    ASSERT_EQ(MB_SUCCESS, rval);
+  }
+  rval = DAG->delete_volume(box);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(n_vols, DAG->num_entities(3));
+}
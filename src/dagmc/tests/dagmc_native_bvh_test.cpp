@@ -0,0 +1,1201 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <tuple>
+
+#include "BVH.hpp"
+#include "BVHCache.hpp"
+#include "DagMC.hpp"
+#include "NativeRayTracer.hpp"
+#include "moab/Core.hpp"
+#include "moab/Interface.hpp"
+
+using namespace moab;
+
+using moab::DagMC;
+
+std::shared_ptr<moab::DagMC> DAG;
+
+static const char input_file[] = "test_geom.h5m";
+double eps = 1.0e-6;
+
+// triangles of an axis-aligned cube of half-width 5 at the origin with
+// outward facing normals, handles 1-12
+static void cube_triangles(std::vector<double>& coords,
+                           std::vector<EntityHandle>& handles) {
+  static const int faces[12][3] = {{0, 2, 1}, {0, 3, 2}, {4, 5, 6}, {4, 6, 7},
+                                   {0, 1, 5}, {0, 5, 4}, {2, 3, 7}, {2, 7, 6},
+                                   {1, 2, 6}, {1, 6, 5}, {0, 4, 7}, {0, 7, 3}};
+  static const double verts[8][3] = {{-5, -5, -5}, {5, -5, -5}, {5, 5, -5},
+                                     {-5, 5, -5},  {-5, -5, 5}, {5, -5, 5},
+                                     {5, 5, 5},    {-5, 5, 5}};
+  coords.clear();
+  handles.clear();
+  for (int i = 0; i < 12; i++) {
+    for (int v = 0; v < 3; v++)
+      coords.insert(coords.end(), verts[faces[i][v]], verts[faces[i][v]] + 3);
+    handles.push_back(i + 1);
+  }
+}
+
+TEST(DagmcBVHTest, dagmc_bvh_structure) {
+  // a random triangle soup large enough for a multi-level tree
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> pos(-10.0, 10.0), off(-0.5, 0.5);
+  const int n_tris = 5000;
+  std::vector<double> coords(9 * n_tris);
+  std::vector<EntityHandle> handles(n_tris);
+  for (int i = 0; i < n_tris; i++) {
+    double center[3] = {pos(gen), pos(gen), pos(gen)};
+    for (int j = 0; j < 9; j++) coords[9 * i + j] = center[j % 3] + off(gen);
+    handles[i] = i + 1;
+  }
+
+  TriangleBVH bvh;
+  bvh.build(coords, handles);
+  EXPECT_EQ(n_tris, bvh.num_triangles());
+
+  // every triangle is stored exactly once and lies inside its leaf box
+  const BVHArray<BVHNode>& nodes = bvh.get_nodes();
+  const BVHArray<TriangleBlock>& blocks = bvh.get_blocks();
+  std::set<EntityHandle> seen;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const BVHNode& node = nodes[i];
+    if (!node.is_leaf()) {
+      // children are bounded by their parent
+      const BVHNode* children[2] = {&nodes[i + 1], &nodes[node.first]};
+      for (int c = 0; c < 2; c++) {
+        for (int k = 0; k < 3; k++) {
+          EXPECT_LE(node.lo[k], children[c]->lo[k]);
+          EXPECT_GE(node.hi[k], children[c]->hi[k]);
+        }
+      }
+      continue;
+    }
+    for (int b = node.first; b < node.first + node.count; b++) {
+      EXPECT_GT(blocks[b].count, 0);
+      EXPECT_LE(blocks[b].count, BVH_BLOCK_WIDTH);
+      for (int lane = 0; lane < blocks[b].count; lane++) {
+        EXPECT_TRUE(seen.insert(blocks[b].handle[lane]).second);
+        for (int v = 0; v < 3; v++) {
+          EXPECT_LE(node.lo[0], blocks[b].x[v][lane]);
+          EXPECT_GE(node.hi[0], blocks[b].x[v][lane]);
+          EXPECT_LE(node.lo[2], blocks[b].z[v][lane]);
+          EXPECT_GE(node.hi[2], blocks[b].z[v][lane]);
+        }
+      }
+    }
+  }
+  EXPECT_EQ(n_tris, (int)seen.size());
+}
+
+TEST(DagmcBVHTest, dagmc_bvh_ray_intersect) {
+  std::vector<double> coords;
+  std::vector<EntityHandle> handles;
+  cube_triangles(coords, handles);
+  TriangleBVH bvh;
+  bvh.build(coords, handles);
+
+  double origin[3] = {0.0, 0.0, 0.0};
+  double dirs[6][3] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                       {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+  for (int i = 0; i < 6; i++) {
+    BVHRay ray(origin, dirs[i]);
+    double tmax = std::numeric_limits<double>::max();
+    double nearest = tmax;
+    EntityHandle facet = 0;
+    // exiting intersections only
+    int orient = 1;
+    bvh.ray_intersect(ray, &orient, tmax,
+                      [&](EntityHandle hit_facet, const double*, double dist,
+                          bool) {
+                        if (dist < nearest) {
+                          nearest = dist;
+                          facet = hit_facet;
+                          tmax = dist;
+                        }
+                      });
+    EXPECT_NEAR(5.0, nearest, eps);
+    EXPECT_NE(0u, facet);
+
+    // no entering intersections from inside the cube
+    orient = -1;
+    tmax = std::numeric_limits<double>::max();
+    int n_hits = 0;
+    bvh.ray_intersect(ray, &orient, tmax,
+                      [&](EntityHandle, const double*, double, bool) {
+                        n_hits++;
+                      });
+    EXPECT_EQ(0, n_hits);
+  }
+
+  // a ray outside the cube pointing away misses
+  double outside[3] = {10.0, 0.0, 0.0};
+  BVHRay ray(outside, dirs[0]);
+  double tmax = std::numeric_limits<double>::max();
+  int n_hits = 0;
+  bvh.ray_intersect(
+      ray, NULL, tmax,
+      [&](EntityHandle, const double*, double, bool) { n_hits++; });
+  EXPECT_EQ(0, n_hits);
+}
+
+TEST(DagmcBVHTest, dagmc_bvh_closest_to_location) {
+  std::vector<double> coords;
+  std::vector<EntityHandle> handles;
+  cube_triangles(coords, handles);
+  TriangleBVH bvh;
+  bvh.build(coords, handles);
+
+  double point[3] = {1.0, 2.0, 3.0};
+  double dist_sqr = std::numeric_limits<double>::max();
+  double closest[3];
+  EntityHandle facet = 0;
+  EXPECT_TRUE(bvh.closest_to_location(point, dist_sqr, closest, facet));
+  EXPECT_NEAR(2.0, std::sqrt(dist_sqr), eps);
+  EXPECT_NEAR(5.0, closest[2], eps);
+
+  // points outside the cube measure to the nearest corner
+  double corner[3] = {6.0, 6.0, 6.0};
+  dist_sqr = std::numeric_limits<double>::max();
+  EXPECT_TRUE(bvh.closest_to_location(corner, dist_sqr, closest, facet));
+  EXPECT_NEAR(std::sqrt(3.0), std::sqrt(dist_sqr), eps);
+}
+
+TEST(DagmcBVHTest, dagmc_bvh_block_kernel) {
+  // triangles on a coarse grid so that rays often graze edges and vertices
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<int> grid(-2, 2);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  const int n_tris = 800;
+  std::vector<double> coords(9 * n_tris);
+  std::vector<EntityHandle> handles(n_tris);
+  for (int i = 0; i < n_tris; i++) {
+    for (int j = 0; j < 9; j++) coords[9 * i + j] = grid(gen);
+    handles[i] = i + 1;
+  }
+  TriangleBVH bvh;
+  bvh.build(coords, handles);
+  const BVHArray<TriangleBlock>& blocks = bvh.get_blocks();
+
+  int n_hits = 0;
+  for (int r = 0; r < 200; r++) {
+    double origin[3], dir[3];
+    for (int i = 0; i < 3; i++) {
+      origin[i] = r % 2 ? grid(gen) : normal(gen);
+      dir[i] = r % 3 ? normal(gen) : grid(gen);
+    }
+    if (dir[0] == 0 && dir[1] == 0 && dir[2] == 0) dir[0] = 1;
+    BVHRay ray(origin, dir, -1.0, r % 4 == 0);
+    int orient = r % 3 - 1;
+    const int* orient_ptr = orient ? &orient : NULL;
+    double tmax = r % 5 ? std::numeric_limits<double>::max() : 1.5;
+
+    // the block kernel must match the scalar test lane by lane
+    for (size_t b = 0; b < blocks.size(); b++) {
+      double dist[BVH_BLOCK_WIDTH];
+      unsigned on_edge;
+      unsigned hits =
+          ray_block_intersect(blocks[b], ray, orient_ptr, tmax, dist, on_edge);
+      for (int lane = 0; lane < BVH_BLOCK_WIDTH; lane++) {
+        double lane_dist;
+        bool lane_edge;
+        bool lane_hit =
+            lane < blocks[b].count &&
+            plucker_ray_tri_intersect(blocks[b], lane, ray, orient_ptr,
+                                      lane_dist, lane_edge) &&
+            lane_dist <= tmax &&
+            (ray.use_neg_len ? lane_dist > ray.neg_len : lane_dist >= 0.0);
+        EXPECT_EQ(lane_hit, (bool)((hits >> lane) & 1));
+        if (lane_hit && ((hits >> lane) & 1)) {
+          EXPECT_EQ(lane_dist, dist[lane]);
+          EXPECT_EQ(lane_edge, (bool)((on_edge >> lane) & 1));
+          n_hits++;
+        }
+      }
+    }
+  }
+  EXPECT_GT(n_hits, 0);
+}
+
+TEST(DagmcBVHTest, dagmc_bvh_distance_kernel) {
+  std::mt19937 gen(4);
+  std::uniform_int_distribution<int> grid(-2, 2);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  const int n_tris = 800;
+  std::vector<double> coords(9 * n_tris);
+  std::vector<EntityHandle> handles(n_tris);
+  for (int i = 0; i < n_tris; i++) {
+    // grid triangles are often degenerate
+    for (int j = 0; j < 9; j++)
+      coords[9 * i + j] = i % 2 ? grid(gen) : normal(gen);
+    handles[i] = i + 1;
+  }
+  TriangleBVH bvh;
+  bvh.build(coords, handles);
+  const BVHArray<TriangleBlock>& blocks = bvh.get_blocks();
+
+  for (int r = 0; r < 100; r++) {
+    double p[3] = {3 * normal(gen), 3 * normal(gen), (double)grid(gen)};
+
+    // the block kernel must match the scalar distance lane by lane
+    for (size_t b = 0; b < blocks.size(); b++) {
+      double dist_sqr[BVH_BLOCK_WIDTH];
+      block_dist_sqr(blocks[b], p, dist_sqr);
+      for (int lane = 0; lane < blocks[b].count; lane++) {
+        double closest[3];
+        double expected = closest_point_on_tri(blocks[b], lane, p, closest);
+        EXPECT_NEAR(expected, dist_sqr[lane], 1e-12 * (1.0 + expected));
+      }
+    }
+
+    // the closest triangle is the closest of all, and the lower bound is
+    // no larger
+    double expected = std::numeric_limits<double>::max();
+    for (int i = 0; i < n_tris; i++) {
+      double closest[3];
+      expected =
+          std::min(expected, closest_point_on_tri(&coords[9 * i], p, closest));
+    }
+    double dist_sqr = std::numeric_limits<double>::max();
+    double closest[3];
+    EntityHandle facet = 0;
+    bvh.closest_to_location(p, dist_sqr, closest, facet);
+    EXPECT_NEAR(expected, dist_sqr, 1e-12 * (1.0 + expected));
+    double bound = std::numeric_limits<double>::max();
+    bvh.dist_sqr_lower_bound(p, bound);
+    EXPECT_LE(bound, dist_sqr);
+  }
+}
+
+TEST(DagmcBVHTest, dagmc_bvh_cache_file) {
+  std::vector<double> coords;
+  std::vector<EntityHandle> handles;
+  cube_triangles(coords, handles);
+  TriangleBVH bvh;
+  bvh.build(coords, handles);
+
+  const char cache_file[] = "dagmc_bvh_cache_test.dagbvh";
+  std::vector<std::pair<EntityHandle, const TriangleBVH*>> trees;
+  trees.push_back(std::make_pair(EntityHandle(42), &bvh));
+  EXPECT_EQ(MB_SUCCESS, write_bvh_cache(cache_file, 1234, trees));
+
+  // missing files and files written for other geometry are rejected
+  std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>> read;
+  EXPECT_EQ(MB_FILE_DOES_NOT_EXIST,
+            read_bvh_cache("no_such_file.dagbvh", 1234, BVH_DOUBLE, read));
+  EXPECT_EQ(MB_FAILURE, read_bvh_cache(cache_file, 4321, BVH_DOUBLE, read));
+  EXPECT_EQ(MB_FAILURE, read_bvh_cache(cache_file, 1234, BVH_MIXED, read));
+  EXPECT_TRUE(read.empty());
+
+  EXPECT_EQ(MB_SUCCESS, read_bvh_cache(cache_file, 1234, BVH_DOUBLE, read));
+  std::remove(cache_file);
+  ASSERT_EQ(1u, read.count(42));
+  const TriangleBVH& cached = *read[42];
+  EXPECT_EQ(bvh.num_triangles(), cached.num_triangles());
+  ASSERT_EQ(bvh.get_nodes().size(), cached.get_nodes().size());
+  ASSERT_EQ(bvh.get_blocks().size(), cached.get_blocks().size());
+  EXPECT_EQ(0, std::memcmp(bvh.get_blocks().data(), cached.get_blocks().data(),
+                           bvh.get_blocks().size() * sizeof(TriangleBlock)));
+
+  // the mapped tree answers queries like the original
+  double point[3] = {1.0, 2.0, 3.0};
+  double dist_sqr = std::numeric_limits<double>::max();
+  double closest[3];
+  EntityHandle facet = 0;
+  EXPECT_TRUE(cached.closest_to_location(point, dist_sqr, closest, facet));
+  EXPECT_NEAR(2.0, std::sqrt(dist_sqr), eps);
+}
+
+TEST(DagmcBVHTest, dagmc_bvh_mixed_precision) {
+  // coordinates that single precision cannot represent, on a grid so that
+  // rays often graze edges and vertices
+  std::mt19937 gen(6);
+  std::uniform_int_distribution<int> grid(-20, 20);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  const int n_tris = 3000;
+  std::vector<double> coords(9 * n_tris);
+  std::vector<EntityHandle> handles(n_tris);
+  for (int i = 0; i < n_tris; i++) {
+    for (int j = 0; j < 9; j++) coords[9 * i + j] = 0.1 * grid(gen) + 1e-9;
+    handles[i] = i + 1;
+  }
+  TriangleBVH exact_bvh, mixed_bvh;
+  exact_bvh.build(coords, handles);
+  mixed_bvh.build(coords, handles, BVH_MIXED);
+  EXPECT_EQ(BVH_MIXED, mixed_bvh.precision());
+  EXPECT_TRUE(mixed_bvh.get_nodes().empty());
+  EXPECT_LT(2 * mixed_bvh.memory_size(), 1.2 * exact_bvh.memory_size());
+
+  FacetCoordsFn exact = [&](EntityHandle facet, double* facet_coords) {
+    std::copy(&coords[9 * (facet - 1)], &coords[9 * facet], facet_coords);
+    return MB_SUCCESS;
+  };
+
+  typedef std::tuple<EntityHandle, double, bool> Hit;
+  for (int r = 0; r < 500; r++) {
+    double origin[3], dir[3];
+    for (int i = 0; i < 3; i++) {
+      origin[i] = r % 2 ? 0.1 * grid(gen) : normal(gen);
+      dir[i] = r % 3 ? normal(gen) : grid(gen);
+    }
+    if (dir[0] == 0 && dir[1] == 0 && dir[2] == 0) dir[0] = 1;
+    BVHRay ray(origin, dir, -1.0, r % 4 == 0);
+    int orient = r % 3 - 1;
+    const int* orient_ptr = orient ? &orient : NULL;
+
+    // every intersection is found, with the double precision distance
+    std::vector<Hit> exact_hits, mixed_hits;
+    double tmax = r % 5 ? std::numeric_limits<double>::max() : 1.5;
+    exact_bvh.ray_intersect(
+        ray, orient_ptr, tmax,
+        [&](EntityHandle facet, const double*, double dist, bool on_edge) {
+          exact_hits.push_back(Hit(facet, dist, on_edge));
+        });
+    mixed_bvh.ray_intersect(
+        ray, orient_ptr, tmax,
+        [&](EntityHandle facet, const double* facet_coords, double dist,
+            bool on_edge) {
+          EXPECT_EQ(coords[9 * (facet - 1)], facet_coords[0]);
+          mixed_hits.push_back(Hit(facet, dist, on_edge));
+        },
+        exact);
+    std::sort(exact_hits.begin(), exact_hits.end());
+    std::sort(mixed_hits.begin(), mixed_hits.end());
+    EXPECT_EQ(exact_hits, mixed_hits);
+
+    // closest points match as well
+    double exact_dist_sqr = std::numeric_limits<double>::max();
+    double mixed_dist_sqr = exact_dist_sqr;
+    double exact_closest[3], mixed_closest[3];
+    EntityHandle exact_facet = 0, mixed_facet = 0;
+    exact_bvh.closest_to_location(origin, exact_dist_sqr, exact_closest,
+                                  exact_facet);
+    mixed_bvh.closest_to_location(origin, mixed_dist_sqr, mixed_closest,
+                                  mixed_facet, exact);
+    EXPECT_EQ(exact_dist_sqr, mixed_dist_sqr);
+
+    std::vector<EntityHandle> exact_near, mixed_near;
+    exact_bvh.facets_within(origin, 0.5, exact_near);
+    mixed_bvh.facets_within(origin, 0.5, mixed_near, exact);
+    std::sort(exact_near.begin(), exact_near.end());
+    std::sort(mixed_near.begin(), mixed_near.end());
+    EXPECT_EQ(exact_near, mixed_near);
+  }
+
+  // the filter passes few lanes that the exact test rejects
+  const BVHArray<TriangleBlockF>& blocks = mixed_bvh.get_float_blocks();
+  int n_lanes = 0, n_candidates = 0;
+  for (int r = 0; r < 50; r++) {
+    double origin[3] = {normal(gen), normal(gen), normal(gen)};
+    double dir[3] = {normal(gen), normal(gen), normal(gen)};
+    BVHRay ray(origin, dir);
+    for (size_t b = 0; b < blocks.size(); b++) {
+      unsigned candidates = ray_block_filter(
+          blocks[b], ray, NULL, std::numeric_limits<double>::max());
+      for (; candidates; candidates &= candidates - 1) n_candidates++;
+      n_lanes += blocks[b].count;
+    }
+  }
+  EXPECT_LT(10 * n_candidates, n_lanes);
+
+  // mixed precision trees round trip through a cache file
+  const char cache_file[] = "dagmc_bvh_mixed_test.dagbvh";
+  std::vector<std::pair<EntityHandle, const TriangleBVH*>> trees;
+  trees.push_back(std::make_pair(EntityHandle(7), &mixed_bvh));
+  EXPECT_EQ(MB_SUCCESS, write_bvh_cache(cache_file, 99, trees));
+  trees.push_back(std::make_pair(EntityHandle(8), &exact_bvh));
+  EXPECT_EQ(MB_FAILURE, write_bvh_cache(cache_file, 99, trees));
+  std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>> read;
+  EXPECT_EQ(MB_FAILURE, read_bvh_cache(cache_file, 99, BVH_DOUBLE, read));
+  EXPECT_EQ(MB_SUCCESS, read_bvh_cache(cache_file, 99, BVH_MIXED, read));
+  std::remove(cache_file);
+  ASSERT_EQ(1u, read.count(7));
+  EXPECT_EQ(BVH_MIXED, read[7]->precision());
+  EXPECT_EQ(0, std::memcmp(blocks.data(), read[7]->get_float_blocks().data(),
+                           blocks.size() * sizeof(TriangleBlockF)));
+}
+
+class DagmcNativeBVHTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // Create new DAGMC instance
+    DAG = std::make_shared<moab::DagMC>();
+    // Load mesh from file
+    rloadval = DAG->load_file(input_file);
+    assert(rloadval == moab::MB_SUCCESS);
+    // Create the OBB
+    rval = DAG->init_OBBTree();
+    assert(rval == moab::MB_SUCCESS);
+    // Build the native BVH on the same geometry
+    native = std::make_shared<NativeRayTracer>(DAG->geom_tool());
+    rval = native->init();
+    assert(rval == moab::MB_SUCCESS);
+  }
+  virtual void TearDown() {}
+
+ protected:
+  moab::ErrorCode rloadval;
+  moab::ErrorCode rval;
+  std::shared_ptr<NativeRayTracer> native;
+};
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_rayfire) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  std::mt19937 gen(1);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  double origin[3] = {0.0, 0.0, 0.0};
+  for (int i = 0; i < 1000; i++) {
+    double dir[3] = {normal(gen), normal(gen), normal(gen)};
+    double len = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    for (int j = 0; j < 3; j++) dir[j] /= len;
+
+    EntityHandle obb_surf, bvh_surf;
+    double obb_dist, bvh_dist;
+    DagMC::RayHistory obb_history, bvh_history;
+    rval = DAG->ray_fire(vol_h, origin, dir, obb_surf, obb_dist, &obb_history);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = native->ray_fire(vol_h, origin, dir, bvh_surf, bvh_dist,
+                            &bvh_history);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(obb_surf, bvh_surf);
+    EXPECT_NEAR(obb_dist, bvh_dist, eps);
+    EXPECT_EQ(obb_history.size(), bvh_history.size());
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_ray_packets) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  // not a multiple of the packet width
+  const int n_rays = 4 * BVH_PACKET_WIDTH + 3;
+  std::mt19937 gen(12);
+  std::uniform_real_distribution<double> coord(-4.0, 4.0), limit(0.5, 10.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  std::vector<double> origins(3 * n_rays), dirs(3 * n_rays), limits(n_rays);
+  for (int i = 0; i < n_rays; i++) {
+    double dir[3] = {normal(gen), normal(gen), normal(gen)};
+    double len = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    for (int j = 0; j < 3; j++) {
+      origins[j * n_rays + i] = coord(gen);
+      dirs[j * n_rays + i] = dir[j] / len;
+    }
+    // some rays stop short of the cube
+    limits[i] = i % 3 ? 0.0 : limit(gen);
+  }
+
+  // twice, the second time with the facets of the first in the histories
+  std::vector<NativeRayTracer::RayHistory> histories(n_rays), ray_histories;
+  for (int pass = 0; pass < 2; pass++) {
+    ray_histories = histories;
+    std::vector<EntityHandle> surfs(n_rays);
+    std::vector<double> dists(n_rays);
+    rval = native->ray_fire_packet(vol_h, n_rays, origins.data(), dirs.data(),
+                                   surfs.data(), dists.data(),
+                                   histories.data(), limits.data());
+    EXPECT_EQ(MB_SUCCESS, rval);
+
+    for (int i = 0; i < n_rays; i++) {
+      double origin[3], dir[3];
+      for (int j = 0; j < 3; j++) {
+        origin[j] = origins[j * n_rays + i];
+        dir[j] = dirs[j * n_rays + i];
+      }
+      EntityHandle surf;
+      double dist;
+      rval = native->ray_fire(vol_h, origin, dir, surf, dist,
+                              &ray_histories[i], limits[i]);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(surf, surfs[i]);
+      if (surf) EXPECT_EQ(dist, dists[i]);
+      EXPECT_EQ(ray_histories[i].size(), histories[i].size());
+    }
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_point_in_volume) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  std::mt19937 gen(2);
+  std::uniform_real_distribution<double> coord(-8.0, 8.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (int i = 0; i < 1000; i++) {
+    double xyz[3] = {coord(gen), coord(gen), coord(gen)};
+    double uvw[3] = {normal(gen), normal(gen), normal(gen)};
+    double len = std::sqrt(uvw[0] * uvw[0] + uvw[1] * uvw[1] + uvw[2] * uvw[2]);
+    for (int j = 0; j < 3; j++) uvw[j] /= len;
+
+    int obb_result, bvh_result;
+    rval = DAG->point_in_volume(vol_h, xyz, obb_result, uvw);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = native->point_in_volume(vol_h, xyz, bvh_result, uvw);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(obb_result, bvh_result);
+
+    double obb_dist, bvh_dist;
+    rval = DAG->closest_to_location(vol_h, xyz, obb_dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = native->closest_to_location(vol_h, xyz, bvh_dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_NEAR(obb_dist, bvh_dist, eps);
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_safety_distance) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  std::mt19937 gen(5);
+  std::uniform_real_distribution<double> coord(-8.0, 8.0);
+  int n_tight = 0;
+  for (int i = 0; i < 1000; i++) {
+    double xyz[3] = {coord(gen), coord(gen), coord(gen)};
+    double dist, bound;
+    rval = native->closest_to_location(vol_h, xyz, dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = native->safety_distance(vol_h, xyz, bound);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_LE(bound, dist);
+    EXPECT_GE(bound, 0.0);
+    if (bound > 0.5 * dist) n_tight++;
+
+    // the exact mode of DagMC is closest_to_location
+    double exact;
+    rval = DAG->safety_distance(vol_h, xyz, exact);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_NEAR(dist, exact, eps);
+  }
+  // outside the cube the boxes are the faces themselves
+  EXPECT_GT(n_tight, 0);
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_measure) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  double obb_volume, bvh_volume;
+  rval = DAG->measure_volume(vol_h, obb_volume);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = native->measure_volume(vol_h, bvh_volume);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(obb_volume, bvh_volume, eps);
+
+  double min[3], max[3];
+  rval = native->get_bbox(vol_h, min, max);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_NEAR(-5.0, min[i], eps);
+    EXPECT_NEAR(5.0, max[i], eps);
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_bvh_cache) {
+  uint64_t hash;
+  rval = native->geometry_hash(hash);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  const char cache_file[] = "test_geom_native.dagbvh";
+  rval = native->save_cache(cache_file, hash);
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // a tracer initialized from the cache gives identical answers
+  NativeRayTracer cached(DAG->geom_tool());
+  rval = cached.load_cache(cache_file, hash);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = cached.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  std::remove(cache_file);
+
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  std::mt19937 gen(4);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  double origin[3] = {0.0, 0.0, 0.0};
+  for (int i = 0; i < 100; i++) {
+    double dir[3] = {normal(gen), normal(gen), normal(gen)};
+    double len = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    for (int j = 0; j < 3; j++) dir[j] /= len;
+
+    EntityHandle surf, cached_surf;
+    double dist, cached_dist;
+    rval = native->ray_fire(vol_h, origin, dir, surf, dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = cached.ray_fire(vol_h, origin, dir, cached_surf, cached_dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(surf, cached_surf);
+    EXPECT_EQ(dist, cached_dist);
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_parallel_build) {
+  // trees built on several threads are identical to the serial ones
+  NativeRayTracer parallel(DAG->geom_tool());
+  parallel.set_num_threads(4);
+  EXPECT_EQ(4, parallel.get_num_threads());
+  rval = parallel.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  std::mt19937 gen(5);
+  std::uniform_real_distribution<double> coord(-4.0, 4.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (unsigned v = 1; v <= DAG->num_entities(3); v++) {
+    EntityHandle vol_h = DAG->entity_by_index(3, v);
+    for (int i = 0; i < 100; i++) {
+      double xyz[3] = {coord(gen), coord(gen), coord(gen)};
+      double dir[3] = {normal(gen), normal(gen), normal(gen)};
+      double len =
+          std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+      for (int j = 0; j < 3; j++) dir[j] /= len;
+
+      EntityHandle surf, parallel_surf;
+      double dist, parallel_dist;
+      rval = native->ray_fire(vol_h, xyz, dir, surf, dist);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = parallel.ray_fire(vol_h, xyz, dir, parallel_surf, parallel_dist);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(surf, parallel_surf);
+      EXPECT_EQ(dist, parallel_dist);
+    }
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_mixed_precision) {
+  // single precision trees give the double precision answers
+  NativeRayTracer mixed(DAG->geom_tool());
+  mixed.set_precision(BVH_MIXED);
+  rval = mixed.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_LT(mixed.memory_size(), native->memory_size());
+
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> coord(-8.0, 8.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (unsigned v = 1; v <= DAG->num_entities(3); v++) {
+    EntityHandle vol_h = DAG->entity_by_index(3, v);
+    for (int i = 0; i < 200; i++) {
+      double xyz[3] = {coord(gen), coord(gen), coord(gen)};
+      // axis-aligned rays run along the edges of the facets
+      double dir[3] = {0.0, 0.0, 0.0};
+      if (i % 4)
+        for (int j = 0; j < 3; j++) dir[j] = normal(gen);
+      else
+        dir[i % 3] = 1.0;
+      double len =
+          std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+      for (int j = 0; j < 3; j++) dir[j] /= len;
+
+      EntityHandle surf, mixed_surf;
+      double dist, mixed_dist;
+      DagMC::RayHistory history, mixed_history;
+      rval = native->ray_fire(vol_h, xyz, dir, surf, dist, &history);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = mixed.ray_fire(vol_h, xyz, dir, mixed_surf, mixed_dist,
+                            &mixed_history);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(surf, mixed_surf);
+      if (surf) {
+        EXPECT_EQ(dist, mixed_dist);
+      }
+      EXPECT_EQ(history.size(), mixed_history.size());
+
+      int result, mixed_result;
+      rval = native->point_in_volume(vol_h, xyz, result, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = mixed.point_in_volume(vol_h, xyz, mixed_result, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(result, mixed_result);
+
+      double closest, mixed_closest;
+      rval = native->closest_to_location(vol_h, xyz, closest);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = mixed.closest_to_location(vol_h, xyz, mixed_closest);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(closest, mixed_closest);
+    }
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_mixed_precision_cases) {
+  // the edge and corner cases of the ray fire and point in volume tests,
+  // where rays run along facet edges and through vertices
+  NativeRayTracer mixed(DAG->geom_tool());
+  mixed.set_precision(BVH_MIXED);
+  rval = mixed.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(BVH_DOUBLE, native->get_precision());
+
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  const double origins[2][3] = {{0.0, 0.0, 0.0}, {-10.0, 0.0, 0.0}};
+  for (int o = 0; o < 2; o++) {
+    for (int d = 0; d < 26; d++) {
+      // the axes, face diagonals and body diagonals: the 27 directions
+      // with components in {-1, 0, 1}, skipping 0 0 0
+      int e = d < 13 ? d : d + 1;
+      double dir[3] = {(double)(e % 3) - 1.0, (double)(e / 3 % 3) - 1.0,
+                       (double)(e / 9) - 1.0};
+      double len =
+          std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+      for (int j = 0; j < 3; j++) dir[j] /= len;
+
+      for (int orientation = -1; orientation <= 1; orientation += 2) {
+        // follow the ray across the surfaces with a history, as the
+        // transport codes do
+        DagMC::RayHistory history, mixed_history;
+        double xyz[3] = {origins[o][0], origins[o][1], origins[o][2]};
+        for (int step = 0; step < 3; step++) {
+          EntityHandle surf, mixed_surf;
+          double dist, mixed_dist;
+          rval = native->ray_fire(vol_h, xyz, dir, surf, dist, &history, 0,
+                                  orientation);
+          EXPECT_EQ(MB_SUCCESS, rval);
+          rval = mixed.ray_fire(vol_h, xyz, dir, mixed_surf, mixed_dist,
+                                &mixed_history, 0, orientation);
+          EXPECT_EQ(MB_SUCCESS, rval);
+          EXPECT_EQ(surf, mixed_surf);
+          EXPECT_EQ(history.size(), mixed_history.size());
+          if (!surf) break;
+          EXPECT_EQ(dist, mixed_dist);
+          for (int j = 0; j < 3; j++) xyz[j] += dist * dir[j];
+        }
+      }
+
+      int result, mixed_result;
+      rval = native->point_in_volume(vol_h, origins[o], result, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = mixed.point_in_volume(vol_h, origins[o], mixed_result, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(result, mixed_result);
+    }
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_compact_mesh) {
+  NativeRayTracer compact(DAG->geom_tool());
+  compact.set_compact_mesh(true);
+  rval = compact.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // every triangle is copied, its vertices within a quantization step
+  const CompactMesh& mesh = compact.get_compact_mesh();
+  Interface* mbi = DAG->moab_instance();
+  EXPECT_EQ(DAG->num_entities(2), (int)mesh.num_surfaces());
+  size_t n_tris = 0;
+  for (int s = 1; s <= DAG->num_entities(2); s++) {
+    EntityHandle surf = DAG->entity_by_index(2, s);
+    std::vector<double> coords;
+    std::vector<EntityHandle> handles;
+    rval = mesh.get_surface_triangles(surf, coords, handles);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    Range tris;
+    rval = mbi->get_entities_by_type(surf, MBTRI, tris);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    ASSERT_EQ(tris.size(), handles.size());
+    n_tris += handles.size();
+    for (size_t i = 0; i < handles.size(); i++) {
+      EXPECT_TRUE(tris.find(handles[i]) != tris.end());
+      const EntityHandle* conn;
+      int len;
+      double exact[9], facet[9];
+      rval = mbi->get_connectivity(handles[i], conn, len);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = mbi->get_coords(conn, 3, exact);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = mesh.get_facet_coords(surf, handles[i], facet);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      for (int j = 0; j < 9; j++) {
+        EXPECT_EQ(coords[9 * i + j], facet[j]);
+        EXPECT_NEAR(exact[j], facet[j], 1e-8);
+      }
+    }
+  }
+  EXPECT_EQ(n_tris, mesh.num_triangles());
+  EXPECT_EQ(MB_ENTITY_NOT_FOUND,
+            mesh.get_facet_coords(DAG->entity_by_index(3, 1), 1, NULL));
+
+  std::mt19937 gen(8);
+  std::uniform_real_distribution<double> coord(-8.0, 8.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (int v = 1; v <= DAG->num_entities(3); v++) {
+    EntityHandle vol_h = DAG->entity_by_index(3, v);
+    double volume, compact_volume;
+    rval = native->measure_volume(vol_h, volume);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = compact.measure_volume(vol_h, compact_volume);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_NEAR(volume, compact_volume, eps);
+
+    for (int i = 0; i < 200; i++) {
+      double xyz[3] = {coord(gen), coord(gen), coord(gen)};
+      double dir[3] = {normal(gen), normal(gen), normal(gen)};
+      double len =
+          std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+      for (int j = 0; j < 3; j++) dir[j] /= len;
+
+      EntityHandle surf, compact_surf;
+      double dist, compact_dist;
+      rval = native->ray_fire(vol_h, xyz, dir, surf, dist);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = compact.ray_fire(vol_h, xyz, dir, compact_surf, compact_dist);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(surf, compact_surf);
+      if (surf) {
+        EXPECT_NEAR(dist, compact_dist, eps);
+      }
+
+      int result, compact_result;
+      rval = native->point_in_volume(vol_h, xyz, result, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = compact.point_in_volume(vol_h, xyz, compact_result, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(result, compact_result);
+    }
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_release_facet_data) {
+  // without a compact mesh the facets are still needed
+  EXPECT_NE(MB_SUCCESS, DAG->release_facet_data());
+
+  std::shared_ptr<DagMC> dag = std::make_shared<DagMC>();
+  dag->set_compact_mesh(true);
+  rval = dag->load_file(input_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->release_facet_data();
+  // MOAB's OBB trees are built on the facets
+  if (MB_NOT_IMPLEMENTED == rval) return;
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  int n_tris = -1, n_verts = -1;
+  rval = dag->moab_instance()->get_number_entities_by_type(0, MBTRI, n_tris);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(0, n_tris);
+  rval =
+      dag->moab_instance()->get_number_entities_by_type(0, MBVERTEX, n_verts);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(0, n_verts);
+
+  // surfaces created afterwards are read from MOAB
+  rval = dag->create_graveyard();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  std::mt19937 gen(9);
+  std::uniform_real_distribution<double> coord(-4.0, 4.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (int v = 1; v <= DAG->num_entities(3); v++) {
+    EntityHandle vol_h = DAG->entity_by_index(3, v);
+    for (int i = 0; i < 100; i++) {
+      double xyz[3] = {coord(gen), coord(gen), coord(gen)};
+      double dir[3] = {normal(gen), normal(gen), normal(gen)};
+      double len =
+          std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+      for (int j = 0; j < 3; j++) dir[j] /= len;
+
+      EntityHandle surf, released_surf;
+      double dist, released_dist;
+      DagMC::RayHistory history;
+      rval = DAG->ray_fire(vol_h, xyz, dir, surf, dist);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = dag->ray_fire(vol_h, xyz, dir, released_surf, released_dist,
+                           &history);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(surf, released_surf);
+      if (!surf) continue;
+      EXPECT_NEAR(dist, released_dist, eps);
+
+      double angle[3];
+      rval = dag->get_angle(released_surf, xyz, angle, &history);
+      EXPECT_EQ(MB_SUCCESS, rval);
+    }
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_compact_mesh_cache) {
+  NativeRayTracer compact(DAG->geom_tool());
+  compact.set_compact_mesh(true);
+  rval = compact.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  uint64_t hash;
+  rval = compact.geometry_hash(hash);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  const char cache_file[] = "test_geom_compact.dagbvh";
+  rval = compact.save_cache(cache_file, hash);
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // the mesh is stored with the trees, and only read with them
+  NativeRayTracer plain(DAG->geom_tool());
+  EXPECT_EQ(MB_FAILURE, plain.load_cache(cache_file, hash));
+  NativeRayTracer cached(DAG->geom_tool());
+  cached.set_compact_mesh(true);
+  rval = cached.load_cache(cache_file, hash);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = cached.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  std::remove(cache_file);
+
+  const CompactMesh& mesh = compact.get_compact_mesh();
+  const CompactMesh& cached_mesh = cached.get_compact_mesh();
+  EXPECT_EQ(mesh.num_surfaces(), cached_mesh.num_surfaces());
+  ASSERT_EQ(mesh.num_vertices(), cached_mesh.num_vertices());
+  ASSERT_EQ(mesh.num_triangles(), cached_mesh.num_triangles());
+  EXPECT_EQ(0, std::memcmp(mesh.get_vertices().data(),
+                           cached_mesh.get_vertices().data(),
+                           3 * mesh.num_vertices() * sizeof(uint32_t)));
+  EXPECT_EQ(0, std::memcmp(mesh.get_connectivity().data(),
+                           cached_mesh.get_connectivity().data(),
+                           3 * mesh.num_triangles() * sizeof(uint32_t)));
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_shared_cache) {
+  // a name no other test run uses
+  std::random_device seed;
+  std::string name = "/dagmc-test-" + std::to_string(seed()) + "-" +
+                     std::to_string(seed());
+
+  NativeRayTracer leader(DAG->geom_tool());
+  leader.set_compact_mesh(true);
+  bool is_leader = false;
+  rval = leader.join_shared_cache(name, is_leader);
+  // no POSIX shared memory on this platform
+  if (MB_NOT_IMPLEMENTED == rval) return;
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(is_leader);
+  rval = leader.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  uint64_t hash;
+  rval = leader.geometry_hash(hash);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = leader.publish_shared_cache(hash);
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // the segment is only readable with the mesh it was published with
+  {
+    SharedBVHCache segment(name);
+    EXPECT_EQ(MB_SUCCESS, segment.join(is_leader));
+    EXPECT_FALSE(is_leader);
+    std::unordered_map<EntityHandle, std::shared_ptr<const TriangleBVH>> trees;
+    uint64_t published = 0;
+    EXPECT_EQ(MB_FAILURE, segment.read(BVH_DOUBLE, 0.0, trees, published));
+    EXPECT_EQ(0u, published);
+  }
+
+  // the others learn the hash from the leader
+  NativeRayTracer follower(DAG->geom_tool());
+  follower.set_compact_mesh(true);
+  rval = follower.join_shared_cache(name, is_leader);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_FALSE(is_leader);
+  uint64_t published = 0;
+  rval = follower.load_shared_cache(0.0, published);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(hash, published);
+  rval = follower.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(leader.get_compact_mesh().num_triangles(),
+            follower.get_compact_mesh().num_triangles());
+
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  std::mt19937 gen(10);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  double origin[3] = {0.0, 0.0, 0.0};
+  for (int i = 0; i < 100; i++) {
+    double dir[3] = {normal(gen), normal(gen), normal(gen)};
+    double len = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    for (int j = 0; j < 3; j++) dir[j] /= len;
+
+    EntityHandle surf, shared_surf;
+    double dist, shared_dist;
+    rval = leader.ray_fire(vol_h, origin, dir, surf, dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = follower.ray_fire(vol_h, origin, dir, shared_surf, shared_dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(surf, shared_surf);
+    EXPECT_EQ(dist, shared_dist);
+  }
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_shared_cache_wait) {
+  std::random_device seed;
+  std::string name = "/dagmc-test-" + std::to_string(seed()) + "-" +
+                     std::to_string(seed());
+
+  // a leader that never publishes
+  SharedBVHCache leader(name);
+  bool is_leader = false;
+  rval = leader.join(is_leader);
+  if (MB_NOT_IMPLEMENTED == rval) return;
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(is_leader);
+
+  // the others stop waiting for it and build their own trees
+  NativeRayTracer follower(DAG->geom_tool());
+  rval = follower.join_shared_cache(name, is_leader);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_FALSE(is_leader);
+  uint64_t published = 0;
+  rval = follower.load_shared_cache(0.05, published);
+  EXPECT_EQ(MB_FAILURE, rval);
+  rval = follower.init();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  const double origin[3] = {0.0, 0.0, 0.0}, dir[3] = {1.0, 0.0, 0.0};
+  EntityHandle surf;
+  double dist;
+  rval = follower.ray_fire(vol_h, origin, dir, surf, dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, dist, eps);
+}
+
+TEST(DagmcBVHTest, dagmc_model_file_key) {
+  uint64_t key, same_key, other_key;
+  ErrorCode rval = model_file_key(input_file, "", key);
+  // no stat on this platform
+  if (MB_NOT_IMPLEMENTED == rval) return;
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(MB_SUCCESS, model_file_key(input_file, "", same_key));
+  EXPECT_EQ(key, same_key);
+  // files read with other options are other geometries
+  EXPECT_EQ(MB_SUCCESS, model_file_key(input_file, "DEBUG_IO=1", other_key));
+  EXPECT_NE(key, other_key);
+  EXPECT_EQ(MB_FILE_DOES_NOT_EXIST,
+            model_file_key("no_such_model.h5m", "", other_key));
+  EXPECT_EQ(MB_FILE_DOES_NOT_EXIST, model_file_key("", "", other_key));
+}
+
+TEST_F(DagmcNativeBVHTest, dagmc_native_instances) {
+  Interface* mbi = DAG->moab_instance();
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+
+  // the cube turned a quarter about z and moved to x = 20, sharing the
+  // trees of the cube's surfaces
+  const double transform[12] = {0, -1, 0, 1, 0, 0, 0, 0, 1, 20, 0, 0};
+  Tag prototype_tag, transform_tag;
+  rval = NativeRayTracer::get_instance_tags(mbi, prototype_tag, transform_tag);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  std::vector<EntityHandle> surfs;
+  rval = mbi->get_child_meshsets(vol_h, surfs);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  EntityHandle instance;
+  rval = mbi->create_meshset(0, instance);
+  ASSERT_EQ(MB_SUCCESS, rval);
+  std::map<EntityHandle, EntityHandle> prototype_of;
+  for (EntityHandle surf : surfs) {
+    int sense;
+    rval = DAG->geom_tool()->get_sense(surf, vol_h, sense);
+    ASSERT_EQ(MB_SUCCESS, rval);
+    EntityHandle copy;
+    rval = mbi->create_meshset(0, copy);
+    ASSERT_EQ(MB_SUCCESS, rval);
+    rval = mbi->tag_set_data(prototype_tag, &copy, 1, &surf);
+    ASSERT_EQ(MB_SUCCESS, rval);
+    rval = mbi->tag_set_data(transform_tag, &copy, 1, transform);
+    ASSERT_EQ(MB_SUCCESS, rval);
+    rval = mbi->add_parent_child(instance, copy);
+    ASSERT_EQ(MB_SUCCESS, rval);
+    if (sense > 0)
+      rval = DAG->geom_tool()->set_surface_senses(copy, instance, 0);
+    else
+      rval = DAG->geom_tool()->set_surface_senses(copy, 0, instance);
+    ASSERT_EQ(MB_SUCCESS, rval);
+    prototype_of[copy] = surf;
+  }
+  rval = native->createBVH(instance);
+  ASSERT_EQ(MB_SUCCESS, rval);
+
+  double min[3], max[3];
+  rval = native->get_bbox(instance, min, max);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  const double center[3] = {20.0, 0.0, 0.0};
+  for (int i = 0; i < 3; i++) {
+    EXPECT_NEAR(center[i] - 5.0, min[i], eps);
+    EXPECT_NEAR(center[i] + 5.0, max[i], eps);
+  }
+  double volume, instance_volume;
+  rval = native->measure_volume(vol_h, volume);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = native->measure_volume(instance, instance_volume);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(volume, instance_volume, eps);
+
+  // queries match the same queries on the cube, moved
+  std::mt19937 gen(11);
+  std::uniform_real_distribution<double> coord(-8.0, 8.0);
+  for (int i = 0; i < 100; i++) {
+    double local[3] = {coord(gen), coord(gen), coord(gen)};
+    double world[3] = {20.0 - local[1], local[0], local[2]};
+    int result, instance_result;
+    rval = native->point_in_volume(vol_h, local, result);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = native->point_in_volume(instance, world, instance_result);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(result, instance_result);
+    rval = native->point_in_volume_slow(instance, world, instance_result);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(result, instance_result);
+
+    double dist, instance_dist;
+    rval = native->closest_to_location(vol_h, local, dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = native->closest_to_location(instance, world, instance_dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_NEAR(dist, instance_dist, eps);
+  }
+
+  // +x in the instance is -y in the cube
+  double origin[3] = {0.0, 0.0, 0.0}, dir[3] = {0.0, -1.0, 0.0};
+  double instance_dir[3] = {1.0, 0.0, 0.0};
+  EntityHandle surf, instance_surf;
+  double dist, instance_dist;
+  NativeRayTracer::RayHistory history, instance_history;
+  rval = native->ray_fire(vol_h, origin, dir, surf, dist, &history);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = native->ray_fire(instance, center, instance_dir, instance_surf,
+                          instance_dist, &instance_history);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, instance_dist, eps);
+  EXPECT_NEAR(dist, instance_dist, eps);
+  EXPECT_EQ(surf, prototype_of[instance_surf]);
+  ASSERT_EQ(1, instance_history.size());
+
+  double outside[3] = {27.0, 0.0, 0.0};
+  EntityHandle closest_surf;
+  rval = native->closest_to_location(instance, outside, instance_dist,
+                                     &closest_surf);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(2.0, instance_dist, eps);
+  EXPECT_EQ(instance_surf, closest_surf);
+
+  // facets crossed in an instance are not those of the prototype
+  EntityHandle facet, instance_facet;
+  history.get_last_intersection(facet);
+  instance_history.get_last_intersection(instance_facet);
+  EXPECT_NE(facet, instance_facet);
+  NativeRayTracer::RayHistory crossed = instance_history;
+  rval = native->ray_fire(vol_h, origin, dir, surf, dist, &crossed);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, dist, eps);
+
+  double hit[3] = {25.0, 0.0, 0.0};
+  int result, instance_result;
+  double cube_hit[3] = {0.0, -5.0, 0.0};
+  rval = native->test_volume_boundary(vol_h, surf, cube_hit, dir, result,
+                                      &history);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = native->test_volume_boundary(instance, instance_surf, hit,
+                                      instance_dir, instance_result,
+                                      &instance_history);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(result, instance_result);
+
+  // normals are turned with the instance
+  for (int i = 0; i < 2; i++) {
+    double angle[3];
+    rval = native->get_normal(instance_surf, hit, angle,
+                              i ? &instance_history : NULL);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_NEAR(1.0, angle[0], eps);
+    EXPECT_NEAR(0.0, angle[1], eps);
+    EXPECT_NEAR(0.0, angle[2], eps);
+  }
+}
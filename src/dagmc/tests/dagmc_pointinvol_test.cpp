@@ -232,3 +232,91 @@ TEST_F(DagmcPointInVolTest, dagmc_point_on_corner_8) {
 
   EXPECT_EQ(expected_result, result);
 }
+
+TEST_F(DagmcPointInVolTest, dagmc_find_volume) {
+  double xyz[3] = {0.0, 0.0, 0.0};
+  EntityHandle vol_h = 0;
+  ErrorCode rval = DAG->find_volume(xyz, vol_h);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(DAG->entity_by_index(3, 1), vol_h);
+
+  // the index must agree with a scan over all volumes in index order
+  srand(42);
+  for (int i = 0; i < 1000; i++) {
+    for (int j = 0; j < 3; j++) xyz[j] = 12.0 * rand() / RAND_MAX - 6.0;
+
+    EntityHandle expected = 0;
+    for (int v = 1; v <= DAG->num_entities(3) && !expected; v++) {
+      int result = 0;
+      rval = DAG->point_in_volume(DAG->entity_by_index(3, v), xyz, result);
+      EXPECT_EQ(rval, MB_SUCCESS);
+      if (result == 1) expected = DAG->entity_by_index(3, v);
+    }
+
+    rval = DAG->find_volume(xyz, vol_h);
+    EXPECT_EQ(rval, MB_SUCCESS);
+    EXPECT_EQ(expected, vol_h);
+  }
+
+  // a point outside the boxes of all volumes is only tested against the
+  // implicit complement, which has no box in the index
+  const double far[3] = {100.0, 100.0, 100.0};
+  EntityHandle expected = 0;
+  for (int v = 1; v <= DAG->num_entities(3) && !expected; v++) {
+    EntityHandle vol = DAG->entity_by_index(3, v);
+    int result = 0;
+    rval = DAG->point_in_volume(vol, far, result);
+    EXPECT_EQ(rval, MB_SUCCESS);
+    if (result == 1) {
+      EXPECT_TRUE(DAG->is_implicit_complement(vol));
+      expected = vol;
+    }
+  }
+  rval = DAG->find_volume(far, vol_h);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(expected, vol_h);
+}
+
+TEST_F(DagmcPointInVolTest, dagmc_point_in_vol_fast_paths) {
+  // the box rejection and the verdict cache must agree with the spherical
+  // area test, for points inside and outside the boxes
+  DAG->set_point_cache(true);
+  srand(7);
+  for (int i = 0; i < 200; i++) {
+    double xyz[3];
+    for (int j = 0; j < 3; j++) xyz[j] = 16.0 * rand() / RAND_MAX - 8.0;
+    for (int v = 1; v <= DAG->num_entities(3); v++) {
+      EntityHandle vol_h = DAG->entity_by_index(3, v);
+      int expected = 0;
+      ErrorCode rval = DAG->point_in_volume_slow(vol_h, xyz, expected);
+      EXPECT_EQ(rval, MB_SUCCESS);
+      // the second call is answered from the cache
+      for (int k = 0; k < 2; k++) {
+        int result = -2;
+        rval = DAG->point_in_volume(vol_h, xyz, result);
+        EXPECT_EQ(rval, MB_SUCCESS);
+        EXPECT_EQ(expected, result);
+      }
+    }
+  }
+
+  // a cached verdict is only reused for the same direction
+  double xyz[3] = {5.0, 0.0, 0.0};
+  double dirs[2][3] = {{1.0, 0.0, 0.0}, {-1.0, 0.0, 0.0}};
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  int expected[2];
+  DAG->set_point_cache(false);
+  for (int d = 0; d < 2; d++) {
+    EXPECT_EQ(MB_SUCCESS,
+              DAG->point_in_volume(vol_h, xyz, expected[d], dirs[d]));
+  }
+  DAG->set_point_cache(true);
+  for (int k = 0; k < 2; k++) {
+    for (int d = 0; d < 2; d++) {
+      int result = -2;
+      EXPECT_EQ(MB_SUCCESS, DAG->point_in_volume(vol_h, xyz, result, dirs[d]));
+      EXPECT_EQ(expected[d], result);
+    }
+  }
+  DAG->set_point_cache(false);
+}
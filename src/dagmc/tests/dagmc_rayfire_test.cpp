@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <vector>
 
 #include "DagMC.hpp"
 #include "moab/Core.hpp"
@@ -153,3 +156,142 @@ TEST_F(DagmcRayFireTest, dagmc_outside_face_rayfire_history) {
   EntityHandle ZERO = 0;
   EXPECT_EQ(ZERO, next_surf);
 }
+
+TEST_F(DagmcRayFireTest, dagmc_rayfire_batch) {
+  int vol_idx = 1;
+  EntityHandle vol_h = DAG->entity_by_index(3, vol_idx);
+
+  // six rays fired from the origin along each axis, in SoA layout
+  const int n_rays = 6;
+  double origins[3 * n_rays] = {0.0};
+  double dirs[3 * n_rays] = {0.0};
+  for (int i = 0; i < n_rays; i++) {
+    dirs[(i / 2) * n_rays + i] = (i % 2) ? -1.0 : 1.0;
+  }
+
+  EntityHandle next_surfs[n_rays];
+  double next_surf_dists[n_rays];
+  std::vector<DagMC::RayHistory> histories(n_rays);
+  ErrorCode rval =
+      DAG->ray_fire_batch(vol_h, n_rays, origins, dirs, next_surfs,
+                          next_surf_dists, histories.data());
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // every ray in the packet should match the equivalent scalar ray fire
+  for (int i = 0; i < n_rays; i++) {
+    double origin[3] = {0.0, 0.0, 0.0};
+    double dir[3] = {dirs[i], dirs[n_rays + i], dirs[2 * n_rays + i]};
+    EntityHandle next_surf;
+    double next_surf_dist;
+    DagMC::RayHistory history;
+    rval = DAG->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist,
+                         &history);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(next_surf, next_surfs[i]);
+    EXPECT_NEAR(next_surf_dist, next_surf_dists[i], eps);
+    EXPECT_EQ(history.size(), histories[i].size());
+  }
+
+  // batched rays are counted like single ones, on the volume and on the
+  // surfaces they hit
+  QueryCounters& counters = DAG->query_counters();
+  DAG->set_query_counters(true);
+  counters.reset();
+  rval = DAG->ray_fire_batch(vol_h, n_rays, origins, dirs, next_surfs,
+                             next_surf_dists);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  DAG->set_query_counters(false);
+  std::map<EntityHandle, QueryCounters::VolumeStats> totals;
+  counters.collect(totals);
+  EXPECT_EQ((uint64_t)n_rays, totals[vol_h][QUERY_RAY_FIRE].calls);
+  std::map<EntityHandle, QueryCounters::SurfaceStats> surf_totals;
+  counters.collect_surfaces(surf_totals);
+  uint64_t surf_calls = 0;
+  for (const auto& surf : surf_totals)
+    surf_calls += surf.second[QUERY_RAY_FIRE].calls;
+  EXPECT_EQ((uint64_t)n_rays, surf_calls);
+
+  // with their tree traversal, if the ray tracer reports it for ray_fire
+  const BVHCounts batch_counts = totals[vol_h][QUERY_RAY_FIRE].counts;
+  counters.reset();
+  DAG->set_query_counters(true);
+  for (int i = 0; i < n_rays; i++) {
+    double origin[3] = {0.0, 0.0, 0.0};
+    double dir[3] = {dirs[i], dirs[n_rays + i], dirs[2 * n_rays + i]};
+    EntityHandle next_surf;
+    double next_surf_dist;
+    rval = DAG->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+  }
+  DAG->set_query_counters(false);
+  totals.clear();
+  counters.collect(totals);
+  const BVHCounts& single_counts = totals[vol_h][QUERY_RAY_FIRE].counts;
+  EXPECT_EQ(0u < single_counts.nodes_visited, 0u < batch_counts.nodes_visited);
+  EXPECT_EQ(0u < single_counts.triangles_tested,
+            0u < batch_counts.triangles_tested);
+  counters.reset();
+}
+
+TEST_F(DagmcRayFireTest, dagmc_rayfire_history_facets) {
+  int vol_idx = 1;
+  EntityHandle vol_h = DAG->entity_by_index(3, vol_idx);
+  // off the diagonals splitting the faces of the cube into facets
+  double origin[3] = {0.0, 1.0, 2.0};
+  double dir[3] = {1.0, 0.0, 0.0};
+  EntityHandle next_surf;
+  double next_surf_dist;
+
+  // each ray fire records the facet it hits
+  DagMC::RayHistory history;
+  rval = DAG->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist,
+                       &history);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, history.size());
+  EntityHandle facet;
+  EXPECT_EQ(MB_SUCCESS, history.get_last_intersection(facet));
+  EXPECT_TRUE(history.in_history(facet));
+
+  // a ray fired back from the hit point adds the facet of the far side
+  double back[3] = {-1.0, 0.0, 0.0};
+  double hit[3] = {next_surf_dist, 1.0, 2.0};
+  rval = DAG->ray_fire(vol_h, hit, back, next_surf, next_surf_dist, &history);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(10.0, next_surf_dist, eps);
+  EXPECT_EQ(2, history.size());
+  EXPECT_TRUE(history.in_history(facet));
+}
+
+TEST(DagmcRayHistoryTest, compact_ray_history) {
+  // longer than the inline storage
+  const int n = 3 * CompactRayHistory::INLINE_CAPACITY + 1;
+  CompactRayHistory history;
+  for (int i = 1; i <= n; i++) history.add_entity(i);
+  EXPECT_EQ(n, history.size());
+  for (int i = 1; i <= n; i++) EXPECT_TRUE(history.in_history(i));
+  EXPECT_FALSE(history.in_history(n + 1));
+
+  CompactRayHistory copy(history);
+  EXPECT_EQ(n, copy.size());
+  EXPECT_TRUE(std::equal(history.begin(), history.end(), copy.begin()));
+
+  CompactRayHistory moved(std::move(copy));
+  EXPECT_EQ(n, moved.size());
+  EXPECT_EQ(0, copy.size());
+
+  CompactRayHistory short_history;
+  short_history.add_entity(42);
+  moved = short_history;
+  EXPECT_EQ(1, moved.size());
+  EXPECT_TRUE(moved.in_history(42));
+  EXPECT_FALSE(moved.in_history(1));
+
+  history.reset_to_last_intersection();
+  EXPECT_EQ(1, history.size());
+  EntityHandle last;
+  EXPECT_EQ(MB_SUCCESS, history.get_last_intersection(last));
+  EXPECT_EQ((EntityHandle)n, last);
+  history.rollback_last_intersection();
+  EXPECT_EQ(0, history.size());
+  EXPECT_EQ(MB_ENTITY_NOT_FOUND, history.get_last_intersection(last));
+}
@@ -1,6 +1,13 @@
 #include <gtest/gtest.h>
 
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "DagMC.hpp"
 #include "moab/Core.hpp"
@@ -108,6 +115,32 @@ TEST_F(DagmcSimpleTest, dagmc_load_file_dagmc_internal_build_obb) {
   EXPECT_EQ(rval, MB_SUCCESS);
 }
 
+TEST_F(DagmcSimpleTest, dagmc_load_times) {
+  std::shared_ptr<DagMC> dagmc = std::make_shared<DagMC>();
+  dagmc->set_load_options("BUFFER_SIZE=1048576");
+  ErrorCode rval = dagmc->load_file(input_file);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = dagmc->init_OBBTree();
+  EXPECT_EQ(rval, MB_SUCCESS);
+
+  const char* phases[] = {"read", "faceting tolerance",
+                          "geometry sets (load)", "geometry sets (init)",
+                          "implicit complement",
+                          "acceleration data structures", "indices"};
+  const std::vector<std::pair<std::string, double>>& times =
+      dagmc->load_times();
+  ASSERT_EQ(sizeof(phases) / sizeof(phases[0]), times.size());
+  for (size_t i = 0; i < times.size(); i++) {
+    EXPECT_EQ(phases[i], times[i].first);
+    EXPECT_LE(0.0, times[i].second);
+  }
+
+  // a new load starts a new list
+  rval = dagmc->load_existing_contents();
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(2u, dagmc->load_times().size());
+}
+
 TEST_F(DagmcSimpleTest, dagmc_test_obb_retreval) {
   // make new dagmc
   std::cout << "test_obb_retreval" << std::endl;
@@ -265,4 +298,258 @@ TEST_F(DagmcSimpleTest, dagmc_test_get_obb) {
     EXPECT_LE(llc[i], -geom_extent);
     EXPECT_GE(urc[i], geom_extent);
   }
-}
\ No newline at end of file
+}
+TEST_F(DagmcSimpleTest, dagmc_next_vol_by_index) {
+  // the index-based queries must agree with the handle-based ones
+  for (unsigned s = 1; s <= DAG->num_entities(2); s++) {
+    EntityHandle surf_h = DAG->entity_by_index(2, s);
+    for (unsigned v = 1; v <= DAG->num_entities(3); v++) {
+      EntityHandle vol_h = DAG->entity_by_index(3, v);
+      EntityHandle next_h = 0;
+      ErrorCode expect_rval = DAG->next_vol(surf_h, vol_h, next_h);
+      int next = -1;
+      ErrorCode rval = DAG->next_vol_by_index(s, v, next);
+      EXPECT_EQ(expect_rval == MB_SUCCESS, rval == MB_SUCCESS);
+      if (MB_SUCCESS == rval) {
+        EXPECT_EQ(next_h ? DAG->index_by_handle(next_h) : 0, next);
+      }
+
+      int expect_sense = 2, sense = 2;
+      expect_rval = DAG->surface_sense(vol_h, surf_h, expect_sense);
+      rval = DAG->surface_sense_by_index(v, s, sense);
+      EXPECT_EQ(expect_rval == MB_SUCCESS, rval == MB_SUCCESS);
+      if (MB_SUCCESS == rval) {
+        EXPECT_EQ(expect_sense, sense);
+      }
+    }
+  }
+  int next;
+  EXPECT_NE(MB_SUCCESS, DAG->next_vol_by_index(0, 1, next));
+}
+
+TEST_F(DagmcSimpleTest, dagmc_queries_by_index) {
+  int vol_idx = 1;
+  EntityHandle vol_h = DAG->entity_by_index(3, vol_idx);
+  double xyz[3] = {0.0, 0.0, 0.0};
+  double dir[3] = {0.0, 0.0, 1.0};
+
+  EntityHandle surf_h;
+  double dist, dist_by_index;
+  ErrorCode rval = DAG->ray_fire(vol_h, xyz, dir, surf_h, dist);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  int surf_idx;
+  rval = DAG->ray_fire_by_index(vol_idx, xyz, dir, surf_idx, dist_by_index);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(DAG->index_by_handle(surf_h), surf_idx);
+  EXPECT_EQ(dist, dist_by_index);
+
+  int result;
+  rval = DAG->point_in_volume_by_index(vol_idx, xyz, result);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(1, result);
+
+  double on_surf[3] = {0.0, 0.0, 5.0};
+  double angle[3], angle_by_index[3];
+  rval = DAG->get_angle(surf_h, on_surf, angle);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = DAG->get_angle_by_index(surf_idx, on_surf, angle_by_index);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  for (int i = 0; i < 3; i++) EXPECT_EQ(angle[i], angle_by_index[i]);
+
+  double measure, measure_by_index;
+  rval = DAG->measure_volume(vol_h, measure);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = DAG->measure_volume_by_index(vol_idx, measure_by_index);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(measure, measure_by_index);
+  rval = DAG->measure_area(surf_h, measure);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = DAG->measure_area_by_index(surf_idx, measure_by_index);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(measure, measure_by_index);
+
+  // the cached IDs are those of the GID tag
+  for (int dim = 2; dim <= 3; dim++) {
+    for (unsigned i = 1; i <= DAG->num_entities(dim); i++) {
+      EXPECT_EQ(DAG->get_entity_id(DAG->entity_by_index(dim, i)),
+                DAG->id_by_index(dim, i));
+    }
+  }
+}
+
+TEST_F(DagmcSimpleTest, dagmc_measure_all) {
+  // the measures of each entity, before measure_all caches them
+  std::vector<double> measures[4];
+  ErrorCode rval;
+  for (int dim = 2; dim <= 3; dim++) {
+    measures[dim].resize(DAG->num_entities(dim) + 1);
+    for (unsigned i = 1; i <= DAG->num_entities(dim); i++) {
+      EntityHandle h = DAG->entity_by_index(dim, i);
+      rval = 2 == dim ? DAG->measure_area(h, measures[dim][i])
+                      : DAG->measure_volume(h, measures[dim][i]);
+      EXPECT_EQ(MB_SUCCESS, rval);
+    }
+  }
+
+  DAG->set_num_threads(2);
+  rval = DAG->measure_all();
+  DAG->set_num_threads(1);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  for (int dim = 2; dim <= 3; dim++) {
+    for (unsigned i = 1; i <= DAG->num_entities(dim); i++) {
+      double cached;
+      rval = 2 == dim ? DAG->measure_area_by_index(i, cached)
+                      : DAG->measure_volume_by_index(i, cached);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_NEAR(measures[dim][i], cached,
+                  1e-10 * std::max(1.0, fabs(measures[dim][i])));
+    }
+  }
+
+  // the measures are stored as tags and read back by the next measure_all
+  Interface* mbi = DAG->moab_instance();
+  Tag tag;
+  rval = mbi->tag_get_handle("DAGMC_MEASURE", tag);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  double stored;
+  rval = mbi->tag_get_data(tag, &vol_h, 1, &stored);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(measures[3][1], stored,
+              1e-10 * std::max(1.0, fabs(measures[3][1])));
+
+  double original = stored;
+  stored = 42.0;
+  rval = mbi->tag_set_data(tag, &vol_h, 1, &stored);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->setup_indices();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->measure_all();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  double volume;
+  rval = DAG->measure_volume(vol_h, volume);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(42.0, volume);
+
+  // a moved vertex, which keeps the facet count, makes measure_all measure
+  // the volume again
+  Range surfs, tris;
+  rval = mbi->get_child_meshsets(vol_h, surfs);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  ASSERT_FALSE(surfs.empty());
+  rval = mbi->get_entities_by_type(surfs.front(), MBTRI, tris);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  ASSERT_FALSE(tris.empty());
+  const EntityHandle* conn;
+  int n_conn;
+  rval = mbi->get_connectivity(tris.front(), conn, n_conn);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EntityHandle vert = conn[0];
+  double xyz[3], moved[3];
+  rval = mbi->get_coords(&vert, 1, xyz);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  for (int i = 0; i < 3; i++) moved[i] = xyz[i] + 0.1;
+  rval = mbi->set_coords(&vert, 1, moved);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  stored = 42.0;
+  rval = mbi->tag_set_data(tag, &vol_h, 1, &stored);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->setup_indices();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->measure_all();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->measure_volume(vol_h, volume);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NE(42.0, volume);
+  EXPECT_NEAR(original, volume, 0.1 * std::max(1.0, fabs(original)));
+
+  // and again once it is moved back
+  rval = mbi->set_coords(&vert, 1, xyz);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->setup_indices();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->measure_all();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->measure_volume(vol_h, volume);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(original, volume, 1e-10 * std::max(1.0, fabs(original)));
+}
+
+TEST_F(DagmcSimpleTest, dagmc_parse_properties_many_groups) {
+  std::shared_ptr<DagMC> dagmc = std::make_shared<DagMC>();
+  ErrorCode rval = dagmc->load_file(input_file);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = dagmc->init_OBBTree();
+  EXPECT_EQ(rval, MB_SUCCESS);
+
+  // a synthetic model with many groups spread over the volumes
+  const int num_groups = 100000;
+  const int num_vols = dagmc->num_entities(3);
+  Interface* mbi = dagmc->moab_instance();
+  Tag name_tag, category_tag;
+  rval = mbi->tag_get_handle(NAME_TAG_NAME, NAME_TAG_SIZE, MB_TYPE_OPAQUE,
+                             name_tag, MB_TAG_SPARSE | MB_TAG_CREAT);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = mbi->tag_get_handle(CATEGORY_TAG_NAME, CATEGORY_TAG_SIZE,
+                             MB_TYPE_OPAQUE, category_tag,
+                             MB_TAG_SPARSE | MB_TAG_CREAT);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  std::string category = "Group";
+  category.resize(CATEGORY_TAG_SIZE);
+  for (int k = 0; k < num_groups; k++) {
+    EntityHandle group;
+    rval = mbi->create_meshset(0, group);
+    ASSERT_EQ(rval, MB_SUCCESS);
+    std::string name = "bulk_" + std::to_string(k);
+    name.resize(NAME_TAG_SIZE);
+    rval = mbi->tag_set_data(name_tag, &group, 1, name.c_str());
+    ASSERT_EQ(rval, MB_SUCCESS);
+    rval = mbi->tag_set_data(category_tag, &group, 1, category.c_str());
+    ASSERT_EQ(rval, MB_SUCCESS);
+    EntityHandle vol = dagmc->entity_by_index(3, k % num_vols + 1);
+    rval = mbi->add_entities(group, &vol, 1);
+    ASSERT_EQ(rval, MB_SUCCESS);
+  }
+  rval = dagmc->setup_indices();
+  EXPECT_EQ(rval, MB_SUCCESS);
+
+  std::vector<std::string> keywords = {"bulk"};
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  rval = dagmc->parse_properties(keywords);
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  EXPECT_EQ(rval, MB_SUCCESS);
+  // the time is reported, not checked: it depends on the machine
+  std::cout << "parse_properties of " << num_groups << " groups took "
+            << seconds << " s" << std::endl;
+
+  // every volume, and nothing else, got the property
+  std::vector<EntityHandle> tagged;
+  rval = dagmc->entities_by_property("bulk", tagged);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(num_vols, (int)tagged.size());
+  rval = dagmc->entities_by_property("bulk", tagged, 2);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_TRUE(tagged.empty());
+
+  // each volume has the values of its groups in group order
+  for (int i = 1; i <= num_vols; i++) {
+    std::vector<std::string> values;
+    rval = dagmc->prop_values(dagmc->entity_by_index(3, i), "bulk", values);
+    EXPECT_EQ(rval, MB_SUCCESS);
+    ASSERT_EQ((num_groups - i) / num_vols + 1, (int)values.size());
+    EXPECT_EQ(std::to_string(i - 1), values.front());
+    EXPECT_EQ(std::to_string(i - 1 + num_vols), values[1]);
+  }
+
+  // parsing again appends to the values already stored
+  rval = dagmc->parse_properties(keywords);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  std::vector<std::string> values;
+  rval = dagmc->prop_values(dagmc->entity_by_index(3, 1), "bulk", values);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  ASSERT_EQ(2 * ((num_groups - 1) / num_vols + 1), (int)values.size());
+  EXPECT_EQ("0", values[values.size() / 2]);
+}
@@ -0,0 +1,245 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "DagMC.hpp"
+#include "moab/Core.hpp"
+#include "moab/Interface.hpp"
+
+using namespace moab;
+
+using moab::DagMC;
+
+std::shared_ptr<moab::DagMC> DAG;
+
+static const char input_file[] = "test_geom.h5m";
+
+static const int num_threads = 4;
+static const int num_queries = 500;
+
+// results of a fixed set of queries from a single point/direction pair
+struct QueryResult {
+  EntityHandle next_surf;
+  double next_surf_dist;
+  int inside;
+  int inside_random;
+  int boundary;
+  double closest_dist;
+};
+
+class DagmcThreadingTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // Create new DAGMC instance
+    DAG = std::make_shared<moab::DagMC>();
+    // Load mesh from file
+    rloadval = DAG->load_file(input_file);
+    assert(rloadval == moab::MB_SUCCESS);
+    // Create the OBB
+    rval = DAG->init_OBBTree();
+    assert(rval == moab::MB_SUCCESS);
+
+    vol_h = DAG->entity_by_index(3, 1);
+    surf_h = DAG->entity_by_index(2, 1);
+
+    // seeded random points around the test geometry and random directions
+    std::mt19937 gen(12345);
+    std::uniform_real_distribution<double> coord(-4.0, 4.0);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    points.resize(3 * num_queries);
+    dirs.resize(3 * num_queries);
+    for (int i = 0; i < num_queries; i++) {
+      double len = 0.0;
+      for (int j = 0; j < 3; j++) {
+        points[3 * i + j] = coord(gen);
+        dirs[3 * i + j] = normal(gen);
+        len += dirs[3 * i + j] * dirs[3 * i + j];
+      }
+      len = std::sqrt(len);
+      for (int j = 0; j < 3; j++) dirs[3 * i + j] /= len;
+    }
+  }
+  virtual void TearDown() {}
+
+  // run every query type for query i, using only thread-owned state;
+  // serialized unless the build supports concurrent queries
+  ErrorCode run_query(int i, QueryResult& result) {
+    std::unique_lock<std::mutex> lock(query_mutex, std::defer_lock);
+    if (!DagMC::concurrent_queries()) lock.lock();
+    const double* xyz = &points[3 * i];
+    const double* uvw = &dirs[3 * i];
+    DagMC::RayHistory history;
+    ErrorCode rval = DAG->ray_fire(vol_h, xyz, uvw, result.next_surf,
+                                   result.next_surf_dist, &history);
+    if (MB_SUCCESS != rval) return rval;
+    rval = DAG->point_in_volume(vol_h, xyz, result.inside, uvw);
+    if (MB_SUCCESS != rval) return rval;
+    // and without one, which picks a random direction
+    rval = DAG->point_in_volume(vol_h, xyz, result.inside_random);
+    if (MB_SUCCESS != rval) return rval;
+    rval = DAG->test_volume_boundary(vol_h, surf_h, xyz, uvw, result.boundary);
+    if (MB_SUCCESS != rval) return rval;
+    return DAG->closest_to_location(vol_h, xyz, result.closest_dist);
+  }
+
+ protected:
+  moab::ErrorCode rloadval;
+  moab::ErrorCode rval;
+  EntityHandle vol_h;
+  EntityHandle surf_h;
+  std::vector<double> points;
+  std::vector<double> dirs;
+  std::mutex query_mutex;
+};
+
+TEST_F(DagmcThreadingTest, dagmc_concurrent_queries) {
+  // serial reference results
+  std::vector<QueryResult> expected(num_queries);
+  for (int i = 0; i < num_queries; i++) {
+    ErrorCode rval = run_query(i, expected[i]);
+    EXPECT_EQ(MB_SUCCESS, rval);
+  }
+
+  // every thread repeats every query against the shared instance
+  std::vector<int> failures(num_threads, 0);
+  std::vector<int> mismatches(num_threads, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < num_queries; i++) {
+        // stagger the starting query so threads hit different geometry
+        int q = (i + t * num_queries / num_threads) % num_queries;
+        QueryResult result;
+        if (MB_SUCCESS != run_query(q, result)) {
+          failures[t]++;
+          continue;
+        }
+        const QueryResult& ref = expected[q];
+        if (result.next_surf != ref.next_surf ||
+            result.next_surf_dist != ref.next_surf_dist ||
+            result.inside != ref.inside ||
+            result.inside_random != ref.inside_random ||
+            result.boundary != ref.boundary ||
+            result.closest_dist != ref.closest_dist)
+          mismatches[t]++;
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  for (int t = 0; t < num_threads; t++) {
+    EXPECT_EQ(0, failures[t]);
+    EXPECT_EQ(0, mismatches[t]);
+  }
+}
+
+TEST_F(DagmcThreadingTest, dagmc_query_counters) {
+  QueryCounters& counters = DAG->query_counters();
+  DAG->set_query_counters(true);
+  counters.reset();
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < num_queries; i++) {
+        QueryResult result;
+        run_query(i, result);
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  DAG->set_query_counters(false);
+
+  // every thread's queries are counted, and only on the queried volume
+  std::map<EntityHandle, QueryCounters::VolumeStats> totals;
+  counters.collect(totals);
+  ASSERT_EQ(1u, totals.size());
+  ASSERT_EQ(vol_h, totals.begin()->first);
+  const QueryCounters::VolumeStats& stats = totals.begin()->second;
+  for (int type = 0; type < NUM_QUERY_TYPES; type++) {
+    // run_query asks for no lower-bound safeties
+    if (QUERY_SAFETY_LOWER_BOUND == type) {
+      EXPECT_EQ(0u, stats[type].calls);
+      continue;
+    }
+    // point_in_volume is run with and without a direction
+    uint64_t per_query = type == QUERY_POINT_IN_VOLUME ? 2 : 1;
+    EXPECT_EQ(per_query * num_threads * num_queries, stats[type].calls);
+    EXPECT_LT(0.0, stats[type].seconds);
+  }
+
+  // nothing is counted while disabled
+  QueryResult result;
+  run_query(0, result);
+  counters.collect(totals);
+  EXPECT_EQ((uint64_t)num_threads * num_queries,
+            totals[vol_h][QUERY_RAY_FIRE].calls);
+
+  std::ostringstream csv;
+  counters.write_csv(csv, [&](EntityHandle vol) {
+    return DAG->get_entity_id(vol);
+  });
+  std::string first_line = csv.str().substr(0, csv.str().find('\n'));
+  EXPECT_EQ(
+      "volume,query,calls,seconds,nodes_visited,leaves_visited,"
+      "triangles_tested,history_hits,retries",
+      first_line);
+
+  counters.reset();
+  counters.collect(totals);
+  EXPECT_EQ(0u, totals[vol_h][QUERY_RAY_FIRE].calls);
+}
+
+TEST_F(DagmcThreadingTest, dagmc_query_cost_tags) {
+  DAG->set_query_counters(true);
+  DAG->query_counters().reset();
+  std::map<EntityHandle, int> hits;
+  for (int i = 0; i < num_queries; i++) {
+    EntityHandle surf;
+    double dist;
+    rval = DAG->ray_fire(vol_h, &points[3 * i], &dirs[3 * i], surf, dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    if (surf) hits[surf]++;
+  }
+  DAG->set_query_counters(false);
+  rval = DAG->tag_query_costs();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // the volume carries every ray, each surface the rays that hit it
+  Interface* mbi = DAG->moab_instance();
+  Tag calls_tag, seconds_tag;
+  rval = mbi->tag_get_handle("DAGMC_QUERY_CALLS", calls_tag);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = mbi->tag_get_handle("DAGMC_QUERY_SECONDS", seconds_tag);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  double calls, seconds;
+  rval = mbi->tag_get_data(calls_tag, &vol_h, 1, &calls);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(num_queries, calls);
+  rval = mbi->tag_get_data(seconds_tag, &vol_h, 1, &seconds);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_LT(0.0, seconds);
+
+  for (int s = 1; s <= (int)DAG->num_entities(2); s++) {
+    EntityHandle surf = DAG->entity_by_index(2, s);
+    rval = mbi->tag_get_data(calls_tag, &surf, 1, &calls);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(hits[surf], calls);
+
+    // and so do its triangles
+    Range tris;
+    rval = mbi->get_entities_by_type(surf, MBTRI, tris);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    std::vector<double> tri_calls(tris.size());
+    rval = mbi->tag_get_data(calls_tag, tris, tri_calls.data());
+    EXPECT_EQ(MB_SUCCESS, rval);
+    for (double c : tri_calls) EXPECT_EQ(calls, c);
+  }
+}
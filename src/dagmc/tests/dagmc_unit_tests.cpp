@@ -252,6 +252,59 @@ TEST_F(DagmcMetadataTest, TestTallyAssigns) {
   }
 }
 
+//---------------------------------------------------------------------------//
+// FIXTURE-BASED TESTS: Tests to make sure that the compiled tables agree with
+// the string properties they were built from
+//---------------------------------------------------------------------------//
+TEST_F(DagmcMetadataTest, TestCompiledTables) {
+  // new metadata instance
+  dgm = std::make_shared<dagmcMetaData>(DAG.get());
+
+  // process
+  dgm->load_property_data();
+  EXPECT_FALSE(dgm->tables_compiled());
+  dgm->compile_tables();
+  EXPECT_TRUE(dgm->tables_compiled());
+
+  ASSERT_EQ(dgm->compiled_material_names().size(), 1);
+  EXPECT_EQ(dgm->compiled_material_names()[0], "Hydrogen");
+
+  int neutron = dgm->importance_particle_index("Neutron");
+  EXPECT_GE(neutron, 0);
+  EXPECT_EQ(dgm->importance_particle_index("Muon"), -1);
+
+  int num_vols = DAG->num_entities(3);
+  for (int i = 1; i <= num_vols; i++) {
+    moab::EntityHandle eh = DAG->entity_by_index(3, i);
+    EXPECT_EQ(dgm->volume_material_number(i), -1);
+    EXPECT_EQ(dgm->volume_density(i), 0.0);
+    EXPECT_FALSE(dgm->volume_is_graveyard(i));
+    EXPECT_EQ(dgm->volume_importance(i, neutron), 1.0);
+    if (!DAG->is_implicit_complement(eh)) {
+      EXPECT_EQ(dgm->volume_material_index(i), 0);
+      EXPECT_FALSE(dgm->volume_is_vacuum(i));
+    } else {
+      EXPECT_EQ(dgm->volume_material_index(i), -1);
+      EXPECT_TRUE(dgm->volume_is_vacuum(i));
+    }
+  }
+
+  int num_surfs = DAG->num_entities(2);
+  for (int i = 1; i <= num_surfs; i++) {
+    std::string bc =
+        dgm->get_surface_property("boundary", DAG->entity_by_index(2, i));
+    dagmcMetaData::Boundary expected = dagmcMetaData::BOUNDARY_NONE;
+    if (bc == "Reflecting")
+      expected = dagmcMetaData::BOUNDARY_REFLECTING;
+    else if (bc == "Vacuum")
+      expected = dagmcMetaData::BOUNDARY_VACUUM;
+    EXPECT_EQ(dgm->surface_boundary(i), expected);
+  }
+  EXPECT_EQ(dgm->surface_boundary(DAG->index_by_handle(
+                DAG->entity_by_id(2, 17))),
+            dagmcMetaData::BOUNDARY_VACUUM);
+}
+
 //---------------------------------------------------------------------------//
 // FIXTURE-BASED TESTS: Tests to make sure that the return_property function
 // behaves as it is intended
@@ -0,0 +1,303 @@
+// Microbenchmark of the native BVH against MOAB's OBB trees
+//
+// For each input file, random rays are fired and closest-point queries made
+// in every volume through both GeomQueryTool and NativeRayTracer, and the
+// triangle block kernel is timed against the per-triangle Plucker test. With
+// -m the native BVH is built in mixed precision, and with -c from a compact
+// copy of the mesh.
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "BVH.hpp"
+#include "DagMC.hpp"
+#include "NativeRayTracer.hpp"
+#include "moab/Core.hpp"
+#include "moab/GeomQueryTool.hpp"
+#include "moab/Interface.hpp"
+
+using namespace moab;
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Query {
+  double xyz[3];
+  double uvw[3];
+};
+
+static void usage(const char* name) {
+  std::cerr << "Usage: " << name
+            << " [-n <rays>] [-z <seed>] [-m] [-c] file.h5m ..." << std::endl
+            << "-n <int>  number of queries per volume (default 10000)"
+            << std::endl
+            << "-z <int>  random number seed (default 12345)" << std::endl
+            << "-m        mixed precision native BVH" << std::endl
+            << "-c        native BVH on a compact mesh" << std::endl;
+}
+
+static void report(const char* what, int n, double obb_time,
+                   double bvh_time, int mismatches) {
+  std::cout << "  " << std::left << std::setw(20) << what << std::right
+            << " OBB " << std::setw(10) << 1e9 * obb_time / n << " ns"
+            << "   BVH " << std::setw(10) << 1e9 * bvh_time / n << " ns"
+            << "   speedup " << std::setw(6) << obb_time / bvh_time
+            << "   mismatches " << mismatches << std::endl;
+}
+
+// random queries from points inside a volume
+static void sample_queries(NativeRayTracer& native, EntityHandle vol, int n,
+                           std::mt19937& gen, std::vector<Query>& queries) {
+  double lo[3], hi[3];
+  queries.clear();
+  if (MB_SUCCESS != native.get_bbox(vol, lo, hi)) return;
+
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (int attempt = 0; (int)queries.size() < n && attempt < 100 * n;
+       attempt++) {
+    Query q;
+    for (int i = 0; i < 3; i++) {
+      q.xyz[i] = lo[i] + (hi[i] - lo[i]) * unit(gen);
+      q.uvw[i] = normal(gen);
+    }
+    double len = std::sqrt(q.uvw[0] * q.uvw[0] + q.uvw[1] * q.uvw[1] +
+                           q.uvw[2] * q.uvw[2]);
+    for (int i = 0; i < 3; i++) q.uvw[i] /= len;
+
+    int inside;
+    if (MB_SUCCESS == native.point_in_volume(vol, q.xyz, inside, q.uvw) &&
+        inside == 1)
+      queries.push_back(q);
+  }
+}
+
+// every triangle in the file, in TriangleBlocks
+static ErrorCode build_all_triangles(Interface* mbi, TriangleBVH& bvh) {
+  Range tris;
+  ErrorCode rval = mbi->get_entities_by_type(0, MBTRI, tris);
+  MB_CHK_SET_ERR(rval, "Failed to get the triangles");
+
+  std::vector<double> coords;
+  std::vector<EntityHandle> handles;
+  for (Range::iterator it = tris.begin(); it != tris.end(); ++it) {
+    const EntityHandle* conn;
+    int len;
+    rval = mbi->get_connectivity(*it, conn, len, true);
+    MB_CHK_SET_ERR(rval, "Failed to get triangle connectivity");
+    double tri[9];
+    rval = mbi->get_coords(conn, 3, tri);
+    MB_CHK_SET_ERR(rval, "Failed to get triangle coordinates");
+    coords.insert(coords.end(), tri, tri + 9);
+    handles.push_back(*it);
+  }
+  bvh.build(coords, handles);
+  return MB_SUCCESS;
+}
+
+// time the block kernel against one plucker_ray_tri_intersect call per lane
+static void bench_kernel(const TriangleBVH& bvh,
+                         const std::vector<Query>& queries) {
+  const BVHArray<TriangleBlock>& blocks = bvh.get_blocks();
+  if (blocks.empty() || queries.empty()) return;
+
+  // keep the number of triangle tests near 10^8
+  size_t n_rays = 1 + 100000000 / (BVH_BLOCK_WIDTH * blocks.size());
+  if (n_rays > queries.size()) n_rays = queries.size();
+  const double tmax = std::numeric_limits<double>::max();
+  int orient = 1;
+
+  long block_hits = 0;
+  Clock::time_point start = Clock::now();
+  for (size_t r = 0; r < n_rays; r++) {
+    BVHRay ray(queries[r].xyz, queries[r].uvw);
+    for (size_t b = 0; b < blocks.size(); b++) {
+      double dist[BVH_BLOCK_WIDTH];
+      unsigned on_edge;
+      unsigned hits =
+          ray_block_intersect(blocks[b], ray, &orient, tmax, dist, on_edge);
+      for (; hits; hits &= hits - 1) block_hits++;
+    }
+  }
+  double block_time = seconds_since(start);
+
+  long lane_hits = 0;
+  start = Clock::now();
+  for (size_t r = 0; r < n_rays; r++) {
+    BVHRay ray(queries[r].xyz, queries[r].uvw);
+    for (size_t b = 0; b < blocks.size(); b++) {
+      for (int lane = 0; lane < blocks[b].count; lane++) {
+        double dist;
+        bool on_edge;
+        if (plucker_ray_tri_intersect(blocks[b], lane, ray, &orient, dist,
+                                      on_edge) &&
+            dist >= 0.0)
+          lane_hits++;
+      }
+    }
+  }
+  double lane_time = seconds_since(start);
+
+  double n_tests = (double)n_rays * bvh.num_triangles();
+  std::cout << "  triangle kernel (" << bvh_simd_isa() << "): "
+            << 1e9 * block_time / n_tests << " ns/triangle, scalar "
+            << 1e9 * lane_time / n_tests << " ns/triangle, speedup "
+            << lane_time / block_time << ", hits " << block_hits << "/"
+            << lane_hits << std::endl;
+}
+
+static int bench_file(const char* filename, int n_queries, int seed,
+                      bool mixed, bool compact) {
+  DagMC dagmc{};
+  ErrorCode rval = dagmc.load_file(filename);
+  if (MB_SUCCESS != rval) {
+    std::cerr << "Failed to load file " << filename << std::endl;
+    return 2;
+  }
+  rval = dagmc.init_OBBTree();
+  if (MB_SUCCESS != rval) {
+    std::cerr << "Failed to initialize DagMC." << std::endl;
+    return 2;
+  }
+
+  std::cout << filename << ": " << dagmc.num_entities(3) << " volumes"
+            << std::endl;
+
+  // the OBB trees may not have been built if DagMC uses the native BVH
+  std::shared_ptr<GeomTopoTool> gtt = dagmc.geom_tool();
+  if (!gtt->have_obb_tree()) {
+    Clock::time_point start = Clock::now();
+    rval = gtt->construct_obb_trees();
+    if (MB_SUCCESS != rval) {
+      std::cerr << "Failed to build the OBB trees." << std::endl;
+      return 2;
+    }
+    std::cout << "  OBB build " << seconds_since(start) << " s" << std::endl;
+  }
+  GeomQueryTool gqt(gtt.get());
+
+  NativeRayTracer native(gtt);
+  if (mixed) native.set_precision(BVH_MIXED);
+  Clock::time_point start = Clock::now();
+  native.set_compact_mesh(compact);
+  rval = native.init();
+  if (MB_SUCCESS != rval) {
+    std::cerr << "Failed to build the native BVH." << std::endl;
+    return 2;
+  }
+
+  std::cout << "  BVH build " << seconds_since(start) << " s, "
+            << native.memory_size() / 1048576.0 << " MiB"
+            << (mixed ? " (mixed precision)" : "") << std::endl;
+  if (compact) {
+    const CompactMesh& mesh = native.get_compact_mesh();
+    std::cout << "  compact mesh " << mesh.memory_size() / 1048576.0
+              << " MiB for " << mesh.num_triangles() << " triangles, "
+              << mesh.num_vertices() << " vertices" << std::endl;
+  }
+
+  std::mt19937 gen(seed);
+  std::vector<Query> all_queries, queries;
+  double obb_fire = 0, bvh_fire = 0, obb_closest = 0, bvh_closest = 0;
+  int n_total = 0, fire_mismatch = 0, closest_mismatch = 0;
+  for (unsigned v = 1; v <= dagmc.num_entities(3); v++) {
+    EntityHandle vol = dagmc.entity_by_index(3, v);
+    sample_queries(native, vol, n_queries, gen, queries);
+    if (queries.empty()) continue;
+    int n = queries.size();
+    std::vector<EntityHandle> obb_surf(n), bvh_surf(n);
+    std::vector<double> obb_dist(n), bvh_dist(n);
+
+    start = Clock::now();
+    for (int i = 0; i < n; i++)
+      gqt.ray_fire(vol, queries[i].xyz, queries[i].uvw, obb_surf[i],
+                   obb_dist[i]);
+    obb_fire += seconds_since(start);
+
+    start = Clock::now();
+    for (int i = 0; i < n; i++)
+      native.ray_fire(vol, queries[i].xyz, queries[i].uvw, bvh_surf[i],
+                      bvh_dist[i]);
+    bvh_fire += seconds_since(start);
+
+    for (int i = 0; i < n; i++)
+      if (obb_surf[i] != bvh_surf[i] || obb_dist[i] != bvh_dist[i])
+        fire_mismatch++;
+
+    start = Clock::now();
+    for (int i = 0; i < n; i++)
+      gqt.closest_to_location(vol, queries[i].xyz, obb_dist[i]);
+    obb_closest += seconds_since(start);
+
+    start = Clock::now();
+    for (int i = 0; i < n; i++)
+      native.closest_to_location(vol, queries[i].xyz, bvh_dist[i]);
+    bvh_closest += seconds_since(start);
+
+    for (int i = 0; i < n; i++)
+      if (std::fabs(obb_dist[i] - bvh_dist[i]) > 1e-10 * (1 + obb_dist[i]))
+        closest_mismatch++;
+
+    n_total += n;
+    all_queries.insert(all_queries.end(), queries.begin(), queries.end());
+  }
+
+  if (0 == n_total) {
+    std::cerr << "No points found inside any volume." << std::endl;
+    return 3;
+  }
+  report("ray_fire", n_total, obb_fire, bvh_fire, fire_mismatch);
+  report("closest_to_location", n_total, obb_closest, bvh_closest,
+         closest_mismatch);
+
+  TriangleBVH all_tris;
+  rval = build_all_triangles(dagmc.moab_instance(), all_tris);
+  if (MB_SUCCESS != rval) return 2;
+  bench_kernel(all_tris, all_queries);
+
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  int n_queries = 10000;
+  int seed = 12345;
+  bool mixed = false;
+  bool compact = false;
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "-n" && i + 1 < argc) {
+      n_queries = atoi(argv[++i]);
+    } else if (arg == "-z" && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else if (arg == "-m") {
+      mixed = true;
+    } else if (arg == "-c") {
+      compact = true;
+    } else if (arg == "-h" || arg[0] == '-') {
+      usage(argv[0]);
+      return arg == "-h" ? 0 : 1;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty() || n_queries <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (size_t i = 0; i < files.size(); i++) {
+    int result = bench_file(files[i], n_queries, seed, mixed, compact);
+    if (result) return result;
+  }
+  return 0;
+}
@@ -0,0 +1,449 @@
+// Benchmark suite for the DagMC geometry queries
+//
+// For each input model, random points and directions are sampled inside
+// every volume with a seeded generator, and ray_fire, point_in_volume,
+// closest_to_location, next_vol and straight-line particle tracks are timed
+// through the DagMC interface on each of a list of thread counts. Every
+// workload is warmed up before it is timed. Throughput and latency
+// percentiles are printed and, with -j, written as JSON so that runs with
+// different MOAB versions or ray tracers can be compared.
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "DagMC.hpp"
+#include "DagMCVersion.hpp"
+
+using namespace moab;
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// a particle tracked through at most this many volumes is counted as lost
+static const int max_crossings = 100000;
+
+struct Query {
+  EntityHandle volume;
+  double xyz[3];
+  double uvw[3];
+  // the surface the ray from xyz along uvw leaves volume through, or 0
+  EntityHandle surface;
+};
+
+enum Workload {
+  RAY_FIRE,
+  POINT_IN_VOLUME,
+  CLOSEST_TO_LOCATION,
+  NEXT_VOL,
+  TRACK,
+  NUM_WORKLOADS
+};
+
+static const char* workload_names[NUM_WORKLOADS] = {
+    "ray_fire", "point_in_volume", "closest_to_location", "next_vol",
+    "track"};
+
+struct Result {
+  Workload workload;
+  int n_threads;
+  long operations;
+  double seconds;
+  long errors;
+  // surface crossings of the track workload
+  long crossings;
+  double p50, p90, p99, max;  // latencies in ns
+};
+
+struct ModelResult {
+  std::string filename;
+  double load_seconds;
+  double init_seconds;
+  // the phases of load_seconds and init_seconds
+  std::vector<std::pair<std::string, double>> load_phases;
+  int n_volumes;
+  int n_surfaces;
+  long n_queries;
+  std::vector<Result> results;
+};
+
+static void usage(const char* name) {
+  std::cerr << "Usage: " << name
+            << " [-n <queries>] [-z <seed>] [-w <queries>] [-t <threads>]"
+            << " [-s <workloads>] [-j <file>] file.h5m ..." << std::endl
+            << "-n <int>  number of queries per volume (default 1000)"
+            << std::endl
+            << "-z <int>  random number seed (default 12345)" << std::endl
+            << "-w <int>  untimed warm-up queries per workload (default 1000)"
+            << std::endl
+            << "-t <list> comma separated thread counts (default 1)"
+            << std::endl
+            << "-s <list> comma separated workloads (default all of"
+            << " ray_fire, point_in_volume, closest_to_location, next_vol,"
+            << " track)" << std::endl
+            << "-j <file> write the results as JSON" << std::endl;
+}
+
+static bool parse_list(const std::string& arg, std::vector<std::string>& out) {
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    if (!item.empty()) out.push_back(item);
+  return !out.empty();
+}
+
+// random points inside each volume other than the implicit complement, with
+// random directions and the surfaces their rays leave the volume through
+static ErrorCode sample_queries(DagMC& dagmc, int n_per_volume, int seed,
+                                std::vector<Query>& queries) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  queries.clear();
+  for (unsigned v = 1; v <= dagmc.num_entities(3); v++) {
+    EntityHandle vol = dagmc.entity_by_index(3, v);
+    if (dagmc.is_implicit_complement(vol)) continue;
+    double lo[3], hi[3];
+    ErrorCode rval = dagmc.getobb(vol, lo, hi);
+    MB_CHK_SET_ERR(rval, "Failed to get the bounding box of volume " << v);
+
+    int n_found = 0;
+    for (int attempt = 0;
+         n_found < n_per_volume && attempt < 100 * n_per_volume; attempt++) {
+      Query q;
+      q.volume = vol;
+      for (int i = 0; i < 3; i++) {
+        q.xyz[i] = lo[i] + (hi[i] - lo[i]) * unit(gen);
+        q.uvw[i] = normal(gen);
+      }
+      double len = std::sqrt(q.uvw[0] * q.uvw[0] + q.uvw[1] * q.uvw[1] +
+                             q.uvw[2] * q.uvw[2]);
+      for (int i = 0; i < 3; i++) q.uvw[i] /= len;
+
+      int inside;
+      rval = dagmc.point_in_volume(vol, q.xyz, inside, q.uvw);
+      MB_CHK_SET_ERR(rval, "Failed to sample a point in volume " << v);
+      if (1 != inside) continue;
+      double dist;
+      rval = dagmc.ray_fire(vol, q.xyz, q.uvw, q.surface, dist);
+      MB_CHK_SET_ERR(rval, "Failed to sample a ray in volume " << v);
+      queries.push_back(q);
+      n_found++;
+    }
+  }
+  return MB_SUCCESS;
+}
+
+// follow a particle in a straight line until it leaves the geometry
+static ErrorCode track(DagMC& dagmc, const Query& q, long& crossings) {
+  EntityHandle vol = q.volume;
+  double xyz[3] = {q.xyz[0], q.xyz[1], q.xyz[2]};
+  DagMC::RayHistory history;
+  for (int n = 0; n < max_crossings; n++) {
+    EntityHandle surf;
+    double dist;
+    ErrorCode rval = dagmc.ray_fire(vol, xyz, q.uvw, surf, dist, &history);
+    if (MB_SUCCESS != rval) return rval;
+    // only the implicit complement is unbounded
+    if (!surf)
+      return dagmc.is_implicit_complement(vol) ? MB_SUCCESS : MB_FAILURE;
+    for (int i = 0; i < 3; i++) xyz[i] += dist * q.uvw[i];
+    rval = dagmc.next_vol(surf, vol, vol);
+    if (MB_SUCCESS != rval) return rval;
+    crossings++;
+  }
+  return MB_FAILURE;
+}
+
+static ErrorCode run_query(DagMC& dagmc, Workload workload, const Query& q,
+                           long& crossings) {
+  switch (workload) {
+    case RAY_FIRE: {
+      EntityHandle surf;
+      double dist;
+      return dagmc.ray_fire(q.volume, q.xyz, q.uvw, surf, dist);
+    }
+    case POINT_IN_VOLUME: {
+      int inside;
+      return dagmc.point_in_volume(q.volume, q.xyz, inside, q.uvw);
+    }
+    case CLOSEST_TO_LOCATION: {
+      double dist;
+      return dagmc.closest_to_location(q.volume, q.xyz, dist);
+    }
+    case NEXT_VOL: {
+      EntityHandle next;
+      return q.surface ? dagmc.next_vol(q.surface, q.volume, next)
+                       : MB_SUCCESS;
+    }
+    case TRACK:
+      return track(dagmc, q, crossings);
+    default:
+      return MB_FAILURE;
+  }
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  size_t i = (size_t)std::ceil(p * sorted.size());
+  return sorted[std::min(sorted.size() - 1, i ? i - 1 : 0)];
+}
+
+// thread t of n_threads runs queries t, t + n_threads, ...
+static Result run_workload(DagMC& dagmc, Workload workload, int n_threads,
+                           int n_warmup, const std::vector<Query>& queries) {
+  long warmup_crossings = 0;
+  for (int i = 0; i < n_warmup && i < (int)queries.size(); i++)
+    run_query(dagmc, workload, queries[i], warmup_crossings);
+
+  std::vector<std::vector<double>> latencies(n_threads);
+  std::vector<long> errors(n_threads, 0), crossings(n_threads, 0);
+  auto worker = [&](int t) {
+    std::vector<double>& times = latencies[t];
+    times.reserve(queries.size() / n_threads + 1);
+    for (size_t i = t; i < queries.size(); i += n_threads) {
+      Clock::time_point start = Clock::now();
+      ErrorCode rval = run_query(dagmc, workload, queries[i], crossings[t]);
+      times.push_back(1e9 * seconds_since(start));
+      if (MB_SUCCESS != rval) errors[t]++;
+    }
+  };
+
+  Clock::time_point start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 1; t < n_threads; t++) threads.emplace_back(worker, t);
+  worker(0);
+  for (auto& thread : threads) thread.join();
+
+  Result result;
+  result.workload = workload;
+  result.n_threads = n_threads;
+  result.seconds = seconds_since(start);
+  result.errors = 0;
+  result.crossings = 0;
+  std::vector<double> all;
+  for (int t = 0; t < n_threads; t++) {
+    all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+    result.errors += errors[t];
+    result.crossings += crossings[t];
+  }
+  std::sort(all.begin(), all.end());
+  result.operations = all.size();
+  result.p50 = percentile(all, 0.50);
+  result.p90 = percentile(all, 0.90);
+  result.p99 = percentile(all, 0.99);
+  result.max = all.empty() ? 0.0 : all.back();
+  return result;
+}
+
+static void report(const Result& r) {
+  std::cout << "  " << std::left << std::setw(20)
+            << workload_names[r.workload] << std::right << std::setw(4)
+            << r.n_threads << " threads " << std::setw(12)
+            << r.operations / r.seconds << " /s   p50 " << std::setw(9)
+            << r.p50 << " ns   p90 " << std::setw(9) << r.p90
+            << " ns   p99 " << std::setw(9) << r.p99 << " ns";
+  if (TRACK == r.workload)
+    std::cout << "   " << r.crossings / r.seconds << " crossings/s";
+  if (r.errors) std::cout << "   errors " << r.errors;
+  std::cout << std::endl;
+}
+
+static std::string json_string(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if ('"' == c || '\\' == c) out += '\\';
+    out += c;
+  }
+  return out + "\"";
+}
+
+static void write_json(std::ostream& out, int n_per_volume, int seed,
+                       int n_warmup, const std::vector<ModelResult>& models) {
+  out << std::setprecision(10);
+  out << "{\n"
+      << "  \"dagmc_version\": " << json_string(DAGMC_VERSION_STRING) << ",\n"
+      << "  \"dagmc_git_sha\": " << json_string(DAGMC_GIT_SHA) << ",\n"
+      << "  \"queries_per_volume\": " << n_per_volume << ",\n"
+      << "  \"seed\": " << seed << ",\n"
+      << "  \"warmup\": " << n_warmup << ",\n"
+      << "  \"models\": [";
+  for (size_t m = 0; m < models.size(); m++) {
+    const ModelResult& model = models[m];
+    out << (m ? "," : "") << "\n    {\n"
+        << "      \"file\": " << json_string(model.filename) << ",\n"
+        << "      \"load_seconds\": " << model.load_seconds << ",\n"
+        << "      \"init_seconds\": " << model.init_seconds << ",\n"
+        << "      \"load_phases\": [";
+    for (size_t i = 0; i < model.load_phases.size(); i++) {
+      out << (i ? ", " : "") << "{\"phase\": "
+          << json_string(model.load_phases[i].first)
+          << ", \"seconds\": " << model.load_phases[i].second << "}";
+    }
+    out << "],\n"
+        << "      \"volumes\": " << model.n_volumes << ",\n"
+        << "      \"surfaces\": " << model.n_surfaces << ",\n"
+        << "      \"queries\": " << model.n_queries << ",\n"
+        << "      \"results\": [";
+    for (size_t i = 0; i < model.results.size(); i++) {
+      const Result& r = model.results[i];
+      out << (i ? "," : "") << "\n        {"
+          << "\"workload\": " << json_string(workload_names[r.workload])
+          << ", \"threads\": " << r.n_threads
+          << ", \"operations\": " << r.operations
+          << ", \"seconds\": " << r.seconds
+          << ", \"ops_per_second\": " << r.operations / r.seconds
+          << ", \"crossings\": " << r.crossings
+          << ", \"errors\": " << r.errors << ", \"p50_ns\": " << r.p50
+          << ", \"p90_ns\": " << r.p90 << ", \"p99_ns\": " << r.p99
+          << ", \"max_ns\": " << r.max << "}";
+    }
+    out << "\n      ]\n    }";
+  }
+  out << "\n  ]\n}\n";
+}
+
+static int bench_file(const char* filename, int n_per_volume, int seed,
+                      int n_warmup, const std::vector<int>& thread_counts,
+                      const std::vector<Workload>& workloads,
+                      ModelResult& model) {
+  std::cout << filename << std::endl;
+  model.filename = filename;
+
+  DagMC dagmc;
+  Clock::time_point start = Clock::now();
+  ErrorCode rval = dagmc.load_file(filename);
+  if (MB_SUCCESS != rval) {
+    std::cerr << "Failed to load " << filename << std::endl;
+    return 2;
+  }
+  model.load_seconds = seconds_since(start);
+  start = Clock::now();
+  rval = dagmc.init_OBBTree();
+  if (MB_SUCCESS != rval) {
+    std::cerr << "Failed to build the acceleration data structures."
+              << std::endl;
+    return 2;
+  }
+  model.init_seconds = seconds_since(start);
+  model.load_phases = dagmc.load_times();
+  model.n_volumes = dagmc.num_entities(3);
+  model.n_surfaces = dagmc.num_entities(2);
+  std::cout << "  load " << model.load_seconds << " s, init "
+            << model.init_seconds << " s, " << model.n_volumes
+            << " volumes, " << model.n_surfaces << " surfaces" << std::endl;
+  for (const auto& phase : model.load_phases)
+    std::cout << "    " << phase.first << " " << phase.second << " s"
+              << std::endl;
+
+  std::vector<Query> queries;
+  rval = sample_queries(dagmc, n_per_volume, seed, queries);
+  if (MB_SUCCESS != rval) return 2;
+  if (queries.empty()) {
+    std::cerr << "No points found inside any volume." << std::endl;
+    return 3;
+  }
+  model.n_queries = queries.size();
+
+  for (Workload workload : workloads) {
+    for (int n_threads : thread_counts) {
+      Result r = run_workload(dagmc, workload, n_threads, n_warmup, queries);
+      report(r);
+      model.results.push_back(r);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  int n_per_volume = 1000;
+  int seed = 12345;
+  int n_warmup = 1000;
+  std::vector<int> thread_counts;
+  std::vector<Workload> workloads;
+  std::string json_file;
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    std::vector<std::string> items;
+    if (arg == "-n" && i + 1 < argc) {
+      n_per_volume = atoi(argv[++i]);
+    } else if (arg == "-z" && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else if (arg == "-w" && i + 1 < argc) {
+      n_warmup = atoi(argv[++i]);
+    } else if (arg == "-t" && i + 1 < argc && parse_list(argv[++i], items)) {
+      for (const std::string& item : items) {
+        int n = atoi(item.c_str());
+        if (n <= 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        thread_counts.push_back(n);
+      }
+    } else if (arg == "-s" && i + 1 < argc && parse_list(argv[++i], items)) {
+      for (const std::string& item : items) {
+        const char** name =
+            std::find(workload_names, workload_names + NUM_WORKLOADS, item);
+        if (name == workload_names + NUM_WORKLOADS) {
+          std::cerr << "Unknown workload " << item << std::endl;
+          return 1;
+        }
+        workloads.push_back((Workload)(name - workload_names));
+      }
+    } else if (arg == "-j" && i + 1 < argc) {
+      json_file = argv[++i];
+    } else if (arg == "-h" || arg[0] == '-') {
+      usage(argv[0]);
+      return arg == "-h" ? 0 : 1;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty() || n_per_volume <= 0 || n_warmup < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (!DagMC::concurrent_queries() &&
+      std::count_if(thread_counts.begin(), thread_counts.end(),
+                    [](int n) { return n > 1; })) {
+    std::cerr << "Concurrent queries need the native BVH; running on 1 thread"
+              << std::endl;
+    thread_counts.assign(1, 1);
+  }
+  if (thread_counts.empty()) thread_counts.push_back(1);
+  if (workloads.empty()) {
+    for (int w = 0; w < NUM_WORKLOADS; w++) workloads.push_back((Workload)w);
+  }
+
+  std::vector<ModelResult> models(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    int result = bench_file(files[i], n_per_volume, seed, n_warmup,
+                            thread_counts, workloads, models[i]);
+    if (result) return result;
+  }
+
+  if (!json_file.empty()) {
+    std::ofstream out(json_file.c_str());
+    write_json(out, n_per_volume, seed, n_warmup, models);
+    if (!out) {
+      std::cerr << "Failed to write " << json_file << std::endl;
+      return 2;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,433 @@
+// Particle random walk driver for DagMC geometries
+//
+// Follows particles through a model the way a Monte Carlo transport code
+// would, without any physics beyond a constant mean free path: flights are
+// sampled from an exponential distribution, collisions either absorb the
+// particle or scatter it isotropically, and surface crossings go through
+// ray_fire and next_vol with a ray history that survives streaming and
+// reflection. Boundary conditions are read from the boundary properties of
+// the surfaces and the graveyard and vacuum volumes from the material
+// properties, as DAGMC-based codes read them. This times the geometry under
+// a transport access pattern independently of any transport code.
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DagMC.hpp"
+#include "dagmcmetadata.hpp"
+
+using namespace moab;
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// lost particles reported in detail
+static const int max_reported = 10;
+
+enum Boundary { TRANSMIT, VACUUM, REFLECT, WHITE };
+
+struct Settings {
+  long n_particles = 10000;
+  int seed = 12345;
+  int n_threads = 1;
+  double mean_free_path = 10.0;
+  double survival = 0.9;
+  long max_events = 100000;
+  bool check_entry = false;
+  bool fixed_source = false;
+  double source[3] = {0.0, 0.0, 0.0};
+  // file to write the cost map of the walk to
+  std::string cost_map;
+};
+
+struct Tally {
+  long collisions = 0;
+  long crossings = 0;
+  long reflections = 0;
+  long absorbed = 0;
+  long leaked = 0;
+  long lost = 0;
+  // crossings into a volume that point_in_volume says the particle is
+  // not in, with -p
+  long entry_mismatches = 0;
+
+  void add(const Tally& other) {
+    collisions += other.collisions;
+    crossings += other.crossings;
+    reflections += other.reflections;
+    absorbed += other.absorbed;
+    leaked += other.leaked;
+    lost += other.lost;
+    entry_mismatches += other.entry_mismatches;
+  }
+};
+
+// the properties of the model the walk needs, looked up once
+struct Model {
+  DagMC* dagmc;
+  std::map<EntityHandle, Boundary> boundaries;
+  std::map<EntityHandle, bool> graveyard;
+  std::map<EntityHandle, bool> vacuum;
+  double lo[3], hi[3];
+};
+
+static void usage(const char* name) {
+  std::cerr << "Usage: " << name
+            << " [-n <particles>] [-z <seed>] [-t <threads>] [-l <mfp>]"
+            << " [-s <survival>] [-e <events>] [-x <x,y,z>] [-p]"
+            << " [-o <file>] file.h5m" << std::endl
+            << "-n <int>    number of particles (default 10000)" << std::endl
+            << "-z <int>    random number seed (default 12345)" << std::endl
+            << "-t <int>    number of threads (default 1)" << std::endl
+            << "-l <float>  mean free path in non-vacuum volumes"
+            << " (default 10)" << std::endl
+            << "-s <float>  scattering probability of a collision"
+            << " (default 0.9)" << std::endl
+            << "-e <int>    events before a particle is counted lost"
+            << " (default 100000)" << std::endl
+            << "-x <x,y,z>  point source (default uniform in the model's"
+            << " bounding box)" << std::endl
+            << "-p          check every crossing with point_in_volume"
+            << std::endl
+            << "-o <file>   write the model with the query cost of each"
+            << " volume and surface" << std::endl;
+}
+
+static void isotropic(std::mt19937_64& gen, double uvw[3]) {
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  double mu = 2.0 * unit(gen) - 1.0;
+  double phi = 2.0 * M_PI * unit(gen);
+  double s = std::sqrt(1.0 - mu * mu);
+  uvw[0] = s * std::cos(phi);
+  uvw[1] = s * std::sin(phi);
+  uvw[2] = mu;
+}
+
+static ErrorCode load_model(DagMC& dagmc, Model& model) {
+  model.dagmc = &dagmc;
+  dagmcMetaData metadata(&dagmc, false, false);
+  metadata.load_property_data();
+  metadata.compile_tables();
+
+  for (int i = 1; i <= (int)dagmc.num_entities(2); i++) {
+    EntityHandle surf = dagmc.entity_by_index(2, i);
+    Boundary boundary = TRANSMIT;
+    switch (metadata.surface_boundary(i)) {
+      case dagmcMetaData::BOUNDARY_VACUUM:
+        boundary = VACUUM;
+        break;
+      case dagmcMetaData::BOUNDARY_REFLECTING:
+        boundary = REFLECT;
+        break;
+      case dagmcMetaData::BOUNDARY_WHITE:
+        boundary = WHITE;
+        break;
+      default:
+        break;
+    }
+    model.boundaries[surf] = boundary;
+  }
+
+  // the source box covers every volume but the graveyard
+  for (int j = 0; j < 3; j++) {
+    model.lo[j] = HUGE_VAL;
+    model.hi[j] = -HUGE_VAL;
+  }
+  for (int i = 1; i <= (int)dagmc.num_entities(3); i++) {
+    EntityHandle vol = dagmc.entity_by_index(3, i);
+    model.graveyard[vol] = metadata.volume_is_graveyard(i);
+    model.vacuum[vol] = metadata.volume_is_vacuum(i);
+    if (model.graveyard[vol] || dagmc.is_implicit_complement(vol)) continue;
+    double lo[3], hi[3];
+    ErrorCode rval = dagmc.getobb(vol, lo, hi);
+    MB_CHK_SET_ERR(rval, "Failed to get the bounding box of volume " << i);
+    for (int j = 0; j < 3; j++) {
+      model.lo[j] = std::min(model.lo[j], lo[j]);
+      model.hi[j] = std::max(model.hi[j], hi[j]);
+    }
+  }
+  return MB_SUCCESS;
+}
+
+// sample a source point and find its volume; 0 if none was found
+static EntityHandle sample_source(const Model& model, const Settings& settings,
+                                  std::mt19937_64& gen, double xyz[3],
+                                  double uvw[3]) {
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  for (int attempt = 0; attempt < 1000; attempt++) {
+    isotropic(gen, uvw);
+    for (int j = 0; j < 3; j++) {
+      xyz[j] = settings.fixed_source
+                   ? settings.source[j]
+                   : model.lo[j] + (model.hi[j] - model.lo[j]) * unit(gen);
+    }
+    EntityHandle vol;
+    if (MB_SUCCESS != model.dagmc->find_volume(xyz, vol, uvw)) return 0;
+    if (vol && !model.graveyard.at(vol)) return vol;
+    if (settings.fixed_source) return 0;
+  }
+  return 0;
+}
+
+static void report_lost(std::mutex& mutex, int& n_reported, long particle,
+                        const char* why, DagMC& dagmc, EntityHandle vol,
+                        const double xyz[3], const double uvw[3]) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (n_reported++ >= max_reported) return;
+  std::cout << "  lost particle " << particle << " (" << why << ")";
+  if (vol) std::cout << " in volume " << dagmc.get_entity_id(vol);
+  std::cout << " at " << xyz[0] << " " << xyz[1] << " " << xyz[2]
+            << " direction " << uvw[0] << " " << uvw[1] << " " << uvw[2]
+            << std::endl;
+}
+
+// follow one particle from birth to absorption, leakage or loss
+static void walk(const Model& model, const Settings& settings, long particle,
+                 Tally& tally, std::mutex& mutex, int& n_reported) {
+  DagMC& dagmc = *model.dagmc;
+  std::seed_seq seq{(long)settings.seed, particle};
+  std::mt19937_64 gen(seq);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  double xyz[3], uvw[3];
+  EntityHandle vol = sample_source(model, settings, gen, xyz, uvw);
+  if (!vol) {
+    tally.lost++;
+    report_lost(mutex, n_reported, particle, "no source volume", dagmc, 0,
+                xyz, uvw);
+    return;
+  }
+
+  DagMC::RayHistory history;
+  for (long event = 0; event < settings.max_events; event++) {
+    EntityHandle surf;
+    double dist;
+    ErrorCode rval = dagmc.ray_fire(vol, xyz, uvw, surf, dist, &history);
+    if (MB_SUCCESS != rval || !surf) {
+      // only the implicit complement is unbounded
+      if (MB_SUCCESS == rval && dagmc.is_implicit_complement(vol)) {
+        tally.leaked++;
+      } else {
+        tally.lost++;
+        report_lost(mutex, n_reported, particle, "no surface hit", dagmc, vol,
+                    xyz, uvw);
+      }
+      return;
+    }
+
+    double flight = model.vacuum.at(vol)
+                        ? HUGE_VAL
+                        : -settings.mean_free_path * std::log(1.0 - unit(gen));
+    if (flight < dist) {
+      for (int j = 0; j < 3; j++) xyz[j] += flight * uvw[j];
+      tally.collisions++;
+      if (unit(gen) >= settings.survival) {
+        tally.absorbed++;
+        return;
+      }
+      isotropic(gen, uvw);
+      history.reset();
+      continue;
+    }
+
+    for (int j = 0; j < 3; j++) xyz[j] += dist * uvw[j];
+    Boundary boundary = model.boundaries.at(surf);
+    if (VACUUM == boundary) {
+      tally.leaked++;
+      return;
+    }
+    if (REFLECT == boundary || WHITE == boundary) {
+      double normal[3];
+      rval = dagmc.get_angle(surf, xyz, normal, &history);
+      if (MB_SUCCESS != rval) {
+        tally.lost++;
+        report_lost(mutex, n_reported, particle, "get_angle failed", dagmc,
+                    vol, xyz, uvw);
+        return;
+      }
+      double dot = uvw[0] * normal[0] + uvw[1] * normal[1] + uvw[2] * normal[2];
+      if (REFLECT == boundary) {
+        for (int j = 0; j < 3; j++) uvw[j] -= 2.0 * dot * normal[j];
+      } else {
+        // back into the volume with a cosine distribution about the normal
+        double sign = dot > 0.0 ? -1.0 : 1.0;
+        double mu = std::sqrt(unit(gen));
+        double t[3];
+        isotropic(gen, t);
+        double tn = t[0] * normal[0] + t[1] * normal[1] + t[2] * normal[2];
+        double len = 0.0;
+        for (int j = 0; j < 3; j++) {
+          t[j] -= tn * normal[j];
+          len += t[j] * t[j];
+        }
+        len = std::sqrt(len);
+        double s = std::sqrt(1.0 - mu * mu);
+        for (int j = 0; j < 3; j++)
+          uvw[j] = sign * mu * normal[j] + (len > 0.0 ? s * t[j] / len : 0.0);
+      }
+      history.reset_to_last_intersection();
+      tally.reflections++;
+      continue;
+    }
+
+    EntityHandle next;
+    rval = dagmc.next_vol(surf, vol, next);
+    if (MB_SUCCESS != rval || !next) {
+      tally.lost++;
+      report_lost(mutex, n_reported, particle, "next_vol failed", dagmc, vol,
+                  xyz, uvw);
+      return;
+    }
+    vol = next;
+    tally.crossings++;
+    if (model.graveyard.at(vol)) {
+      tally.leaked++;
+      return;
+    }
+    if (settings.check_entry) {
+      int inside;
+      rval = dagmc.point_in_volume(vol, xyz, inside, uvw, &history);
+      if (MB_SUCCESS != rval || 0 == inside) tally.entry_mismatches++;
+    }
+  }
+
+  tally.lost++;
+  report_lost(mutex, n_reported, particle, "too many events", dagmc, vol, xyz,
+              uvw);
+}
+
+static bool parse_point(const char* arg, double xyz[3]) {
+  std::stringstream ss(arg);
+  char comma;
+  return (ss >> xyz[0] >> comma >> xyz[1] >> comma >> xyz[2]) && ss.eof();
+}
+
+int main(int argc, char* argv[]) {
+  Settings settings;
+  const char* filename = NULL;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "-n" && i + 1 < argc) {
+      settings.n_particles = atol(argv[++i]);
+    } else if (arg == "-z" && i + 1 < argc) {
+      settings.seed = atoi(argv[++i]);
+    } else if (arg == "-t" && i + 1 < argc) {
+      settings.n_threads = atoi(argv[++i]);
+    } else if (arg == "-l" && i + 1 < argc) {
+      settings.mean_free_path = atof(argv[++i]);
+    } else if (arg == "-s" && i + 1 < argc) {
+      settings.survival = atof(argv[++i]);
+    } else if (arg == "-e" && i + 1 < argc) {
+      settings.max_events = atol(argv[++i]);
+    } else if (arg == "-x" && i + 1 < argc &&
+               parse_point(argv[++i], settings.source)) {
+      settings.fixed_source = true;
+    } else if (arg == "-p") {
+      settings.check_entry = true;
+    } else if (arg == "-o" && i + 1 < argc) {
+      settings.cost_map = argv[++i];
+    } else if (arg == "-h" || arg[0] == '-' || filename) {
+      usage(argv[0]);
+      return arg == "-h" ? 0 : 1;
+    } else {
+      filename = argv[i];
+    }
+  }
+  if (!filename || settings.n_particles <= 0 || settings.n_threads <= 0 ||
+      settings.mean_free_path <= 0.0 || settings.survival < 0.0 ||
+      settings.survival > 1.0 || settings.max_events <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (settings.n_threads > 1 && !DagMC::concurrent_queries()) {
+    std::cerr << "Concurrent queries need the native BVH; running on 1 thread"
+              << std::endl;
+    settings.n_threads = 1;
+  }
+
+  DagMC dagmc;
+  Clock::time_point start = Clock::now();
+  ErrorCode rval = dagmc.load_file(filename);
+  if (MB_SUCCESS != rval) {
+    std::cerr << "Failed to load " << filename << std::endl;
+    return 2;
+  }
+  rval = dagmc.init_OBBTree();
+  if (MB_SUCCESS != rval) {
+    std::cerr << "Failed to build the acceleration data structures."
+              << std::endl;
+    return 2;
+  }
+  Model model;
+  rval = load_model(dagmc, model);
+  if (MB_SUCCESS != rval) return 2;
+  std::cout << filename << ": set up in " << seconds_since(start) << " s, "
+            << dagmc.num_entities(3) << " volumes, " << dagmc.num_entities(2)
+            << " surfaces" << std::endl;
+
+  if (!settings.cost_map.empty()) {
+    dagmc.query_counters().reset();
+    dagmc.set_query_counters(true);
+  }
+
+  // particle p is run by thread p % n_threads with its own random stream,
+  // so the results do not depend on the number of threads
+  std::vector<Tally> tallies(settings.n_threads);
+  std::mutex mutex;
+  int n_reported = 0;
+  auto worker = [&](int t) {
+    for (long p = t; p < settings.n_particles; p += settings.n_threads)
+      walk(model, settings, p, tallies[t], mutex, n_reported);
+  };
+  start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 1; t < settings.n_threads; t++) threads.emplace_back(worker, t);
+  worker(0);
+  for (auto& thread : threads) thread.join();
+  double seconds = seconds_since(start);
+
+  Tally total;
+  for (const Tally& tally : tallies) total.add(tally);
+  std::cout << "  " << settings.n_particles << " particles in " << seconds
+            << " s on " << settings.n_threads << " threads" << std::endl
+            << "  " << total.crossings << " crossings, " << total.reflections
+            << " reflections, " << total.collisions << " collisions"
+            << std::endl
+            << "  " << total.absorbed << " absorbed, " << total.leaked
+            << " leaked, " << total.lost << " lost" << std::endl
+            << "  " << settings.n_particles / seconds << " particles/s, "
+            << total.crossings / seconds << " crossings/s" << std::endl;
+  if (settings.check_entry)
+    std::cout << "  " << total.entry_mismatches
+              << " crossings into a volume not containing the particle"
+              << std::endl;
+
+  if (!settings.cost_map.empty()) {
+    dagmc.set_query_counters(false);
+    rval = dagmc.tag_query_costs();
+    if (MB_SUCCESS == rval)
+      rval = dagmc.write_mesh(settings.cost_map.c_str(),
+                              settings.cost_map.size());
+    if (MB_SUCCESS != rval) {
+      std::cerr << "Failed to write " << settings.cost_map << std::endl;
+      return 2;
+    }
+    std::cout << "  query costs written to " << settings.cost_map
+              << std::endl;
+  }
+  return 0;
+}
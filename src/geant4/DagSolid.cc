@@ -214,7 +214,16 @@ EInside DagSolid::Inside(const G4ThreeVector& p) const {
     exit(1);
   }
 
+#ifdef NATIVE_BVH
+  // a lower bound beyond the tolerance rules out the surface; only points
+  // near it need the exact distance
+  ec = fdagmc->safety_distance(fvolEntity, point, minDist, true);
+  if (minDist <= 0.5 * kCarTolerance)
+    ec = fdagmc->closest_to_location(fvolEntity, point, minDist);
+#else
+  // other ray tracers answer the lower bound exactly anyway
   ec = fdagmc->closest_to_location(fvolEntity, point, minDist);
+#endif
 
   // if on surface
   if (minDist <= 0.5 * kCarTolerance) {
@@ -285,7 +294,8 @@ G4double DagSolid::DistanceToIn(const G4ThreeVector& p) const {
   G4double point[3] = {p.x() / cm, p.y() / cm,
                        p.z() / cm};  // convert position to cm
 
-  fdagmc->closest_to_location(fvolEntity, point, minDist);
+  // Geant4 allows the safety to be underestimated
+  fdagmc->safety_distance(fvolEntity, point, minDist, true);
   minDist *= cm;  // convert back to mm
   if (minDist <= kCarTolerance * 0.5)
     return 0.0;
@@ -360,7 +370,8 @@ G4double DagSolid::DistanceToOut(const G4ThreeVector& p) const {
   G4double minDist = kInfinity;
   G4double point[3] = {p.x() / cm, p.y() / cm, p.z() / cm};  // convert to cm
 
-  fdagmc->closest_to_location(fvolEntity, point, minDist);
+  // Geant4 allows the safety to be underestimated
+  fdagmc->safety_distance(fvolEntity, point, minDist, true);
   minDist *= cm;  // convert back to mm
   if (minDist < kCarTolerance / 2.0)
     return 0.0;
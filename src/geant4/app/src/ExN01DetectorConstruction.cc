@@ -77,6 +77,10 @@ G4VPhysicalVolume* ExN01DetectorConstruction::Construct() {
     exit(1);
   }
 
+  // Inside and DistanceToIn test the same points of a geometry that does
+  // not change, so let repeated point_in_volume queries be answered once
+  dagmc->set_point_cache(true);
+
   // build the trees
   rval = dagmc->init_OBBTree();
   if (rval != moab::MB_SUCCESS) {
@@ -84,6 +88,13 @@ G4VPhysicalVolume* ExN01DetectorConstruction::Construct() {
     exit(1);
   }
 
+  // measure every volume once, for the detector volumes below
+  rval = dagmc->measure_all();
+  if (rval != moab::MB_SUCCESS) {
+    G4cout << "ERROR: Failed to measure the volumes" << G4endl;
+    exit(1);
+  }
+
   // attach a metadata instance
   DMD = new dagmcMetaData(dagmc);
   DMD->load_property_data();
@@ -34,17 +34,30 @@ UWUW* workflow_data;
 static std::ostream* raystat_dump = NULL;
 #endif
 
-/* Static values used by dagmctrack_ */
-
-static DagMC::RayHistory history;
-static int last_nps = 0;
-static double last_uvw[3] = {0, 0, 0};
-static std::vector<DagMC::RayHistory> history_bank;
-static std::vector<DagMC::RayHistory> pblcm_history_stack;
-static bool visited_surface = false;
+/* Static values used by dagmctrack_
+ *
+ * Each (OpenMP) thread tracks its own particle through the shared DagMC
+ * instance, so all per-particle state is thread-local. */
+
+static thread_local DagMC::RayHistory history;
+static thread_local int last_nps = 0;
+static thread_local double last_uvw[3] = {0, 0, 0};
+static thread_local std::vector<DagMC::RayHistory> history_bank;
+static thread_local std::vector<DagMC::RayHistory> pblcm_history_stack;
+static thread_local bool visited_surface = false;
 
 static bool use_dist_limit = false;
-static double dist_limit;  // needs to be thread-local
+static thread_local double dist_limit;
+
+// size of the pblcm history stack, shared by all threads
+static int pblcm_history_stack_size = 0;
+
+// the thread-local stacks are sized on first use by each thread
+static std::vector<DagMC::RayHistory>& get_pblcm_history_stack() {
+  if (pblcm_history_stack.size() != (unsigned)pblcm_history_stack_size)
+    pblcm_history_stack.resize(pblcm_history_stack_size);
+  return pblcm_history_stack;
+}
 
 static std::string graveyard_str = "Graveyard";
 static std::string vacuum_str = "Vacuum";
@@ -104,7 +117,7 @@ void dagmcinit_(char* cfile, int* clen,   // geom
   DMD->load_property_data();
   // all metadata now loaded
 
-  pblcm_history_stack.resize(*max_pbl + 1);  // fortran will index from 1
+  pblcm_history_stack_size = *max_pbl + 1;  // fortran will index from 1
 }
 
 void dagmcwritefacets_(char* ffile, int* flen) {  // facet file
@@ -358,9 +371,8 @@ void write_tally_data(std::ostringstream& lcadfile) {
 }
 
 void dagmcangl_(int* jsu, double* xxx, double* yyy, double* zzz, double* ang) {
-  moab::EntityHandle surf = DAG->entity_by_index(2, *jsu);
   double xyz[3] = {*xxx, *yyy, *zzz};
-  moab::ErrorCode rval = DAG->get_angle(surf, xyz, ang, &history);
+  moab::ErrorCode rval = DAG->get_angle_by_index(*jsu, xyz, ang, &history);
   if (moab::MB_SUCCESS != rval) {
     std::cerr << "DAGMC: failed in calling get_angle" << std::endl;
     exit(EXIT_FAILURE);
@@ -392,12 +404,9 @@ void dagmcchkcel_by_angle_(double* uuu, double* vvv, double* www, double* xxx,
   double xyz[3] = {*xxx, *yyy, *zzz};
   double uvw[3] = {*uuu, *vvv, *www};
 
-  moab::EntityHandle surf = DAG->entity_by_index(2, *jsu);
-  moab::EntityHandle vol = DAG->entity_by_index(3, *i1);
-
   int result;
-  moab::ErrorCode rval =
-      DAG->test_volume_boundary(vol, surf, xyz, uvw, result, &history);
+  moab::ErrorCode rval = DAG->test_volume_boundary_by_index(
+      *i1, *jsu, xyz, uvw, result, &history);
   if (moab::MB_SUCCESS != rval) {
     std::cerr << "DAGMC: failed calling test_volume_boundary" << std::endl;
     exit(EXIT_FAILURE);
@@ -431,10 +440,9 @@ void dagmcchkcel_(double* uuu, double* vvv, double* www, double* xxx,
 #endif
 
   int inside;
-  moab::EntityHandle vol = DAG->entity_by_index(3, *i1);
   double xyz[3] = {*xxx, *yyy, *zzz};
   double uvw[3] = {*uuu, *vvv, *www};
-  moab::ErrorCode rval = DAG->point_in_volume(vol, xyz, inside, uvw);
+  moab::ErrorCode rval = DAG->point_in_volume_by_index(*i1, xyz, inside, uvw);
 
   if (moab::MB_SUCCESS != rval) {
     std::cerr << "DAGMC: failed in point_in_volume" << std::endl;
@@ -469,11 +477,10 @@ void dagmcdbmin_(int* ih, double* xxx, double* yyy, double* zzz, double* huge,
                  double* dbmin) {
   double point[3] = {*xxx, *yyy, *zzz};
 
-  // get handle for this volume (*ih)
-  moab::EntityHandle vol = DAG->entity_by_index(3, *ih);
-
-  // get distance to closest surface
-  moab::ErrorCode rval = DAG->closest_to_location(vol, point, *dbmin);
+  // get a lower bound on the distance to the closest surface of this
+  // volume (*ih), which is all MCNP needs of dbmin
+  moab::ErrorCode rval =
+      DAG->safety_distance_by_index(*ih, point, *dbmin, true);
 
   // if failed, return 'huge'
   if (moab::MB_SUCCESS != rval) {
@@ -490,19 +497,13 @@ void dagmcdbmin_(int* ih, double* xxx, double* yyy, double* zzz, double* huge,
 }
 
 void dagmcnewcel_(int* jsu, int* icl, int* iap) {
-  moab::EntityHandle surf = DAG->entity_by_index(2, *jsu);
-  moab::EntityHandle vol = DAG->entity_by_index(3, *icl);
-  moab::EntityHandle newvol = 0;
-
-  moab::ErrorCode rval = DAG->next_vol(surf, vol, newvol);
+  moab::ErrorCode rval = DAG->next_vol_by_index(*jsu, *icl, *iap);
   if (moab::MB_SUCCESS != rval) {
     *iap = -1;
     std::cerr << "DAGMC: error calling next_vol, newcel_ returning -1"
               << std::endl;
   }
 
-  *iap = DAG->index_by_handle(newvol);
-
   visited_surface = true;
 
 #ifdef TRACE_DAGMC_CALLS
@@ -568,10 +569,7 @@ void dagmc_particle_terminate_() {
 void dagmctrack_(int* ih, double* uuu, double* vvv, double* www, double* xxx,
                  double* yyy, double* zzz, double* huge, double* dls, int* jap,
                  int* jsu, int* nps) {
-  // Get data from IDs
-  moab::EntityHandle vol = DAG->entity_by_index(3, *ih);
-  moab::EntityHandle prev = DAG->entity_by_index(2, *jsu);
-  moab::EntityHandle next_surf = 0;
+  int next_surf = 0;
   double next_surf_dist;
 
 #ifdef ENABLE_RAYSTAT_DUMPS
@@ -582,7 +580,7 @@ void dagmctrack_(int* ih, double* uuu, double* vvv, double* www, double* xxx,
   double dir[3] = {*uuu, *vvv, *www};
 
   /* detect streaming or reflecting situations */
-  if (last_nps != *nps || prev == 0) {
+  if (last_nps != *nps || *jsu == 0) {
     // not streaming or reflecting: reset history
     history.reset();
 #ifdef TRACE_DAGMC_CALLS
@@ -612,11 +610,11 @@ void dagmctrack_(int* ih, double* uuu, double* vvv, double* www, double* xxx,
   }
 
   moab::ErrorCode result =
-      DAG->ray_fire(vol, point, dir, next_surf, next_surf_dist, &history,
-                    (use_dist_limit ? dist_limit : 0)
+      DAG->ray_fire_by_index(*ih, point, dir, next_surf, next_surf_dist,
+                             &history, (use_dist_limit ? dist_limit : 0)
 #ifdef ENABLE_RAYSTAT_DUMPS
-                        ,
-                    raystat_dump ? &trv : NULL
+                             ,
+                             1, raystat_dump ? &trv : NULL
 #endif
       );
 
@@ -633,7 +631,7 @@ void dagmctrack_(int* ih, double* uuu, double* vvv, double* www, double* xxx,
   // Return results: if next_surf exists, then next_surf_dist will be nearer
   // than dist_limit (if any)
   if (next_surf != 0) {
-    *jap = DAG->index_by_handle(next_surf);
+    *jap = next_surf;
     *dls = next_surf_dist;
   } else {
     // no next surface
@@ -727,24 +725,30 @@ void dagmc_savpar_(int* n) {
 #ifdef TRACE_DAGMC_CALLS
   std::cout << "savpar: " << *n << " (" << history.size() << ")" << std::endl;
 #endif
-  pblcm_history_stack[*n] = history;
+  get_pblcm_history_stack()[*n] = history;
 }
 
 void dagmc_getpar_(int* n) {
 #ifdef TRACE_DAGMC_CALLS
-  std::cout << "getpar: " << *n << " (" << pblcm_history_stack[*n].size() << ")"
-            << std::endl;
+  std::cout << "getpar: " << *n << " (" << get_pblcm_history_stack()[*n].size()
+            << ")" << std::endl;
 #endif
-  history = pblcm_history_stack[*n];
+  history = get_pblcm_history_stack()[*n];
 }
 
 void dagmcvolume_(int* mxa, double* vols, int* mxj, double* aras) {
-  moab::ErrorCode rval;
+  // measure everything at once, or read the measures saved with the model
+  moab::ErrorCode rval = DAG->measure_all();
+  if (moab::MB_SUCCESS != rval) {
+    std::cerr << "DAGMC: failed to measure the volumes and surfaces"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
   // get size of each volume
   int num_vols = DAG->num_entities(3);
   for (int i = 0; i < num_vols; ++i) {
-    rval = DAG->measure_volume(DAG->entity_by_index(3, i + 1), vols[i * 2]);
+    rval = DAG->measure_volume_by_index(i + 1, vols[i * 2]);
     if (moab::MB_SUCCESS != rval) {
       std::cerr << "DAGMC: could not measure volume " << i + 1 << std::endl;
       exit(EXIT_FAILURE);
@@ -754,7 +758,7 @@ void dagmcvolume_(int* mxa, double* vols, int* mxj, double* aras) {
   // get size of each surface
   int num_surfs = DAG->num_entities(2);
   for (int i = 0; i < num_surfs; ++i) {
-    rval = DAG->measure_area(DAG->entity_by_index(2, i + 1), aras[i * 2]);
+    rval = DAG->measure_area_by_index(i + 1, aras[i * 2]);
     if (moab::MB_SUCCESS != rval) {
       std::cerr << "DAGMC: could not measure surface " << i + 1 << std::endl;
       exit(EXIT_FAILURE);
@@ -803,6 +807,12 @@ void dagmc_init_settings_(int* fort_use_dist_limit, int* use_cad,
 
 // delete the stored data
 void dagmc_teardown_() {
+  if (DAG->query_counters().enabled()) {
+    if (moab::MB_SUCCESS ==
+        DAG->write_query_counters("dagmc_query_counters.csv"))
+      std::cout << "DAGMC query counters written to "
+                << "dagmc_query_counters.csv" << std::endl;
+  }
   delete DMD;
   delete DAG;
 }